@@ -5,13 +5,51 @@ header_base_files=(
     "zest/base/noncopyable.h"
     "zest/base/fix_buffer.h"
     "zest/base/logging.h"
+    "zest/base/simd_search.h"
+    "zest/base/simd_mask.h"
 )
 header_net_files=(
     "zest/net/tcp_server.h"
     "zest/net/tcp_client.h"
+    "zest/net/tcp_connector.h"
+    "zest/net/connection_pool.h"
+    "zest/net/tcp_relay.h"
     "zest/net/tcp_connection.h"
+    "zest/net/context_slot.h"
     "zest/net/base_addr.h"
     "zest/net/inet_addr.h"
+    "zest/net/unix_addr.h"
+    "zest/net/slice.h"
+    "zest/net/length_codec.h"
+    "zest/net/udp_socket.h"
+    "zest/net/udp_server.h"
+)
+header_http_files=(
+    "zest/net/http/http_server.h"
+    "zest/net/http/http_request.h"
+    "zest/net/http/http_response.h"
+)
+header_redis_files=(
+    "zest/net/redis/resp.h"
+    "zest/net/redis/resp_writer.h"
+    "zest/net/redis/resp_server.h"
+)
+header_rpc_files=(
+    "zest/net/rpc/rpc_protocol.h"
+    "zest/net/rpc/rpc_channel.h"
+    "zest/net/rpc/rpc_server.h"
+    "zest/net/rpc/rpc_client.h"
+)
+header_websocket_files=(
+    "zest/net/websocket/websocket.h"
+    "zest/net/websocket/websocket_server.h"
+)
+header_pubsub_files=(
+    "zest/net/pubsub/pubsub_hub.h"
+)
+header_shm_files=(
+    "zest/net/shm/shm_connection.h"
+    "zest/net/shm/shm_server.h"
 )
 
 # Flag to check if copy operation fails
@@ -28,6 +66,12 @@ if [ $? -eq 0 ]; then
         sudo mkdir -p /usr/local/lib/
         sudo mkdir -p /usr/local/include/zest/base/
         sudo mkdir -p /usr/local/include/zest/net/
+        sudo mkdir -p /usr/local/include/zest/net/http/
+        sudo mkdir -p /usr/local/include/zest/net/redis/
+        sudo mkdir -p /usr/local/include/zest/net/rpc/
+        sudo mkdir -p /usr/local/include/zest/net/websocket/
+        sudo mkdir -p /usr/local/include/zest/net/pubsub/
+        sudo mkdir -p /usr/local/include/zest/net/shm/
 
         # If no path is provided, copy the generated static library to the default /usr/local/lib using sudo
         sudo cp ./lib/libzest.a /usr/local/lib/
@@ -51,12 +95,72 @@ if [ $? -eq 0 ]; then
                 copy_failed=true
             fi
         done
+
+        for file in "${header_http_files[@]}"; do
+            if sudo cp -r "$file" /usr/local/include/zest/net/http/; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_redis_files[@]}"; do
+            if sudo cp -r "$file" /usr/local/include/zest/net/redis/; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_rpc_files[@]}"; do
+            if sudo cp -r "$file" /usr/local/include/zest/net/rpc/; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_websocket_files[@]}"; do
+            if sudo cp -r "$file" /usr/local/include/zest/net/websocket/; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_pubsub_files[@]}"; do
+            if sudo cp -r "$file" /usr/local/include/zest/net/pubsub/; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_shm_files[@]}"; do
+            if sudo cp -r "$file" /usr/local/include/zest/net/shm/; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
         echo "Headers copied to the default path /usr/local/include/zest/"
     else
         # Create the directory if it doesn't exist
         sudo mkdir -p "$1/lib/"
         sudo mkdir -p "$1/include/zest/base/"
         sudo mkdir -p "$1/include/zest/net/"
+        sudo mkdir -p "$1/include/zest/net/http/"
+        sudo mkdir -p "$1/include/zest/net/redis/"
+        sudo mkdir -p "$1/include/zest/net/rpc/"
+        sudo mkdir -p "$1/include/zest/net/websocket/"
+        sudo mkdir -p "$1/include/zest/net/pubsub/"
+        sudo mkdir -p "$1/include/zest/net/shm/"
 
         # If a path is provided, copy the generated static library to the specified path using sudo
         sudo cp ./lib/libzest.a "$1/lib/"
@@ -80,6 +184,60 @@ if [ $? -eq 0 ]; then
                 copy_failed=true
             fi
         done
+
+        for file in "${header_http_files[@]}"; do
+            if sudo cp -r "$file" "$1/include/zest/net/http/"; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_redis_files[@]}"; do
+            if sudo cp -r "$file" "$1/include/zest/net/redis/"; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_rpc_files[@]}"; do
+            if sudo cp -r "$file" "$1/include/zest/net/rpc/"; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_websocket_files[@]}"; do
+            if sudo cp -r "$file" "$1/include/zest/net/websocket/"; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_pubsub_files[@]}"; do
+            if sudo cp -r "$file" "$1/include/zest/net/pubsub/"; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
+
+        for file in "${header_shm_files[@]}"; do
+            if sudo cp -r "$file" "$1/include/zest/net/shm/"; then
+                echo "Copied $file successfully"
+            else
+                echo "Failed to Copy $file"
+                copy_failed=true
+            fi
+        done
         echo "Headers copied to the specified path: $1/include/zest/"
     fi
 
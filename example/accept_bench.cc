@@ -0,0 +1,203 @@
+/* 连接建立和断开的压力测试，在子进程中启动基于 zest::net::TcpServer 的服务器
+ * 客户端每一轮同时打开 -c 条连接，然后全部关闭，持续 -t 秒，统计每秒建立的连接数
+ * 服务器统计每接受一个连接堆分配的次数（包括这个连接断开和回收），先关闭连接对象复用，再开启复用并预先分配 -c 个对象 */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "zest/net/inet_addr.h"
+#include "zest/net/tcp_server.h"
+
+using namespace zest::net;
+
+int connections = 200;        // 每一轮同时打开的连接数
+int seconds = 4;              // 每种方式的测试时间
+int server_threads = 2;       // 服务器的IO线程数
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12359;
+
+// 统计堆分配次数，服务器的IO线程也会分配，所以用原子变量
+static std::atomic<uint64_t> g_allocations {0};
+
+void *operator new(std::size_t size)
+{
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  void *p = malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./accept_bench [options] \n \
+Options: \n \
+-c Connections opened in each round, default 200\n \
+-t Running time of each mode (seconds), default 4\n \
+-w IO threads of the server, default 2\n \
+-h Show help information. \n \
+For example: ./accept_bench -c 1000 -w 4\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 连接数较多时需要提高文件描述符的上限
+void raiseFdLimit()
+{
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+}
+
+/* 服务器只接受连接，读到对端关闭就关闭连接
+ * 从第一个连接开始计数，每接受一个连接记录一次分配次数，不包括启动和退出时的分配 */
+void runServer(const std::string &name, std::size_t preallocate, std::size_t max_idle)
+{
+  InetAddress local_addr(server_ip, port);
+  TcpServer server(local_addr, server_threads);
+  server.setConnectionRecycling(preallocate, max_idle);
+  // 连接回调在各个IO线程中执行
+  std::atomic<uint64_t> accepts {0}, first {0}, last {0};
+  server.setOnConnectionCallback([&](TcpConnection &conn){
+    uint64_t now = g_allocations.load(std::memory_order_relaxed);
+    last.store(now, std::memory_order_relaxed);
+    if (accepts.fetch_add(1, std::memory_order_relaxed) == 0)
+      first.store(now, std::memory_order_relaxed);
+    conn.waitForMessage();
+  });
+  server.setMessageCallback([](TcpConnection &conn){
+    conn.clearData();
+  });
+  server.start();
+
+  std::cout << "  " << name << "  " << accepts.load() << " accepts, ";
+  if (accepts.load() > 1)
+    std::cout << static_cast<double>(last.load() - first.load()) / (accepts.load() - 1) << " allocations per accept, ";
+  std::cout << server.connectionsAllocated() << " objects allocated, "
+            << server.connectionsReused() << " reused" << std::endl;
+}
+
+int connectTo()
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void measure(const std::string &name, std::size_t preallocate, std::size_t max_idle)
+{
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    runServer(name, preallocate, max_idle);
+    exit(0);
+  }
+  usleep(300 * 1000);
+
+  uint64_t opened = 0, failed = 0;
+  std::vector<int> fds;
+  int64_t start = nowNanos();
+  int64_t deadline = start + static_cast<int64_t>(seconds) * 1000000000;
+  while (nowNanos() < deadline) {
+    for (int i = 0; i < connections; ++i) {
+      int fd = connectTo();
+      if (fd < 0)
+        ++failed;
+      else
+        fds.push_back(fd);
+    }
+    opened += fds.size();
+    for (int fd : fds)
+      close(fd);
+    fds.clear();
+  }
+  int64_t elapsed = nowNanos() - start;
+
+  // 等服务器处理完最后一批连接
+  usleep(500 * 1000);
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  std::cout << "  " << name << "  " << static_cast<uint64_t>(opened / (elapsed / 1e9)) << " connections/sec";
+  if (failed > 0)
+    std::cout << "  (" << failed << " failed)";
+  std::cout << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "c:t:w:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      connections = atoi(optarg);
+      break;
+    case 't':
+      seconds = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (connections <= 0 || seconds <= 0 || server_threads <= 0) {
+    showHelp();
+    exit(-1);
+  }
+  raiseFdLimit();
+
+  std::cout << connections << " connections per round, " << server_threads << " IO threads" << std::endl;
+  measure("no recycling", 0, 0);
+  measure("recycling   ", connections, TcpServer::DEFAULT_MAX_IDLE_CONNECTIONS);
+  return 0;
+}
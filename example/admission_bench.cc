@@ -0,0 +1,257 @@
+/* 连接准入控制的测试，在子进程中启动基于 zest::net::TcpServer 的回声服务器
+ * 客户端一次打开 -n 条连接并保持不关闭，每条连接发送一个字节，统计得到回应、被拒绝和超时的连接数
+ * 依次测试：文件描述符耗尽、最大连接数、接受速率上限、IO线程过载（两个IO线程都在处理耗时的请求） */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "zest/net/inet_addr.h"
+#include "zest/net/tcp_server.h"
+
+using namespace zest::net;
+
+int connections = 300;        // 每种方式同时打开的连接数
+int fd_limit = 64;            // 服务器的文件描述符上限
+int max_connections = 100;    // 最大连接数
+int accept_rate = 1000;       // 每秒接受的连接数
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12360;
+
+const int IO_THREADS = 2;
+const int SLOW_REQUEST_MS = 300;   // 耗时请求占用IO线程的时间
+const int MAX_LOOP_LAG_MS = 20;
+const int RECV_TIMEOUT_MS = 3000;
+
+// 每种方式的服务器配置
+struct Mode
+{
+  std::string m_name;
+  int m_fd_limit;            // 0 表示不修改
+  std::size_t m_max_connections;
+  double m_accept_rate;
+  uint64_t m_max_loop_lag_ms;
+  bool m_slow_requests;      // 先让每个IO线程都处理一个耗时的请求
+};
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./admission_bench [options] \n \
+Options: \n \
+-n Connections opened at once in each mode, default 300\n \
+-f File descriptor limit of the server, default 64\n \
+-m Max connections of the server, default 100\n \
+-r Accepted connections per second, default 1000\n \
+-h Show help information. \n \
+For example: ./admission_bench -n 1000 -f 256 -m 500\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowMs()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void setFdLimit(rlim_t n)
+{
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+    rl.rlim_cur = n < rl.rlim_max ? n : rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+}
+
+int64_t cpuMs()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+// 回声服务器，收到 'S' 时先占用IO线程 SLOW_REQUEST_MS 毫秒
+void runServer(const Mode &mode)
+{
+  InetAddress local_addr(server_ip, port);
+  TcpServer server(local_addr, IO_THREADS);
+  server.setMaxConnections(mode.m_max_connections);
+  if (mode.m_accept_rate > 0)
+    server.setAcceptRateLimit(mode.m_accept_rate, 50);
+  server.setMaxLoopLag(mode.m_max_loop_lag_ms);
+  server.setMessageCallback([](TcpConnection &conn){
+    std::string msg = conn.data();
+    conn.clearData();
+    if (msg.find('S') != std::string::npos) {
+      int64_t until = nowMs() + SLOW_REQUEST_MS;
+      while (nowMs() < until) {}
+    }
+    conn.send(msg);
+  });
+  server.setWriteCompleteCallback([](TcpConnection &conn){
+    conn.waitForMessage();
+  });
+  // 文件描述符上限在创建完服务器之后设置，只限制连接
+  if (mode.m_fd_limit > 0)
+    setFdLimit(mode.m_fd_limit);
+  server.start();
+
+  std::cout << "  " << mode.m_name << "  server: " << server.connectionsRejected() << " rejected, "
+            << server.acceptsDeferred() << " deferred, " << cpuMs() << " ms cpu" << std::endl;
+}
+
+int connectTo()
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  struct timeval tv;
+  tv.tv_sec = RECV_TIMEOUT_MS / 1000;
+  tv.tv_usec = RECV_TIMEOUT_MS % 1000 * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+// 发送一个字节并等待回应，返回 1 表示得到回应，0 表示被拒绝，-1 表示超时
+int request(int fd, char c)
+{
+  if (send(fd, &c, 1, MSG_NOSIGNAL) != 1)
+    return 0;
+  char reply;
+  ssize_t n = recv(fd, &reply, 1, 0);
+  if (n == 1)
+    return 1;
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return -1;
+  return 0;
+}
+
+void measure(const Mode &mode)
+{
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    runServer(mode);
+    exit(0);
+  }
+  usleep(300 * 1000);
+
+  // 每个IO线程一个耗时的请求，不等待回应
+  std::vector<int> slow_fds;
+  if (mode.m_slow_requests) {
+    for (int i = 0; i < IO_THREADS; ++i) {
+      int fd = connectTo();
+      if (fd >= 0) {
+        char c = 'S';
+        send(fd, &c, 1, MSG_NOSIGNAL);
+        slow_fds.push_back(fd);
+      }
+    }
+    usleep(50 * 1000);
+  }
+
+  uint64_t served = 0, rejected = 0, timeout = 0;
+  std::vector<int> fds;
+  int64_t start = nowMs();
+  for (int i = 0; i < connections; ++i) {
+    int fd = connectTo();
+    if (fd < 0)
+      ++rejected;
+    else
+      fds.push_back(fd);
+  }
+  for (int fd : fds) {
+    int ret = request(fd, 'x');
+    if (ret > 0)
+      ++served;
+    else if (ret == 0)
+      ++rejected;
+    else
+      ++timeout;
+  }
+  int64_t elapsed = nowMs() - start;
+  for (int fd : fds)
+    close(fd);
+  for (int fd : slow_fds)
+    close(fd);
+
+  usleep(200 * 1000);
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  std::cout << "  " << mode.m_name << "  client: " << served << " served, " << rejected << " rejected, "
+            << timeout << " timed out, " << elapsed << " ms" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "n:f:m:r:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      connections = atoi(optarg);
+      break;
+    case 'f':
+      fd_limit = atoi(optarg);
+      break;
+    case 'm':
+      max_connections = atoi(optarg);
+      break;
+    case 'r':
+      accept_rate = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (connections <= 0 || fd_limit <= 0 || max_connections <= 0 || accept_rate <= 0) {
+    showHelp();
+    exit(-1);
+  }
+  setFdLimit(RLIM_INFINITY);
+
+  std::cout << connections << " connections opened at once, " << IO_THREADS << " IO threads" << std::endl;
+  std::vector<Mode> modes = {
+    {"fd limit " + std::to_string(fd_limit), fd_limit, 0, 0, 0, false},
+    {"max " + std::to_string(max_connections) + " connections", 0, static_cast<std::size_t>(max_connections), 0, 0, false},
+    {std::to_string(accept_rate) + " accepts/sec", 0, 0, static_cast<double>(accept_rate), 0, false},
+    {"loop lag > " + std::to_string(MAX_LOOP_LAG_MS) + " ms", 0, 0, 0, MAX_LOOP_LAG_MS, true},
+  };
+  for (const Mode &mode : modes)
+    measure(mode);
+  return 0;
+}
@@ -0,0 +1,162 @@
+/* 回环地址上的大块数据吞吐测试，统计服务器每发送1GB数据消耗的CPU时间，用于对比 MSG_ZEROCOPY 的效果 */
+#include <arpa/inet.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+
+#include "zest/net/tcp_server.h"
+
+int payload_mb = 8;        // 每个数据片的大小，单位 MB
+int total_gb = 4;          // 总共发送的数据量，单位 GB
+bool zerocopy = false;     // 是否开启 MSG_ZEROCOPY
+uint16_t port = 12346;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./bulk_bench [options] \n \
+Options: \n \
+-m Payload size of each send (MB), default 8\n \
+-g Total data to transfer (GB), default 4\n \
+-z Enable MSG_ZEROCOPY\n \
+-p Port on 127.0.0.1, default 12346\n \
+-h Show help information. \n \
+For example: ./bulk_bench -m 8 -g 4 -z\n \
+";
+
+  std::cout << help_msg;
+}
+
+double toSeconds(const struct timeval &tv)
+{
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// 服务器进程：收到任何数据后，把同一个数据片重复发送，发完后半关闭
+void runServer()
+{
+  zest::net::InetAddress local_addr("127.0.0.1", port);
+  zest::net::TcpServer server(local_addr, 1);
+
+  const std::size_t payload_size = static_cast<std::size_t>(payload_mb) << 20;
+  const int times = static_cast<int>((static_cast<uint64_t>(total_gb) << 30) / payload_size);
+  zest::net::Slice payload(std::string(payload_size, 'z'));
+
+  server.setOnConnectionCallback([](zest::net::TcpConnection &conn){
+    if (zerocopy)
+      conn.setZeroCopyThreshold(64 * 1024);
+    conn.waitForMessage();
+  });
+  server.setMessageCallback([payload, times](zest::net::TcpConnection &conn){
+    conn.clearData();
+    // 所有的发送共享同一块内存
+    for (int i = 0; i < times; ++i)
+      conn.send(payload);
+    conn.shutdown();
+  });
+  server.start();
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "m:g:p:zh";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'm':
+      payload_mb = atoi(optarg);
+      break;
+    case 'g':
+      total_gb = atoi(optarg);
+      break;
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'z':
+      zerocopy = true;
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (payload_mb <= 0 || total_gb <= 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    runServer();
+    exit(0);
+  }
+
+  // 客户端：连接服务器，读到对端关闭为止
+  int sockfd = -1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  for (int i = 0; i < 50; ++i) {
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(sockfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+      break;
+    close(sockfd);
+    sockfd = -1;
+    usleep(100 * 1000);
+  }
+  if (sockfd == -1) {
+    std::cerr << "connect to server failed" << std::endl;
+    kill(pid, SIGKILL);
+    exit(-1);
+  }
+
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  ssize_t len = send(sockfd, "go", 2, 0);
+
+  static char buf[1 << 20];
+  uint64_t received = 0;
+  while ((len = recv(sockfd, buf, sizeof(buf), 0)) > 0)
+    received += len;
+  gettimeofday(&end, NULL);
+  close(sockfd);
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+
+  struct rusage usage;
+  getrusage(RUSAGE_CHILDREN, &usage);
+  double server_cpu = toSeconds(usage.ru_utime) + toSeconds(usage.ru_stime);
+  double elapsed = toSeconds(end) - toSeconds(start);
+  double gb = received / double(1 << 30);
+
+  std::cout << "mode:            " << (zerocopy ? "MSG_ZEROCOPY" : "copy") << std::endl;
+  std::cout << "received:        " << gb << " GB" << std::endl;
+  std::cout << "throughput:      " << gb / elapsed << " GB/s" << std::endl;
+  std::cout << "server user cpu: " << toSeconds(usage.ru_utime) << " s" << std::endl;
+  std::cout << "server sys cpu:  " << toSeconds(usage.ru_stime) << " s" << std::endl;
+  std::cout << "server cpu/GB:   " << (gb > 0 ? server_cpu / gb : 0) << " s" << std::endl;
+
+  return 0;
+}
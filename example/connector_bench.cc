@@ -0,0 +1,203 @@
+/* 异步主动连接的压力测试，在子进程中启动基于 zest::net::TcpServer 的回显服务器
+ * 客户端只有一个线程：用 -c 个 zest::net::TcpConnector 同时连接服务器，每个连接不停地做请求-响应，统计吞吐量
+ * 客户端先于服务器启动，连接失败后按指数退避重试，不需要像 echo_bench 那样每个客户端 fork 一个进程 */
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zest/net/eventloop.h"
+#include "zest/net/inet_addr.h"
+#include "zest/net/tcp_connector.h"
+#include "zest/net/tcp_server.h"
+#include "zest/net/timer_event.h"
+
+using namespace zest::net;
+
+int connections = 500;        // 同时保持的连接数
+int seconds = 5;              // 测试时间
+int payload_size = 64;        // 每次请求的大小
+int server_threads = 1;       // 服务器的IO线程数
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12355;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./connector_bench [options] \n \
+Options: \n \
+-c Connections driven by one client thread, default 500\n \
+-t Running time (seconds), default 5\n \
+-s Payload size (bytes), default 64\n \
+-w IO threads of the server, default 1\n \
+-h Show help information. \n \
+For example: ./connector_bench -c 1000 -t 5 -s 64\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 回显服务器，收到多少发回多少
+void runServer()
+{
+  InetAddress local_addr(server_ip, port);
+  TcpServer server(local_addr, server_threads);
+  server.setOnConnectionCallback([](TcpConnection &conn){
+    conn.setTcpNoDelay(true);
+    conn.waitForMessage();
+  });
+  server.setMessageCallback([](TcpConnection &conn){
+    conn.send(conn.peek(), conn.dataSize());
+    conn.clearData();
+  });
+  server.setWriteCompleteCallback([](TcpConnection &conn){
+    conn.waitForMessage();
+  });
+  server.start();
+}
+
+// 连接数较多时需要提高文件描述符的上限
+void raiseFdLimit()
+{
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "c:t:s:w:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      connections = atoi(optarg);
+      break;
+    case 't':
+      seconds = atoi(optarg);
+      break;
+    case 's':
+      payload_size = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (connections <= 0 || seconds <= 0 || payload_size <= 0 || server_threads <= 0) {
+    showHelp();
+    exit(-1);
+  }
+  raiseFdLimit();
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    // 服务器晚一点启动，让客户端经历连接失败和退避重试
+    usleep(200 * 1000);
+    runServer();
+    exit(0);
+  }
+
+  auto eventloop = EventLoop::CreateEventLoop();
+  InetAddress server_addr(server_ip, port);
+  std::string request(static_cast<std::size_t>(payload_size), 'x');
+
+  int connected = 0;
+  bool stopping = false;
+  uint64_t round_trips = 0, round_trips_at_ready = 0;
+  int64_t start_ns = nowNanos(), ready_ns = 0;
+
+  std::vector<TcpConnector::s_ptr> connectors;
+  connectors.reserve(connections);
+  for (int i = 0; i < connections; ++i) {
+    auto connector = std::make_shared<TcpConnector>(eventloop, server_addr);
+    connector->setRetry(20, 1000);
+    connector->setConnectionCallback([&](TcpConnection &conn){
+      conn.setTcpNoDelay(true);
+      if (++connected == connections) {
+        ready_ns = nowNanos();
+        round_trips_at_ready = round_trips;
+      }
+      conn.send(request);
+      conn.waitForMessage();
+    });
+    connector->setMessageCallback([&](TcpConnection &conn){
+      // 回显可能分几次到达，凑齐一个请求的大小才算一次往返
+      while (conn.dataSize() >= request.size()) {
+        conn.clearBytesData(static_cast<int>(request.size()));
+        ++round_trips;
+        if (!stopping)
+          conn.send(request);
+      }
+    });
+    connector->setWriteCompleteCallback([](TcpConnection &conn){
+      conn.waitForMessage();
+    });
+    connector->start();
+    connectors.push_back(connector);
+  }
+
+  TimerEvent::s_ptr stop_timer = std::make_shared<TimerEvent>(
+    static_cast<uint64_t>(seconds) * 1000,
+    [&](){
+      stopping = true;
+      eventloop->stop();
+    }
+  );
+  eventloop->addTimerEvent(stop_timer);
+  eventloop->loop();
+  int64_t end_ns = nowNanos();
+
+  uint64_t attempts = 0, failures = 0;
+  for (const auto &connector : connectors) {
+    attempts += connector->connectAttempts();
+    failures += connector->connectFailures();
+  }
+
+  std::cout << "connections:      " << connected << " / " << connections << " (1 client thread)" << std::endl;
+  std::cout << "connect attempts: " << attempts << ", failed " << failures << std::endl;
+  if (ready_ns > 0) {
+    double ready_sec = (end_ns - ready_ns) / 1e9;
+    std::cout << "all connected in: " << (ready_ns - start_ns) / 1000000 << " ms" << std::endl;
+    std::cout << "round trips:      " << round_trips << " ("
+              << static_cast<uint64_t>((round_trips - round_trips_at_ready) / ready_sec)
+              << " round trips/sec after all connected)" << std::endl;
+  }
+  else {
+    std::cout << "round trips:      " << round_trips << std::endl;
+  }
+
+  connectors.clear();
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  return 0;
+}
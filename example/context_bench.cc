@@ -0,0 +1,154 @@
+/* 连接上下文的存取开销测试，对比按字符串名字存取（Put/Get）和按槽位存取（ContextSlot）
+ * 每次取值的耗时模拟消息回调中取会话状态，放置和销毁的耗时和堆分配次数模拟每个连接建立和断开 */
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "zest/net/context_slot.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/inet_addr.h"
+#include "zest/net/tcp_connection.h"
+
+using namespace zest::net;
+
+int lookups = 50000000;       // 取值次数
+int connections = 1000000;    // 创建和销毁连接的次数
+
+// 统计堆分配次数
+static uint64_t g_allocations = 0;
+
+void *operator new(std::size_t size)
+{
+  ++g_allocations;
+  void *p = malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+// 典型的会话状态
+struct Session
+{
+  int m_protocol {2};
+  bool m_closing {false};
+  uint64_t m_requests {0};
+};
+
+static const ContextSlot<Session> SESSION_SLOT;
+static const char *SESSION_KEY = "__session";
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./context_bench [options] \n \
+Options: \n \
+-g Number of lookups, default 50000000\n \
+-p Number of connections created, default 1000000\n \
+-h Show help information. \n \
+For example: ./context_bench -g 100000000\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void reportGet(const std::string &name, int64_t elapsed, uint64_t sum)
+{
+  std::cout << "  get " << name << "  " << static_cast<double>(elapsed) / lookups << " ns"
+            << "  (checksum " << sum << ")" << std::endl;
+}
+
+void reportPut(const std::string &name, int64_t elapsed, uint64_t allocations)
+{
+  std::cout << "  create+destroy " << name << "  " << static_cast<double>(elapsed) / connections << " ns  "
+            << static_cast<double>(allocations) / connections << " allocations" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "g:p:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'g':
+      lookups = atoi(optarg);
+      break;
+    case 'p':
+      connections = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (lookups <= 0 || connections <= 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    std::cerr << "socketpair failed" << std::endl;
+    exit(-1);
+  }
+  auto eventloop = EventLoop::CreateEventLoop();
+  auto peer_addr = std::make_shared<InetAddress>("127.0.0.1", 0);
+  TcpConnection conn(fds[0], eventloop, peer_addr);
+  conn.Put<Session>(SESSION_KEY);
+  conn.Put(SESSION_SLOT);
+
+  // 每条消息取一次会话状态
+  std::cout << "Context lookup, " << lookups << " times" << std::endl;
+  uint64_t sum = 0;
+  int64_t start = nowNanos();
+  for (int i = 0; i < lookups; ++i)
+    sum += ++conn.Get<Session>(SESSION_KEY)->m_requests;
+  reportGet("by name", nowNanos() - start, sum);
+
+  sum = 0;
+  start = nowNanos();
+  for (int i = 0; i < lookups; ++i)
+    sum += ++conn.Get(SESSION_SLOT)->m_requests;
+  reportGet("by slot", nowNanos() - start, sum);
+
+  // 每个连接放置一次，断开时销毁，第一行是不放置上下文的连接本身的开销
+  std::cout << "Connection with context, " << connections << " times" << std::endl;
+  for (int mode = 0; mode < 3; ++mode) {
+    uint64_t allocations = g_allocations;
+    start = nowNanos();
+    for (int i = 0; i < connections; ++i) {
+      TcpConnection c(fds[0], eventloop, peer_addr);
+      if (mode == 1)
+        c.Put<Session>(SESSION_KEY);
+      else if (mode == 2)
+        c.Put(SESSION_SLOT);
+    }
+    int64_t elapsed = nowNanos() - start;
+    reportPut(mode == 0 ? "none   " : (mode == 1 ? "by name" : "by slot"), elapsed, g_allocations - allocations);
+  }
+  close(fds[1]);
+  return 0;
+}
@@ -0,0 +1,194 @@
+/* 长度前缀分帧的性能测试，客户端连续发送大量小帧，统计服务器每秒解析的帧数 */
+#include <arpa/inet.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+
+#include "zest/net/length_codec.h"
+#include "zest/net/tcp_server.h"
+
+int frame_size = 64;          // 每一帧消息体的大小，单位字节
+int total_frames = 5000000;   // 总共发送的帧数
+zest::net::LengthCodec::LengthType length_type = zest::net::LengthCodec::Fixed32;
+uint16_t port = 12347;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./frame_bench [options] \n \
+Options: \n \
+-s Payload size of each frame (bytes), default 64\n \
+-n Total frames to send, default 5000000\n \
+-t Length field: 2, 4, 8 or v (varint), default 4\n \
+-p Port on 127.0.0.1, default 12347\n \
+-h Show help information. \n \
+For example: ./frame_bench -s 64 -n 5000000 -t v\n \
+";
+
+  std::cout << help_msg;
+}
+
+double nowSeconds()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// 服务器进程：解析所有的帧，收齐之后回复一帧，内容是收到的帧数
+void runServer()
+{
+  zest::net::InetAddress local_addr("127.0.0.1", port);
+  zest::net::TcpServer server(local_addr, 1);
+  zest::net::LengthCodec codec(length_type);
+
+  long received = 0;
+  codec.setFrameCallback([&received, &codec](zest::net::TcpConnection &conn, const char *, std::size_t){
+    if (++received == total_frames)
+      codec.send(conn, std::to_string(received));
+  });
+  server.setMessageCallback(std::bind(&zest::net::LengthCodec::onMessage, &codec, std::placeholders::_1));
+  server.start();
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "s:n:t:p:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      frame_size = atoi(optarg);
+      break;
+    case 'n':
+      total_frames = atoi(optarg);
+      break;
+    case 't':
+      if (optarg[0] == 'v')
+        length_type = zest::net::LengthCodec::Varint;
+      else
+        length_type = static_cast<zest::net::LengthCodec::LengthType>(atoi(optarg));
+      break;
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (frame_size < 0 || total_frames <= 0 ||
+      (length_type != zest::net::LengthCodec::Varint && length_type != zest::net::LengthCodec::Fixed16 &&
+       length_type != zest::net::LengthCodec::Fixed32 && length_type != zest::net::LengthCodec::Fixed64)) {
+    showHelp();
+    exit(-1);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    runServer();
+    exit(0);
+  }
+
+  // 客户端：预先编码好一批帧，重复发送
+  zest::net::LengthCodec codec(length_type);
+  char header[zest::net::LengthCodec::MAX_HEADER_SIZE];
+  std::size_t header_len = codec.encodeHeader(header, frame_size);
+  if (header_len == 0) {
+    std::cerr << "frame size too large for this length field" << std::endl;
+    kill(pid, SIGKILL);
+    exit(-1);
+  }
+  std::string frame(header, header_len);
+  frame.append(frame_size, 'f');
+  int frames_per_batch = std::max(1, static_cast<int>((64 * 1024) / frame.size()));
+  std::string batch;
+  for (int i = 0; i < frames_per_batch; ++i)
+    batch += frame;
+
+  int sockfd = -1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  for (int i = 0; i < 50; ++i) {
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(sockfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+      break;
+    close(sockfd);
+    sockfd = -1;
+    usleep(100 * 1000);
+  }
+  if (sockfd == -1) {
+    std::cerr << "connect to server failed" << std::endl;
+    kill(pid, SIGKILL);
+    exit(-1);
+  }
+
+  double start = nowSeconds();
+  int sent = 0;
+  while (sent < total_frames) {
+    int n = std::min(frames_per_batch, total_frames - sent);
+    const char *p = batch.data();
+    std::size_t left = n * frame.size();
+    while (left > 0) {
+      ssize_t len = send(sockfd, p, left, 0);
+      if (len <= 0) {
+        std::cerr << "send failed, errno = " << errno << std::endl;
+        kill(pid, SIGKILL);
+        exit(-1);
+      }
+      p += len;
+      left -= len;
+    }
+    sent += n;
+  }
+
+  // 等待服务器的回复帧
+  std::string reply;
+  char buf[256];
+  uint64_t reply_len = 0;
+  int reply_header = 0;
+  while (reply_header <= 0 || reply.size() < reply_header + reply_len) {
+    ssize_t len = recv(sockfd, buf, sizeof(buf), 0);
+    if (len <= 0)
+      break;
+    reply.append(buf, len);
+    if (reply_header <= 0)
+      reply_header = codec.decodeHeader(reply.data(), reply.size(), &reply_len);
+  }
+  double elapsed = nowSeconds() - start;
+  close(sockfd);
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+
+  std::string count = reply_header > 0 ? reply.substr(reply_header, reply_len) : "0";
+  std::cout << "length field:    " << (length_type == zest::net::LengthCodec::Varint ? "varint" : std::to_string(length_type) + " bytes") << std::endl;
+  std::cout << "frame size:      " << frame_size << " bytes" << std::endl;
+  std::cout << "frames parsed:   " << count << std::endl;
+  std::cout << "elapsed:         " << elapsed << " s" << std::endl;
+  std::cout << "frames/sec:      " << static_cast<uint64_t>(total_frames / elapsed) << std::endl;
+  std::cout << "throughput:      " << total_frames * frame.size() / elapsed / (1 << 20) << " MB/s" << std::endl;
+
+  return 0;
+}
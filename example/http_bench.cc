@@ -0,0 +1,303 @@
+/* 仿照 wrk 的HTTP压力测试，统计纯文本接口每秒处理的请求数和延迟分布
+ * 不指定 -s 时在子进程中启动一个 zest::net::http::HttpServer */
+#include <arpa/inet.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zest/net/http/http_server.h"
+
+int threads = 2;              // 客户端线程数
+int connections = 64;         // 连接总数
+int seconds = 10;             // 测试时间
+int pipeline = 1;             // 每个连接同时发出的请求数
+int server_threads = 2;       // 内置服务器的IO线程数
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12348;
+bool external_server = false;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./http_bench [options] \n \
+Options: \n \
+-t Client threads, default 2\n \
+-c Connections, default 64\n \
+-d Duration (seconds), default 10\n \
+-P Pipelined requests per connection, default 1\n \
+-w IO threads of the built-in server, default 2\n \
+-s Benchmark an external server (ip:port) instead of the built-in one\n \
+-h Show help information. \n \
+For example: ./http_bench -t 2 -c 64 -d 10 -P 16\n \
+";
+
+  std::cout << help_msg;
+}
+
+double nowSeconds()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// 服务器进程：GET /plaintext 返回 "Hello, World!"
+void runServer()
+{
+  zest::net::InetAddress local_addr(server_ip, port);
+  zest::net::http::HttpServer server(local_addr, server_threads);
+  server.handle("/plaintext", [](const zest::net::http::HttpRequest &, zest::net::http::HttpResponse &resp){
+    resp.setHeader("Content-Type", "text/plain");
+    resp.setHeader("Server", "zest");
+    resp.setBody("Hello, World!");
+    resp.send();
+  });
+  server.start();
+}
+
+struct ThreadResult
+{
+  uint64_t requests {0};
+  uint64_t bytes {0};
+  uint64_t errors {0};
+  std::vector<uint32_t> latencies;   // 单位 us
+};
+
+struct ClientConn
+{
+  int fd {-1};
+  std::string in;
+  std::deque<double> send_times;
+};
+
+// 从 offset 开始解析一个完整的响应，返回响应的长度，不完整时返回0，格式错误返回-1
+long parseResponse(const std::string &in, std::size_t offset)
+{
+  std::size_t header_end = in.find("\r\n\r\n", offset);
+  if (header_end == std::string::npos)
+    return 0;
+  if (in.compare(offset, 12, "HTTP/1.1 200") != 0)
+    return -1;
+  std::size_t pos = in.find("Content-Length: ", offset);
+  if (pos == std::string::npos || pos > header_end)
+    return -1;
+  long body = atol(in.c_str() + pos + 16);
+  if (in.size() < header_end + 4 + body)
+    return 0;
+  return header_end + 4 + body - offset;
+}
+
+void runClient(int conn_num, double deadline, ThreadResult *result)
+{
+  const std::string request = "GET /plaintext HTTP/1.1\r\nHost: " + server_ip + "\r\nAccept: text/plain\r\n\r\n";
+  std::string batch;
+  for (int i = 0; i < pipeline; ++i)
+    batch += request;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = inet_addr(server_ip.c_str());
+
+  int epfd = epoll_create1(0);
+  std::vector<ClientConn> conns(conn_num);
+  for (int i = 0; i < conn_num; ++i) {
+    conns[i].fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(conns[i].fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+      ++result->errors;
+      close(conns[i].fd);
+      conns[i].fd = -1;
+      continue;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, conns[i].fd, &ev);
+    double now = nowSeconds();
+    if (send(conns[i].fd, batch.data(), batch.size(), 0) != static_cast<ssize_t>(batch.size()))
+      ++result->errors;
+    for (int j = 0; j < pipeline; ++j)
+      conns[i].send_times.push_back(now);
+  }
+
+  char buf[64 * 1024];
+  struct epoll_event events[256];
+  while (nowSeconds() < deadline) {
+    int n = epoll_wait(epfd, events, 256, 100);
+    for (int i = 0; i < n; ++i) {
+      ClientConn &conn = conns[events[i].data.u32];
+      ssize_t len = recv(conn.fd, buf, sizeof(buf), 0);
+      if (len <= 0) {
+        ++result->errors;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        continue;
+      }
+      result->bytes += len;
+      conn.in.append(buf, len);
+
+      // 每收到一个完整的响应就补发一个请求，保持 pipeline 个请求在途
+      double now = nowSeconds();
+      int completed = 0;
+      std::size_t offset = 0;
+      while (true) {
+        long resp_len = parseResponse(conn.in, offset);
+        if (resp_len < 0) {
+          ++result->errors;
+          offset = conn.in.size();
+          break;
+        }
+        if (resp_len == 0)
+          break;
+        offset += resp_len;
+        ++completed;
+        result->latencies.push_back(static_cast<uint32_t>((now - conn.send_times.front()) * 1e6));
+        conn.send_times.pop_front();
+      }
+      conn.in.erase(0, offset);
+      if (completed > 0) {
+        result->requests += completed;
+        std::string more;
+        for (int j = 0; j < completed; ++j) {
+          more += request;
+          conn.send_times.push_back(now);
+        }
+        if (send(conn.fd, more.data(), more.size(), 0) != static_cast<ssize_t>(more.size()))
+          ++result->errors;
+      }
+    }
+  }
+
+  for (auto &conn : conns) {
+    if (conn.fd != -1)
+      close(conn.fd);
+  }
+  close(epfd);
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "t:c:d:P:w:s:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'c':
+      connections = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atoi(optarg);
+      break;
+    case 'P':
+      pipeline = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 's': {
+      std::string addr(optarg);
+      std::size_t colon = addr.find(':');
+      if (colon == std::string::npos) {
+        showHelp();
+        exit(-1);
+      }
+      server_ip = addr.substr(0, colon);
+      port = atoi(addr.c_str() + colon + 1);
+      external_server = true;
+      break;
+    }
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (threads <= 0 || connections < threads || seconds <= 0 || pipeline <= 0 || server_threads <= 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  pid_t pid = -1;
+  if (!external_server) {
+    pid = fork();
+    if (pid < 0) {
+      std::cerr << "fork failed" << std::endl;
+      exit(-1);
+    }
+    else if (pid == 0) {
+      runServer();
+      exit(0);
+    }
+    usleep(300 * 1000);
+  }
+
+  std::cout << "Running " << seconds << "s test @ http://" << server_ip << ":" << port << "/plaintext" << std::endl;
+  std::cout << "  " << threads << " threads and " << connections << " connections, pipeline " << pipeline << std::endl;
+
+  double start = nowSeconds();
+  double deadline = start + seconds;
+  std::vector<ThreadResult> results(threads);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    int conn_num = connections / threads + (i < connections % threads ? 1 : 0);
+    workers.emplace_back(runClient, conn_num, deadline, &results[i]);
+  }
+  for (auto &worker : workers)
+    worker.join();
+  double elapsed = nowSeconds() - start;
+
+  if (pid > 0) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+  }
+
+  ThreadResult total;
+  for (auto &res : results) {
+    total.requests += res.requests;
+    total.bytes += res.bytes;
+    total.errors += res.errors;
+    total.latencies.insert(total.latencies.end(), res.latencies.begin(), res.latencies.end());
+  }
+  std::sort(total.latencies.begin(), total.latencies.end());
+  auto percentile = [&total](double p) -> double {
+    if (total.latencies.empty())
+      return 0;
+    std::size_t idx = static_cast<std::size_t>(p * (total.latencies.size() - 1));
+    return total.latencies[idx] / 1000.0;
+  };
+  double avg = 0;
+  for (uint32_t lat : total.latencies)
+    avg += lat;
+  avg = total.latencies.empty() ? 0 : avg / total.latencies.size() / 1000.0;
+
+  std::cout << "  Latency (ms)   avg " << avg << "  p50 " << percentile(0.5) << "  p90 " << percentile(0.9)
+            << "  p99 " << percentile(0.99) << "  max " << percentile(1.0) << std::endl;
+  std::cout << "  " << total.requests << " requests in " << elapsed << "s, "
+            << total.bytes / double(1 << 20) << " MB read" << std::endl;
+  if (total.errors > 0)
+    std::cout << "  Errors: " << total.errors << std::endl;
+  std::cout << "Requests/sec:  " << static_cast<uint64_t>(total.requests / elapsed) << std::endl;
+  std::cout << "Transfer/sec:  " << total.bytes / elapsed / (1 << 20) << " MB" << std::endl;
+
+  return 0;
+}
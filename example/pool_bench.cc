@@ -0,0 +1,276 @@
+/* 连接池的压力测试，在子进程中启动长度前缀分帧的回显服务器
+ * 客户端一个线程保持 -c 个调用在途，先通过 zest::net::ConnectionPool 复用连接并流水线发送，
+ * 再对比每次调用新建一条连接（用 zest::net::TcpConnector，收到响应后关闭），统计每秒完成的调用数和延迟分布 */
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zest/net/connection_pool.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/inet_addr.h"
+#include "zest/net/length_codec.h"
+#include "zest/net/tcp_connector.h"
+#include "zest/net/tcp_server.h"
+#include "zest/net/timer_event.h"
+
+using namespace zest::net;
+
+int concurrency = 64;         // 同时在途的调用数
+int seconds = 2;              // 每种方式的测试时间
+int payload_size = 64;        // 每次请求的消息体大小
+int max_connections = 4;      // 连接池的连接数上限
+int max_pipeline = 32;        // 每条连接上的流水线深度
+int server_threads = 1;       // 服务器的IO线程数
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12356;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./pool_bench [options] \n \
+Options: \n \
+-c Calls in flight, default 64\n \
+-t Running time of each mode (seconds), default 2\n \
+-s Payload size (bytes), default 64\n \
+-n Max connections of the pool, default 4\n \
+-P Max pipelined calls per pooled connection, default 32\n \
+-w IO threads of the server, default 1\n \
+-h Show help information. \n \
+For example: ./pool_bench -c 64 -n 4 -P 32\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 长度前缀分帧的回显服务器
+void runServer()
+{
+  LengthCodec codec(LengthCodec::Fixed32);
+  codec.setFrameCallback([&codec](TcpConnection &conn, const char *data, std::size_t len){
+    codec.send(conn, data, len);
+  });
+  InetAddress local_addr(server_ip, port);
+  TcpServer server(local_addr, server_threads);
+  server.setOnConnectionCallback([](TcpConnection &conn){
+    conn.setTcpNoDelay(true);
+    conn.waitForMessage();
+  });
+  server.setMessageCallback(std::bind(&LengthCodec::onMessage, &codec, std::placeholders::_1));
+  server.setWriteCompleteCallback([](TcpConnection &conn){
+    conn.waitForMessage();
+  });
+  server.start();
+}
+
+void report(const std::string &name, std::vector<int64_t> &latencies, int64_t elapsed_ns, uint64_t failed)
+{
+  if (latencies.empty()) {
+    std::cout << "  " << name << ": failed" << std::endl;
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  int64_t sum = 0;
+  for (int64_t l : latencies)
+    sum += l;
+  auto percentile = [&latencies](double p) -> double {
+    return latencies[static_cast<std::size_t>(p * (latencies.size() - 1))] / 1000.0;
+  };
+  std::cout << "  " << name << "  " << static_cast<uint64_t>(latencies.size() / (elapsed_ns / 1e9))
+            << " calls/sec  avg " << static_cast<double>(sum) / latencies.size() / 1000.0
+            << "  p50 " << percentile(0.5) << "  p99 " << percentile(0.99) << " us";
+  if (failed > 0)
+    std::cout << "  (" << failed << " failed)";
+  std::cout << std::endl;
+}
+
+// 运行事件循环 seconds 秒
+int64_t runFor(std::shared_ptr<EventLoop> eventloop, bool &stopping)
+{
+  int64_t start = nowNanos();
+  TimerEvent::s_ptr stop_timer = std::make_shared<TimerEvent>(
+    static_cast<uint64_t>(seconds) * 1000,
+    [&stopping, eventloop](){
+      stopping = true;
+      eventloop->stop();
+    }
+  );
+  eventloop->addTimerEvent(stop_timer);
+  eventloop->loop();
+  return nowNanos() - start;
+}
+
+void benchPool(std::shared_ptr<EventLoop> eventloop, NetBaseAddress &server_addr, const std::string &request)
+{
+  LengthCodec codec(LengthCodec::Fixed32);
+  auto pool = std::make_shared<ConnectionPool>(eventloop, server_addr);
+  pool->setResponseParser([&codec](const char *data, std::size_t len) -> int64_t {
+    uint64_t body = 0;
+    int header = codec.decodeHeader(data, len, &body);
+    if (header <= 0)
+      return header;
+    return len >= header + body ? static_cast<int64_t>(header + body) : 0;
+  });
+  pool->setMinConnections(1);
+  pool->setMaxConnections(max_connections);
+  pool->setMaxPipeline(max_pipeline);
+  pool->setRequestTimeout(3000);
+  pool->start();
+
+  bool stopping = false;
+  uint64_t failed = 0;
+  std::vector<int64_t> latencies;
+  std::function<void()> issue = [&](){
+    int64_t start = nowNanos();
+    pool->call(request, [&, start](bool ok, const char*, std::size_t){
+      if (ok)
+        latencies.push_back(nowNanos() - start);
+      else
+        ++failed;
+      if (!stopping)
+        issue();
+    });
+  };
+  for (int i = 0; i < concurrency; ++i)
+    issue();
+
+  int64_t elapsed = runFor(eventloop, stopping);
+  report("pooled  (" + std::to_string(pool->connectionCount()) + " conns)", latencies, elapsed, failed);
+  pool->stop();
+}
+
+// 每次调用新建一条连接
+void benchConnectPerCall(std::shared_ptr<EventLoop> eventloop, NetBaseAddress &server_addr,
+                         const std::string &request)
+{
+  LengthCodec codec(LengthCodec::Fixed32);
+  bool stopping = false;
+  uint64_t failed = 0;
+  std::vector<int64_t> latencies;
+  std::vector<TcpConnector::s_ptr> lanes(concurrency);
+
+  std::function<void(int)> issue = [&](int lane){
+    int64_t start = nowNanos();
+    auto connector = std::make_shared<TcpConnector>(eventloop, server_addr);
+    connector->setRetry(10, 100, 3);
+    connector->setConnectionCallback([&](TcpConnection &conn){
+      conn.setTcpNoDelay(true);
+      conn.send(request);
+      conn.waitForMessage();
+    });
+    connector->setMessageCallback([&, lane, start](TcpConnection &conn){
+      uint64_t body = 0;
+      int header = codec.decodeHeader(conn.peek(), conn.dataSize(), &body);
+      if (header <= 0 || conn.dataSize() < header + body)
+        return;
+      latencies.push_back(nowNanos() - start);
+      conn.close();
+      // connector 的回调函数返回之后才能释放它
+      eventloop->runAtIterationEnd([&, lane](){
+        if (!stopping)
+          issue(lane);
+      });
+    });
+    connector->setWriteCompleteCallback([](TcpConnection &conn){
+      conn.waitForMessage();
+    });
+    connector->setConnectFailedCallback([&, lane](TcpConnector&, int){
+      ++failed;
+      eventloop->runAtIterationEnd([&, lane](){
+        if (!stopping)
+          issue(lane);
+      });
+    });
+    lanes[lane] = connector;
+    connector->start();
+  };
+  for (int i = 0; i < concurrency; ++i)
+    issue(i);
+
+  int64_t elapsed = runFor(eventloop, stopping);
+  report("connect per call   ", latencies, elapsed, failed);
+  lanes.clear();
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "c:t:s:n:P:w:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      concurrency = atoi(optarg);
+      break;
+    case 't':
+      seconds = atoi(optarg);
+      break;
+    case 's':
+      payload_size = atoi(optarg);
+      break;
+    case 'n':
+      max_connections = atoi(optarg);
+      break;
+    case 'P':
+      max_pipeline = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (concurrency <= 0 || seconds <= 0 || payload_size <= 0 || max_connections <= 0 ||
+      max_pipeline <= 0 || server_threads <= 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    runServer();
+    exit(0);
+  }
+  usleep(300 * 1000);
+
+  auto eventloop = EventLoop::CreateEventLoop();
+  InetAddress server_addr(server_ip, port);
+  LengthCodec codec(LengthCodec::Fixed32);
+  char header[LengthCodec::MAX_HEADER_SIZE];
+  std::size_t header_len = codec.encodeHeader(header, payload_size);
+  std::string request = std::string(header, header_len) + std::string(payload_size, 'x');
+
+  std::cout << concurrency << " calls in flight, " << payload_size << " bytes each, latency in us" << std::endl;
+  benchPool(eventloop, server_addr, request);
+  benchConnectPerCall(eventloop, server_addr, request);
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  return 0;
+}
@@ -0,0 +1,326 @@
+/* 发布/订阅扇出延迟测试，在子进程中启动基于 zest::net::pubsub::PubSubHub 的服务器
+ * -n 个订阅者连接订阅同一个主题，一个发布者按 -r 的速率发布带时间戳的消息，统计从发布到每个订阅者收到的延迟
+ * 协议是文本行："SUB <topic>\n" 订阅，"PUB <topic> <message>\n" 发布，订阅者收到 "<message>\n" */
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zest/net/inet_addr.h"
+#include "zest/net/pubsub/pubsub_hub.h"
+#include "zest/net/tcp_server.h"
+
+using namespace zest::net;
+using namespace zest::net::pubsub;
+
+int subscribers = 1000;       // 订阅者连接数
+int client_threads = 4;       // 驱动订阅者连接的线程数
+int rate = 1000;              // 每秒发布的消息数
+int seconds = 5;              // 测试时间
+int payload_size = 64;        // 消息的大小
+int server_threads = 4;       // 服务器的IO线程数
+bool disconnect_policy = false;
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12351;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./pubsub_bench [options] \n \
+Options: \n \
+-n Subscriber connections, default 1000\n \
+-t Client threads driving the subscribers, default 4\n \
+-r Messages published per second, default 1000\n \
+-d Duration (seconds), default 5\n \
+-s Payload size (bytes), default 64\n \
+-w IO threads of the server, default 4\n \
+-D Disconnect slow subscribers instead of dropping their oldest messages\n \
+-h Show help information. \n \
+For example: ./pubsub_bench -n 10000 -r 1000 -d 5\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowMicros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void runServer()
+{
+  InetAddress local_addr(server_ip, port);
+  TcpServer server(local_addr, server_threads);
+  PubSubHub hub;
+  PubSubHub *p_hub = &hub;
+  SubscriberOptions options;
+  if (disconnect_policy)
+    options.m_policy = Disconnect;
+  hub.setDefaultOptions(options);
+
+  server.setOnConnectionCallback([](TcpConnection &conn){
+    conn.setTcpNoDelay(true);
+    conn.waitForMessage();
+  });
+  server.setMessageCallback([p_hub](TcpConnection &conn){
+    std::size_t start = 0, end;
+    const char *data = conn.peek();
+    while ((end = conn.find('\n', start)) != std::string::npos) {
+      std::string line(data + start, end - start);
+      start = end + 1;
+      std::size_t sp = line.find(' ');
+      if (sp == std::string::npos)
+        continue;
+      if (line.compare(0, sp, "SUB") == 0) {
+        p_hub->subscribe(conn, line.substr(sp + 1));
+      }
+      else if (line.compare(0, sp, "PUB") == 0) {
+        std::size_t sp2 = line.find(' ', sp + 1);
+        if (sp2 != std::string::npos)
+          p_hub->publish(line.substr(sp + 1, sp2 - sp - 1), Slice(line.substr(sp2 + 1) + "\n"));
+      }
+    }
+    if (start > 0)
+      conn.clearBytesData(start);
+  });
+  server.setWriteCompleteCallback([p_hub](TcpConnection &conn){
+    p_hub->onWriteComplete(conn);
+    conn.waitForMessage();
+  });
+  server.setCloseCallback([p_hub](TcpConnection &conn){
+    p_hub->unsubscribeAll(conn);
+  });
+  server.start();
+}
+
+int connectServer()
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+// 一个客户端线程的统计数据
+struct SubscriberStats
+{
+  uint64_t received {0};
+  uint64_t closed {0};
+  std::vector<uint32_t> latencies;   // 单位 us
+};
+
+// 用 epoll 驱动一组订阅者连接，直到 stop 被设置
+void runSubscribers(const std::vector<int> &fds, SubscriberStats *stats, std::atomic<bool> *stop)
+{
+  int epfd = epoll_create1(0);
+  std::vector<std::string> buffers(fds.size());
+  for (std::size_t i = 0; i < fds.size(); ++i) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = i;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev);
+  }
+  epoll_event events[256];
+  char buf[64 * 1024];
+  while (!stop->load()) {
+    int n = epoll_wait(epfd, events, 256, 100);
+    for (int i = 0; i < n; ++i) {
+      std::size_t idx = events[i].data.u64;
+      ssize_t len = read(fds[idx], buf, sizeof(buf));
+      if (len <= 0) {
+        if (len == 0 || (errno != EAGAIN && errno != EINTR)) {
+          ++stats->closed;
+          epoll_ctl(epfd, EPOLL_CTL_DEL, fds[idx], NULL);
+        }
+        continue;
+      }
+      int64_t now = nowMicros();
+      std::string &pending = buffers[idx];
+      pending.append(buf, len);
+      std::size_t start = 0, end;
+      while ((end = pending.find('\n', start)) != std::string::npos) {
+        int64_t ts = strtoll(pending.c_str() + start, NULL, 10);
+        stats->latencies.push_back(static_cast<uint32_t>(now - ts));
+        ++stats->received;
+        start = end + 1;
+      }
+      pending.erase(0, start);
+    }
+  }
+  close(epfd);
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "n:t:r:d:s:w:Dh";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      subscribers = atoi(optarg);
+      break;
+    case 't':
+      client_threads = atoi(optarg);
+      break;
+    case 'r':
+      rate = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atoi(optarg);
+      break;
+    case 's':
+      payload_size = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 'D':
+      disconnect_policy = true;
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (subscribers <= 0 || client_threads <= 0 || rate <= 0 || seconds <= 0 ||
+      payload_size < 24 || server_threads <= 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  // 订阅者很多时需要足够的文件描述符
+  rlimit rl;
+  getrlimit(RLIMIT_NOFILE, &rl);
+  rl.rlim_cur = rl.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &rl);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    runServer();
+    exit(0);
+  }
+  usleep(300 * 1000);
+
+  std::cout << "Running " << seconds << "s pub/sub fan-out test @ " << server_ip << ":" << port << std::endl;
+  std::cout << "  " << subscribers << " subscribers, " << rate << " messages/sec, payload "
+            << payload_size << " bytes" << std::endl;
+
+  std::vector<std::vector<int>> groups(client_threads);
+  for (int i = 0; i < subscribers; ++i) {
+    int fd = connectServer();
+    if (fd < 0) {
+      std::cerr << "connect failed after " << i << " subscribers" << std::endl;
+      kill(pid, SIGTERM);
+      waitpid(pid, NULL, 0);
+      exit(-1);
+    }
+    const char sub[] = "SUB bench\n";
+    if (write(fd, sub, sizeof(sub) - 1) != static_cast<ssize_t>(sizeof(sub) - 1)) {
+      std::cerr << "subscribe failed" << std::endl;
+      exit(-1);
+    }
+    groups[i % client_threads].push_back(fd);
+  }
+  int pub_fd = connectServer();
+  usleep(500 * 1000);
+
+  std::vector<SubscriberStats> stats(client_threads);
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < client_threads; ++i)
+    threads.emplace_back(runSubscribers, std::cref(groups[i]), &stats[i], &stop);
+
+  // 按固定的节奏发布，每条消息带上发布时的时间戳
+  uint64_t published = 0;
+  int64_t start = nowMicros();
+  int64_t deadline = start + static_cast<int64_t>(seconds) * 1000000;
+  int64_t interval = 1000000 / rate;
+  int64_t next = start;
+  while (next < deadline) {
+    int64_t now = nowMicros();
+    if (now < next) {
+      if (next - now > 50)
+        usleep(static_cast<useconds_t>(next - now - 50));
+      continue;
+    }
+    std::string line = "PUB bench " + std::to_string(now) + " ";
+    line.append(static_cast<std::size_t>(payload_size) - 1 - (line.size() - 10), 'x');
+    line += '\n';
+    if (write(pub_fd, line.data(), line.size()) != static_cast<ssize_t>(line.size()))
+      break;
+    ++published;
+    next += interval;
+  }
+  double elapsed = (nowMicros() - start) / 1e6;
+
+  // 等待最后的消息送达
+  usleep(500 * 1000);
+  stop = true;
+  for (auto &t : threads)
+    t.join();
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+
+  SubscriberStats total;
+  for (auto &s : stats) {
+    total.received += s.received;
+    total.closed += s.closed;
+    total.latencies.insert(total.latencies.end(), s.latencies.begin(), s.latencies.end());
+  }
+  std::sort(total.latencies.begin(), total.latencies.end());
+  auto percentile = [&total](double p) -> double {
+    if (total.latencies.empty())
+      return 0;
+    std::size_t idx = static_cast<std::size_t>(p * (total.latencies.size() - 1));
+    return total.latencies[idx] / 1000.0;
+  };
+
+  std::cout << "  Latency (ms)   p50 " << percentile(0.5) << "  p90 " << percentile(0.9)
+            << "  p99 " << percentile(0.99) << "  max " << percentile(1.0) << std::endl;
+  std::cout << "  " << published << " messages published, " << total.received << " of "
+            << published * subscribers << " deliveries received in " << elapsed << "s" << std::endl;
+  if (total.closed > 0)
+    std::cout << "  Disconnected subscribers: " << total.closed << std::endl;
+  std::cout << "Deliveries/sec:  " << static_cast<uint64_t>(total.received / elapsed) << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,383 @@
+/* 基于 zest::net::redis::RespServer 的内存 GET/SET 服务器，可以直接用 redis-cli / redis-benchmark 访问
+ * 加上 -B 时作为压力测试客户端，在子进程中启动服务器，流水线发送 SET/GET 统计每秒处理的命令数 */
+#include <arpa/inet.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "zest/net/redis/resp_server.h"
+
+using zest::net::Slice;
+using zest::net::TcpConnection;
+using zest::net::redis::RespCommand;
+using zest::net::redis::RespParser;
+using zest::net::redis::RespValue;
+using zest::net::redis::RespWriter;
+
+int server_threads = 4;       // 服务器的IO线程数
+std::string server_ip = "127.0.0.1";
+uint16_t port = 6380;
+bool bench_mode = false;
+bool external_server = false;
+int threads = 2;              // 客户端线程数
+int connections = 50;         // 连接总数
+int seconds = 10;             // 测试时间
+int pipeline = 16;            // 每个连接同时发出的命令数
+int value_size = 32;          // SET 的值大小
+int key_space = 10000;        // 键的数量
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./redis_server [options] \n \
+Options: \n \
+-i Server ip, default 127.0.0.1\n \
+-p Server port, default 6380\n \
+-w IO threads of the server, default 4\n \
+-B Run as a pipelined load generator (starts the server in a child process unless -s is given)\n \
+-s Benchmark an external server (ip:port)\n \
+-t Client threads, default 2\n \
+-c Connections, default 50\n \
+-d Duration (seconds), default 10\n \
+-P Pipelined commands per connection, default 16\n \
+-v Value size of SET (bytes), default 32\n \
+-h Show help information. \n \
+For example: ./redis_server -p 6380 -w 4\n \
+             ./redis_server -B -c 50 -P 16 -d 10\n \
+";
+
+  std::cout << help_msg;
+}
+
+double nowSeconds()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// 分段加锁的键值存储，值用 Slice 保存，GET 较大的值时不拷贝
+class Store
+{
+ public:
+  static const int SHARDS = 16;
+
+  void set(std::string &&key, Slice &&value)
+  {
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.map[std::move(key)] = std::move(value);
+  }
+
+  bool get(const std::string &key, Slice *value)
+  {
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end())
+      return false;
+    *value = it->second;
+    return true;
+  }
+
+  bool del(const std::string &key)
+  {
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.map.erase(key) > 0;
+  }
+
+ private:
+  struct Shard
+  {
+    std::mutex mutex;
+    std::unordered_map<std::string, Slice> map;
+  };
+
+  Shard &shardOf(const std::string &key)
+  {
+    return m_shards[std::hash<std::string>()(key) % SHARDS];
+  }
+
+  Shard m_shards[SHARDS];
+};
+
+void runServer()
+{
+  Store store;
+  zest::net::InetAddress local_addr(server_ip, port);
+  zest::net::redis::RespServer server(local_addr, server_threads);
+
+  server.handle("SET", [&store](TcpConnection &, const RespCommand &cmd, RespWriter &writer){
+    if (cmd.size() != 3) {
+      writer.error("ERR wrong number of arguments for 'set' command");
+      return;
+    }
+    store.set(cmd[1].str(), Slice(cmd[2].data, cmd[2].len));
+    writer.simpleString("OK", 2);
+  });
+  server.handle("GET", [&store](TcpConnection &, const RespCommand &cmd, RespWriter &writer){
+    if (cmd.size() != 2) {
+      writer.error("ERR wrong number of arguments for 'get' command");
+      return;
+    }
+    Slice value;
+    if (store.get(cmd[1].str(), &value))
+      writer.bulk(value);
+    else
+      writer.null();
+  });
+  server.handle("DEL", [&store](TcpConnection &, const RespCommand &cmd, RespWriter &writer){
+    if (cmd.size() < 2) {
+      writer.error("ERR wrong number of arguments for 'del' command");
+      return;
+    }
+    int64_t removed = 0;
+    for (std::size_t i = 1; i < cmd.size(); ++i)
+      removed += store.del(cmd[i].str());
+    writer.integer(removed);
+  });
+  server.start();
+}
+
+struct ThreadResult
+{
+  uint64_t commands {0};
+  uint64_t errors {0};
+};
+
+struct ClientConn
+{
+  int fd {-1};
+  std::string in;
+  uint64_t seq {0};
+};
+
+// 生成一条命令，SET 和 GET 交替
+void appendCommand(ClientConn &conn, const std::string &value, std::string *out)
+{
+  RespWriter writer;
+  std::string key = "key:" + std::to_string(conn.seq % key_space);
+  if (conn.seq % 2 == 0)
+    writer.command({"SET", key, value});
+  else
+    writer.command({"GET", key});
+  ++conn.seq;
+  *out += writer.take();
+}
+
+void runClient(int conn_num, double deadline, ThreadResult *result)
+{
+  const std::string value(value_size, 'x');
+  RespParser parser;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = inet_addr(server_ip.c_str());
+
+  int epfd = epoll_create1(0);
+  std::vector<ClientConn> conns(conn_num);
+  for (int i = 0; i < conn_num; ++i) {
+    conns[i].fd = socket(AF_INET, SOCK_STREAM, 0);
+    conns[i].seq = i;
+    if (connect(conns[i].fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+      ++result->errors;
+      close(conns[i].fd);
+      conns[i].fd = -1;
+      continue;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, conns[i].fd, &ev);
+    std::string batch;
+    for (int j = 0; j < pipeline; ++j)
+      appendCommand(conns[i], value, &batch);
+    if (send(conns[i].fd, batch.data(), batch.size(), 0) != static_cast<ssize_t>(batch.size()))
+      ++result->errors;
+  }
+
+  char buf[64 * 1024];
+  struct epoll_event events[256];
+  RespValue reply;
+  while (nowSeconds() < deadline) {
+    int n = epoll_wait(epfd, events, 256, 100);
+    for (int i = 0; i < n; ++i) {
+      ClientConn &conn = conns[events[i].data.u32];
+      ssize_t len = recv(conn.fd, buf, sizeof(buf), 0);
+      if (len <= 0) {
+        ++result->errors;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        continue;
+      }
+      conn.in.append(buf, len);
+
+      // 每收到一个回复就补发一条命令，保持 pipeline 条命令在途
+      int completed = 0;
+      std::size_t offset = 0;
+      while (offset < conn.in.size()) {
+        int used = parser.parseValue(conn.in.data() + offset, conn.in.size() - offset, &reply);
+        if (used < 0) {
+          ++result->errors;
+          offset = conn.in.size();
+          break;
+        }
+        if (used == 0)
+          break;
+        offset += used;
+        ++completed;
+        if (reply.isError())
+          ++result->errors;
+      }
+      conn.in.erase(0, offset);
+      if (completed > 0) {
+        result->commands += completed;
+        std::string more;
+        for (int j = 0; j < completed; ++j)
+          appendCommand(conn, value, &more);
+        if (send(conn.fd, more.data(), more.size(), 0) != static_cast<ssize_t>(more.size()))
+          ++result->errors;
+      }
+    }
+  }
+
+  for (auto &conn : conns) {
+    if (conn.fd != -1)
+      close(conn.fd);
+  }
+  close(epfd);
+}
+
+void runBench()
+{
+  pid_t pid = -1;
+  if (!external_server) {
+    pid = fork();
+    if (pid < 0) {
+      std::cerr << "fork failed" << std::endl;
+      exit(-1);
+    }
+    else if (pid == 0) {
+      runServer();
+      exit(0);
+    }
+    usleep(300 * 1000);
+  }
+
+  std::cout << "Running " << seconds << "s SET/GET test @ " << server_ip << ":" << port << std::endl;
+  std::cout << "  " << threads << " threads and " << connections << " connections, pipeline "
+            << pipeline << ", value " << value_size << " bytes" << std::endl;
+
+  double start = nowSeconds();
+  double deadline = start + seconds;
+  std::vector<ThreadResult> results(threads);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    int conn_num = connections / threads + (i < connections % threads ? 1 : 0);
+    workers.emplace_back(runClient, conn_num, deadline, &results[i]);
+  }
+  for (auto &worker : workers)
+    worker.join();
+  double elapsed = nowSeconds() - start;
+
+  if (pid > 0) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+  }
+
+  ThreadResult total;
+  for (auto &res : results) {
+    total.commands += res.commands;
+    total.errors += res.errors;
+  }
+  std::cout << "  " << total.commands << " commands in " << elapsed << "s" << std::endl;
+  if (total.errors > 0)
+    std::cout << "  Errors: " << total.errors << std::endl;
+  std::cout << "Commands/sec:  " << static_cast<uint64_t>(total.commands / elapsed) << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "i:p:w:Bs:t:c:d:P:v:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'i':
+      server_ip = std::string(optarg);
+      break;
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 'B':
+      bench_mode = true;
+      break;
+    case 's': {
+      std::string addr(optarg);
+      std::size_t colon = addr.find(':');
+      if (colon == std::string::npos) {
+        showHelp();
+        exit(-1);
+      }
+      server_ip = addr.substr(0, colon);
+      port = atoi(addr.c_str() + colon + 1);
+      external_server = true;
+      break;
+    }
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'c':
+      connections = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atoi(optarg);
+      break;
+    case 'P':
+      pipeline = atoi(optarg);
+      break;
+    case 'v':
+      value_size = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (server_threads <= 0 || threads <= 0 || connections < threads || seconds <= 0
+      || pipeline <= 0 || value_size < 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  if (bench_mode)
+    runBench();
+  else
+    runServer();
+
+  return 0;
+}
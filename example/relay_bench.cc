@@ -0,0 +1,239 @@
+/* 四层转发的吞吐量测试，在子进程中启动基于 zest::net::TcpServer 的转发服务器
+ * 源线程连接转发服务器，发送 -n MB 数据后半关闭；转发服务器为每个连接用 TcpConnector 连接接收端，
+ * 接收端线程读到 FIN 为止，统计 GB/s；先测试 TcpRelay（splice，不拷贝到用户空间），再测试在消息回调中拷贝转发 */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zest/net/inet_addr.h"
+#include "zest/net/tcp_connector.h"
+#include "zest/net/tcp_relay.h"
+#include "zest/net/tcp_server.h"
+
+using namespace zest::net;
+
+int total_mb = 2048;          // 每种方式转发的数据量
+int pipe_kb = 1024;           // TcpRelay 每个方向管道的容量
+std::string server_ip = "127.0.0.1";
+uint16_t relay_port = 12357;
+uint16_t sink_port = 12358;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./relay_bench [options] \n \
+Options: \n \
+-n Megabytes to relay in each mode, default 2048\n \
+-p Pipe size of TcpRelay (KB), default 1024\n \
+-h Show help information. \n \
+For example: ./relay_bench -n 4096\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* 转发服务器：每个接入的连接对应一个到接收端的连接
+ * use_splice 为 true 时两个连接都建立后交给 TcpRelay，否则在消息回调中拷贝数据 */
+void runRelayServer(bool use_splice)
+{
+  InetAddress local_addr(server_ip, relay_port);
+  InetAddress sink_addr(server_ip, sink_port);
+  TcpServer server(local_addr, 1);
+  server.setOnConnectionCallback([&](TcpConnection &client){
+    // 接收端的连接放在接入连接所属的IO线程中，两个连接才能互相转发
+    auto connector = std::make_shared<TcpConnector>(client.getEventLoop(), sink_addr);
+    client.Put<TcpConnector::s_ptr>("upstream", connector);
+    TcpConnection *client_ptr = &client;
+    if (use_splice) {
+      connector->setConnectionCallback([client_ptr](TcpConnection &upstream){
+        auto relay = std::make_shared<TcpRelay>(*client_ptr, upstream);
+        relay->setPipeSize(static_cast<std::size_t>(pipe_kb) * 1024);
+        relay->start();
+      });
+    }
+    else {
+      client.setMessageCallback([](TcpConnection &conn){
+        auto connector = *conn.Get<TcpConnector::s_ptr>("upstream");
+        if (!connector->connection())
+          return;   // 接收端还没连上，数据留在接收缓存中
+        connector->connection()->send(conn.peek(), conn.dataSize());
+        conn.clearData();
+      });
+      client.setCloseCallback([](TcpConnection &conn){
+        auto connector = *conn.Get<TcpConnector::s_ptr>("upstream");
+        if (connector->connection())
+          connector->connection()->shutdown();
+      });
+      connector->setConnectionCallback([client_ptr](TcpConnection &upstream){
+        if (client_ptr->dataSize() > 0) {
+          upstream.send(client_ptr->peek(), client_ptr->dataSize());
+          client_ptr->clearData();
+        }
+        upstream.waitForMessage();
+      });
+      connector->setCloseCallback([client_ptr](TcpConnection&){
+        if (client_ptr->getState() == Connected || client_ptr->getState() == HalfClosing)
+          client_ptr->close();
+      });
+      client.waitForMessage();
+    }
+    connector->start();
+  });
+  server.start();
+}
+
+int listenOn(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int connectTo(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// 返回接收端收到的字节数和耗时（ns）
+std::pair<uint64_t, int64_t> measure(bool use_splice)
+{
+  int sink_listen = listenOn(sink_port);
+  if (sink_listen < 0) {
+    std::cerr << "listen failed" << std::endl;
+    exit(-1);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    close(sink_listen);
+    runRelayServer(use_splice);
+    exit(0);
+  }
+  usleep(300 * 1000);
+
+  uint64_t received = 0;
+  int64_t start = 0, end = 0;
+  std::thread sink([&](){
+    int fd = accept(sink_listen, nullptr, nullptr);
+    std::vector<char> buf(1024 * 1024);
+    while (true) {
+      ssize_t n = read(fd, buf.data(), buf.size());
+      if (n <= 0)
+        break;
+      received += n;
+    }
+    end = nowNanos();
+    close(fd);
+  });
+
+  int fd = connectTo(relay_port);
+  if (fd < 0) {
+    std::cerr << "connect failed" << std::endl;
+    exit(-1);
+  }
+  std::vector<char> chunk(1024 * 1024, 'x');
+  start = nowNanos();
+  for (int i = 0; i < total_mb; ++i) {
+    std::size_t sent = 0;
+    while (sent < chunk.size()) {
+      ssize_t n = write(fd, chunk.data() + sent, chunk.size() - sent);
+      if (n <= 0)
+        break;
+      sent += n;
+    }
+  }
+  // 半关闭，转发服务器把 FIN 传给接收端
+  shutdown(fd, SHUT_WR);
+  sink.join();
+  close(fd);
+  close(sink_listen);
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  return {received, end - start};
+}
+
+void report(const std::string &name, std::pair<uint64_t, int64_t> result)
+{
+  uint64_t expected = static_cast<uint64_t>(total_mb) * 1024 * 1024;
+  std::cout << "  " << name << "  " << result.first / (result.second / 1e9) / 1e9 << " GB/s";
+  if (result.first != expected)
+    std::cout << "  (received " << result.first << " of " << expected << " bytes)";
+  std::cout << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "n:p:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      total_mb = atoi(optarg);
+      break;
+    case 'p':
+      pipe_kb = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (total_mb <= 0 || pipe_kb <= 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  std::cout << "Relaying " << total_mb << " MB through 127.0.0.1:" << relay_port << std::endl;
+  report("splice (TcpRelay)", measure(true));
+  report("copy   (callback)", measure(false));
+  return 0;
+}
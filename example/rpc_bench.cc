@@ -0,0 +1,201 @@
+/* RPC 压力测试，每条连接上保持 -P 个调用在途，统计每秒完成的调用数和延迟分布
+ * 在子进程中启动 zest::net::rpc::RpcServer，-P 1 相当于一条连接同一时刻只有一个请求 */
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zest/net/rpc/rpc_client.h"
+#include "zest/net/rpc/rpc_server.h"
+
+using namespace zest::net;
+using namespace zest::net::rpc;
+
+static const uint32_t METHOD_ECHO = 1;
+
+int connections = 4;          // 连接数，每条连接由一个IO线程驱动
+int pipeline = 64;            // 每条连接同时在途的调用数
+int seconds = 10;             // 测试时间
+int payload_size = 64;        // 请求的大小
+int server_threads = 2;       // 服务器的IO线程数
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12349;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./rpc_bench [options] \n \
+Options: \n \
+-c Connections, default 4\n \
+-P Calls in flight per connection, default 64\n \
+-d Duration (seconds), default 10\n \
+-s Payload size (bytes), default 64\n \
+-w IO threads of the server, default 2\n \
+-h Show help information. \n \
+For example: ./rpc_bench -c 4 -P 64 -d 10\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowMicros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void runServer()
+{
+  InetAddress local_addr(server_ip, port);
+  RpcServer server(local_addr, server_threads);
+  server.registerMethod(METHOD_ECHO, [](const RpcRequest &req, RpcResponder &resp){
+    resp.reply(req.data(), req.size());
+  });
+  server.start();
+}
+
+// 一条连接的统计数据，只在这条连接的IO线程中修改
+struct ConnStats
+{
+  uint64_t calls {0};
+  uint64_t errors {0};
+  std::vector<uint32_t> latencies;   // 单位 us
+};
+
+// 完成一个调用后立即发起下一个，直到截止时间
+void issueCall(RpcClient *client, ConnStats *stats, const std::string *payload,
+               int64_t deadline, std::atomic<int> *inflight)
+{
+  int64_t start = nowMicros();
+  client->call(METHOD_ECHO, *payload,
+    [client, stats, payload, deadline, inflight, start](RpcStatus status, const char *, std::size_t len){
+      int64_t now = nowMicros();
+      if (status == RpcOk && len == payload->size()) {
+        ++stats->calls;
+        stats->latencies.push_back(static_cast<uint32_t>(now - start));
+      }
+      else {
+        ++stats->errors;
+      }
+      if (now < deadline && status != RpcConnectionClosed)
+        issueCall(client, stats, payload, deadline, inflight);
+      else
+        inflight->fetch_sub(1);
+    }, 5000);
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "c:P:d:s:w:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      connections = atoi(optarg);
+      break;
+    case 'P':
+      pipeline = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atoi(optarg);
+      break;
+    case 's':
+      payload_size = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (connections <= 0 || pipeline <= 0 || seconds <= 0 || payload_size < 0 || server_threads <= 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    runServer();
+    exit(0);
+  }
+  usleep(300 * 1000);
+
+  std::cout << "Running " << seconds << "s RPC test @ " << server_ip << ":" << port << std::endl;
+  std::cout << "  " << connections << " connections, " << pipeline << " calls in flight per connection, payload "
+            << payload_size << " bytes" << std::endl;
+
+  InetAddress peer_addr(server_ip, port);
+  std::string payload(payload_size, 'x');
+  std::vector<std::unique_ptr<RpcClient>> clients;
+  std::vector<ConnStats> stats(connections);
+  for (int i = 0; i < connections; ++i) {
+    clients.emplace_back(new RpcClient(peer_addr));
+    if (!clients.back()->connect()) {
+      std::cerr << "connect failed" << std::endl;
+      kill(pid, SIGTERM);
+      waitpid(pid, NULL, 0);
+      exit(-1);
+    }
+  }
+
+  int64_t start = nowMicros();
+  int64_t deadline = start + static_cast<int64_t>(seconds) * 1000000;
+  std::atomic<int> inflight(connections * pipeline);
+  for (int i = 0; i < connections; ++i) {
+    for (int j = 0; j < pipeline; ++j)
+      issueCall(clients[i].get(), &stats[i], &payload, deadline, &inflight);
+  }
+  while (inflight.load() > 0)
+    usleep(10 * 1000);
+  double elapsed = (nowMicros() - start) / 1e6;
+
+  // 断开连接之后才能读取IO线程中修改的统计数据
+  for (auto &client : clients)
+    client->disconnect();
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+
+  ConnStats total;
+  for (auto &s : stats) {
+    total.calls += s.calls;
+    total.errors += s.errors;
+    total.latencies.insert(total.latencies.end(), s.latencies.begin(), s.latencies.end());
+  }
+  std::sort(total.latencies.begin(), total.latencies.end());
+  auto percentile = [&total](double p) -> double {
+    if (total.latencies.empty())
+      return 0;
+    std::size_t idx = static_cast<std::size_t>(p * (total.latencies.size() - 1));
+    return total.latencies[idx] / 1000.0;
+  };
+
+  std::cout << "  Latency (ms)   p50 " << percentile(0.5) << "  p90 " << percentile(0.9)
+            << "  p99 " << percentile(0.99) << "  max " << percentile(1.0) << std::endl;
+  std::cout << "  " << total.calls << " calls in " << elapsed << "s" << std::endl;
+  if (total.errors > 0)
+    std::cout << "  Errors: " << total.errors << std::endl;
+  std::cout << "Calls/sec:  " << static_cast<uint64_t>(total.calls / elapsed) << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+/* 分隔符查找的性能测试，对比 zest::simd_find 系列函数和 std::string::find */
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "zest/base/simd_search.h"
+
+int buffer_kb = 64;      // 被查找的数据大小，单位 KB
+int rounds = 20000;      // 每种查找重复的次数
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./search_bench [options] \n \
+Options: \n \
+-k Buffer size (KB), default 64\n \
+-r Rounds of each search, default 20000\n \
+-h Show help information. \n \
+For example: ./search_bench -k 64 -r 20000\n \
+";
+
+  std::cout << help_msg;
+}
+
+double nowSeconds()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* 生成随机的可打印字符，分隔符只出现在末尾
+ * line_len 大于0时，每隔 line_len 个字节插入一个 "\r\n"，模拟HTTP头部这类由很多行组成的数据 */
+std::string makeBuffer(std::size_t size, const std::string &delim, std::size_t line_len = 0)
+{
+  std::mt19937 gen(12345);
+  std::uniform_int_distribution<> dis(' ', '~');
+  std::string buf;
+  buf.reserve(size);
+  while (buf.size() + delim.size() + 2 < size) {
+    if (line_len > 0 && buf.size() % line_len == line_len - 1)
+      buf += "\r\n";
+    else
+      buf.push_back(static_cast<char>(dis(gen)));
+  }
+  buf += delim;
+  return buf;
+}
+
+template <typename Func>
+void report(const std::string &name, const std::string &buf, Func func)
+{
+  volatile std::size_t sink = 0;
+  double start = nowSeconds();
+  for (int i = 0; i < rounds; ++i) {
+    // 防止编译器把查找提到循环外（memchr 等函数被声明为 pure）
+    asm volatile("" : : "r"(buf.data()) : "memory");
+    sink += func(buf);
+  }
+  double elapsed = nowSeconds() - start;
+  double gb = static_cast<double>(buf.size()) * rounds / (1 << 30);
+  std::cout << "  " << name << gb / elapsed << " GB/s" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "k:r:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'k':
+      buffer_kb = atoi(optarg);
+      break;
+    case 'r':
+      rounds = atoi(optarg);
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (buffer_kb <= 0 || rounds <= 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  std::size_t size = static_cast<std::size_t>(buffer_kb) * 1024;
+  std::cout << "simd implementation: " << zest::simd_search_impl() << std::endl;
+
+  std::string buf = makeBuffer(size, "\n");
+  std::cout << "find '\\n':" << std::endl;
+  report("std::string::find     ", buf, [](const std::string &s){ return s.find('\n'); });
+  report("zest::simd_find_byte  ", buf, [](const std::string &s){
+    return zest::simd_find_byte(s.data(), s.data() + s.size(), '\n') - s.data();
+  });
+
+  buf = makeBuffer(size, "\r\n");
+  std::cout << "find \"\\r\\n\":" << std::endl;
+  report("std::string::find     ", buf, [](const std::string &s){ return s.find("\r\n"); });
+  report("zest::simd_find_crlf  ", buf, [](const std::string &s){
+    return zest::simd_find_crlf(s.data(), s.data() + s.size()) - s.data();
+  });
+
+  buf = makeBuffer(size, "\r\n\r\n");
+  std::cout << "find \"\\r\\n\\r\\n\":" << std::endl;
+  report("std::string::find     ", buf, [](const std::string &s){ return s.find("\r\n\r\n"); });
+  report("zest::simd_find       ", buf, [](const std::string &s){
+    return zest::simd_find(s.data(), s.data() + s.size(), "\r\n\r\n", 4) - s.data();
+  });
+
+  buf = makeBuffer(size, "\r\n\r\n", 32);
+  std::cout << "find \"\\r\\n\\r\\n\" in 32-byte lines:" << std::endl;
+  report("std::string::find     ", buf, [](const std::string &s){ return s.find("\r\n\r\n"); });
+  report("zest::simd_find       ", buf, [](const std::string &s){
+    return zest::simd_find(s.data(), s.data() + s.size(), "\r\n\r\n", 4) - s.data();
+  });
+
+  buf = makeBuffer(size, "\n\n");
+  std::cout << "find \"\\n\\n\":" << std::endl;
+  report("std::string::find     ", buf, [](const std::string &s){ return s.find("\n\n"); });
+  report("zest::simd_find       ", buf, [](const std::string &s){
+    return zest::simd_find(s.data(), s.data() + s.size(), "\n\n", 2) - s.data();
+  });
+
+  return 0;
+}
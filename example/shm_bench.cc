@@ -0,0 +1,270 @@
+/* 共享内存环和 TCP 回环的延迟对比，在子进程中分别启动 zest::net::shm::ShmServer 和 zest::net::TcpServer 回显服务器
+ * 客户端用一个连接做 -n 次请求-响应（每次 -s 字节），统计往返延迟和共享内存每次往返的门铃次数 */
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "zest/net/eventloop.h"
+#include "zest/net/inet_addr.h"
+#include "zest/net/shm/shm_server.h"
+#include "zest/net/tcp_server.h"
+
+using namespace zest::net;
+using namespace zest::net::shm;
+
+int round_trips = 100000;     // 请求-响应的次数
+int payload_size = 64;        // 每次请求的大小
+int busy_poll_us = 0;         // 共享内存两端的忙等时间
+int ring_kb = 1024;           // 每个方向的环的大小
+std::string shm_path = "@zest_shm_bench";
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12354;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./shm_bench [options] \n \
+Options: \n \
+-n Round trips per transport, default 100000\n \
+-s Payload size (bytes), default 64\n \
+-B Busy-poll time (us) of both shm endpoints before sleeping, default 0\n \
+-r Ring size per direction (KB), default 1024\n \
+-p Unix socket path for the shm handshake, default @zest_shm_bench\n \
+-h Show help information. \n \
+For example: ./shm_bench -n 100000 -s 64 -B 50\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void runShmServer()
+{
+  UnixAddress local_addr(shm_path);
+  ShmServer server(local_addr, 1);
+  server.setBusyPoll(busy_poll_us);
+  server.setMessageCallback([](ShmConnection &conn){
+    conn.send(conn.peek(), conn.dataSize());
+    conn.clearData();
+  });
+  server.start();
+}
+
+void runTcpServer()
+{
+  InetAddress local_addr(server_ip, port);
+  TcpServer server(local_addr, 1);
+  server.setOnConnectionCallback([](TcpConnection &conn){
+    conn.setTcpNoDelay(true);
+    conn.waitForMessage();
+  });
+  server.setMessageCallback([](TcpConnection &conn){
+    conn.send(conn.peek(), conn.dataSize());
+    conn.clearData();
+  });
+  server.setWriteCompleteCallback([](TcpConnection &conn){
+    conn.waitForMessage();
+  });
+  server.start();
+}
+
+pid_t startServer(void (*run)())
+{
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    run();
+    exit(0);
+  }
+  usleep(300 * 1000);
+  return pid;
+}
+
+void stopServer(pid_t pid)
+{
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+}
+
+// 客户端的共享内存连接由本线程的事件循环驱动，收到完整的回显后发出下一个请求
+std::vector<int64_t> measureShm(double *doorbells_per_trip)
+{
+  std::vector<int64_t> latencies;
+  pid_t pid = startServer(runShmServer);
+  std::shared_ptr<EventLoop> eventloop = EventLoop::CreateEventLoop();
+  UnixAddress addr(shm_path);
+  ShmConnection::s_ptr conn = ShmConnection::connect(eventloop, addr, static_cast<std::size_t>(ring_kb) * 1024);
+  if (!conn) {
+    std::cerr << "shm connect failed" << std::endl;
+    stopServer(pid);
+    return latencies;
+  }
+  std::string request(static_cast<std::size_t>(payload_size), 'x');
+  latencies.reserve(round_trips);
+  int64_t start = 0;
+  std::vector<int64_t> *p_latencies = &latencies;
+  int64_t *p_start = &start;
+  EventLoop *p_loop = eventloop.get();
+  conn->setBusyPoll(busy_poll_us);
+  conn->setMessageCallback([p_latencies, p_start, p_loop, &request](ShmConnection &conn){
+    while (conn.dataSize() >= request.size()) {
+      conn.clearBytesData(static_cast<int>(request.size()));
+      p_latencies->push_back(nowNanos() - *p_start);
+      if (p_latencies->size() >= static_cast<std::size_t>(round_trips)) {
+        p_loop->stop();
+        return;
+      }
+      *p_start = nowNanos();
+      conn.send(request);
+    }
+  });
+  conn->setCloseCallback([p_loop](ShmConnection&){
+    p_loop->stop();
+  });
+  conn->waitForMessage();
+  start = nowNanos();
+  conn->send(request);
+  eventloop->loop();
+
+  uint64_t doorbells = conn->doorbellsSent() + conn->doorbellsReceived();
+  *doorbells_per_trip = latencies.empty() ? 0 : static_cast<double>(doorbells) / latencies.size();
+  if (conn->getState() == Connected)
+    conn->close();
+  stopServer(pid);
+  return latencies;
+}
+
+std::vector<int64_t> measureTcp()
+{
+  std::vector<int64_t> latencies;
+  pid_t pid = startServer(runTcpServer);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    std::cerr << "tcp connect failed" << std::endl;
+    close(fd);
+    stopServer(pid);
+    return latencies;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  std::string request(static_cast<std::size_t>(payload_size), 'x');
+  std::vector<char> response(request.size());
+  latencies.reserve(round_trips);
+  for (int i = 0; i < round_trips; ++i) {
+    int64_t start = nowNanos();
+    if (write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+      break;
+    std::size_t got = 0;
+    while (got < response.size()) {
+      ssize_t len = read(fd, response.data() + got, response.size() - got);
+      if (len <= 0)
+        break;
+      got += len;
+    }
+    if (got < response.size())
+      break;
+    latencies.push_back(nowNanos() - start);
+  }
+  close(fd);
+  stopServer(pid);
+  return latencies;
+}
+
+void report(const std::string &name, std::vector<int64_t> &latencies)
+{
+  if (latencies.empty()) {
+    std::cout << "  " << name << ": failed" << std::endl;
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  int64_t sum = 0;
+  for (int64_t l : latencies)
+    sum += l;
+  auto percentile = [&latencies](double p) -> double {
+    return latencies[static_cast<std::size_t>(p * (latencies.size() - 1))] / 1000.0;
+  };
+  double avg = static_cast<double>(sum) / latencies.size() / 1000.0;
+  std::cout << "  " << name << "  avg " << avg << "  p50 " << percentile(0.5) << "  p99 "
+            << percentile(0.99) << "  max " << percentile(1.0) << "  (" << static_cast<uint64_t>(1e6 / avg)
+            << " round trips/sec)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "n:s:B:r:p:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      round_trips = atoi(optarg);
+      break;
+    case 's':
+      payload_size = atoi(optarg);
+      break;
+    case 'B':
+      busy_poll_us = atoi(optarg);
+      break;
+    case 'r':
+      ring_kb = atoi(optarg);
+      break;
+    case 'p':
+      shm_path = optarg;
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (round_trips <= 0 || payload_size <= 0 || busy_poll_us < 0 || ring_kb <= 0 ||
+      static_cast<std::size_t>(payload_size) > static_cast<std::size_t>(ring_kb) * 1024 ||
+      !UnixAddress(shm_path).check()) {
+    showHelp();
+    exit(-1);
+  }
+
+  std::cout << "Running " << round_trips << " round trips of " << payload_size << " bytes, latency in us" << std::endl;
+  double doorbells_per_trip = 0;
+  std::vector<int64_t> shm_latencies = measureShm(&doorbells_per_trip);
+  report("shm ", shm_latencies);
+  std::cout << "        " << doorbells_per_trip << " doorbell syscalls per round trip";
+  if (busy_poll_us > 0)
+    std::cout << ", busy poll " << busy_poll_us << "us";
+  std::cout << std::endl;
+  std::vector<int64_t> tcp_latencies = measureTcp();
+  report("tcp ", tcp_latencies);
+
+  return 0;
+}
@@ -0,0 +1,290 @@
+/* UDP 收包速率测试，在子进程中启动基于 zest::net::UdpServer 的服务器
+ * -c 个客户端线程各用一个套接字，通过 sendmmsg 向服务器发送 -s 字节的数据报，统计服务器每秒收到的数据报数
+ * -g 让服务器开启 UDP_GRO，-G 让客户端用 UDP_SEGMENT 发送，-e 让服务器把收到的数据报原样发回 */
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zest/net/inet_addr.h"
+#include "zest/net/udp_server.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+using namespace zest::net;
+
+int client_threads = 4;       // 客户端线程数
+int seconds = 5;              // 测试时间
+int payload_size = 64;        // 数据报的大小
+int batch = 64;               // 客户端一次 sendmmsg 发送的数据报数
+int server_threads = 4;       // 服务器的IO线程数
+bool server_gro = false;
+bool client_gso = false;
+bool echo = false;
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12352;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./udp_bench [options] \n \
+Options: \n \
+-c Client threads, default 4\n \
+-d Duration (seconds), default 5\n \
+-s Payload size (bytes), default 64\n \
+-b Datagrams per sendmmsg on the client side, default 64\n \
+-w IO threads of the server, default 4\n \
+-g Enable UDP_GRO on the server\n \
+-G Send with UDP_SEGMENT on the client side\n \
+-e Echo every datagram back to the client\n \
+-h Show help information. \n \
+For example: ./udp_bench -c 4 -s 64 -d 5\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowMicros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 服务器退出时把统计数据写入管道，交给父进程
+void runServer(int stats_fd)
+{
+  InetAddress local_addr(server_ip, port);
+  UdpServer server(local_addr, server_threads);
+  if (echo) {
+    server.setMessageCallback([](UdpSocket &sock, const char *data, std::size_t len, const UdpPeer &peer){
+      sock.sendTo(data, len, peer);
+    });
+  }
+  else {
+    server.setMessageCallback([](UdpSocket&, const char*, std::size_t, const UdpPeer&){});
+  }
+  server.enableGro(server_gro);
+  if (echo && client_gso)
+    server.enableGso(static_cast<uint16_t>(payload_size));
+  server.start();
+
+  UdpStats stats = server.stats();
+  if (write(stats_fd, &stats, sizeof(stats)) != static_cast<ssize_t>(sizeof(stats)))
+    std::cerr << "write stats failed" << std::endl;
+}
+
+struct ClientStats
+{
+  uint64_t sent {0};
+  uint64_t syscalls {0};
+  uint64_t received {0};
+};
+
+/* 每个线程用一个 connect 过的套接字，四元组不同，内核会把它们分散到服务器的各个套接字
+ * 开启 -G 时一个消息携带 batch 个分段，由内核切成 batch 个数据报 */
+void runClient(ClientStats *stats, std::atomic<bool> *stop)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return;
+  }
+  int sndbuf = 4 * 1024 * 1024;
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sndbuf, sizeof(sndbuf));
+
+  std::vector<char> payload(static_cast<std::size_t>(payload_size) * batch, 'x');
+  std::vector<mmsghdr> msgs(batch);
+  std::vector<iovec> iovs(batch);
+  char control[CMSG_SPACE(sizeof(uint16_t))];
+  int msg_count = batch;
+  int segments_per_msg = 1;
+  memset(msgs.data(), 0, sizeof(mmsghdr) * batch);
+  if (client_gso) {
+    iovs[0].iov_base = payload.data();
+    iovs[0].iov_len = payload.size();
+    msgs[0].msg_hdr.msg_iov = &iovs[0];
+    msgs[0].msg_hdr.msg_iovlen = 1;
+    memset(control, 0, sizeof(control));
+    msgs[0].msg_hdr.msg_control = control;
+    msgs[0].msg_hdr.msg_controllen = sizeof(control);
+    cmsghdr *cm = CMSG_FIRSTHDR(&msgs[0].msg_hdr);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    uint16_t gso_size = static_cast<uint16_t>(payload_size);
+    memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+    msg_count = 1;
+    segments_per_msg = batch;
+  }
+  else {
+    for (int i = 0; i < batch; ++i) {
+      iovs[i].iov_base = payload.data() + static_cast<std::size_t>(i) * payload_size;
+      iovs[i].iov_len = payload_size;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+  }
+
+  char buf[65536];
+  while (!stop->load(std::memory_order_relaxed)) {
+    int n = sendmmsg(fd, msgs.data(), msg_count, 0);
+    ++stats->syscalls;
+    if (n > 0)
+      stats->sent += static_cast<uint64_t>(n) * segments_per_msg;
+    else if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR)
+      break;
+    if (echo) {
+      ssize_t len;
+      while ((len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        stats->received += (len + payload_size - 1) / payload_size;
+    }
+  }
+  close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "c:d:s:b:w:gGeh";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      client_threads = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atoi(optarg);
+      break;
+    case 's':
+      payload_size = atoi(optarg);
+      break;
+    case 'b':
+      batch = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 'g':
+      server_gro = true;
+      break;
+    case 'G':
+      client_gso = true;
+      break;
+    case 'e':
+      echo = true;
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (client_threads <= 0 || seconds <= 0 || payload_size <= 0 || payload_size > 1472 ||
+      batch <= 0 || batch > 64 || server_threads <= 0) {
+    showHelp();
+    exit(-1);
+  }
+  if (client_gso && static_cast<std::size_t>(payload_size) * batch > 65000)
+    batch = 65000 / payload_size;
+
+  int stats_pipe[2];
+  if (pipe(stats_pipe) != 0) {
+    std::cerr << "pipe failed" << std::endl;
+    exit(-1);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    close(stats_pipe[0]);
+    runServer(stats_pipe[1]);
+    exit(0);
+  }
+  close(stats_pipe[1]);
+  usleep(300 * 1000);
+
+  std::cout << "Running " << seconds << "s UDP test @ " << server_ip << ":" << port << std::endl;
+  std::cout << "  " << client_threads << " client threads, payload " << payload_size << " bytes, "
+            << (client_gso ? "UDP_SEGMENT" : "sendmmsg") << " x" << batch
+            << (server_gro ? ", server GRO" : "") << (echo ? ", echo" : "") << std::endl;
+
+  std::vector<ClientStats> stats(client_threads);
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  int64_t start = nowMicros();
+  for (int i = 0; i < client_threads; ++i)
+    threads.emplace_back(runClient, &stats[i], &stop);
+  sleep(seconds);
+  stop = true;
+  for (auto &t : threads)
+    t.join();
+  double elapsed = (nowMicros() - start) / 1e6;
+
+  // 等待服务器处理完套接字中剩余的数据报
+  usleep(200 * 1000);
+  kill(pid, SIGTERM);
+  UdpStats server_stats;
+  bool got = read(stats_pipe[0], &server_stats, sizeof(server_stats)) == static_cast<ssize_t>(sizeof(server_stats));
+  waitpid(pid, NULL, 0);
+  close(stats_pipe[0]);
+
+  ClientStats total;
+  for (auto &s : stats) {
+    total.sent += s.sent;
+    total.syscalls += s.syscalls;
+    total.received += s.received;
+  }
+  std::cout << "  Client: " << total.sent << " datagrams sent with " << total.syscalls << " syscalls";
+  if (echo)
+    std::cout << ", " << total.received << " echoed back";
+  std::cout << std::endl;
+  if (!got) {
+    std::cerr << "no statistics from the server" << std::endl;
+    return -1;
+  }
+  std::cout << "  Server: " << server_stats.m_packets_received << " datagrams received with "
+            << server_stats.m_recv_syscalls << " syscalls ("
+            << (server_stats.m_recv_syscalls ? server_stats.m_packets_received / server_stats.m_recv_syscalls : 0)
+            << " per call)";
+  if (echo)
+    std::cout << ", " << server_stats.m_packets_sent << " sent with " << server_stats.m_send_syscalls << " syscalls";
+  std::cout << std::endl;
+  std::cout << "  Lost: " << (total.sent > server_stats.m_packets_received ? total.sent - server_stats.m_packets_received : 0)
+            << " datagrams" << std::endl;
+  std::cout << "Packets/sec:  " << static_cast<uint64_t>(server_stats.m_packets_received / elapsed) << std::endl;
+  std::cout << "MB/sec:       " << server_stats.m_bytes_received / elapsed / 1024 / 1024 << std::endl;
+
+  return 0;
+}
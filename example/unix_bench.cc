@@ -0,0 +1,213 @@
+/* Unix 域套接字和 TCP 回环的延迟对比，在子进程中启动基于 zest::net::TcpServer 的回显服务器
+ * 客户端用一个连接做 -n 次请求-响应（每次 -s 字节），先走 Unix 域套接字，再走 127.0.0.1，统计往返延迟 */
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "zest/net/inet_addr.h"
+#include "zest/net/tcp_server.h"
+#include "zest/net/unix_addr.h"
+
+using namespace zest::net;
+
+int round_trips = 100000;     // 请求-响应的次数
+int payload_size = 64;        // 每次请求的大小
+int server_threads = 1;       // 服务器的IO线程数
+std::string unix_path = "@zest_unix_bench";
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12353;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./unix_bench [options] \n \
+Options: \n \
+-n Round trips per transport, default 100000\n \
+-s Payload size (bytes), default 64\n \
+-w IO threads of the server, default 1\n \
+-p Unix socket path, a leading '@' means the abstract namespace, default @zest_unix_bench\n \
+-h Show help information. \n \
+For example: ./unix_bench -n 100000 -s 64\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 回显服务器，收到多少发回多少
+void runServer(NetBaseAddress &local_addr)
+{
+  TcpServer server(local_addr, server_threads);
+  server.setOnConnectionCallback([](TcpConnection &conn){
+    conn.setTcpNoDelay(true);
+    conn.waitForMessage();
+  });
+  server.setMessageCallback([](TcpConnection &conn){
+    conn.send(conn.peek(), conn.dataSize());
+    conn.clearData();
+  });
+  server.setWriteCompleteCallback([](TcpConnection &conn){
+    conn.waitForMessage();
+  });
+  server.start();
+}
+
+int connectServer(bool use_unix)
+{
+  if (use_unix) {
+    UnixAddress addr(unix_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, addr.sockaddr(), addr.socklen()) != 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+// 启动服务器，做 round_trips 次请求-响应，返回每次的往返时间（ns），失败返回空
+std::vector<int64_t> measure(bool use_unix)
+{
+  std::vector<int64_t> latencies;
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    if (use_unix) {
+      UnixAddress local_addr(unix_path);
+      runServer(local_addr);
+    }
+    else {
+      InetAddress local_addr(server_ip, port);
+      runServer(local_addr);
+    }
+    exit(0);
+  }
+  usleep(300 * 1000);
+
+  int fd = connectServer(use_unix);
+  if (fd < 0) {
+    std::cerr << "connect failed" << std::endl;
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return latencies;
+  }
+  std::string request(static_cast<std::size_t>(payload_size), 'x');
+  std::vector<char> response(request.size());
+  latencies.reserve(round_trips);
+  for (int i = 0; i < round_trips; ++i) {
+    int64_t start = nowNanos();
+    if (write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+      break;
+    std::size_t got = 0;
+    while (got < response.size()) {
+      ssize_t len = read(fd, response.data() + got, response.size() - got);
+      if (len <= 0)
+        break;
+      got += len;
+    }
+    if (got < response.size())
+      break;
+    latencies.push_back(nowNanos() - start);
+  }
+  close(fd);
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  return latencies;
+}
+
+void report(const std::string &name, std::vector<int64_t> &latencies)
+{
+  if (latencies.empty()) {
+    std::cout << "  " << name << ": failed" << std::endl;
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  int64_t sum = 0;
+  for (int64_t l : latencies)
+    sum += l;
+  auto percentile = [&latencies](double p) -> double {
+    return latencies[static_cast<std::size_t>(p * (latencies.size() - 1))] / 1000.0;
+  };
+  double avg = static_cast<double>(sum) / latencies.size() / 1000.0;
+  std::cout << "  " << name << "  avg " << avg << "  p50 " << percentile(0.5) << "  p99 "
+            << percentile(0.99) << "  max " << percentile(1.0) << "  (" << static_cast<uint64_t>(1e6 / avg)
+            << " round trips/sec)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "n:s:w:p:h";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      round_trips = atoi(optarg);
+      break;
+    case 's':
+      payload_size = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 'p':
+      unix_path = optarg;
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (round_trips <= 0 || payload_size <= 0 || server_threads <= 0 || !UnixAddress(unix_path).check()) {
+    showHelp();
+    exit(-1);
+  }
+
+  std::cout << "Running " << round_trips << " round trips of " << payload_size << " bytes, latency in us" << std::endl;
+  std::vector<int64_t> unix_latencies = measure(true);
+  report("unix:" + unix_path, unix_latencies);
+  std::vector<int64_t> tcp_latencies = measure(false);
+  report("tcp:" + server_ip + ":" + std::to_string(port), tcp_latencies);
+
+  return 0;
+}
@@ -0,0 +1,358 @@
+/* WebSocket 压力测试，在子进程中启动 zest::net::websocket::WebSocketServer
+ * echo 模式：每条连接一次发出 -P 条带掩码的消息，收齐回显后再发下一批，统计每秒的消息数
+ * broadcast 模式：第一条连接发消息，服务器编码一次后广播给所有连接，统计每秒送达的消息数 */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zest/base/simd_mask.h"
+#include "zest/net/websocket/websocket_server.h"
+
+using namespace zest::net;
+using namespace zest::net::websocket;
+
+int connections = 4;          // 连接数，每条连接一个线程
+int pipeline = 16;            // echo 模式下每条连接一批发出的消息数
+int seconds = 10;             // 测试时间
+int payload_size = 64;        // 消息的大小
+int server_threads = 2;       // 服务器的IO线程数
+bool broadcast_mode = false;
+std::string server_ip = "127.0.0.1";
+uint16_t port = 12350;
+
+// 显示帮助信息
+void showHelp()
+{
+  std::string help_msg =
+" \
+Usage: ./websocket_bench [options] \n \
+Options: \n \
+-c Connections, default 4\n \
+-P Messages in flight per connection (echo mode), default 16\n \
+-d Duration (seconds), default 10\n \
+-s Payload size (bytes), default 64\n \
+-w IO threads of the server, default 2\n \
+-b Broadcast mode: the first connection publishes, the server fans out to all\n \
+-h Show help information. \n \
+For example: ./websocket_bench -c 4 -P 16 -d 10\n \
+";
+
+  std::cout << help_msg;
+}
+
+int64_t nowMicros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void runServer()
+{
+  InetAddress local_addr(server_ip, port);
+  WebSocketServer server(local_addr, server_threads);
+  WebSocketServer *p_server = &server;
+  server.setMessageCallback([p_server](const WebSocketPtr &ws, const char *data, std::size_t len, bool binary){
+    if (broadcast_mode)
+      p_server->broadcast(WebSocket::encodeFrame(binary ? WsBinary : WsText, data, len));
+    else if (binary)
+      ws->sendBinary(data, len);
+    else
+      ws->sendText(data, len);
+  });
+  server.start();
+}
+
+// 阻塞的最小客户端，只实现测试需要的部分
+class BenchClient
+{
+ public:
+  ~BenchClient() {if (m_fd >= 0) ::close(m_fd);}
+
+  bool connect()
+  {
+    m_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+    if (::connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+      return false;
+    int one = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::string req =
+      "GET /bench HTTP/1.1\r\n"
+      "Host: " + server_ip + "\r\n"
+      "Upgrade: websocket\r\n"
+      "Connection: Upgrade\r\n"
+      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+      "Sec-WebSocket-Version: 13\r\n\r\n";
+    if (!writeAll(req.data(), req.size()))
+      return false;
+    std::size_t end;
+    while ((end = m_buf.find("\r\n\r\n")) == std::string::npos) {
+      if (!fill())
+        return false;
+    }
+    bool ok = m_buf.compare(0, 12, "HTTP/1.1 101") == 0;
+    m_buf.erase(0, end + 4);
+    return ok;
+  }
+
+  // 编码一个带掩码的二进制帧追加到 out
+  static void appendFrame(std::string *out, const std::string &payload)
+  {
+    std::size_t len = payload.size();
+    out->push_back(static_cast<char>(0x82));
+    if (len < 126) {
+      out->push_back(static_cast<char>(0x80 | len));
+    }
+    else if (len <= 0xFFFF) {
+      out->push_back(static_cast<char>(0x80 | 126));
+      out->push_back(static_cast<char>(len >> 8));
+      out->push_back(static_cast<char>(len));
+    }
+    else {
+      out->push_back(static_cast<char>(0x80 | 127));
+      for (int i = 7; i >= 0; --i)
+        out->push_back(static_cast<char>(static_cast<uint64_t>(len) >> (i * 8)));
+    }
+    const char key[4] = {0x12, 0x34, 0x56, 0x78};
+    out->append(key, 4);
+    std::size_t begin = out->size();
+    out->append(payload);
+    zest::simd_xor_mask(&(*out)[begin], len, key);
+  }
+
+  bool writeAll(const char *data, std::size_t len)
+  {
+    while (len > 0) {
+      ssize_t n = ::write(m_fd, data, len);
+      if (n <= 0)
+        return false;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  // 读取一个服务器发来的帧（无掩码），返回数据的长度，出错时返回 -1
+  int64_t readFrame()
+  {
+    while (true) {
+      if (m_buf.size() >= 2) {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(m_buf.data());
+        uint64_t len = p[1] & 0x7F;
+        std::size_t header = 2;
+        if (len == 126) {
+          header = 4;
+          if (m_buf.size() >= header)
+            len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+        }
+        else if (len == 127) {
+          header = 10;
+          if (m_buf.size() >= header) {
+            len = 0;
+            for (int i = 0; i < 8; ++i)
+              len = (len << 8) | p[2 + i];
+          }
+        }
+        if (m_buf.size() >= header && m_buf.size() >= header + len) {
+          m_buf.erase(0, header + len);
+          return static_cast<int64_t>(len);
+        }
+      }
+      if (!fill())
+        return -1;
+    }
+  }
+
+  int fd() const {return m_fd;}
+
+ private:
+  bool fill()
+  {
+    char buf[64 * 1024];
+    ssize_t n = ::read(m_fd, buf, sizeof(buf));
+    if (n <= 0)
+      return false;
+    m_buf.append(buf, n);
+    return true;
+  }
+
+ private:
+  int m_fd {-1};
+  std::string m_buf;
+};
+
+// 测试原地去掩码的吞吐量
+void maskBench()
+{
+  std::vector<char> buf(1024 * 1024, 'x');
+  const char key[4] = {0x11, 0x22, 0x33, 0x44};
+  const int rounds = 2000;
+  int64_t start = nowMicros();
+  for (int i = 0; i < rounds; ++i)
+    zest::simd_xor_mask(buf.data(), buf.size(), key);
+  double elapsed = (nowMicros() - start) / 1e6;
+  std::cout << "Unmask (" << zest::simd_mask_impl() << "): "
+            << static_cast<double>(buf.size()) * rounds / elapsed / 1e9 << " GB/s" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  const char *str = "c:P:d:s:w:bh";
+  while ((opt = getopt(argc, argv, str)) != -1)
+  {
+    switch (opt)
+    {
+    case 'c':
+      connections = atoi(optarg);
+      break;
+    case 'P':
+      pipeline = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atoi(optarg);
+      break;
+    case 's':
+      payload_size = atoi(optarg);
+      break;
+    case 'w':
+      server_threads = atoi(optarg);
+      break;
+    case 'b':
+      broadcast_mode = true;
+      break;
+    case 'h':
+      showHelp();
+      exit(0);
+    default:
+      showHelp();
+      exit(-1);
+    }
+  }
+  if (connections <= 0 || pipeline <= 0 || seconds <= 0 || payload_size < 0 || server_threads <= 0) {
+    showHelp();
+    exit(-1);
+  }
+
+  maskBench();
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr << "fork failed" << std::endl;
+    exit(-1);
+  }
+  else if (pid == 0) {
+    runServer();
+    exit(0);
+  }
+  usleep(300 * 1000);
+
+  std::cout << "Running " << seconds << "s WebSocket " << (broadcast_mode ? "broadcast" : "echo")
+            << " test @ " << server_ip << ":" << port << std::endl;
+  std::cout << "  " << connections << " connections, payload " << payload_size << " bytes";
+  if (!broadcast_mode)
+    std::cout << ", " << pipeline << " messages in flight per connection";
+  std::cout << std::endl;
+
+  std::vector<std::unique_ptr<BenchClient>> clients;
+  for (int i = 0; i < connections; ++i) {
+    clients.emplace_back(new BenchClient());
+    if (!clients.back()->connect()) {
+      std::cerr << "handshake failed" << std::endl;
+      kill(pid, SIGTERM);
+      waitpid(pid, NULL, 0);
+      exit(-1);
+    }
+  }
+  // 等待所有连接加入服务器的广播列表
+  usleep(100 * 1000);
+
+  std::string payload(payload_size, 'x');
+  std::vector<uint64_t> received(connections, 0);
+  int64_t start = nowMicros();
+  int64_t deadline = start + static_cast<int64_t>(seconds) * 1000000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < connections; ++i) {
+    threads.emplace_back([&, i](){
+      BenchClient *client = clients[i].get();
+      if (!broadcast_mode) {
+        std::string batch;
+        for (int j = 0; j < pipeline; ++j)
+          BenchClient::appendFrame(&batch, payload);
+        while (nowMicros() < deadline) {
+          if (!client->writeAll(batch.data(), batch.size()))
+            return;
+          for (int j = 0; j < pipeline; ++j) {
+            if (client->readFrame() < 0)
+              return;
+          }
+          received[i] += pipeline;
+        }
+      }
+      else if (i == 0) {
+        // 发布者等到自己收到广播后再发下一条
+        std::string frame;
+        BenchClient::appendFrame(&frame, payload);
+        while (nowMicros() < deadline) {
+          if (!client->writeAll(frame.data(), frame.size()) || client->readFrame() < 0)
+            break;
+          ++received[i];
+        }
+        shutdown(client->fd(), SHUT_WR);
+      }
+      else {
+        // 订阅者一直读到服务器断开连接
+        while (client->readFrame() >= 0)
+          ++received[i];
+      }
+    });
+  }
+  double elapsed;
+  if (broadcast_mode) {
+    threads[0].join();
+    elapsed = (nowMicros() - start) / 1e6;
+    // 等待最后一条广播送达后断开订阅者
+    usleep(200 * 1000);
+    for (int i = 1; i < connections; ++i)
+      shutdown(clients[i]->fd(), SHUT_RDWR);
+    for (int i = 1; i < connections; ++i)
+      threads[i].join();
+  }
+  else {
+    for (auto &t : threads)
+      t.join();
+    elapsed = (nowMicros() - start) / 1e6;
+  }
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+
+  uint64_t total = 0;
+  for (uint64_t n : received)
+    total += n;
+  if (broadcast_mode)
+    std::cout << "  " << received[0] << " messages published, " << total << " delivered in "
+              << elapsed << "s" << std::endl;
+  else
+    std::cout << "  " << total << " messages in " << elapsed << "s" << std::endl;
+  std::cout << "Messages/sec:  " << static_cast<uint64_t>(total / elapsed) << std::endl;
+
+  return 0;
+}
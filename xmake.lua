@@ -5,7 +5,9 @@ target("zest")
     set_targetdir("lib")
     set_objectdir("obj")
     set_languages("c++11")
-    add_files("zest/base/*.cc", "zest/net/*.cc")
+    add_files("zest/base/*.cc", "zest/net/*.cc", "zest/net/http/*.cc",
+              "zest/net/redis/*.cc", "zest/net/rpc/*.cc", "zest/net/websocket/*.cc",
+              "zest/net/pubsub/*.cc", "zest/net/shm/*.cc")
     add_includedirs(".")
     set_optimize("fastest")
     add_syslinks("pthread")
@@ -42,4 +44,190 @@ target("echo_bench")
     set_optimize("fastest")
     add_syslinks("pthread")
     add_deps("zest")
-    
\ No newline at end of file
+    
+target("bulk_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/bulk_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("search_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/search_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("frame_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/frame_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("http_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/http_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("redis_server")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/redis_server.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("rpc_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/rpc_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("websocket_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/websocket_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("pubsub_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/pubsub_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("udp_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/udp_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("unix_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/unix_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("shm_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/shm_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("connector_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/connector_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("pool_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/pool_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("relay_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/relay_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("context_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/context_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("accept_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/accept_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
+
+target("admission_bench")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_objectdir("obj")
+    set_languages("c++11")
+    add_files("example/admission_bench.cc")
+    add_includedirs(".")
+    set_optimize("fastest")
+    add_syslinks("pthread")
+    add_deps("zest")
@@ -0,0 +1,164 @@
+/* SHA-1 摘要和 base64 编解码，用于 WebSocket 握手，不依赖外部库 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/base/sha1.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace zest
+{
+
+static inline uint32_t rotl(uint32_t x, int n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+// 处理一个 64 字节的块
+static void sha1_block(uint32_t state[5], const unsigned char *block)
+{
+  uint32_t w[80];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) | (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+           (static_cast<uint32_t>(block[i * 4 + 2]) << 8) | static_cast<uint32_t>(block[i * 4 + 3]);
+  }
+  for (int i = 16; i < 80; ++i)
+    w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+  for (int i = 0; i < 80; ++i) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    }
+    else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    }
+    else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    }
+    else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rotl(b, 30);
+    b = a;
+    a = temp;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+void sha1(const char *data, std::size_t len, unsigned char *digest)
+{
+  uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+
+  std::size_t full = len / 64 * 64;
+  for (std::size_t i = 0; i < full; i += 64)
+    sha1_block(state, p + i);
+
+  // 最后不足一块的数据，加上 0x80、填充和 64 位的比特长度，可能占用一块或两块
+  unsigned char tail[128];
+  std::size_t rest = len - full;
+  memcpy(tail, p + full, rest);
+  tail[rest] = 0x80;
+  std::size_t tail_len = rest + 1 + 8 <= 64 ? 64 : 128;
+  memset(tail + rest + 1, 0, tail_len - rest - 1);
+  uint64_t bits = static_cast<uint64_t>(len) * 8;
+  for (int i = 0; i < 8; ++i)
+    tail[tail_len - 1 - i] = static_cast<unsigned char>(bits >> (i * 8));
+  for (std::size_t i = 0; i < tail_len; i += 64)
+    sha1_block(state, tail + i);
+
+  for (int i = 0; i < 5; ++i) {
+    digest[i * 4] = static_cast<unsigned char>(state[i] >> 24);
+    digest[i * 4 + 1] = static_cast<unsigned char>(state[i] >> 16);
+    digest[i * 4 + 2] = static_cast<unsigned char>(state[i] >> 8);
+    digest[i * 4 + 3] = static_cast<unsigned char>(state[i]);
+  }
+}
+
+static const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string base64_encode(const unsigned char *data, std::size_t len)
+{
+  std::string out;
+  out.reserve((len + 2) / 3 * 4);
+  std::size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    out += BASE64_CHARS[(v >> 18) & 0x3f];
+    out += BASE64_CHARS[(v >> 12) & 0x3f];
+    out += BASE64_CHARS[(v >> 6) & 0x3f];
+    out += BASE64_CHARS[v & 0x3f];
+  }
+  if (len - i == 1) {
+    uint32_t v = data[i] << 16;
+    out += BASE64_CHARS[(v >> 18) & 0x3f];
+    out += BASE64_CHARS[(v >> 12) & 0x3f];
+    out += "==";
+  }
+  else if (len - i == 2) {
+    uint32_t v = (data[i] << 16) | (data[i + 1] << 8);
+    out += BASE64_CHARS[(v >> 18) & 0x3f];
+    out += BASE64_CHARS[(v >> 12) & 0x3f];
+    out += BASE64_CHARS[(v >> 6) & 0x3f];
+    out += '=';
+  }
+  return out;
+}
+
+static int base64_value(char c)
+{
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+bool base64_decode(const std::string &in, std::string *out)
+{
+  out->clear();
+  if (in.size() % 4 != 0)
+    return false;
+  out->reserve(in.size() / 4 * 3);
+  for (std::size_t i = 0; i < in.size(); i += 4) {
+    int pad = 0;
+    uint32_t v = 0;
+    for (int j = 0; j < 4; ++j) {
+      char c = in[i + j];
+      // '=' 只能出现在最后一组的末尾
+      if (c == '=' && i + 4 == in.size() && j >= 2) {
+        ++pad;
+        v <<= 6;
+        continue;
+      }
+      int d = base64_value(c);
+      if (d < 0 || pad > 0)
+        return false;
+      v = (v << 6) | static_cast<uint32_t>(d);
+    }
+    out->push_back(static_cast<char>((v >> 16) & 0xff));
+    if (pad < 2)
+      out->push_back(static_cast<char>((v >> 8) & 0xff));
+    if (pad < 1)
+      out->push_back(static_cast<char>(v & 0xff));
+  }
+  return true;
+}
+
+} // namespace zest
@@ -0,0 +1,30 @@
+/* SHA-1 摘要和 base64 编解码，用于 WebSocket 握手，不依赖外部库 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is an internal header file, you should not include this.
+
+#ifndef ZEST_BASE_SHA1_H
+#define ZEST_BASE_SHA1_H
+
+#include <cstddef>
+#include <string>
+
+namespace zest
+{
+
+static const std::size_t SHA1_DIGEST_SIZE = 20;
+
+// 计算 [data, data+len) 的 SHA-1 摘要，写入 digest（SHA1_DIGEST_SIZE 字节）
+void sha1(const char *data, std::size_t len, unsigned char *digest);
+
+// 标准 base64 编码（带 '=' 填充）
+std::string base64_encode(const unsigned char *data, std::size_t len);
+
+// 标准 base64 解码，格式错误时返回 false
+bool base64_decode(const std::string &in, std::string *out);
+
+} // namespace zest
+
+#endif // ZEST_BASE_SHA1_H
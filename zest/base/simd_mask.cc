@@ -0,0 +1,128 @@
+/* 向量化的 4 字节循环异或，用于 WebSocket 帧的原地去掩码，运行时根据CPU选择 AVX2/SSE2/标量实现 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/base/simd_mask.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZEST_SIMD_X86 1
+#endif
+
+namespace zest
+{
+
+/************************************* 标量实现 *************************************/
+
+// 每次处理 8 字节，剩下的逐字节处理；长度是 4 的倍数，所以掩码的相位不变
+static void scalar_xor_mask(char *data, std::size_t len, const char *key)
+{
+  uint32_t key32;
+  memcpy(&key32, key, 4);
+  uint64_t key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+
+  std::size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t v;
+    memcpy(&v, data + i, 8);
+    v ^= key64;
+    memcpy(data + i, &v, 8);
+  }
+  for (; i < len; ++i)
+    data[i] ^= key[i & 3];
+}
+
+#ifdef ZEST_SIMD_X86
+
+/************************************* SSE2 实现 *************************************/
+
+static void sse2_xor_mask(char *data, std::size_t len, const char *key)
+{
+  int32_t key32;
+  memcpy(&key32, key, 4);
+  const __m128i mask = _mm_set1_epi32(key32);
+
+  std::size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m128i *p = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask));
+    _mm_storeu_si128(p + 1, _mm_xor_si128(_mm_loadu_si128(p + 1), mask));
+    _mm_storeu_si128(p + 2, _mm_xor_si128(_mm_loadu_si128(p + 2), mask));
+    _mm_storeu_si128(p + 3, _mm_xor_si128(_mm_loadu_si128(p + 3), mask));
+  }
+  for (; i + 16 <= len; i += 16) {
+    __m128i *p = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask));
+  }
+  scalar_xor_mask(data + i, len - i, key);
+}
+
+/************************************* AVX2 实现 *************************************/
+
+__attribute__((target("avx2")))
+static void avx2_xor_mask(char *data, std::size_t len, const char *key)
+{
+  int32_t key32;
+  memcpy(&key32, key, 4);
+  const __m256i mask = _mm256_set1_epi32(key32);
+
+  std::size_t i = 0;
+  for (; i + 128 <= len; i += 128) {
+    __m256i *p = reinterpret_cast<__m256i*>(data + i);
+    _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), mask));
+    _mm256_storeu_si256(p + 1, _mm256_xor_si256(_mm256_loadu_si256(p + 1), mask));
+    _mm256_storeu_si256(p + 2, _mm256_xor_si256(_mm256_loadu_si256(p + 2), mask));
+    _mm256_storeu_si256(p + 3, _mm256_xor_si256(_mm256_loadu_si256(p + 3), mask));
+  }
+  for (; i + 32 <= len; i += 32) {
+    __m256i *p = reinterpret_cast<__m256i*>(data + i);
+    _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), mask));
+  }
+  scalar_xor_mask(data + i, len - i, key);
+}
+
+#endif // ZEST_SIMD_X86
+
+/************************************* 运行时选择 *************************************/
+
+struct MaskImpl
+{
+  const char *name;
+  void (*xor_mask)(char*, std::size_t, const char*);
+};
+
+static MaskImpl select_impl()
+{
+#ifdef ZEST_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return {"avx2", avx2_xor_mask};
+  if (__builtin_cpu_supports("sse2"))
+    return {"sse2", sse2_xor_mask};
+#endif
+  return {"scalar", scalar_xor_mask};
+}
+
+static const MaskImpl &impl()
+{
+  static const MaskImpl s_impl = select_impl();
+  return s_impl;
+}
+
+void simd_xor_mask(char *data, std::size_t len, const char *key)
+{
+  if (len == 0)
+    return;
+  impl().xor_mask(data, len, key);
+}
+
+const char *simd_mask_impl()
+{
+  return impl().name;
+}
+
+} // namespace zest
@@ -0,0 +1,24 @@
+/* 向量化的 4 字节循环异或，用于 WebSocket 帧的原地去掩码，运行时根据CPU选择 AVX2/SSE2/标量实现 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_BASE_SIMD_MASK_H
+#define ZEST_BASE_SIMD_MASK_H
+
+#include <cstddef>
+
+namespace zest
+{
+
+// data[i] ^= key[i % 4]，原地修改，掩码和去掩码是同一个操作
+void simd_xor_mask(char *data, std::size_t len, const char *key);
+
+// 当前使用的实现："avx2"、"sse2" 或 "scalar"
+const char *simd_mask_impl();
+
+} // namespace zest
+
+#endif // ZEST_BASE_SIMD_MASK_H
@@ -0,0 +1,277 @@
+/* 向量化的字节查找，用于在接收缓存中查找分隔符，运行时根据CPU选择 AVX2/SSE2/标量实现 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/base/simd_search.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZEST_SIMD_X86 1
+#endif
+
+namespace zest
+{
+
+/************************************* 标量实现 *************************************/
+
+static const char *scalar_find_byte(const char *begin, const char *end, char c)
+{
+  const void *p = memchr(begin, c, end - begin);
+  return p ? static_cast<const char*>(p) : end;
+}
+
+static const char *scalar_find_crlf(const char *begin, const char *end)
+{
+  for (const char *p = begin; p + 1 < end; ++p) {
+    if (p[0] == '\r' && p[1] == '\n')
+      return p;
+  }
+  return end;
+}
+
+static const char *scalar_find(const char *begin, const char *end, const char *needle, std::size_t len)
+{
+  for (const char *p = begin; p + len <= end; ++p) {
+    if (p[0] == needle[0] && memcmp(p, needle, len) == 0)
+      return p;
+  }
+  return end;
+}
+
+#ifdef ZEST_SIMD_X86
+
+/************************************* SSE2 实现 *************************************/
+
+static const char *sse2_find_byte(const char *begin, const char *end, char c)
+{
+  const __m128i target = _mm_set1_epi8(c);
+  const char *p = begin;
+  // 每次处理64字节，只有在其中找到目标时才逐块定位
+  for (; p + 64 <= end; p += 64) {
+    __m128i c0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), target);
+    __m128i c1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), target);
+    __m128i c2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), target);
+    __m128i c3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), target);
+    __m128i any = _mm_or_si128(_mm_or_si128(c0, c1), _mm_or_si128(c2, c3));
+    if (_mm_movemask_epi8(any) != 0)
+      break;
+  }
+  for (; p + 16 <= end; p += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, target));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return scalar_find_byte(p, end, c);
+}
+
+// 同时比较 p 处的 '\r' 和 p+1 处的 '\n'，两个掩码按位与即为 "\r\n" 的起始位置
+static const char *sse2_find_crlf(const char *begin, const char *end)
+{
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const char *p = begin;
+  for (; p + 65 <= end; p += 64) {
+    __m128i any = _mm_setzero_si128();
+    for (int i = 0; i < 64; i += 16) {
+      __m128i block0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      __m128i block1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 1));
+      any = _mm_or_si128(any, _mm_and_si128(_mm_cmpeq_epi8(block0, cr), _mm_cmpeq_epi8(block1, lf)));
+    }
+    if (_mm_movemask_epi8(any) != 0)
+      break;
+  }
+  for (; p + 17 <= end; p += 16) {
+    __m128i block0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i block1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block0, cr)) &
+               _mm_movemask_epi8(_mm_cmpeq_epi8(block1, lf));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return scalar_find_crlf(p, end);
+}
+
+// 先用子串的首字节和尾字节筛选候选位置，再对候选位置逐个 memcmp
+static const char *sse2_find(const char *begin, const char *end, const char *needle, std::size_t len)
+{
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[len - 1]);
+  const char *p = begin;
+  // 先跳过首尾字节都不可能匹配的大段数据
+  for (; p + len - 1 + 64 <= end; p += 64) {
+    __m128i any = _mm_setzero_si128();
+    for (int i = 0; i < 64; i += 16) {
+      __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + len - 1));
+      any = _mm_or_si128(any, _mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                            _mm_cmpeq_epi8(block_last, last)));
+    }
+    if (_mm_movemask_epi8(any) != 0)
+      break;
+  }
+  for (; p + len - 1 + 16 <= end; p += 16) {
+    __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + len - 1));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block_first, first)) &
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(block_last, last));
+    while (mask != 0) {
+      int i = __builtin_ctz(mask);
+      if (memcmp(p + i + 1, needle + 1, len > 2 ? len - 2 : 0) == 0)
+        return p + i;
+      mask &= mask - 1;
+    }
+  }
+  return scalar_find(p, end, needle, len);
+}
+
+/************************************* AVX2 实现 *************************************/
+
+__attribute__((target("avx2")))
+static const char *avx2_find_byte(const char *begin, const char *end, char c)
+{
+  const __m256i target = _mm256_set1_epi8(c);
+  const char *p = begin;
+  // 每次处理128字节，只有在其中找到目标时才逐块定位
+  for (; p + 128 <= end; p += 128) {
+    __m256i c0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), target);
+    __m256i c1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), target);
+    __m256i c2 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 64)), target);
+    __m256i c3 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 96)), target);
+    __m256i any = _mm256_or_si256(_mm256_or_si256(c0, c1), _mm256_or_si256(c2, c3));
+    if (_mm256_movemask_epi8(any) != 0)
+      break;
+  }
+  for (; p + 32 <= end; p += 32) {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, target));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return sse2_find_byte(p, end, c);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_find_crlf(const char *begin, const char *end)
+{
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const char *p = begin;
+  for (; p + 129 <= end; p += 128) {
+    __m256i any = _mm256_setzero_si256();
+    for (int i = 0; i < 128; i += 32) {
+      __m256i block0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      __m256i block1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 1));
+      any = _mm256_or_si256(any, _mm256_and_si256(_mm256_cmpeq_epi8(block0, cr), _mm256_cmpeq_epi8(block1, lf)));
+    }
+    if (_mm256_movemask_epi8(any) != 0)
+      break;
+  }
+  for (; p + 33 <= end; p += 32) {
+    __m256i block0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i block1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block0, cr)) &
+                    _mm256_movemask_epi8(_mm256_cmpeq_epi8(block1, lf));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+  return sse2_find_crlf(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_find(const char *begin, const char *end, const char *needle, std::size_t len)
+{
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[len - 1]);
+  const char *p = begin;
+  // 先跳过首尾字节都不可能匹配的大段数据
+  for (; p + len - 1 + 128 <= end; p += 128) {
+    __m256i any = _mm256_setzero_si256();
+    for (int i = 0; i < 128; i += 32) {
+      __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + len - 1));
+      any = _mm256_or_si256(any, _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                  _mm256_cmpeq_epi8(block_last, last)));
+    }
+    if (_mm256_movemask_epi8(any) != 0)
+      break;
+  }
+  for (; p + len - 1 + 32 <= end; p += 32) {
+    __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + len - 1));
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block_first, first)) &
+                    _mm256_movemask_epi8(_mm256_cmpeq_epi8(block_last, last));
+    while (mask != 0) {
+      int i = __builtin_ctz(mask);
+      if (memcmp(p + i + 1, needle + 1, len > 2 ? len - 2 : 0) == 0)
+        return p + i;
+      mask &= mask - 1;
+    }
+  }
+  return sse2_find(p, end, needle, len);
+}
+
+#endif // ZEST_SIMD_X86
+
+/************************************* 运行时选择 *************************************/
+
+struct SearchImpl
+{
+  const char *name;
+  const char *(*find_byte)(const char*, const char*, char);
+  const char *(*find_crlf)(const char*, const char*);
+  const char *(*find)(const char*, const char*, const char*, std::size_t);
+};
+
+static SearchImpl select_impl()
+{
+#ifdef ZEST_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return {"avx2", avx2_find_byte, avx2_find_crlf, avx2_find};
+  if (__builtin_cpu_supports("sse2"))
+    return {"sse2", sse2_find_byte, sse2_find_crlf, sse2_find};
+#endif
+  return {"scalar", scalar_find_byte, scalar_find_crlf, scalar_find};
+}
+
+static const SearchImpl &impl()
+{
+  static const SearchImpl s_impl = select_impl();
+  return s_impl;
+}
+
+const char *simd_find_byte(const char *begin, const char *end, char c)
+{
+  if (begin >= end)
+    return end;
+  return impl().find_byte(begin, end, c);
+}
+
+const char *simd_find_crlf(const char *begin, const char *end)
+{
+  if (end - begin < 2)
+    return end;
+  return impl().find_crlf(begin, end);
+}
+
+const char *simd_find(const char *begin, const char *end, const char *needle, std::size_t len)
+{
+  if (len == 0)
+    return begin;
+  if (static_cast<std::size_t>(end - begin) < len)
+    return end;
+  if (len == 1)
+    return simd_find_byte(begin, end, needle[0]);
+  return impl().find(begin, end, needle, len);
+}
+
+const char *simd_search_impl()
+{
+  return impl().name;
+}
+
+} // namespace zest
@@ -0,0 +1,32 @@
+/* 向量化的字节查找，用于在接收缓存中查找分隔符，运行时根据CPU选择 AVX2/SSE2/标量实现 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_BASE_SIMD_SEARCH_H
+#define ZEST_BASE_SIMD_SEARCH_H
+
+#include <cstddef>
+
+namespace zest
+{
+
+// 以下函数在 [begin, end) 中查找，返回第一次出现的位置，找不到时返回 end
+
+// 查找单个字节
+const char *simd_find_byte(const char *begin, const char *end, char c);
+
+// 查找 "\r\n"，返回 '\r' 的位置
+const char *simd_find_crlf(const char *begin, const char *end);
+
+// 查找任意长度的子串，适合较短的分隔符，例如 "\r\n\r\n"
+const char *simd_find(const char *begin, const char *end, const char *needle, std::size_t len);
+
+// 当前使用的实现："avx2"、"sse2" 或 "scalar"
+const char *simd_search_impl();
+
+} // namespace zest
+
+#endif // ZEST_BASE_SIMD_SEARCH_H
@@ -0,0 +1,41 @@
+/* 全进程的连接缓冲区内存预算，统计所有连接的缓冲区占用，超出预算时减慢读取并暂缓接受新连接 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/buffer_budget.h"
+
+#include <atomic>
+
+using namespace zest;
+using namespace zest::net;
+
+static std::atomic<std::size_t> g_buffer_limit {0};   // 预算，0 表示不限制
+static std::atomic<int64_t> g_buffer_used {0};        // 所有IO线程的连接缓冲区占用之和
+
+void BufferBudget::setLimit(std::size_t bytes)
+{
+  g_buffer_limit.store(bytes, std::memory_order_relaxed);
+}
+
+std::size_t BufferBudget::limit()
+{
+  return g_buffer_limit.load(std::memory_order_relaxed);
+}
+
+std::size_t BufferBudget::used()
+{
+  int64_t used = g_buffer_used.load(std::memory_order_relaxed);
+  return used > 0 ? static_cast<std::size_t>(used) : 0;
+}
+
+void BufferBudget::add(int64_t delta)
+{
+  g_buffer_used.fetch_add(delta, std::memory_order_relaxed);
+}
+
+bool BufferBudget::exceeded()
+{
+  std::size_t limit = BufferBudget::limit();
+  return limit > 0 && used() > limit;
+}
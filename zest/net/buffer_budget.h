@@ -0,0 +1,41 @@
+/* 全进程的连接缓冲区内存预算，统计所有连接的缓冲区占用，超出预算时减慢读取并暂缓接受新连接 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is an internal header file, you should not include this.
+
+#ifndef ZEST_NET_BUFFER_BUDGET_H
+#define ZEST_NET_BUFFER_BUDGET_H
+
+#include <stdint.h>
+
+#include <cstddef>
+
+namespace zest
+{
+namespace net
+{
+
+class BufferBudget
+{
+ public:
+  BufferBudget() = delete;
+
+  // 设置预算，单位字节，0 表示不限制
+  static void setLimit(std::size_t bytes);
+  static std::size_t limit();
+
+  // 当前所有连接缓冲区占用的字节数
+  static std::size_t used();
+
+  // 连接的缓冲区占用变化时调用
+  static void add(int64_t delta);
+
+  static bool exceeded();
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_BUFFER_BUDGET_H
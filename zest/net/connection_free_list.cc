@@ -0,0 +1,71 @@
+/* 每个IO线程的连接对象池，断开的 TcpConnection 对象回收后给新连接复用 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/connection_free_list.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+
+#include "zest/base/logging.h"
+#include "zest/net/eventloop.h"
+
+using namespace zest;
+using namespace zest::net;
+
+
+ConnectionFreeList::ConnectionFreeList(std::shared_ptr<EventLoop> eventloop, std::size_t max_idle) :
+  m_eventloop(eventloop), m_max_idle(max_idle)
+{
+  /* do nothing */
+}
+
+void ConnectionFreeList::preallocate(std::size_t n)
+{
+  m_free.reserve(std::max(m_free.size() + n, m_max_idle));
+  for (std::size_t i = 0; i < n; ++i)
+    m_free.emplace_back(new TcpConnection(m_eventloop));
+  m_allocated.fetch_add(n, std::memory_order_relaxed);
+}
+
+TcpConnection::s_ptr ConnectionFreeList::acquire(const AcceptedSocket &client)
+{
+  TcpConnection::s_ptr conn;
+  if (!m_free.empty()) {
+    conn = std::move(m_free.back());
+    m_free.pop_back();
+    m_reused.fetch_add(1, std::memory_order_relaxed);
+  }
+  else {
+    try {
+      conn.reset(new TcpConnection(m_eventloop));
+    }
+    catch(const std::bad_alloc &e) {
+      LOG_ERROR << "create new connection object failed, bad alloc";
+      ::close(client.m_fd);
+      return nullptr;
+    }
+    m_allocated.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (!conn->reopen(client.m_fd, client.m_addr, client.m_len)) {
+    LOG_ERROR << "invalid peer address";
+    ::close(client.m_fd);
+    m_free.push_back(std::move(conn));
+    return nullptr;
+  }
+  return conn;
+}
+
+void ConnectionFreeList::recycle(TcpConnection::s_ptr conn)
+{
+  m_eventloop->assertInLoopThread();
+  if (!conn || conn->getState() != Closed || conn.use_count() > 1)
+    return;
+  conn->recycle();
+  if (m_free.size() < m_max_idle)
+    m_free.push_back(std::move(conn));
+}
@@ -0,0 +1,64 @@
+/* 每个IO线程的连接对象池，断开的 TcpConnection 对象回收后给新连接复用 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is an internal header file, you should not include this.
+
+#ifndef ZEST_NET_CONNECTION_FREE_LIST_H
+#define ZEST_NET_CONNECTION_FREE_LIST_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/tcp_acceptor.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+
+/* 复用的对象连同它的接收缓存、发送队列、FdEvent、定时器容器和对端地址对象一起复用，
+ * 新连接不再需要为这些对象分配内存
+ * 由所属IO线程的 ConnectionRegistry 使用，除了统计数据，只能在IO线程中访问 */
+class ConnectionFreeList : public noncopyable
+{
+ public:
+  ConnectionFreeList(std::shared_ptr<EventLoop> eventloop, std::size_t max_idle);
+  ~ConnectionFreeList() = default;
+
+  // 预先分配 n 个对象，连接风暴到来时不必调用 malloc，必须在IO线程开始处理连接之前调用
+  void preallocate(std::size_t n);
+
+  // 为新接受的套接字取一个对象，没有空闲对象时新分配；对端地址不合法或者内存不足时返回 nullptr
+  TcpConnection::s_ptr acquire(const AcceptedSocket &client);
+
+  /* 回收已经 close() 的连接，必须在本轮循环结束时调用，这时本轮中捕获了 this 的任务
+   * （flush、已经取出的 epoll 事件等）都已经执行完
+   * 对象还被其它地方（包括其它线程提交、尚未执行的任务）持有时只放弃这里的引用，
+   * 空闲对象已经达到上限时直接释放 */
+  void recycle(TcpConnection::s_ptr conn);
+
+  uint64_t allocated() const {return m_allocated.load(std::memory_order_relaxed);}
+  uint64_t reused() const {return m_reused.load(std::memory_order_relaxed);}
+
+ private:
+  std::shared_ptr<EventLoop> m_eventloop;
+  std::size_t m_max_idle;
+  std::vector<TcpConnection::s_ptr> m_free;
+
+  std::atomic<uint64_t> m_allocated {0};   // 新分配的对象数，包括预先分配的
+  std::atomic<uint64_t> m_reused {0};      // 从空闲对象中取用的次数
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_CONNECTION_FREE_LIST_H
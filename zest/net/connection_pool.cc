@@ -0,0 +1,423 @@
+/* 主动连接池：每个IO线程、每个后端地址一个，复用到后端的连接，在连接上流水线地发送请求 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/connection_pool.h"
+
+#include <algorithm>
+
+#include "zest/base/logging.h"
+#include "zest/base/util.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/tcp_connector.h"
+#include "zest/net/timer_event.h"
+
+using namespace zest;
+using namespace zest::net;
+
+
+// 检查超时、空闲连接和健康检查的周期
+static const uint64_t MAINTAIN_INTERVAL = 100;   // ms
+
+struct ConnectionPool::Slot
+{
+  TcpConnector::s_ptr m_connector;
+  TcpConnection *m_conn {nullptr};        // 连接建立后指向 connector 持有的连接
+  std::deque<PendingCall> m_inflight;     // 已经发出、等待响应的请求，和响应的顺序一致
+  int64_t m_last_used_ms {0};             // 最近一次发出用户请求的时间，用于回收空闲连接
+  int64_t m_idle_since_ms {0};            // 最近一次没有在途请求的时间，用于健康检查
+  bool m_evicting {false};                // 正在关闭，不再分配请求
+};
+
+ConnectionPool::ConnectionPool(std::shared_ptr<EventLoop> eventloop, NetBaseAddress &backend) :
+  m_eventloop(eventloop), m_backend(backend.copy())
+{
+  /* do nothing */
+}
+
+ConnectionPool::~ConnectionPool()
+{
+  if (m_maintain_timer)
+    m_maintain_timer->set_valid(false);
+  // connector 析构时会关闭各自的连接，连接的回调函数只持有弱引用，不会再回到这里
+}
+
+void ConnectionPool::setHealthCheck(const std::string &probe, uint64_t interval_ms)
+{
+  m_probe = Slice(probe);
+  m_health_interval = probe.empty() ? 0 : interval_ms;
+}
+
+void ConnectionPool::start()
+{
+  auto self = shared_from_this();
+  m_eventloop->runInLoop([self](){
+    self->startInLoop();
+  });
+}
+
+void ConnectionPool::stop()
+{
+  auto self = shared_from_this();
+  m_eventloop->runInLoop([self](){
+    self->stopInLoop();
+  });
+}
+
+void ConnectionPool::startInLoop()
+{
+  m_eventloop->assertInLoopThread();
+  if (!m_stopped)
+    return;
+  if (!m_parser) {
+    LOG_ERROR << "ConnectionPool for " << m_backend->to_string() << " has no response parser";
+    return;
+  }
+  m_stopped = false;
+  m_min_connections = std::min(m_min_connections, m_max_connections);
+
+  std::weak_ptr<ConnectionPool> weak_self = shared_from_this();
+  m_maintain_timer = std::make_shared<TimerEvent>(
+    MAINTAIN_INTERVAL,
+    [weak_self](){
+      auto self = weak_self.lock();
+      if (self)
+        self->maintain();
+    },
+    true
+  );
+  m_eventloop->addTimerEvent(m_maintain_timer);
+
+  // 预热，调用者第一次发请求时不必等待建立连接
+  while (m_slots.size() < m_min_connections)
+    addConnection();
+}
+
+void ConnectionPool::stopInLoop()
+{
+  m_eventloop->assertInLoopThread();
+  if (m_stopped)
+    return;
+  m_stopped = true;
+  if (m_maintain_timer) {
+    m_maintain_timer->set_valid(false);
+    m_maintain_timer.reset();
+  }
+
+  std::deque<WaitingCall> waiting;
+  waiting.swap(m_waiting);
+  for (auto &w : waiting)
+    failCall(w.m_call, false);
+
+  // 已经建立的连接等发送队列清空后半关闭，在途请求在连接关闭时失败；还在连接中的直接移除
+  std::vector<SlotPtr> slots = m_slots;
+  for (auto &slot : slots) {
+    slot->m_evicting = true;
+    slot->m_connector->stop();
+    if (!slot->m_conn)
+      removeConnection(slot.get());
+  }
+}
+
+void ConnectionPool::addConnection()
+{
+  SlotPtr slot = std::make_shared<Slot>();
+  slot->m_connector = std::make_shared<TcpConnector>(m_eventloop, *m_backend);
+  slot->m_connector->setConnectTimeout(m_connect_timeout);
+  slot->m_connector->setReconnect(true);
+
+  // 回调函数只持有弱引用，连接池和连接之间没有循环引用
+  std::weak_ptr<ConnectionPool> weak_self = shared_from_this();
+  std::weak_ptr<Slot> weak_slot = slot;
+  slot->m_connector->setConnectionCallback([weak_self, weak_slot](TcpConnection &conn){
+    auto self = weak_self.lock();
+    auto slot = weak_slot.lock();
+    if (self && slot)
+      self->onConnected(slot.get(), conn);
+  });
+  slot->m_connector->setMessageCallback([weak_self, weak_slot](TcpConnection &conn){
+    auto self = weak_self.lock();
+    auto slot = weak_slot.lock();
+    if (self && slot)
+      self->onMessage(slot.get(), conn);
+  });
+  slot->m_connector->setWriteCompleteCallback([](TcpConnection &conn){
+    conn.waitForMessage();
+  });
+  slot->m_connector->setCloseCallback([weak_self, weak_slot](TcpConnection&){
+    auto self = weak_self.lock();
+    auto slot = weak_slot.lock();
+    if (self && slot)
+      self->onClose(slot.get());
+  });
+  slot->m_connector->setConnectFailedCallback([weak_self, weak_slot](TcpConnector&, int){
+    auto self = weak_self.lock();
+    auto slot = weak_slot.lock();
+    if (self && slot)
+      self->onConnectFailed(slot.get());
+  });
+
+  m_slots.push_back(slot);
+  slot->m_connector->start();
+}
+
+void ConnectionPool::removeConnection(Slot *slot)
+{
+  auto it = std::find_if(m_slots.begin(), m_slots.end(),
+                         [slot](const SlotPtr &p){ return p.get() == slot; });
+  if (it == m_slots.end())
+    return;
+  // 可能正处在 connector 的回调函数中，留到本轮循环结束再释放
+  SlotPtr removed = *it;
+  m_slots.erase(it);
+  m_eventloop->runAtIterationEnd([removed](){});
+}
+
+// 在途请求最少、还没有达到流水线深度的连接
+ConnectionPool::Slot *ConnectionPool::pickConnection() const
+{
+  Slot *best = nullptr;
+  for (const auto &slot : m_slots) {
+    if (!slot->m_conn || slot->m_evicting || slot->m_inflight.size() >= m_max_pipeline)
+      continue;
+    if (!best || slot->m_inflight.size() < best->m_inflight.size()) {
+      best = slot.get();
+      if (best->m_inflight.empty())
+        break;
+    }
+  }
+  return best;
+}
+
+int64_t ConnectionPool::deadline(int64_t now) const
+{
+  return m_request_timeout > 0 ? now + static_cast<int64_t>(m_request_timeout) : 0;
+}
+
+void ConnectionPool::call(const Slice &request, const ResponseCallback &cb)
+{
+  m_eventloop->assertInLoopThread();
+  m_requests.fetch_add(1, std::memory_order_relaxed);
+  PendingCall call{cb, deadline(get_now_ms()), false};
+  if (m_stopped) {
+    failCall(call, false);
+    return;
+  }
+
+  Slot *slot = pickConnection();
+  /* 最空闲的连接上也有请求在途时，再建立一条连接分担后面的请求
+   * 同一时刻只新建一条，避免突发的请求一下子把连接数撑到上限 */
+  if ((!slot || !slot->m_inflight.empty()) && m_slots.size() < m_max_connections) {
+    bool connecting = std::any_of(m_slots.begin(), m_slots.end(),
+                                  [](const SlotPtr &p){ return !p->m_conn && !p->m_evicting; });
+    if (!connecting)
+      addConnection();
+  }
+
+  if (slot) {
+    sendOn(slot, request, std::move(call));
+    return;
+  }
+  if (m_waiting.size() >= m_max_waiting) {
+    LOG_DEBUG << "ConnectionPool for " << m_backend->to_string() << " is full, reject request";
+    failCall(call, false);
+    return;
+  }
+  m_waiting.push_back(WaitingCall{request, std::move(call)});
+}
+
+void ConnectionPool::sendOn(Slot *slot, const Slice &request, PendingCall &&call)
+{
+  int64_t now = get_now_ms();
+  if (!call.m_probe)
+    slot->m_last_used_ms = now;
+  slot->m_inflight.push_back(std::move(call));
+  // 同一轮中发往同一条连接的请求由写合并在本轮结束时一次写出
+  slot->m_conn->send(request);
+}
+
+void ConnectionPool::dispatchWaiting()
+{
+  while (!m_waiting.empty()) {
+    Slot *slot = pickConnection();
+    if (!slot)
+      return;
+    WaitingCall w = std::move(m_waiting.front());
+    m_waiting.pop_front();
+    sendOn(slot, w.m_request, std::move(w.m_call));
+  }
+}
+
+void ConnectionPool::failCall(PendingCall &call, bool timeout)
+{
+  if (call.m_probe)
+    return;
+  m_failed.fetch_add(1, std::memory_order_relaxed);
+  if (timeout)
+    m_timeouts.fetch_add(1, std::memory_order_relaxed);
+  if (call.m_cb)
+    call.m_cb(false, nullptr, 0);
+}
+
+void ConnectionPool::onConnected(Slot *slot, TcpConnection &conn)
+{
+  m_connections_opened.fetch_add(1, std::memory_order_relaxed);
+  slot->m_conn = &conn;
+  slot->m_last_used_ms = slot->m_idle_since_ms = get_now_ms();
+  if (m_tcp_nodelay)
+    conn.setTcpNoDelay(true);
+  conn.waitForMessage();
+  dispatchWaiting();
+}
+
+void ConnectionPool::onMessage(Slot *slot, TcpConnection &conn)
+{
+  // 一次读取中收到的所有完整响应依次交给回调函数，最后一次性从接收缓存中丢弃
+  std::size_t consumed = 0;
+  bool bad_response = false;
+  while (!slot->m_inflight.empty()) {
+    const char *data = conn.peek() + consumed;
+    std::size_t available = conn.dataSize() - consumed;
+    if (available == 0)
+      break;
+    int64_t n = m_parser(data, available);
+    if (n == 0)
+      break;
+    if (n < 0 || static_cast<std::size_t>(n) > available) {
+      bad_response = true;
+      break;
+    }
+    PendingCall call = std::move(slot->m_inflight.front());
+    slot->m_inflight.pop_front();
+    consumed += n;
+    if (!call.m_probe)
+      m_completed.fetch_add(1, std::memory_order_relaxed);
+    if (call.m_cb)
+      call.m_cb(true, data, n);
+    // 回调函数中可能关闭了连接，在途请求已经在 onClose 中处理
+    if (conn.getState() != Connected)
+      return;
+  }
+  // 没有请求在途却收到了数据，响应和请求已经对不上
+  if (!bad_response && slot->m_inflight.empty() && conn.dataSize() > consumed)
+    bad_response = true;
+  if (bad_response) {
+    LOG_ERROR << "bad response from " << m_backend->to_string() << ", close pooled connection";
+    conn.close();
+    return;
+  }
+
+  if (consumed > 0)
+    conn.clearBytesData(static_cast<int>(consumed));
+  if (slot->m_inflight.empty())
+    slot->m_idle_since_ms = get_now_ms();
+  dispatchWaiting();
+}
+
+void ConnectionPool::onClose(Slot *slot)
+{
+  slot->m_conn = nullptr;
+  std::deque<PendingCall> inflight;
+  inflight.swap(slot->m_inflight);
+  // 被回收或者连接池已经停止的连接不再重连，其余的由 connector 按退避时间重连
+  if (slot->m_evicting || m_stopped)
+    removeConnection(slot);
+
+  for (auto &call : inflight)
+    failCall(call, false);
+}
+
+void ConnectionPool::onConnectFailed(Slot *slot)
+{
+  // connector 遇到不可恢复的错误，不会再重试
+  removeConnection(slot);
+  if (m_slots.empty()) {
+    std::deque<WaitingCall> waiting;
+    waiting.swap(m_waiting);
+    for (auto &w : waiting)
+      failCall(w.m_call, false);
+  }
+}
+
+void ConnectionPool::maintain()
+{
+  if (m_stopped)
+    return;
+  int64_t now = get_now_ms();
+
+  // 排队超时的请求，排队的请求截止时间是递增的
+  while (!m_waiting.empty() && m_waiting.front().m_call.m_deadline_ms != 0 &&
+         m_waiting.front().m_call.m_deadline_ms <= now) {
+    WaitingCall w = std::move(m_waiting.front());
+    m_waiting.pop_front();
+    failCall(w.m_call, true);
+  }
+
+  std::size_t alive = std::count_if(m_slots.begin(), m_slots.end(),
+                                    [](const SlotPtr &p){ return !p->m_evicting; });
+  // 回调函数可能修改 m_slots，遍历一份拷贝
+  std::vector<SlotPtr> slots = m_slots;
+  for (auto &slot : slots) {
+    if (!slot->m_conn || slot->m_evicting)
+      continue;
+    if (!slot->m_inflight.empty()) {
+      // 最早发出的请求最先超时，关闭连接，这条连接上的在途请求全部失败
+      const PendingCall &oldest = slot->m_inflight.front();
+      if (oldest.m_deadline_ms != 0 && oldest.m_deadline_ms <= now) {
+        LOG_ERROR << "request to " << m_backend->to_string() << " timeout, close pooled connection";
+        if (!oldest.m_probe)
+          m_timeouts.fetch_add(1, std::memory_order_relaxed);
+        slot->m_conn->close();
+      }
+      continue;
+    }
+
+    if (m_idle_timeout > 0 && alive > m_min_connections &&
+        now - slot->m_last_used_ms >= static_cast<int64_t>(m_idle_timeout)) {
+      LOG_DEBUG << "evict idle connection to " << m_backend->to_string();
+      slot->m_evicting = true;
+      --alive;
+      m_connections_evicted.fetch_add(1, std::memory_order_relaxed);
+      slot->m_connector->stop();
+      continue;
+    }
+
+    if (m_health_interval > 0 && now - slot->m_idle_since_ms >= static_cast<int64_t>(m_health_interval)) {
+      uint64_t timeout = m_request_timeout > 0 ? m_request_timeout : m_health_interval;
+      PendingCall probe{nullptr, now + static_cast<int64_t>(timeout), true};
+      sendOn(slot.get(), m_probe, std::move(probe));
+    }
+  }
+}
+
+std::size_t ConnectionPool::connectionCount() const
+{
+  return m_slots.size();
+}
+
+std::size_t ConnectionPool::readyConnections() const
+{
+  return std::count_if(m_slots.begin(), m_slots.end(),
+                       [](const SlotPtr &p){ return p->m_conn != nullptr && !p->m_evicting; });
+}
+
+std::size_t ConnectionPool::outstanding() const
+{
+  std::size_t total = 0;
+  for (const auto &slot : m_slots)
+    total += slot->m_inflight.size();
+  return total;
+}
+
+ConnectionPoolStats ConnectionPool::stats() const
+{
+  ConnectionPoolStats s;
+  s.m_requests = m_requests.load(std::memory_order_relaxed);
+  s.m_completed = m_completed.load(std::memory_order_relaxed);
+  s.m_failed = m_failed.load(std::memory_order_relaxed);
+  s.m_timeouts = m_timeouts.load(std::memory_order_relaxed);
+  s.m_connections_opened = m_connections_opened.load(std::memory_order_relaxed);
+  s.m_connections_evicted = m_connections_evicted.load(std::memory_order_relaxed);
+  return s;
+}
@@ -0,0 +1,174 @@
+/* 主动连接池：每个IO线程、每个后端地址一个，复用到后端的连接，在连接上流水线地发送请求 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_CONNECTION_POOL_H
+#define ZEST_NET_CONNECTION_POOL_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/base_addr.h"
+#include "zest/net/slice.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+class TimerEvent;
+
+// 连接池的统计数据，可以在任意线程读取
+struct ConnectionPoolStats
+{
+  uint64_t m_requests {0};          // call() 的次数
+  uint64_t m_completed {0};         // 收到响应的请求数
+  uint64_t m_failed {0};            // 因连接断开、超时、排队已满而失败的请求数
+  uint64_t m_timeouts {0};          // 其中超时的请求数
+  uint64_t m_connections_opened {0};
+  uint64_t m_connections_evicted {0};   // 空闲太久被关闭的连接数
+};
+
+/* 连接池属于一个 EventLoop，除 start() / stop() / stats() 外的方法只能在这个IO线程中调用，内部不加锁
+ * 每个IO线程为每个后端创建一个连接池（例如放在 thread_local 变量中），线程之间不共享连接
+ *
+ * 请求和响应在每条连接上按顺序一一对应（HTTP/1.1、RESP 这类协议），
+ * 所以一条连接上可以同时有多个请求在途，响应由 setResponseParser() 设置的解析函数分帧：
+ *   返回接收缓存开头第一个完整响应的字节数，不完整返回 0，格式错误返回 -1（连接会被关闭）
+ *
+ * 选择连接：在已建立的连接中选在途请求最少的一条，所有连接都有请求在途时再新建连接（不超过上限），
+ * 每条连接都达到流水线深度时请求在池中排队，有连接空出来时发出
+ * 连接断开后按指数退避自动重连，至少保持 setMinConnections() 条连接，多出的连接空闲太久会被关闭
+ * 在途请求超时后，这条连接上的响应顺序已经无法保证，所以关闭连接，其上的请求全部失败 */
+class ConnectionPool : public noncopyable, public std::enable_shared_from_this<ConnectionPool>
+{
+ public:
+  using s_ptr = std::shared_ptr<ConnectionPool>;
+  using ResponseParser = std::function<int64_t(const char *data, std::size_t len)>;
+  /* 请求完成，ok 为 true 时 [data, data+len) 是完整的响应，直接指向接收缓存，只在回调函数执行期间有效
+   * ok 为 false 表示请求失败，data 为 nullptr */
+  using ResponseCallback = std::function<void(bool ok, const char *data, std::size_t len)>;
+
+  static const std::size_t DEFAULT_MIN_CONNECTIONS = 1;
+  static const std::size_t DEFAULT_MAX_CONNECTIONS = 8;
+  static const std::size_t DEFAULT_MAX_PIPELINE = 16;
+  static const std::size_t DEFAULT_MAX_WAITING = 4096;
+  static const uint64_t DEFAULT_IDLE_TIMEOUT = 60000;   // ms
+
+  // 必须由 std::shared_ptr 管理
+  ConnectionPool(std::shared_ptr<EventLoop> eventloop, NetBaseAddress &backend);
+  ~ConnectionPool();
+
+  // 以下设置必须在 start() 之前调用
+  void setResponseParser(const ResponseParser &parser) {m_parser = parser;}
+  void setMinConnections(std::size_t n) {m_min_connections = n;}      // 预热并一直保持的连接数
+  void setMaxConnections(std::size_t n) {m_max_connections = n > 0 ? n : 1;}
+  void setMaxPipeline(std::size_t n) {m_max_pipeline = n > 0 ? n : 1;}   // 每条连接上最多在途的请求数
+  void setMaxWaiting(std::size_t n) {m_max_waiting = n;}              // 排队的请求数上限，超出时立即失败
+  void setIdleTimeout(uint64_t ms) {m_idle_timeout = ms;}             // 多出的连接空闲多久后关闭，0 表示不关闭
+  void setConnectTimeout(uint64_t ms) {m_connect_timeout = ms;}
+  void setRequestTimeout(uint64_t ms) {m_request_timeout = ms;}       // 包括排队的时间，0 表示不设超时
+  void setTcpNoDelay(bool on) {m_tcp_nodelay = on;}
+
+  /* 健康检查：连接空闲 interval_ms 毫秒后发送一次 probe，超时（请求超时，没有设置时为 interval_ms）
+   * 或者响应格式错误时关闭连接并重连，interval_ms 为 0 表示不检查 */
+  void setHealthCheck(const std::string &probe, uint64_t interval_ms);
+
+  // 预热到最少连接数，可以在任意线程调用
+  void start();
+
+  // 关闭所有连接，排队和在途的请求失败，可以在任意线程调用
+  void stop();
+
+  // 发送一个请求，cb 在IO线程中执行
+  void call(const Slice &request, const ResponseCallback &cb);
+  void call(const std::string &request, const ResponseCallback &cb) {call(Slice(request), cb);}
+
+  std::size_t connectionCount() const;      // 包括正在连接的
+  std::size_t readyConnections() const;     // 已经建立的
+  std::size_t outstanding() const;          // 所有连接上在途的请求数
+  std::size_t waiting() const {return m_waiting.size();}
+
+  std::shared_ptr<EventLoop> getEventLoop() const {return m_eventloop;}
+  NetBaseAddress &backendAddress() const {return *m_backend;}
+
+  ConnectionPoolStats stats() const;
+
+ private:
+  struct PendingCall
+  {
+    ResponseCallback m_cb;
+    int64_t m_deadline_ms;   // 0 表示不设超时
+    bool m_probe;
+  };
+
+  struct WaitingCall
+  {
+    Slice m_request;
+    PendingCall m_call;
+  };
+
+  struct Slot;   // 一条池化的连接，在 .cc 中定义
+  using SlotPtr = std::shared_ptr<Slot>;
+
+  void startInLoop();
+  void stopInLoop();
+  void addConnection();
+  void removeConnection(Slot *slot);
+  Slot *pickConnection() const;
+  void sendOn(Slot *slot, const Slice &request, PendingCall &&call);
+  void dispatchWaiting();
+  void failCall(PendingCall &call, bool timeout);
+  void onConnected(Slot *slot, TcpConnection &conn);
+  void onMessage(Slot *slot, TcpConnection &conn);
+  void onClose(Slot *slot);
+  void onConnectFailed(Slot *slot);
+  void maintain();
+  int64_t deadline(int64_t now) const;
+
+ private:
+  std::shared_ptr<EventLoop> m_eventloop;
+  NetBaseAddress::s_ptr m_backend;
+  ResponseParser m_parser {nullptr};
+
+  std::size_t m_min_connections {DEFAULT_MIN_CONNECTIONS};
+  std::size_t m_max_connections {DEFAULT_MAX_CONNECTIONS};
+  std::size_t m_max_pipeline {DEFAULT_MAX_PIPELINE};
+  std::size_t m_max_waiting {DEFAULT_MAX_WAITING};
+  uint64_t m_idle_timeout {DEFAULT_IDLE_TIMEOUT};
+  uint64_t m_connect_timeout {3000};
+  uint64_t m_request_timeout {0};
+  bool m_tcp_nodelay {true};
+  Slice m_probe;
+  uint64_t m_health_interval {0};
+
+  // 以下成员只在IO线程中访问
+  bool m_stopped {true};
+  std::vector<SlotPtr> m_slots;
+  std::deque<WaitingCall> m_waiting;
+  std::shared_ptr<TimerEvent> m_maintain_timer;
+
+  std::atomic<uint64_t> m_requests {0};
+  std::atomic<uint64_t> m_completed {0};
+  std::atomic<uint64_t> m_failed {0};
+  std::atomic<uint64_t> m_timeouts {0};
+  std::atomic<uint64_t> m_connections_opened {0};
+  std::atomic<uint64_t> m_connections_evicted {0};
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_CONNECTION_POOL_H
@@ -0,0 +1,94 @@
+/* 每个IO线程持有自己的全部连接，连接 close() 之后在本轮循环结束时立即释放（回收到对象池） */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/connection_registry.h"
+
+#include "zest/base/logging.h"
+#include "zest/net/eventloop.h"
+
+using namespace zest;
+using namespace zest::net;
+
+
+ConnectionRegistry::ConnectionRegistry(std::shared_ptr<EventLoop> eventloop, std::size_t max_idle) :
+  m_eventloop(eventloop), m_free_list(eventloop, max_idle)
+{
+  /* do nothing */
+}
+
+void ConnectionRegistry::post(const AcceptedSocket &client)
+{
+  // 先计入连接数，主线程判断连接数上限时不会漏掉还在队列中的套接字
+  m_size.fetch_add(1, std::memory_order_relaxed);
+  bool wakeup = false;
+  {
+    std::lock_guard<std::mutex> lock(m_incoming_mutex);
+    wakeup = m_incoming.empty();
+    m_incoming.push_back(client);
+  }
+  // 队列原本不为空，说明已经登记了 drainIncoming，新的套接字会一起处理
+  if (wakeup) {
+    ConnectionRegistry *self = this;
+    m_eventloop->runInLoop([self](){self->drainIncoming();});
+  }
+}
+
+void ConnectionRegistry::drainIncoming()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_incoming_mutex);
+    m_draining.swap(m_incoming);
+  }
+  for (const auto &client : m_draining)
+    add(client);
+  m_draining.clear();
+}
+
+void ConnectionRegistry::add(const AcceptedSocket &client)
+{
+  TcpConnection::s_ptr conn = m_free_list.acquire(client);
+  if (!conn) {
+    m_size.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+  conn->m_registry = this;
+  conn->m_registry_index = m_connections.size();
+  m_connections.push_back(conn);
+  if (m_new_connection_callback)
+    m_new_connection_callback(*conn);
+}
+
+/* 从数组中删除，和最后一个元素交换；对象暂时放在 m_closed 中，
+ * 回调函数、flush 等捕获了 this 的任务在本轮循环中还可能执行
+ * 其它线程提交的任务持有连接的引用，回收时 use_count() 大于 1，对象不会被复用，由最后一个任务释放 */
+void ConnectionRegistry::onClosed(TcpConnection &conn)
+{
+  m_eventloop->assertInLoopThread();
+  std::size_t index = conn.m_registry_index;
+  if (index >= m_connections.size() || m_connections[index].get() != &conn)
+    return;
+  m_closed.push_back(std::move(m_connections[index]));
+  if (index + 1 != m_connections.size()) {
+    m_connections[index] = std::move(m_connections.back());
+    m_connections[index]->m_registry_index = index;
+  }
+  m_connections.pop_back();
+  m_size.fetch_sub(1, std::memory_order_relaxed);
+  conn.m_registry = nullptr;
+
+  if (!m_reclaim_pending) {
+    m_reclaim_pending = true;
+    ConnectionRegistry *self = this;
+    m_eventloop->runAtIterationEnd([self](){self->reclaim();});
+  }
+}
+
+void ConnectionRegistry::reclaim()
+{
+  m_reclaim_pending = false;
+  for (auto &conn : m_closed)
+    m_free_list.recycle(std::move(conn));
+  m_closed.clear();
+}
@@ -0,0 +1,90 @@
+/* 每个IO线程持有自己的全部连接，连接 close() 之后在本轮循环结束时立即释放（回收到对象池） */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is an internal header file, you should not include this.
+
+#ifndef ZEST_NET_CONNECTION_REGISTRY_H
+#define ZEST_NET_CONNECTION_REGISTRY_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/connection_free_list.h"
+#include "zest/net/tcp_acceptor.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+
+/* 主线程只负责接受连接，用 post() 把套接字交给IO线程，之后不再持有连接
+ * IO线程从对象池取出连接对象，放进紧凑的数组中，连接记住自己的下标，删除时和最后一个元素交换，O(1)
+ * 连接 close() 时通知所属的 ConnectionRegistry，本轮循环结束时从数组中删除并交还对象池 */
+class ConnectionRegistry : public noncopyable
+{
+ public:
+  using ConnectionCallbackFunc = std::function<void(TcpConnection&)>;
+
+  ConnectionRegistry(std::shared_ptr<EventLoop> eventloop, std::size_t max_idle);
+  ~ConnectionRegistry() = default;
+
+  // 新连接加入之后在IO线程中调用，由 TcpServer 设置回调函数、执行连接回调
+  void setNewConnectionCallback(const ConnectionCallbackFunc &cb) {m_new_connection_callback = cb;}
+
+  // 预先分配 n 个连接对象，必须在IO线程开始处理连接之前调用
+  void preallocate(std::size_t n) {m_free_list.preallocate(n);}
+
+  /* 把新接受的套接字交给IO线程，可以在任意线程调用
+   * 同一批连接只唤醒IO线程一次，队列的内存反复使用，不为每个连接分配任务 */
+  void post(const AcceptedSocket &client);
+
+  std::shared_ptr<EventLoop> eventloop() const {return m_eventloop;}
+
+  // 统计数据，可以在任意线程读取，size() 包括已经 post() 但IO线程还没有处理的套接字
+  std::size_t size() const {return m_size.load(std::memory_order_relaxed);}
+  uint64_t allocated() const {return m_free_list.allocated();}
+  uint64_t reused() const {return m_free_list.reused();}
+
+ private:
+  friend class TcpConnection;
+
+  void drainIncoming();
+  void add(const AcceptedSocket &client);
+
+  // 由 TcpConnection::close() 调用，连接在本轮循环结束时释放
+  void onClosed(TcpConnection &conn);
+  void reclaim();
+
+ private:
+  std::shared_ptr<EventLoop> m_eventloop;
+  ConnectionCallbackFunc m_new_connection_callback {nullptr};
+
+  // 主线程交过来、还没有处理的套接字
+  std::mutex m_incoming_mutex;
+  std::vector<AcceptedSocket> m_incoming;
+  std::vector<AcceptedSocket> m_draining;
+
+  // 以下成员只在IO线程中访问
+  std::vector<TcpConnection::s_ptr> m_connections;   // 连接的 m_registry_index 是它在数组中的下标
+  std::vector<TcpConnection::s_ptr> m_closed;        // 已经 close()，等待本轮循环结束时释放
+  bool m_reclaim_pending {false};
+  ConnectionFreeList m_free_list;
+
+  std::atomic<std::size_t> m_size {0};   // 连接数，post() 时增加，close() 时减少
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_CONNECTION_REGISTRY_H
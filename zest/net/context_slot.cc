@@ -0,0 +1,87 @@
+/* 连接上下文的类型化槽位，槽位在程序启动时登记，对象直接构造在连接对象内部 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/context_slot.h"
+
+#include <mutex>
+
+#include "zest/base/logging.h"
+
+using namespace zest;
+using namespace zest::net;
+
+static_assert(ContextStorage::MAX_SLOTS <= 32, "m_present has 32 bits");
+
+/* 登记表，槽位对象通常是其它编译单元中的静态对象，在动态初始化阶段登记
+ * 这里只用常量初始化的变量，保证登记时它们已经初始化 */
+namespace
+{
+
+struct SlotEntry
+{
+  uint32_t m_offset;
+  void (*m_destroy)(void*);
+};
+
+std::mutex g_slot_mutex;
+SlotEntry g_slots[ContextStorage::MAX_SLOTS];
+int g_slot_count = 0;
+std::size_t g_storage_used = 0;
+
+// 在内联存储中分配 size 字节，放不下返回 false
+bool allocate(std::size_t size, std::size_t align, uint32_t *offset)
+{
+  std::size_t begin = (g_storage_used + align - 1) / align * align;
+  if (begin + size > ContextStorage::STORAGE_BYTES)
+    return false;
+  *offset = static_cast<uint32_t>(begin);
+  g_storage_used = begin + size;
+  return true;
+}
+
+} // namespace
+
+
+ContextSlotBase::ContextSlotBase(std::size_t size, std::size_t align,
+                                 Destroyer destroy_inline, Destroyer destroy_heap)
+{
+  std::lock_guard<std::mutex> lock(g_slot_mutex);
+  if (g_slot_count >= static_cast<int>(ContextStorage::MAX_SLOTS))
+    return;
+
+  // 小的对象直接放在连接内部，大的对象或者内联存储用完之后只放指针
+  if (size <= ContextStorage::INLINE_MAX && align <= alignof(max_align_t) &&
+      allocate(size, align, &m_offset)) {
+    m_inline = true;
+  }
+  else if (!allocate(sizeof(void*), alignof(void*), &m_offset)) {
+    return;
+  }
+  m_index = g_slot_count++;
+  g_slots[m_index].m_offset = m_offset;
+  g_slots[m_index].m_destroy = m_inline ? destroy_inline : destroy_heap;
+}
+
+int ContextSlotBase::slotCount()
+{
+  std::lock_guard<std::mutex> lock(g_slot_mutex);
+  return g_slot_count;
+}
+
+void ContextStorage::clear()
+{
+  // 登记之后槽位不会改变，读 g_slots 不需要加锁
+  while (m_present) {
+    int i = __builtin_ctz(m_present);
+    m_present &= m_present - 1;
+    g_slots[i].m_destroy(m_storage + g_slots[i].m_offset);
+  }
+}
+
+void ContextStorage::invalidSlot()
+{
+  LOG_ERROR << "ContextSlot: too many context slots registered, at most " << MAX_SLOTS
+            << " slots and " << STORAGE_BYTES << " bytes per connection";
+}
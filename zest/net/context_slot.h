@@ -0,0 +1,121 @@
+/* 连接上下文的类型化槽位，槽位在程序启动时登记，对象直接构造在连接对象内部 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_CONTEXT_SLOT_H
+#define ZEST_NET_CONTEXT_SLOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+#include <utility>
+
+#include "zest/base/noncopyable.h"
+
+namespace zest
+{
+namespace net
+{
+
+/* 槽位的登记信息，与值的类型无关的部分
+ * 登记时按顺序分配编号和连接内联存储中的偏移，内联存储放不下的对象放在堆上，槽位中只保存指针 */
+class ContextSlotBase : public noncopyable
+{
+ public:
+  bool valid() const {return m_index >= 0;}
+  int index() const {return m_index;}
+  bool isInline() const {return m_inline;}
+  uint32_t offset() const {return m_offset;}
+
+  // 已经登记的槽位数量
+  static int slotCount();
+
+ protected:
+  using Destroyer = void (*)(void*);
+  ContextSlotBase(std::size_t size, std::size_t align, Destroyer destroy_inline, Destroyer destroy_heap);
+
+ private:
+  int m_index {-1};          // 超过槽位数量上限时为 -1，Put 总是失败
+  uint32_t m_offset {0};
+  bool m_inline {false};
+};
+
+/* 定义成命名空间作用域的静态对象，例如
+ *   static const zest::net::ContextSlot<Session> SESSION_SLOT;
+ * 之后用 conn.Put(SESSION_SLOT, ...) 和 conn.Get(SESSION_SLOT) 存取，不需要哈希和比较类型名 */
+template <typename ValueType>
+class ContextSlot : public ContextSlotBase
+{
+ public:
+  ContextSlot() : ContextSlotBase(sizeof(ValueType), alignof(ValueType), &destroyInline, &destroyHeap) {}
+
+ private:
+  static void destroyInline(void *p) {static_cast<ValueType*>(p)->~ValueType();}
+  static void destroyHeap(void *p) {delete *static_cast<ValueType**>(p);}
+};
+
+// 一个连接的全部槽位，连接析构或者被复用时销毁已经放置的对象
+class ContextStorage : public noncopyable
+{
+ public:
+  static const std::size_t STORAGE_BYTES = 128;   // 每个连接的内联存储
+  static const std::size_t MAX_SLOTS = 32;        // 整个程序能登记的槽位数量
+  static const std::size_t INLINE_MAX = 64;       // 更大的对象放在堆上
+
+  ContextStorage() = default;
+  ~ContextStorage() {clear();}
+
+  // 槽位中已经有对象时返回 false
+  template <typename ValueType, typename... Args>
+  bool emplace(const ContextSlot<ValueType> &slot, Args&&... args);
+
+  template <typename ValueType>
+  ValueType* get(const ContextSlot<ValueType> &slot) const
+  {
+    if (!has(slot))
+      return nullptr;
+    unsigned char *p = const_cast<unsigned char*>(m_storage) + slot.offset();
+    return slot.isInline() ? reinterpret_cast<ValueType*>(p) : *reinterpret_cast<ValueType**>(p);
+  }
+
+  // 销毁所有对象
+  void clear();
+
+ private:
+  bool has(const ContextSlotBase &slot) const
+  {
+    return slot.valid() && (m_present & (1u << slot.index()));
+  }
+  static void invalidSlot();
+
+ private:
+  alignas(max_align_t) unsigned char m_storage[STORAGE_BYTES];
+  uint32_t m_present {0};   // 第 i 位表示第 i 个槽位中有对象
+};
+
+template <typename ValueType, typename... Args>
+bool ContextStorage::emplace(const ContextSlot<ValueType> &slot, Args&&... args)
+{
+  if (!slot.valid()) {
+    invalidSlot();
+    return false;
+  }
+  if (has(slot))
+    return false;
+  unsigned char *p = m_storage + slot.offset();
+  if (slot.isInline())
+    new (p) ValueType(std::forward<Args>(args)...);
+  else
+    *reinterpret_cast<ValueType**>(p) = new ValueType(std::forward<Args>(args)...);
+  m_present |= 1u << slot.index();
+  return true;
+}
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_CONTEXT_SLOT_H
@@ -99,18 +99,22 @@ void EventLoop::loop()
 
   // 在进入loop前先把已经发生的事件处理了
   doPendingTask();
+  doIterationEndTask();
 
   while (!m_stop) {
 
+    m_busy_since_ms.store(0, std::memory_order_relaxed);
     int n = epoll_wait(m_epoll_fd, events, g_epoll_max_events, g_epoll_max_timeout);
     if (n < 0) {
       LOG_ERROR << "epoll_wait failed, errno = " << errno;
       continue;
     }
+    m_busy_since_ms.store(get_now_ms(), std::memory_order_relaxed);
 
     for (int i = 0; i < n; ++i) {
       epoll_event event = events[i];
       FdEventPtr fd_event = m_listen_fds[event.data.fd];
+      fd_event->setReturnedEvents(event.events);
       if (event.events & EPOLLIN) {
         addTask(fd_event->handler(FdEvent::IN_EVENT));
       }
@@ -118,17 +122,33 @@ void EventLoop::loop()
         addTask(fd_event->handler(FdEvent::OUT_EVENT));
       }
       if (event.events & EPOLLERR) {
-        deleteEpollEvent(fd_event);
-        addTask(fd_event->handler(FdEvent::ERROR_EVENT));
+        // 设置了错误回调的fd由回调函数自己处理（例如读取 MSG_ZEROCOPY 的完成通知），否则从epoll中删除
+        auto err_cb = fd_event->handler(FdEvent::ERROR_EVENT);
+        if (!err_cb)
+          deleteEpollEvent(fd_event);
+        addTask(err_cb);
       }
     }
 
     doPendingTask();
+
+    // 本轮产生的所有输出在这里统一发送，每个连接只写一次
+    doIterationEndTask();
   }
   LOG_DEBUG << "stop event loop";
+  m_busy_since_ms.store(0, std::memory_order_relaxed);
   m_is_running = false;
 }
 
+int64_t EventLoop::loopLagMs() const
+{
+  int64_t since = m_busy_since_ms.load(std::memory_order_relaxed);
+  if (since == 0)
+    return 0;
+  int64_t lag = get_now_ms() - since;
+  return lag > 0 ? lag : 0;
+}
+
 void EventLoop::stop()
 {
   m_stop = true;
@@ -224,6 +244,12 @@ void EventLoop::runInLoop(CallBackFunc cb)
   }
 }
 
+void EventLoop::runAtIterationEnd(CallBackFunc cb)
+{
+  assertInLoopThread();
+  m_iteration_end_tasks.push_back(cb);
+}
+
 bool EventLoop::isThisThread() const
 {
   return m_tid == t_tid;
@@ -247,3 +273,15 @@ void EventLoop::doPendingTask()
     if (cb) cb();
   }
 }
+
+void EventLoop::doIterationEndTask()
+{
+  // 回调函数中可能再次调用 runAtIterationEnd（例如在写完成回调中继续发送），所以要循环处理直到为空
+  while (!m_iteration_end_tasks.empty()) {
+    std::vector<CallBackFunc> tasks;
+    tasks.swap(m_iteration_end_tasks);
+    for (auto &cb : tasks) {
+      if (cb) cb();
+    }
+  }
+}
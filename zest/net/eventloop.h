@@ -15,6 +15,7 @@
 #include <memory>
 #include <queue>
 #include <unordered_map>
+#include <vector>
 
 #include "zest/base/noncopyable.h"
 #include "zest/base/sync.h"
@@ -61,6 +62,33 @@ class EventLoop: public noncopyable
     
   void runInLoop(CallBackFunc cb);
 
+  // 在本轮循环处理完所有事件之后执行，只能由本线程调用，用于合并同一轮中的多次写操作
+  void runAtIterationEnd(CallBackFunc cb);
+
+  // 写合并的统计数据，可以由任意线程读取
+  void recordWriteRequest() {m_write_requests.fetch_add(1, std::memory_order_relaxed);}
+  void recordWriteSyscall() {m_write_syscalls.fetch_add(1, std::memory_order_relaxed);}
+  uint64_t writeRequests() const {return m_write_requests.load(std::memory_order_relaxed);}
+  uint64_t writeSyscalls() const {return m_write_syscalls.load(std::memory_order_relaxed);}
+  // 本线程所有连接的缓冲区占用的字节数，可以由任意线程读取
+  void addBufferBytes(int64_t delta) {m_buffer_bytes.fetch_add(delta, std::memory_order_relaxed);}
+  std::size_t bufferBytes() const
+  {
+    int64_t bytes = m_buffer_bytes.load(std::memory_order_relaxed);
+    return bytes > 0 ? static_cast<std::size_t>(bytes) : 0;
+  }
+
+  /* 事件循环的延迟：本轮从 epoll_wait 返回到现在已经处理了多久，单位毫秒，可以由任意线程读取
+   * 在 epoll_wait 中等待时为 0；持续很大说明这个线程处理不过来，新的事件要等这么久才能被处理 */
+  int64_t loopLagMs() const;
+
+  // 因写合并而节省的系统调用次数
+  uint64_t syscallsSaved() const
+  {
+    uint64_t requests = writeRequests(), syscalls = writeSyscalls();
+    return requests > syscalls ? requests - syscalls : 0;
+  }
+
   bool isThisThread() const;   // 判断调用者是否是创建该对象的线程
 
   void assertInLoopThread() const;
@@ -69,6 +97,7 @@ class EventLoop: public noncopyable
   EventLoop();
   void addTask(CallBackFunc cb, bool wake_up = false);
   void doPendingTask();
+  void doIterationEndTask();
 
  private:
   std::unordered_map<int, FdEventPtr> m_listen_fds;  // 所有监听的fd的集合
@@ -77,6 +106,11 @@ class EventLoop: public noncopyable
   bool m_is_running {false};                   // 是否正在运行
   std::atomic<bool> m_stop;                   
   std::queue<CallBackFunc> m_pending_tasks;   // 等待处理的回调函数
+  std::vector<CallBackFunc> m_iteration_end_tasks;  // 本轮循环结束时执行的回调函数，只由本线程访问
+  std::atomic<uint64_t> m_write_requests {0};  // 用户调用 send 的次数
+  std::atomic<uint64_t> m_write_syscalls {0};  // 实际执行写系统调用的次数
+  std::atomic<int64_t> m_buffer_bytes {0};     // 本线程所有连接的缓冲区占用
+  std::atomic<int64_t> m_busy_since_ms {0};    // 本轮从 epoll_wait 返回的时间，等待时为 0
   Mutex m_mutex;                              // 互斥锁
   int m_wakeup_fd {0};                        // wakeup_fd
   std::shared_ptr<WakeUpFdEvent> m_wakeup_event;  // 用于唤醒epoll_wait的事件
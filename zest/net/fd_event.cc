@@ -54,3 +54,13 @@ void FdEvent::set_non_blocking()
 {
   zest::set_non_blocking(m_fd);   // 使用的是utils.h中定义的函数
 }
+
+void FdEvent::reset(int fd)
+{
+  m_fd = fd;
+  memset(&m_event, 0, sizeof(m_event));
+  m_revents = 0;
+  m_read_callback = nullptr;
+  m_write_callback = nullptr;
+  m_error_callback = nullptr;
+}
@@ -41,6 +41,9 @@ class FdEvent: public noncopyable
   // 为IO事件设置回调函数
   void listen(uint32_t ev_type, const CallBackFunc &cb, const CallBackFunc &err_cb = nullptr);
 
+  // 单独设置错误回调函数，不改变监听的事件
+  void setErrorCallback(const CallBackFunc &err_cb) {m_error_callback = err_cb;}
+
   // 获取IO事件的回调函数
   CallBackFunc handler(TriggerEvent type) const;
 
@@ -50,12 +53,20 @@ class FdEvent: public noncopyable
   // 获取epoll_event结构体
   epoll_event getEpollEvent() const {return m_event;}
 
+  // 最近一次 epoll_wait 返回的事件，回调函数可以据此区分 EPOLLRDHUP 等附带的事件
+  void setReturnedEvents(uint32_t ev) {m_revents = ev;}
+  uint32_t returnedEvents() const {return m_revents;}
+
   // 将监听的fd设置为非阻塞
   void set_non_blocking();
+
+  // 改为监听另一个fd，清除监听的事件和回调函数，用于复用连接对象
+  void reset(int fd);
   
  protected:
   int m_fd {-1};
   struct epoll_event m_event;
+  uint32_t m_revents {0};
   CallBackFunc m_read_callback {nullptr};
   CallBackFunc m_write_callback {nullptr};
   CallBackFunc m_error_callback {nullptr};
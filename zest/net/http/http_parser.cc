@@ -0,0 +1,334 @@
+/* 增量式的HTTP请求解析器，直接在连接的接收缓存中解析，不完整的请求留在缓存中等待更多数据 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/http/http_parser.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "zest/base/simd_search.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::http;
+
+// 块大小所在的行（包括扩展）的最大长度
+static const std::size_t MAX_CHUNK_LINE = 1024;
+
+static bool isSpace(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+static bool equalsIgnoreCase(const char *begin, const char *end, const char *str)
+{
+  std::size_t len = strlen(str);
+  return static_cast<std::size_t>(end - begin) == len && strncasecmp(begin, str, len) == 0;
+}
+
+// 逗号分隔的列表 [begin, end) 中是否有 token，例如 Connection: keep-alive, Upgrade
+static bool hasToken(const char *begin, const char *end, const char *token)
+{
+  const char *p = begin;
+  while (p < end) {
+    const char *comma = std::find(p, end, ',');
+    const char *b = p, *e = comma;
+    while (b < e && isSpace(*b)) ++b;
+    while (e > b && isSpace(*(e - 1))) --e;
+    if (equalsIgnoreCase(b, e, token))
+      return true;
+    p = comma == end ? end : comma + 1;
+  }
+  return false;
+}
+
+// 最后一个 token，Transfer-Encoding 只认最后一个编码
+static bool lastTokenIs(const char *begin, const char *end, const char *token)
+{
+  const char *e = end;
+  while (e > begin && isSpace(*(e - 1))) --e;
+  const char *b = e;
+  while (b > begin && *(b - 1) != ',') --b;
+  while (b < e && isSpace(*b)) ++b;
+  return equalsIgnoreCase(b, e, token);
+}
+
+
+HttpParser::HttpParser(std::size_t max_header_size, std::size_t max_body_size) :
+  m_max_header_size(max_header_size), m_max_body_size(max_body_size)
+{
+  /* do nothing */
+}
+
+void HttpParser::reset()
+{
+  m_state = HeaderState;
+  m_scanned = 0;
+  m_off = 0;
+  m_remaining = 0;
+  m_error_code = 0;
+  m_request.clear();
+}
+
+HttpParser::Result HttpParser::parse(const char *data, std::size_t len, std::size_t *consumed)
+{
+  std::size_t off = m_off;
+  *consumed = 0;
+
+  while (true) {
+    switch (m_state) {
+    case HeaderState: {
+      // 上次查找到了末尾，"\r\n\r\n" 可能被截断在末尾的3个字节中
+      std::size_t from = m_scanned > 3 ? m_scanned - 3 : 0;
+      const char *end = simd_find(data + from, data + len, "\r\n\r\n", 4);
+      if (end == data + len) {
+        m_scanned = len;
+        if (len > m_max_header_size)
+          return fail(431);
+        return NeedMore;
+      }
+      std::size_t header_len = end - data + 4;
+      if (header_len > m_max_header_size)
+        return fail(431);
+      if (!parseHeader(data, header_len))
+        return fail(m_error_code);
+      off = header_len;
+      // 没有消息体
+      if (m_state == HeaderState) {
+        m_request.m_base = data;
+        *consumed = off;
+        return Complete;
+      }
+      break;
+    }
+
+    // 消息体整个到达之后才完成，消息体直接引用缓存中的数据
+    case BodyState:
+      if (len - off < m_remaining) {
+        m_off = off;
+        return NeedMore;
+      }
+      m_request.m_body = HttpRequest::Range{off, static_cast<std::size_t>(m_remaining)};
+      off += static_cast<std::size_t>(m_remaining);
+      m_remaining = 0;
+      m_state = HeaderState;
+      m_request.m_base = data;
+      *consumed = off;
+      return Complete;
+
+    case ChunkDataState: {
+      std::size_t take = static_cast<std::size_t>(std::min<uint64_t>(m_remaining, len - off));
+      m_request.m_chunked_body.append(data + off, take);
+      off += take;
+      m_remaining -= take;
+      if (m_remaining > 0) {
+        m_off = off;
+        return NeedMore;
+      }
+      m_state = ChunkCRLFState;
+      break;
+    }
+
+    case ChunkSizeState: {
+      const char *eol = simd_find_crlf(data + off, data + len);
+      if (eol == data + len) {
+        if (len - off > MAX_CHUNK_LINE)
+          return fail(400);
+        m_off = off;
+        return NeedMore;
+      }
+      // 块大小是十六进制数，后面可能跟着 ";扩展"，忽略扩展
+      uint64_t size = 0;
+      int digits = 0;
+      const char *p = data + off;
+      for (; p < eol; ++p) {
+        int v;
+        if (*p >= '0' && *p <= '9') v = *p - '0';
+        else if (*p >= 'a' && *p <= 'f') v = *p - 'a' + 10;
+        else if (*p >= 'A' && *p <= 'F') v = *p - 'A' + 10;
+        else break;
+        if (++digits > 15)
+          return fail(413);
+        size = (size << 4) | v;
+      }
+      if (digits == 0 || (p < eol && *p != ';' && !isSpace(*p)))
+        return fail(400);
+      off = eol - data + 2;
+      // 整个请求都留在缓存中，很小的块会让分块的开销远大于消息体本身，也要限制
+      if (off > m_max_header_size + 2 * m_max_body_size + MAX_CHUNK_LINE)
+        return fail(413);
+      if (size == 0) {
+        m_state = TrailerState;
+      }
+      else {
+        if (m_request.m_chunked_body.size() + size > m_max_body_size)
+          return fail(413);
+        m_remaining = size;
+        m_state = ChunkDataState;
+      }
+      break;
+    }
+
+    case ChunkCRLFState:
+      if (len - off < 2) {
+        m_off = off;
+        return NeedMore;
+      }
+      if (data[off] != '\r' || data[off + 1] != '\n')
+        return fail(400);
+      off += 2;
+      m_state = ChunkSizeState;
+      break;
+
+    case TrailerState: {
+      // 忽略尾部的头部，直到空行
+      const char *eol = simd_find_crlf(data + off, data + len);
+      if (eol == data + len) {
+        if (len - off > m_max_header_size)
+          return fail(431);
+        m_off = off;
+        return NeedMore;
+      }
+      bool empty_line = (eol == data + off);
+      off = eol - data + 2;
+      if (empty_line) {
+        m_state = HeaderState;
+        m_request.m_base = data;
+        *consumed = off;
+        return Complete;
+      }
+      break;
+    }
+    }
+  }
+}
+
+// 解析请求行，例如 "GET /index.html?a=1 HTTP/1.1"，data 是请求的起始位置
+bool HttpParser::parseRequestLine(const char *data, const char *end)
+{
+  const char *begin = data;
+  const char *sp1 = std::find(begin, end, ' ');
+  if (sp1 == begin || sp1 == end)
+    return false;
+  const char *sp2 = std::find(sp1 + 1, end, ' ');
+  if (sp2 == sp1 + 1 || sp2 == end)
+    return false;
+
+  for (const char *p = begin; p < sp1; ++p) {
+    if (*p < 'A' || *p > 'Z')
+      return false;
+  }
+  m_request.m_method = HttpRequest::Range{0, static_cast<std::size_t>(sp1 - data)};
+
+  const char *question = std::find(sp1 + 1, sp2, '?');
+  m_request.m_path = HttpRequest::Range{static_cast<std::size_t>(sp1 + 1 - data),
+                                        static_cast<std::size_t>(question - sp1 - 1)};
+  if (question != sp2)
+    m_request.m_query = HttpRequest::Range{static_cast<std::size_t>(question + 1 - data),
+                                           static_cast<std::size_t>(sp2 - question - 1)};
+
+  const char *version = sp2 + 1;
+  m_request.m_version = HttpRequest::Range{static_cast<std::size_t>(version - data),
+                                           static_cast<std::size_t>(end - version)};
+  if (end - version != 8 || (memcmp(version, "HTTP/1.1", 8) != 0 && memcmp(version, "HTTP/1.0", 8) != 0)) {
+    m_error_code = (end - version >= 5 && memcmp(version, "HTTP/", 5) == 0) ? 505 : 400;
+    return false;
+  }
+  return true;
+}
+
+/* 解析 [data, data+len) 中的请求行和头部，len 包括最后的空行
+ * 根据 Content-Length 和 Transfer-Encoding 决定接下来的状态 */
+bool HttpParser::parseHeader(const char *data, std::size_t len)
+{
+  m_error_code = 400;
+  const char *end = data + len - 2;   // 最后一个 "\r\n" 是空行
+  const char *eol = simd_find_crlf(data, end);
+  if (!parseRequestLine(data, eol))
+    return false;
+  bool http11 = memcmp(eol - 8, "HTTP/1.1", 8) == 0;
+
+  bool has_length = false, connection_close = false, connection_keep_alive = false;
+  uint64_t content_length = 0;
+  const char *line = eol + 2;
+  while (line < end) {
+    eol = simd_find_crlf(line, end);
+    // 不支持已经废弃的折行
+    if (isSpace(*line))
+      return false;
+    const char *colon = std::find(line, eol, ':');
+    if (colon == line || colon == eol)
+      return false;
+    for (const char *p = line; p < colon; ++p) {
+      if (isSpace(*p))
+        return false;
+    }
+    const char *vb = colon + 1, *ve = eol;
+    while (vb < ve && isSpace(*vb)) ++vb;
+    while (ve > vb && isSpace(*(ve - 1))) --ve;
+    m_request.m_headers.emplace_back(
+      HttpRequest::Range{static_cast<std::size_t>(line - data), static_cast<std::size_t>(colon - line)},
+      HttpRequest::Range{static_cast<std::size_t>(vb - data), static_cast<std::size_t>(ve - vb)});
+
+    if (equalsIgnoreCase(line, colon, "content-length")) {
+      if (vb == ve || ve - vb > 18)
+        return false;
+      uint64_t n = 0;
+      for (const char *p = vb; p < ve; ++p) {
+        if (*p < '0' || *p > '9')
+          return false;
+        n = n * 10 + (*p - '0');
+      }
+      // 多个不一致的 Content-Length 是请求走私的常见手段
+      if (has_length && n != content_length)
+        return false;
+      has_length = true;
+      content_length = n;
+    }
+    else if (equalsIgnoreCase(line, colon, "transfer-encoding")) {
+      if (!lastTokenIs(vb, ve, "chunked")) {
+        m_error_code = 501;
+        return false;
+      }
+      m_request.m_chunked = true;
+    }
+    else if (equalsIgnoreCase(line, colon, "connection")) {
+      connection_close = connection_close || hasToken(vb, ve, "close");
+      connection_keep_alive = connection_keep_alive || hasToken(vb, ve, "keep-alive");
+    }
+    line = eol + 2;
+  }
+
+  // 同时出现 Transfer-Encoding 和 Content-Length 时拒绝，避免和前端代理的理解不一致
+  if (m_request.m_chunked && has_length)
+    return false;
+
+  if (http11)
+    m_request.m_keep_alive = !connection_close;
+  else
+    m_request.m_keep_alive = connection_keep_alive && !connection_close;
+
+  if (m_request.m_chunked) {
+    m_state = ChunkSizeState;
+  }
+  else if (content_length > 0) {
+    if (content_length > m_max_body_size) {
+      m_error_code = 413;
+      return false;
+    }
+    m_remaining = content_length;
+    m_state = BodyState;
+  }
+  m_error_code = 0;
+  return true;
+}
+
+HttpParser::Result HttpParser::fail(int code)
+{
+  m_error_code = code;
+  return Error;
+}
@@ -0,0 +1,79 @@
+/* 增量式的HTTP请求解析器，直接在连接的接收缓存中解析，不完整的请求留在缓存中等待更多数据 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is an internal header file, you should not include this.
+
+#ifndef ZEST_NET_HTTP_HTTP_PARSER_H
+#define ZEST_NET_HTTP_HTTP_PARSER_H
+
+#include <stdint.h>
+
+#include <cstddef>
+
+#include "zest/net/http/http_request.h"
+
+namespace zest
+{
+namespace net
+{
+namespace http
+{
+
+class HttpParser
+{
+ public:
+  enum Result {
+    NeedMore = 0,    // 数据不够，等待更多数据
+    Complete = 1,    // 解析出一个完整的请求
+    Error = 2,       // 请求格式错误，errorCode() 是应当返回的状态码
+  };
+
+  HttpParser(std::size_t max_header_size, std::size_t max_body_size);
+
+  /* 解析 [data, data+len)，data 必须指向当前请求的起始位置
+   * 请求完整之前不消耗任何数据，请求留在缓存中，解析出的各部分只记录位置，不拷贝
+   * 返回 Complete 时 *consumed 为整个请求的字节数，调用处理函数之后才能从缓存中丢弃
+   * 已经处理过的部分（查找过的头部、解析过的块）会被记住，下次不再重复处理 */
+  Result parse(const char *data, std::size_t len, std::size_t *consumed);
+
+  // 解析出的请求，在下一次 parse() 之前、缓存中的数据被丢弃之前有效
+  HttpRequest &request() {return m_request;}
+
+  // 开始解析下一个请求
+  void reset();
+
+  int errorCode() const {return m_error_code;}
+
+ private:
+  enum State {
+    HeaderState,
+    BodyState,
+    ChunkSizeState,
+    ChunkDataState,
+    ChunkCRLFState,
+    TrailerState,
+  };
+
+  bool parseHeader(const char *data, std::size_t len);
+  bool parseRequestLine(const char *begin, const char *end);
+  Result fail(int code);
+
+ private:
+  std::size_t m_max_header_size;
+  std::size_t m_max_body_size;
+
+  State m_state {HeaderState};
+  std::size_t m_scanned {0};     // 已经查找过 "\r\n\r\n" 的字节数
+  std::size_t m_off {0};         // 当前请求已经处理过的字节数
+  uint64_t m_remaining {0};      // 消息体或者当前块还没有处理的字节数
+  int m_error_code {0};
+  HttpRequest m_request;
+};
+
+} // namespace http
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_HTTP_HTTP_PARSER_H
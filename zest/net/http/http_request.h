@@ -0,0 +1,149 @@
+/* HTTP请求，由 HttpParser 在接收缓存中解析得到 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_HTTP_HTTP_REQUEST_H
+#define ZEST_NET_HTTP_HTTP_REQUEST_H
+
+#include <string.h>
+#include <strings.h>
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace zest
+{
+namespace net
+{
+namespace http
+{
+
+class HttpParser;
+
+/* 请求行、头部和消息体都不拷贝，只记录它们在接收缓存中的位置
+ * 只在处理函数执行期间有效，需要保留的部分用 str() 拷贝出来 */
+class HttpRequest
+{
+  friend class HttpParser;
+ public:
+  // 接收缓存中的一段数据
+  struct Field
+  {
+    const char *data;
+    std::size_t len;
+
+    std::string str() const {return std::string(data, len);}
+
+    bool empty() const {return len == 0;}
+
+    std::size_t size() const {return len;}
+
+    bool equals(const char *s, std::size_t n) const {return n == len && memcmp(data, s, n) == 0;}
+
+    bool equalsIgnoreCase(const char *s) const
+    {
+      return strlen(s) == len && strncasecmp(data, s, len) == 0;
+    }
+
+    friend bool operator==(const Field &f, const char *s) {return f.equals(s, strlen(s));}
+    friend bool operator!=(const Field &f, const char *s) {return !f.equals(s, strlen(s));}
+  };
+
+  Field method() const {return field(m_method);}
+
+  // 不包括查询字符串的路径，例如 "/index.html"
+  Field path() const {return field(m_path);}
+
+  // '?' 之后的部分，没有时为空
+  Field query() const {return field(m_query);}
+
+  // "HTTP/1.0" 或 "HTTP/1.1"
+  Field version() const {return field(m_version);}
+
+  // 按名称查找头部（不区分大小写），找不到时返回空的 Field
+  Field header(const char *name) const
+  {
+    std::size_t len = strlen(name);
+    for (const auto &h : m_headers) {
+      if (h.first.m_len == len && strncasecmp(m_base + h.first.m_off, name, len) == 0)
+        return field(h.second);
+    }
+    return Field{"", 0};
+  }
+
+  Field header(const std::string &name) const {return header(name.c_str());}
+
+  bool hasHeader(const char *name) const
+  {
+    std::size_t len = strlen(name);
+    for (const auto &h : m_headers) {
+      if (h.first.m_len == len && strncasecmp(m_base + h.first.m_off, name, len) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  // 按出现的顺序访问所有头部
+  std::size_t headerCount() const {return m_headers.size();}
+  Field headerName(std::size_t i) const {return field(m_headers[i].first);}
+  Field headerValue(std::size_t i) const {return field(m_headers[i].second);}
+
+  // 消息体，分块传输的请求已经把所有的块拼接在一起
+  Field body() const
+  {
+    if (m_chunked)
+      return Field{m_chunked_body.data(), m_chunked_body.size()};
+    return field(m_body);
+  }
+
+  // 响应之后是否保持连接
+  bool keepAlive() const {return m_keep_alive;}
+
+  bool isChunked() const {return m_chunked;}
+
+ private:
+  // 相对于请求起始位置的偏移，缓存在请求完整之前可能移动，所以不能直接保存指针
+  struct Range
+  {
+    std::size_t m_off;
+    std::size_t m_len;
+  };
+
+  Field field(const Range &r) const
+  {
+    return r.m_len == 0 ? Field{"", 0} : Field{m_base + r.m_off, r.m_len};
+  }
+
+  void clear()
+  {
+    m_base = nullptr;
+    m_method = m_path = m_query = m_version = m_body = Range{0, 0};
+    m_headers.clear();
+    m_chunked_body.clear();
+    m_keep_alive = true;
+    m_chunked = false;
+  }
+
+ private:
+  const char *m_base {nullptr};     // 请求在接收缓存中的起始位置，解析完成时设置
+  Range m_method {0, 0};
+  Range m_path {0, 0};
+  Range m_query {0, 0};
+  Range m_version {0, 0};
+  std::vector<std::pair<Range, Range>> m_headers;
+  Range m_body {0, 0};              // Content-Length 的消息体
+  std::string m_chunked_body;       // 分块传输的消息体不连续，只能拼接出一份
+  bool m_keep_alive {true};
+  bool m_chunked {false};
+};
+
+} // namespace http
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_HTTP_HTTP_REQUEST_H
@@ -0,0 +1,261 @@
+/* HTTP响应，可以在处理请求的回调函数中直接发送，也可以拷贝到其它线程中异步发送
+ * 同一个连接上的流水线请求，无论响应以什么顺序完成，都按请求的顺序发送 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/http/http_response.h"
+
+#include <stdio.h>
+
+#include <utility>
+#include <vector>
+
+#include "zest/base/logging.h"
+#include "zest/net/http/http_session.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::http;
+
+// 不超过这个大小的消息体和头部拷贝到同一个数据片中，更大的消息体单独作为一个数据片，不拷贝
+static const std::size_t INLINE_BODY_SIZE = 4096;
+
+
+struct HttpResponse::State
+{
+  State(std::weak_ptr<HttpSession> session, uint64_t seq, bool keep_alive, bool http10, bool head)
+    : m_session(session), m_seq(seq), m_keep_alive(keep_alive), m_http10(http10), m_head(head)
+  { /* do nothing */ }
+
+  // 处理函数既没有发送也没有保留响应，自动结束，否则后面的流水线请求永远得不到响应
+  ~State()
+  {
+    if (m_finished)
+      return;
+    if (!m_headers_sent) {
+      LOG_ERROR << "HTTP response dropped without being sent, reply 500";
+      m_code = 500;
+      m_reason.clear();
+      m_headers.clear();
+      m_body = Slice();
+      m_keep_alive = false;
+      deliver({Slice(buildHead(false))}, true);
+    }
+    else {
+      // 分块发送到一半，不能假装正常结束，只能关闭连接
+      LOG_ERROR << "chunked HTTP response dropped without end(), close connection";
+      m_keep_alive = false;
+      deliver({}, true);
+    }
+  }
+
+  std::string buildHead(bool chunked)
+  {
+    std::string head;
+    head.reserve(128 + m_headers.size());
+    head += "HTTP/1.1 ";
+    head += std::to_string(m_code);
+    head += ' ';
+    head += m_reason.empty() ? statusReason(m_code) : m_reason;
+    head += "\r\n";
+    head += m_headers;
+    if (chunked) {
+      // HTTP/1.0 不支持分块传输，以关闭连接表示响应结束
+      if (m_http10)
+        m_keep_alive = false;
+      else
+        head += "Transfer-Encoding: chunked\r\n";
+    }
+    else {
+      head += "Content-Length: ";
+      head += std::to_string(m_body.size());
+      head += "\r\n";
+    }
+    if (!m_keep_alive)
+      head += "Connection: close\r\n";
+    else if (m_http10)
+      head += "Connection: keep-alive\r\n";
+    head += "\r\n";
+    return head;
+  }
+
+  void deliver(std::vector<Slice> data, bool done)
+  {
+    HttpSession::s_ptr session = m_session.lock();
+    if (session)
+      session->deliver(m_seq, std::move(data), done, done && !m_keep_alive);
+  }
+
+  std::weak_ptr<HttpSession> m_session;
+  uint64_t m_seq;
+  bool m_keep_alive;
+  bool m_http10;
+  bool m_head;            // HEAD 请求的响应没有消息体
+
+  int m_code {200};
+  std::string m_reason;
+  std::string m_headers;  // 用户添加的头部，已经是 "Name: value\r\n" 的格式
+  Slice m_body;
+  bool m_headers_sent {false};
+  bool m_finished {false};
+};
+
+
+HttpResponse::HttpResponse(std::weak_ptr<HttpSession> session, uint64_t seq, bool keep_alive, bool http10, bool head) :
+  m_state(std::make_shared<State>(session, seq, keep_alive, http10, head))
+{
+  /* do nothing */
+}
+
+void HttpResponse::setStatus(int code, const std::string &reason /*=""*/)
+{
+  m_state->m_code = code;
+  m_state->m_reason = reason;
+}
+
+void HttpResponse::setHeader(const std::string &name, const std::string &value)
+{
+  m_state->m_headers += name;
+  m_state->m_headers += ": ";
+  m_state->m_headers += value;
+  m_state->m_headers += "\r\n";
+}
+
+void HttpResponse::setBody(const std::string &body)
+{
+  m_state->m_body = Slice(body);
+}
+
+void HttpResponse::setBody(std::string &&body)
+{
+  m_state->m_body = Slice(std::move(body));
+}
+
+void HttpResponse::setBody(const Slice &body)
+{
+  m_state->m_body = body;
+}
+
+void HttpResponse::setCloseConnection()
+{
+  m_state->m_keep_alive = false;
+}
+
+void HttpResponse::send()
+{
+  State &st = *m_state;
+  if (st.m_finished || st.m_headers_sent) {
+    LOG_ERROR << "HTTP response has already been sent";
+    return;
+  }
+  st.m_headers_sent = true;
+  st.m_finished = true;
+
+  std::string head = st.buildHead(false);
+  if (st.m_head || st.m_body.empty()) {
+    st.deliver({Slice(std::move(head))}, true);
+  }
+  else if (st.m_body.size() <= INLINE_BODY_SIZE) {
+    head.append(st.m_body.data(), st.m_body.size());
+    st.deliver({Slice(std::move(head))}, true);
+  }
+  else {
+    st.deliver({Slice(std::move(head)), st.m_body}, true);
+  }
+  st.m_body = Slice();
+}
+
+void HttpResponse::write(const std::string &chunk)
+{
+  write(Slice(chunk));
+}
+
+void HttpResponse::write(const Slice &chunk)
+{
+  State &st = *m_state;
+  if (st.m_finished) {
+    LOG_ERROR << "write to a finished HTTP response";
+    return;
+  }
+  std::vector<Slice> data;
+  if (!st.m_headers_sent) {
+    st.m_headers_sent = true;
+    data.push_back(Slice(st.buildHead(true)));
+  }
+  // 空的块表示结束，不能发送
+  if (!st.m_head && !chunk.empty()) {
+    if (st.m_http10) {
+      data.push_back(chunk);
+    }
+    else {
+      char size_line[24];
+      int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", chunk.size());
+      if (chunk.size() <= INLINE_BODY_SIZE) {
+        std::string frame(size_line, n);
+        frame.append(chunk.data(), chunk.size());
+        frame += "\r\n";
+        data.push_back(Slice(std::move(frame)));
+      }
+      else {
+        data.push_back(Slice(size_line, n));
+        data.push_back(chunk);
+        data.push_back(Slice("\r\n", 2));
+      }
+    }
+  }
+  if (!data.empty())
+    st.deliver(std::move(data), false);
+}
+
+void HttpResponse::end()
+{
+  State &st = *m_state;
+  if (st.m_finished)
+    return;
+  std::vector<Slice> data;
+  if (!st.m_headers_sent) {
+    st.m_headers_sent = true;
+    data.push_back(Slice(st.buildHead(true)));
+  }
+  if (!st.m_head && !st.m_http10)
+    data.push_back(Slice("0\r\n\r\n", 5));
+  st.m_finished = true;
+  st.deliver(std::move(data), true);
+}
+
+bool HttpResponse::finished() const
+{
+  return m_state->m_finished;
+}
+
+const char *zest::net::http::statusReason(int code)
+{
+  switch (code) {
+  case 100: return "Continue";
+  case 101: return "Switching Protocols";
+  case 200: return "OK";
+  case 201: return "Created";
+  case 202: return "Accepted";
+  case 204: return "No Content";
+  case 206: return "Partial Content";
+  case 301: return "Moved Permanently";
+  case 302: return "Found";
+  case 304: return "Not Modified";
+  case 400: return "Bad Request";
+  case 401: return "Unauthorized";
+  case 403: return "Forbidden";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 408: return "Request Timeout";
+  case 413: return "Payload Too Large";
+  case 426: return "Upgrade Required";
+  case 431: return "Request Header Fields Too Large";
+  case 500: return "Internal Server Error";
+  case 501: return "Not Implemented";
+  case 502: return "Bad Gateway";
+  case 503: return "Service Unavailable";
+  case 505: return "HTTP Version Not Supported";
+  default:  return "Unknown";
+  }
+}
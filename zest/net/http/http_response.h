@@ -0,0 +1,77 @@
+/* HTTP响应，可以在处理请求的回调函数中直接发送，也可以拷贝到其它线程中异步发送
+ * 同一个连接上的流水线请求，无论响应以什么顺序完成，都按请求的顺序发送 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_HTTP_HTTP_RESPONSE_H
+#define ZEST_NET_HTTP_HTTP_RESPONSE_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "zest/net/slice.h"
+
+namespace zest
+{
+namespace net
+{
+namespace http
+{
+
+class HttpSession;
+
+/* HttpResponse 只是一个句柄，拷贝之后指向同一个响应，可以把它交给其它线程，
+ * 但同一时刻只能有一个线程使用它
+ * 两种发送方式：
+ *   1. setBody() + send()，带 Content-Length 的完整响应
+ *   2. write() 若干次 + end()，分块传输（HTTP/1.0 的客户端改为发送完关闭连接）
+ * 最后一个句柄析构时如果响应还没有发送，会自动回复 500，避免阻塞后面的流水线请求 */
+class HttpResponse
+{
+ public:
+  HttpResponse(std::weak_ptr<HttpSession> session, uint64_t seq, bool keep_alive, bool http10, bool head);
+
+  // 默认是 200 OK，reason 为空时使用状态码对应的标准短语
+  void setStatus(int code, const std::string &reason = "");
+
+  // 添加一个头部，Content-Length、Transfer-Encoding 和 Connection 由框架生成
+  void setHeader(const std::string &name, const std::string &value);
+
+  void setBody(const std::string &body);
+  void setBody(std::string &&body);
+  void setBody(const Slice &body);          // 共享的消息体，不拷贝
+
+  // 响应之后关闭连接
+  void setCloseConnection();
+
+  // 发送完整的响应
+  void send();
+
+  // 分块发送，第一次调用时发送头部
+  void write(const std::string &chunk);
+  void write(const Slice &chunk);
+
+  // 结束分块发送
+  void end();
+
+  // 是否已经发送完毕
+  bool finished() const;
+
+ private:
+  struct State;
+  std::shared_ptr<State> m_state;
+};
+
+// 状态码对应的标准短语，例如 404 -> "Not Found"
+const char *statusReason(int code);
+
+} // namespace http
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_HTTP_HTTP_RESPONSE_H
@@ -0,0 +1,85 @@
+/* 基于 TcpServer 的 HTTP/1.1 服务器，支持长连接、流水线请求和分块传输 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/http/http_server.h"
+
+#include <memory>
+
+#include "zest/net/http/http_session.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::http;
+using std::placeholders::_1;
+using std::placeholders::_2;
+
+// 连接上下文中保存 HttpSession 的槽位
+static const ContextSlot<HttpSession::s_ptr> HTTP_SESSION_SLOT;
+
+
+HttpServer::HttpServer(NetBaseAddress &local_addr, int thread_nums /*=4*/) :
+  m_server(local_addr, thread_nums),
+  m_max_header_size(DEFAULT_MAX_HEADER_SIZE), m_max_body_size(DEFAULT_MAX_BODY_SIZE)
+{
+  m_server.setOnConnectionCallback(std::bind(&HttpServer::onConnection, this, _1));
+  m_server.setMessageCallback(std::bind(&HttpServer::onMessage, this, _1));
+  m_server.setWriteCompleteCallback(std::bind(&HttpServer::onWriteComplete, this, _1));
+  m_server.setCloseCallback(std::bind(&HttpServer::onClose, this, _1));
+}
+
+void HttpServer::handle(const std::string &path, const HttpCallback &cb)
+{
+  m_routes[path] = cb;
+}
+
+void HttpServer::start()
+{
+  m_server.start();
+}
+
+void HttpServer::onConnection(TcpConnection &conn)
+{
+  HttpSession::s_ptr session = std::make_shared<HttpSession>(
+    conn, std::bind(&HttpServer::dispatch, this, _1, _2), m_max_header_size, m_max_body_size);
+  conn.Put(HTTP_SESSION_SLOT, session);
+  conn.waitForMessage();
+}
+
+void HttpServer::onMessage(TcpConnection &conn)
+{
+  HttpSession::s_ptr *session = conn.Get(HTTP_SESSION_SLOT);
+  if (session)
+    (*session)->onMessage();
+}
+
+// 大的响应发送时改为监听可写事件，发完之后重新监听可读事件
+void HttpServer::onWriteComplete(TcpConnection &conn)
+{
+  conn.waitForMessage();
+}
+
+void HttpServer::onClose(TcpConnection &conn)
+{
+  HttpSession::s_ptr *session = conn.Get(HTTP_SESSION_SLOT);
+  if (session)
+    (*session)->onClose();
+}
+
+void HttpServer::dispatch(const HttpRequest &req, HttpResponse &resp)
+{
+  auto it = m_routes.find(req.path().str());
+  if (it != m_routes.end()) {
+    it->second(req, resp);
+  }
+  else if (m_default_callback) {
+    m_default_callback(req, resp);
+  }
+  else {
+    resp.setStatus(404);
+    resp.setHeader("Content-Type", "text/plain");
+    resp.setBody("Not Found\n");
+    resp.send();
+  }
+}
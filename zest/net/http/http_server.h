@@ -0,0 +1,75 @@
+/* 基于 TcpServer 的 HTTP/1.1 服务器，支持长连接、流水线请求和分块传输 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_HTTP_HTTP_SERVER_H
+#define ZEST_NET_HTTP_HTTP_SERVER_H
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/base_addr.h"
+#include "zest/net/http/http_request.h"
+#include "zest/net/http/http_response.h"
+#include "zest/net/tcp_server.h"
+
+namespace zest
+{
+namespace net
+{
+namespace http
+{
+
+/* 处理函数在连接所属的IO线程中调用，可以直接发送响应，
+ * 也可以拷贝 HttpResponse（以及需要的请求内容）交给其它线程，稍后再发送
+ * req 只在处理函数执行期间有效 */
+class HttpServer : public noncopyable
+{
+ public:
+  using HttpCallback = std::function<void(const HttpRequest&, HttpResponse&)>;
+
+  static const std::size_t DEFAULT_MAX_HEADER_SIZE = 8 * 1024;
+  static const std::size_t DEFAULT_MAX_BODY_SIZE = 8 * 1024 * 1024;
+
+  explicit HttpServer(NetBaseAddress &local_addr, int thread_nums = 4);
+
+  // 为路径注册处理函数（精确匹配），必须在 start() 之前调用
+  void handle(const std::string &path, const HttpCallback &cb);
+
+  // 没有匹配的路径时调用，默认回复 404
+  void setDefaultCallback(const HttpCallback &cb) { m_default_callback = cb; }
+
+  // 请求头和消息体的大小上限，超出时分别回复 431 和 413 并关闭连接
+  void setMaxHeaderSize(std::size_t bytes) { m_max_header_size = bytes; }
+  void setMaxBodySize(std::size_t bytes) { m_max_body_size = bytes; }
+
+  // 底层的 TcpServer，用于设置内存预算、查看统计数据等
+  TcpServer &tcpServer() { return m_server; }
+
+  void start();
+
+ private:
+  void onConnection(TcpConnection &conn);
+  void onMessage(TcpConnection &conn);
+  void onWriteComplete(TcpConnection &conn);
+  void onClose(TcpConnection &conn);
+  void dispatch(const HttpRequest &req, HttpResponse &resp);
+
+ private:
+  TcpServer m_server;
+  std::unordered_map<std::string, HttpCallback> m_routes;
+  HttpCallback m_default_callback {nullptr};
+  std::size_t m_max_header_size;
+  std::size_t m_max_body_size;
+};
+
+} // namespace http
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_HTTP_HTTP_SERVER_H
@@ -0,0 +1,140 @@
+/* 一个HTTP连接的状态：解析请求，按请求的顺序发送响应 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/http/http_session.h"
+
+#include <string>
+#include <utility>
+
+#include "zest/base/logging.h"
+#include "zest/net/eventloop.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::http;
+
+
+HttpSession::HttpSession(TcpConnection &conn, const HttpCallback &dispatch,
+                         std::size_t max_header_size, std::size_t max_body_size) :
+  m_conn(&conn), m_eventloop(conn.getEventLoop()), m_dispatch(dispatch),
+  m_parser(max_header_size, max_body_size)
+{
+  /* do nothing */
+}
+
+/* 依次解析接收缓存中的请求并交给处理函数，流水线发来的多个请求在一次读取中全部处理
+ * 请求在完整之前一直留在接收缓存中，解析器记住已经处理过的位置；
+ * 请求只引用缓存中的数据，所有处理函数返回之后才丢弃这些数据 */
+void HttpSession::onMessage()
+{
+  if (m_closing) {
+    m_conn->clearData();
+    return;
+  }
+
+  const char *data = m_conn->peek();
+  std::size_t size = m_conn->dataSize();
+  std::size_t offset = 0;
+
+  while (!m_closing && offset < size) {
+    std::size_t consumed = 0;
+    HttpParser::Result res = m_parser.parse(data + offset, size - offset, &consumed);
+    offset += consumed;
+    if (res == HttpParser::NeedMore)
+      break;
+    if (res == HttpParser::Error) {
+      LOG_DEBUG << "bad HTTP request from " << m_conn->peerAddress().to_string() << ", status " << m_parser.errorCode();
+      replyError(m_parser.errorCode());
+      offset = size;
+      break;
+    }
+
+    const HttpRequest &req = m_parser.request();
+    if (!req.keepAlive())
+      m_closing = true;
+    HttpResponse resp(shared_from_this(), m_next_seq++, req.keepAlive(),
+                      req.version() == "HTTP/1.0", req.method() == "HEAD");
+    m_dispatch(req, resp);
+    m_parser.reset();
+    // 处理函数中断开了连接
+    if (m_closed)
+      return;
+  }
+
+  if (offset == size)
+    m_conn->clearData();
+  else if (offset > 0)
+    m_conn->clearBytesData(offset);
+}
+
+void HttpSession::onClose()
+{
+  m_closed = true;
+  m_pending.clear();
+}
+
+void HttpSession::deliver(uint64_t seq, std::vector<Slice> data, bool done, bool close)
+{
+  s_ptr self = shared_from_this();
+  m_eventloop->runInLoop([self, seq, data, done, close]() mutable {
+    self->deliverInLoop(seq, data, done, close);
+  });
+}
+
+// 轮到这个响应时直接交给连接发送，否则先保存起来，等前面的响应全部发完
+void HttpSession::deliverInLoop(uint64_t seq, std::vector<Slice> &data, bool done, bool close)
+{
+  if (m_closed)
+    return;
+  if (seq != m_send_seq) {
+    Pending &pending = m_pending[seq];
+    for (auto &slice : data)
+      pending.m_data.push_back(std::move(slice));
+    pending.m_done = done;
+    pending.m_close = pending.m_close || close;
+    return;
+  }
+
+  for (const auto &slice : data)
+    m_conn->send(slice);
+  if (done)
+    finishResponse(close);
+}
+
+// 当前的响应发送完毕，接着发送已经完成的后续响应
+void HttpSession::finishResponse(bool close)
+{
+  while (true) {
+    ++m_send_seq;
+    if (close) {
+      m_closing = true;
+      m_pending.clear();
+      m_conn->shutdown();   // 发送队列清空后才会真正半关闭
+      return;
+    }
+
+    auto it = m_pending.find(m_send_seq);
+    if (it == m_pending.end())
+      return;
+    for (const auto &slice : it->second.m_data)
+      m_conn->send(slice);
+    if (!it->second.m_done) {
+      it->second.m_data.clear();
+      return;
+    }
+    close = it->second.m_close;
+    m_pending.erase(it);
+  }
+}
+
+// 请求格式错误，回复错误码并关闭连接
+void HttpSession::replyError(int code)
+{
+  m_closing = true;
+  std::string head = "HTTP/1.1 " + std::to_string(code) + " " + statusReason(code) +
+                     "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  std::vector<Slice> data {Slice(std::move(head))};
+  deliverInLoop(m_next_seq++, data, true, true);
+}
@@ -0,0 +1,85 @@
+/* 一个HTTP连接的状态：解析请求，按请求的顺序发送响应 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is an internal header file, you should not include this.
+
+#ifndef ZEST_NET_HTTP_HTTP_SESSION_H
+#define ZEST_NET_HTTP_HTTP_SESSION_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "zest/net/http/http_parser.h"
+#include "zest/net/http/http_request.h"
+#include "zest/net/http/http_response.h"
+#include "zest/net/slice.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+
+namespace http
+{
+
+/* HttpSession 保存在 TcpConnection 的上下文中，和连接一起销毁
+ * HttpResponse 只持有它的弱引用，连接断开后再发送的响应会被丢弃
+ * 所有成员都只在连接所属的IO线程中访问，其它线程通过 deliver() 把数据转交过来 */
+class HttpSession : public std::enable_shared_from_this<HttpSession>
+{
+ public:
+  using s_ptr = std::shared_ptr<HttpSession>;
+  using HttpCallback = std::function<void(const HttpRequest&, HttpResponse&)>;
+
+  HttpSession(TcpConnection &conn, const HttpCallback &dispatch,
+              std::size_t max_header_size, std::size_t max_body_size);
+
+  // 连接的消息回调，处理接收缓存中所有完整的请求
+  void onMessage();
+
+  // 连接断开，之后不再访问 TcpConnection
+  void onClose();
+
+  /* 第 seq 个请求的响应数据，done 表示这个响应结束，close 表示之后关闭连接
+   * 可以在任意线程调用 */
+  void deliver(uint64_t seq, std::vector<Slice> data, bool done, bool close);
+
+ private:
+  struct Pending
+  {
+    std::vector<Slice> m_data;
+    bool m_done {false};
+    bool m_close {false};
+  };
+
+  void deliverInLoop(uint64_t seq, std::vector<Slice> &data, bool done, bool close);
+  void finishResponse(bool close);
+  void replyError(int code);
+
+ private:
+  TcpConnection *m_conn;
+  std::shared_ptr<EventLoop> m_eventloop;
+  HttpCallback m_dispatch;
+  HttpParser m_parser;
+
+  bool m_closed {false};           // 连接已经断开
+  bool m_closing {false};          // 不再处理后续的请求，最后一个响应发完后关闭连接
+  uint64_t m_next_seq {0};         // 下一个请求的序号
+  uint64_t m_send_seq {0};         // 正在发送的响应的序号
+  std::map<uint64_t, Pending> m_pending;   // 提前完成、等待前面的响应发完的响应
+};
+
+} // namespace http
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_HTTP_HTTP_SESSION_H
@@ -0,0 +1,172 @@
+/* 长度前缀的分帧编解码器，每一帧由长度字段和消息体组成
+ * 长度字段可以是固定的2/4/8字节（大端或小端），也可以是 varint */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/length_codec.h"
+
+#include <utility>
+
+#include "zest/base/logging.h"
+
+using namespace zest;
+using namespace zest::net;
+
+// 不完整的帧至少有这么大时，才用 setMinReadBytes 让内核攒够整帧再唤醒
+static const std::size_t LARGE_FRAME_HINT = 64 * 1024;
+
+
+LengthCodec::LengthCodec(LengthType type /*=Fixed32*/, bool big_endian /*=true*/,
+                         std::size_t max_frame_size /*=DEFAULT_MAX_FRAME_SIZE*/) :
+  m_type(type), m_big_endian(big_endian), m_max_frame_size(max_frame_size)
+{
+  /* do nothing */
+}
+
+/* 依次处理接收缓存中所有完整的帧，回调函数拿到的是指向接收缓存的指针，
+ * 所以回调函数中不能修改接收缓存（clearData 等），全部处理完之后统一丢弃 */
+void LengthCodec::onMessage(TcpConnection &conn)
+{
+  const char *begin = conn.peek();
+  std::size_t size = conn.dataSize();
+  std::size_t offset = 0;
+  std::size_t need = 0;   // 下一个不完整的帧需要的字节数
+
+  while (offset < size) {
+    uint64_t len = 0;
+    int header = decodeHeader(begin + offset, size - offset, &len);
+    if (header < 0 || len > m_max_frame_size) {
+      handleError(conn, len);
+      return;
+    }
+    if (header == 0)
+      break;
+    if (size - offset - header < len) {
+      need = header + len;
+      break;
+    }
+    if (m_frame_callback)
+      m_frame_callback(conn, begin + offset + header, len);
+    offset += header + len;
+    // 回调函数中断开了连接
+    if (conn.getState() != Connected && conn.getState() != HalfClosing)
+      return;
+  }
+
+  if (offset == size)
+    conn.clearData();
+  else if (offset > 0)
+    conn.clearBytesData(offset);
+
+  // 大帧只收到了一部分，等内核攒够了再唤醒，避免每个TCP分段都解析一次帧头
+  conn.setMinReadBytes(need >= LARGE_FRAME_HINT ? need : 0);
+}
+
+bool LengthCodec::send(TcpConnection &conn, const char *data, std::size_t len) const
+{
+  if (len > m_max_frame_size) {
+    LOG_ERROR << "frame too large to send, len = " << len << ", max = " << m_max_frame_size;
+    return false;
+  }
+  SliceBuilder builder(MAX_HEADER_SIZE, len);
+  builder.append(data, len);
+  return send(conn, std::move(builder));
+}
+
+bool LengthCodec::send(TcpConnection &conn, const std::string &msg) const
+{
+  return send(conn, msg.data(), msg.size());
+}
+
+bool LengthCodec::send(TcpConnection &conn, const Slice &payload) const
+{
+  char header[MAX_HEADER_SIZE];
+  std::size_t header_len = payload.size() <= m_max_frame_size ? encodeHeader(header, payload.size()) : 0;
+  if (header_len == 0) {
+    LOG_ERROR << "frame too large to send, len = " << payload.size() << ", max = " << m_max_frame_size;
+    return false;
+  }
+  conn.send(Slice(header, header_len), payload);
+  return true;
+}
+
+bool LengthCodec::send(TcpConnection &conn, SliceBuilder &&builder) const
+{
+  char header[MAX_HEADER_SIZE];
+  std::size_t header_len = builder.size() <= m_max_frame_size ? encodeHeader(header, builder.size()) : 0;
+  if (header_len == 0) {
+    LOG_ERROR << "frame too large to send, len = " << builder.size() << ", max = " << m_max_frame_size;
+    return false;
+  }
+  builder.prepend(header, header_len);
+  conn.send(std::move(builder));
+  return true;
+}
+
+std::size_t LengthCodec::encodeHeader(char *buf, uint64_t len) const
+{
+  if (m_type == Varint) {
+    std::size_t n = 0;
+    while (len >= 0x80) {
+      buf[n++] = static_cast<char>((len & 0x7f) | 0x80);
+      len >>= 7;
+    }
+    buf[n++] = static_cast<char>(len);
+    return n;
+  }
+
+  std::size_t n = static_cast<std::size_t>(m_type);
+  if (n < 8 && (len >> (8 * n)) != 0)
+    return 0;   // 长度字段放不下
+  for (std::size_t i = 0; i < n; ++i) {
+    char byte = static_cast<char>(len >> (8 * i));
+    if (m_big_endian)
+      buf[n - 1 - i] = byte;
+    else
+      buf[i] = byte;
+  }
+  return n;
+}
+
+int LengthCodec::decodeHeader(const char *data, std::size_t n, uint64_t *len) const
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+  uint64_t value = 0;
+
+  if (m_type == Varint) {
+    for (std::size_t i = 0; i < n && i < MAX_HEADER_SIZE; ++i) {
+      // 第10个字节只能是最高位，否则超出了 uint64_t 的范围
+      if (i == MAX_HEADER_SIZE - 1 && p[i] > 1)
+        return -1;
+      value |= static_cast<uint64_t>(p[i] & 0x7f) << (7 * i);
+      if ((p[i] & 0x80) == 0) {
+        *len = value;
+        return static_cast<int>(i + 1);
+      }
+    }
+    return n >= MAX_HEADER_SIZE ? -1 : 0;
+  }
+
+  std::size_t size = static_cast<std::size_t>(m_type);
+  if (n < size)
+    return 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    if (m_big_endian)
+      value = (value << 8) | p[i];
+    else
+      value |= static_cast<uint64_t>(p[i]) << (8 * i);
+  }
+  *len = value;
+  return static_cast<int>(size);
+}
+
+void LengthCodec::handleError(TcpConnection &conn, uint64_t len)
+{
+  LOG_ERROR << "invalid frame from " << conn.peerAddress().to_string() << ", len = " << len
+            << ", max = " << m_max_frame_size;
+  if (m_error_callback)
+    m_error_callback(conn);
+  else
+    conn.close();
+}
@@ -0,0 +1,99 @@
+/* 长度前缀的分帧编解码器，每一帧由长度字段和消息体组成
+ * 长度字段可以是固定的2/4/8字节（大端或小端），也可以是 varint */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_LENGTH_CODEC_H
+#define ZEST_NET_LENGTH_CODEC_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+
+#include "zest/net/slice.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+/* 编解码器不保存任何连接的状态，不完整的帧留在连接的接收缓存中，
+ * 因此一个编解码器可以被所有连接共享，用法：
+ *   LengthCodec codec(LengthCodec::Fixed32);
+ *   codec.setFrameCallback(onFrame);
+ *   server.setMessageCallback(std::bind(&LengthCodec::onMessage, &codec, std::placeholders::_1));
+ * 一次读取中收到的所有完整帧都会依次交给 onFrame，最后一次性从接收缓存中丢弃 */
+class LengthCodec
+{
+ public:
+  // 长度字段的格式，枚举值是固定长度字段的字节数
+  enum LengthType {
+    Varint = 0,
+    Fixed16 = 2,
+    Fixed32 = 4,
+    Fixed64 = 8,
+  };
+
+  // 长度字段最多占用的字节数（varint 编码的 uint64_t）
+  static const std::size_t MAX_HEADER_SIZE = 10;
+
+  static const std::size_t DEFAULT_MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+  /* 收到一个完整的帧，data 直接指向接收缓存，不发生拷贝
+   * 只在回调函数执行期间有效，需要保留数据时自行拷贝 */
+  using FrameCallback = std::function<void(TcpConnection&, const char *data, std::size_t len)>;
+  // 收到非法的帧（长度超过上限或者 varint 格式错误），默认的处理是断开连接
+  using ErrorCallback = std::function<void(TcpConnection&)>;
+
+  explicit LengthCodec(LengthType type = Fixed32, bool big_endian = true,
+                       std::size_t max_frame_size = DEFAULT_MAX_FRAME_SIZE);
+
+  void setFrameCallback(const FrameCallback &cb) { m_frame_callback = cb; }
+
+  void setErrorCallback(const ErrorCallback &cb) { m_error_callback = cb; }
+
+  LengthType lengthType() const {return m_type;}
+
+  std::size_t maxFrameSize() const {return m_max_frame_size;}
+
+  // 作为 TcpConnection 的消息回调函数
+  void onMessage(TcpConnection &conn);
+
+  /* 发送一帧，长度字段和消息体放在同一个数据片中，消息体只拷贝一次
+   * 帧长度超过上限或者长度字段放不下时返回 false */
+  bool send(TcpConnection &conn, const char *data, std::size_t len) const;
+  bool send(TcpConnection &conn, const std::string &msg) const;
+
+  // 已经是 Slice 的消息体不拷贝，长度字段单独作为一个小数据片，由 writev 一起发出
+  bool send(TcpConnection &conn, const Slice &payload) const;
+
+  // 长度字段写进 builder 的预留空间，不拷贝消息体
+  bool send(TcpConnection &conn, SliceBuilder &&builder) const;
+
+  // 把长度字段写进 buf（至少 MAX_HEADER_SIZE 字节），返回长度字段的字节数，放不下时返回 0
+  std::size_t encodeHeader(char *buf, uint64_t len) const;
+
+  /* 从 [data, data+n) 中解析长度字段
+   * 返回长度字段的字节数，数据不够时返回 0，格式错误时返回 -1 */
+  int decodeHeader(const char *data, std::size_t n, uint64_t *len) const;
+
+ private:
+  void handleError(TcpConnection &conn, uint64_t len);
+
+ private:
+  LengthType m_type;
+  bool m_big_endian;
+  std::size_t m_max_frame_size;
+  FrameCallback m_frame_callback {nullptr};
+  ErrorCallback m_error_callback {nullptr};
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_LENGTH_CODEC_H
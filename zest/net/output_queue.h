@@ -0,0 +1,175 @@
+/* TCP连接的发送队列，按顺序保存待发送的 Slice 和文件区间，入队时不拷贝数据 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is an internal header file, you should not include this.
+
+#ifndef ZEST_NET_OUTPUT_QUEUE_H
+#define ZEST_NET_OUTPUT_QUEUE_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "zest/net/slice.h"
+
+namespace zest
+{
+namespace net
+{
+
+// 待发送的一段文件，用 sendfile 或 splice 直接从文件发往套接字
+struct FileRegion
+{
+  int m_fd {-1};
+  off_t m_offset {0};             // 下一个要发送的字节在文件中的偏移
+  std::size_t m_length {0};       // 文件中还没读出的字节数
+  std::size_t m_in_pipe {0};      // 使用 splice 时，已经搬进管道但还没发出的字节数
+  bool m_use_splice {false};      // sendfile 不可用时改用 splice
+  bool m_seekable {true};         // 管道等不能指定偏移的 fd，splice 时从当前位置读
+  std::function<void()> m_done_callback {nullptr};   // 全部交给内核后调用
+
+  bool finished() const {return m_length == 0 && m_in_pipe == 0;}
+};
+
+class OutputQueue
+{
+  // 队列中的一项，要么是数据片，要么是文件区间
+  struct Item
+  {
+    Slice m_slice;
+    FileRegion m_file;
+    bool m_is_file {false};
+    std::vector<int> m_fds;     // 随数据片的第一个字节发送的文件描述符（SCM_RIGHTS），由队列持有
+  };
+
+ public:
+  OutputQueue() = default;
+  ~OutputQueue() {clear();}
+
+  void append(const Slice &slice)
+  {
+    if (slice.empty())
+      return;
+    Item item;
+    item.m_slice = slice;
+    m_items.push_back(std::move(item));
+    m_bytes += slice.size();
+  }
+
+  // fds 的所有权交给队列，发出之后或者队列清空时关闭
+  void appendWithFds(const Slice &slice, std::vector<int> &&fds)
+  {
+    Item item;
+    item.m_slice = slice;
+    item.m_fds = std::move(fds);
+    m_items.push_back(std::move(item));
+    m_bytes += slice.size();
+  }
+
+  void appendFile(int fd, off_t offset, std::size_t len, std::function<void()> done_cb)
+  {
+    Item item;
+    item.m_file.m_fd = fd;
+    item.m_file.m_offset = offset;
+    item.m_file.m_length = len;
+    item.m_file.m_done_callback = done_cb;
+    item.m_is_file = true;
+    m_items.push_back(std::move(item));
+    m_bytes += len;
+  }
+
+  bool empty() const {return m_items.empty();}
+
+  // 队列中待发送的总字节数
+  std::size_t size() const {return m_bytes;}
+
+  bool frontIsFile() const {return m_items.front().m_is_file;}
+
+  FileRegion &frontFile() {return m_items.front().m_file;}
+
+  const Slice &frontSlice() const {return m_items.front().m_slice;}
+  bool frontHasFds() const {return !m_items.front().m_fds.empty();}
+  const std::vector<int> &frontFds() const {return m_items.front().m_fds;}
+
+  // 文件描述符已经随 sendmsg 交给内核，关闭队列持有的副本
+  void releaseFrontFds() {closeFds(m_items.front());}
+
+  /* 用队列头部的数据片填充 iovec 数组，遇到文件区间时停止，返回填充的个数，用于 writev
+   * 后面带有文件描述符的数据片也会停止，保证文件描述符和它的第一个字节在同一次 sendmsg 中发出 */
+  int fillIovec(struct iovec *iov, int max_num) const
+  {
+    int n = 0;
+    for (auto it = m_items.begin(); it != m_items.end() && n < max_num && !it->m_is_file &&
+         (n == 0 || it->m_fds.empty()); ++it, ++n) {
+      iov[n].iov_base = const_cast<char*>(it->m_slice.data());
+      iov[n].iov_len = it->m_slice.size();
+    }
+    return n;
+  }
+
+  /* 已经发送了 n 个字节，把它们从队列中移除
+   * 头部是数据片时，n 可以跨越多个数据片；头部是文件时，只更新计数，文件区间由 popFront() 移除 */
+  void consume(std::size_t n)
+  {
+    if (!m_items.empty() && m_items.front().m_is_file) {
+      m_bytes -= n;
+      return;
+    }
+    while (n > 0 && !m_items.empty() && !m_items.front().m_is_file) {
+      Slice &slice = m_items.front().m_slice;
+      if (n >= slice.size()) {
+        n -= slice.size();
+        m_bytes -= slice.size();
+        closeFds(m_items.front());
+        m_items.pop_front();
+      }
+      else {
+        slice.remove_prefix(n);
+        m_bytes -= n;
+        n = 0;
+      }
+    }
+  }
+
+  void popFront()
+  {
+    const Item &item = m_items.front();
+    if (item.m_is_file)
+      m_bytes -= item.m_file.m_length + item.m_file.m_in_pipe;
+    else
+      m_bytes -= item.m_slice.size();
+    closeFds(m_items.front());
+    m_items.pop_front();
+  }
+
+  void clear()
+  {
+    for (Item &item : m_items)
+      closeFds(item);
+    m_items.clear();
+    m_bytes = 0;
+  }
+
+ private:
+  static void closeFds(Item &item)
+  {
+    for (int fd : item.m_fds)
+      ::close(fd);
+    item.m_fds.clear();
+  }
+
+ private:
+  std::deque<Item> m_items;
+  std::size_t m_bytes {0};
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_OUTPUT_QUEUE_H
@@ -0,0 +1,312 @@
+/* 按主题的发布/订阅中心：订阅关系按IO线程分片保存，一条消息只交给每个IO线程一次，再由IO线程发给本线程的订阅者 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/pubsub/pubsub_hub.h"
+
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "zest/base/logging.h"
+#include "zest/net/eventloop.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::pubsub;
+
+
+/* 一个IO线程的订阅关系，除了统计数据之外只在这个IO线程中访问 */
+class PubSubHub::Shard : public noncopyable
+{
+ public:
+  explicit Shard(const std::shared_ptr<EventLoop> &eventloop) : m_eventloop(eventloop) {}
+
+  void setOptions(TcpConnection &conn, const SubscriberOptions &options, const SubscriberOptions &defaults)
+  {
+    subscriber(conn, defaults)->m_options = options;
+  }
+
+  void subscribe(TcpConnection &conn, const std::string &topic, const SubscriberOptions &defaults)
+  {
+    Subscriber *sub = subscriber(conn, defaults);
+    if (sub->m_topics.insert(topic).second) {
+      m_topics[topic].insert(sub);
+      m_subscriptions.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void unsubscribe(TcpConnection &conn, const std::string &topic)
+  {
+    auto it = m_subscribers.find(&conn);
+    if (it == m_subscribers.end())
+      return;
+    Subscriber *sub = it->second.get();
+    if (sub->m_topics.erase(topic) > 0)
+      removeFromTopic(sub, topic);
+  }
+
+  void unsubscribeAll(TcpConnection &conn)
+  {
+    auto it = m_subscribers.find(&conn);
+    if (it == m_subscribers.end())
+      return;
+    Subscriber *sub = it->second.get();
+    for (const std::string &topic : sub->m_topics)
+      removeFromTopic(sub, topic);
+    m_subscribers.erase(it);
+    m_subscriber_count.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /* 把消息发给本线程中 topic 的所有订阅者
+   * 需要断开的订阅者在遍历结束后再关闭，关闭回调中的 unsubscribeAll 不会影响遍历 */
+  void deliver(const std::string &topic, const Slice &message)
+  {
+    auto it = m_topics.find(topic);
+    if (it == m_topics.end())
+      return;
+    m_loop_deliveries.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<TcpConnection*> slow;
+    for (Subscriber *sub : it->second) {
+      if (!send(sub, message))
+        slow.push_back(sub->m_conn);
+    }
+    for (TcpConnection *conn : slow) {
+      LOG_DEBUG << "disconnect slow subscriber " << conn->peerAddress().to_string();
+      unsubscribeAll(*conn);
+      conn->close();
+    }
+  }
+
+  void onWriteComplete(TcpConnection &conn)
+  {
+    auto it = m_subscribers.find(&conn);
+    if (it != m_subscribers.end())
+      drain(it->second.get());
+  }
+
+  bool hasSubscriptions() const {return m_subscriptions.load(std::memory_order_relaxed) > 0;}
+
+  const std::shared_ptr<EventLoop> &eventloop() const {return m_eventloop;}
+
+  void addStats(PubSubStats *stats) const
+  {
+    stats->m_loop_deliveries += m_loop_deliveries.load(std::memory_order_relaxed);
+    stats->m_sent += m_sent.load(std::memory_order_relaxed);
+    stats->m_dropped += m_dropped.load(std::memory_order_relaxed);
+    stats->m_disconnected += m_disconnected.load(std::memory_order_relaxed);
+    stats->m_subscribers += m_subscriber_count.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Subscriber
+  {
+    TcpConnection *m_conn;
+    SubscriberOptions m_options;
+    std::unordered_set<std::string> m_topics;
+    std::deque<Slice> m_backlog;     // 发送队列超过高水位时积压的消息
+  };
+
+  Subscriber *subscriber(TcpConnection &conn, const SubscriberOptions &defaults)
+  {
+    std::unique_ptr<Subscriber> &sub = m_subscribers[&conn];
+    if (!sub) {
+      sub.reset(new Subscriber());
+      sub->m_conn = &conn;
+      sub->m_options = defaults;
+      m_subscriber_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return sub.get();
+  }
+
+  void removeFromTopic(Subscriber *sub, const std::string &topic)
+  {
+    auto it = m_topics.find(topic);
+    if (it == m_topics.end())
+      return;
+    it->second.erase(sub);
+    if (it->second.empty())
+      m_topics.erase(it);
+    m_subscriptions.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // 发给一个订阅者，返回 false 表示这个订阅者需要断开
+  bool send(Subscriber *sub, const Slice &message)
+  {
+    TcpConnection *conn = sub->m_conn;
+    if (conn->getState() != Connected)
+      return true;
+    drain(sub);
+    if (sub->m_backlog.empty() && conn->outputBytes() < sub->m_options.m_high_water_bytes) {
+      conn->send(message);
+      m_sent.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    if (sub->m_options.m_policy == Disconnect) {
+      m_disconnected.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    sub->m_backlog.push_back(message);
+    if (sub->m_backlog.size() > sub->m_options.m_max_backlog) {
+      sub->m_backlog.pop_front();
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  // 发送队列降到高水位以下，按顺序补发积压的消息
+  void drain(Subscriber *sub)
+  {
+    TcpConnection *conn = sub->m_conn;
+    while (!sub->m_backlog.empty() && conn->getState() == Connected &&
+           conn->outputBytes() < sub->m_options.m_high_water_bytes) {
+      conn->send(sub->m_backlog.front());
+      sub->m_backlog.pop_front();
+      m_sent.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  std::shared_ptr<EventLoop> m_eventloop;
+  std::unordered_map<TcpConnection*, std::unique_ptr<Subscriber>> m_subscribers;
+  std::unordered_map<std::string, std::unordered_set<Subscriber*>> m_topics;
+
+  // 统计数据，可能在其它线程读取
+  std::atomic<uint64_t> m_subscriptions {0};     // (订阅者, 主题) 的数量，为 0 时 publish 跳过这个IO线程
+  std::atomic<uint64_t> m_subscriber_count {0};
+  std::atomic<uint64_t> m_loop_deliveries {0};
+  std::atomic<uint64_t> m_sent {0};
+  std::atomic<uint64_t> m_dropped {0};
+  std::atomic<uint64_t> m_disconnected {0};
+};
+
+
+PubSubHub::PubSubHub() : m_shards(std::make_shared<ShardList>())
+{
+  /* do nothing */
+}
+
+PubSubHub::~PubSubHub() = default;
+
+void PubSubHub::setDefaultOptions(const SubscriberOptions &options)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_default_options = options;
+}
+
+void PubSubHub::setSubscriberOptions(TcpConnection &conn, const SubscriberOptions &options)
+{
+  std::shared_ptr<EventLoop> eventloop = conn.getEventLoop();
+  if (!eventloop->isThisThread()) {
+    TcpConnection::s_ptr self = conn.shared_from_this();
+    eventloop->runInLoop([this, self, options](){this->setSubscriberOptions(*self, options);});
+    return;
+  }
+  if (conn.getState() == Closed)
+    return;
+  SubscriberOptions defaults;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    defaults = m_default_options;
+  }
+  localShard(eventloop)->setOptions(conn, options, defaults);
+}
+
+void PubSubHub::subscribe(TcpConnection &conn, const std::string &topic)
+{
+  std::shared_ptr<EventLoop> eventloop = conn.getEventLoop();
+  if (!eventloop->isThisThread()) {
+    TcpConnection::s_ptr self = conn.shared_from_this();
+    eventloop->runInLoop([this, self, topic](){this->subscribe(*self, topic);});
+    return;
+  }
+  // 关闭回调中已经调用过 unsubscribeAll()，不能再登记
+  if (conn.getState() == Closed)
+    return;
+  SubscriberOptions defaults;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    defaults = m_default_options;
+  }
+  localShard(eventloop)->subscribe(conn, topic, defaults);
+}
+
+void PubSubHub::unsubscribe(TcpConnection &conn, const std::string &topic)
+{
+  std::shared_ptr<EventLoop> eventloop = conn.getEventLoop();
+  if (!eventloop->isThisThread()) {
+    TcpConnection::s_ptr self = conn.shared_from_this();
+    eventloop->runInLoop([this, self, topic](){this->unsubscribe(*self, topic);});
+    return;
+  }
+  localShard(eventloop)->unsubscribe(conn, topic);
+}
+
+void PubSubHub::unsubscribeAll(TcpConnection &conn)
+{
+  std::shared_ptr<EventLoop> eventloop = conn.getEventLoop();
+  if (!eventloop->isThisThread()) {
+    TcpConnection::s_ptr self = conn.shared_from_this();
+    eventloop->runInLoop([this, self](){this->unsubscribeAll(*self);});
+    return;
+  }
+  localShard(eventloop)->unsubscribeAll(conn);
+}
+
+void PubSubHub::onWriteComplete(TcpConnection &conn)
+{
+  localShard(conn.getEventLoop())->onWriteComplete(conn);
+}
+
+// 在锁内只拷贝分片列表的指针，然后给每个有订阅者的IO线程投递一个任务
+void PubSubHub::publish(const std::string &topic, const Slice &message)
+{
+  std::shared_ptr<const ShardList> shards;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    shards = m_shards;
+  }
+  m_published.fetch_add(1, std::memory_order_relaxed);
+  for (const ShardPtr &shard : *shards) {
+    if (!shard->hasSubscriptions())
+      continue;
+    if (shard->eventloop()->isThisThread()) {
+      shard->deliver(topic, message);
+    }
+    else {
+      shard->eventloop()->runInLoop([shard, topic, message](){
+        shard->deliver(topic, message);
+      });
+    }
+  }
+}
+
+PubSubStats PubSubHub::stats() const
+{
+  std::shared_ptr<const ShardList> shards;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    shards = m_shards;
+  }
+  PubSubStats stats;
+  stats.m_published = m_published.load(std::memory_order_relaxed);
+  for (const ShardPtr &shard : *shards)
+    shard->addStats(&stats);
+  return stats;
+}
+
+PubSubHub::ShardPtr PubSubHub::localShard(const std::shared_ptr<EventLoop> &eventloop)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const ShardPtr &shard : *m_shards) {
+    if (shard->eventloop() == eventloop)
+      return shard;
+  }
+  std::shared_ptr<ShardList> shards = std::make_shared<ShardList>(*m_shards);
+  shards->push_back(std::make_shared<Shard>(eventloop));
+  m_shards = shards;
+  return shards->back();
+}
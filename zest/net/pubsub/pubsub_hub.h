@@ -0,0 +1,104 @@
+/* 按主题的发布/订阅中心：订阅关系按IO线程分片保存，一条消息只交给每个IO线程一次，再由IO线程发给本线程的订阅者 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_PUBSUB_PUBSUB_HUB_H
+#define ZEST_NET_PUBSUB_PUBSUB_HUB_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/slice.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+
+namespace pubsub
+{
+
+// 订阅者跟不上发布速度时的处理方式
+enum SlowPolicy {
+  DropOldest = 0,     // 在订阅者自己的积压队列中丢弃最旧的消息
+  Disconnect = 1,     // 直接断开订阅者
+};
+
+struct SubscriberOptions
+{
+  SlowPolicy m_policy {DropOldest};
+  std::size_t m_high_water_bytes {4 * 1024 * 1024};   // 发送队列超过这个大小，就认为订阅者跟不上
+  std::size_t m_max_backlog {1024};                    // DropOldest 时积压队列最多保存的消息数
+};
+
+// 所有IO线程的统计数据之和
+struct PubSubStats
+{
+  uint64_t m_published {0};       // publish() 的次数
+  uint64_t m_loop_deliveries {0}; // 交给IO线程的次数，每条消息每个有订阅者的IO线程一次
+  uint64_t m_sent {0};            // 发给订阅者的消息数
+  uint64_t m_dropped {0};         // DropOldest 丢弃的消息数
+  uint64_t m_disconnected {0};    // Disconnect 断开的订阅者数
+  uint64_t m_subscribers {0};     // 当前的订阅者（连接）数
+};
+
+/* 消息是编码好的字节（例如一个长度前缀帧或者 WebSocket 帧），以共享的数据片在所有订阅者之间传递，不拷贝
+ * subscribe / unsubscribe 在连接所属的IO线程中执行，publish 可以在任意线程调用
+ * 使用者需要在连接的关闭回调中调用 unsubscribeAll()，在写完成回调中调用 onWriteComplete() */
+class PubSubHub : public noncopyable
+{
+ public:
+  PubSubHub();
+  ~PubSubHub();
+
+  // 新订阅者使用的默认选项
+  void setDefaultOptions(const SubscriberOptions &options);
+
+  // 单独设置某个订阅者的选项，连接还没有订阅任何主题时同样有效
+  void setSubscriberOptions(TcpConnection &conn, const SubscriberOptions &options);
+
+  void subscribe(TcpConnection &conn, const std::string &topic);
+  void unsubscribe(TcpConnection &conn, const std::string &topic);
+  void unsubscribeAll(TcpConnection &conn);
+
+  // 把 message 发给 topic 的所有订阅者，每个IO线程只收到一个任务
+  void publish(const std::string &topic, const Slice &message);
+  void publish(const std::string &topic, const std::string &message) {publish(topic, Slice(message));}
+
+  // 连接的发送队列清空了，继续发送积压的消息
+  void onWriteComplete(TcpConnection &conn);
+
+  PubSubStats stats() const;
+
+ private:
+  class Shard;
+  using ShardPtr = std::shared_ptr<Shard>;
+  using ShardList = std::vector<ShardPtr>;
+
+  // 当前线程的分片，没有时创建
+  ShardPtr localShard(const std::shared_ptr<EventLoop> &eventloop);
+
+ private:
+  mutable std::mutex m_mutex;
+  std::shared_ptr<const ShardList> m_shards;    // 写时复制，publish 只需要在锁内拷贝一个指针
+  SubscriberOptions m_default_options;
+  std::atomic<uint64_t> m_published {0};
+};
+
+} // namespace pubsub
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_PUBSUB_PUBSUB_HUB_H
@@ -0,0 +1,235 @@
+/* Redis 序列化协议（RESP2/RESP3）的解析器，直接在接收缓存中解析，解析结果只引用缓存中的数据 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/redis/resp.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "zest/base/simd_search.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::redis;
+
+// 内联命令和单行类型的最大长度
+static const std::size_t MAX_INLINE_SIZE = 64 * 1024;
+
+// 最短的元素（例如 "_\r\n"）占用的字节数，只用来估计还能容纳多少个元素
+static const std::size_t MIN_ELEMENT_SIZE = 3;
+
+/* 读取一行，*line_end 指向 '\r'
+ * 返回包括 "\r\n" 在内的字节数，没有完整的一行时返回 0，行太长返回 -1 */
+static int readLine(const char *p, const char *end, const char **line_end)
+{
+  const char *cr = simd_find_crlf(p, end);
+  if (cr == end)
+    return static_cast<std::size_t>(end - p) > MAX_INLINE_SIZE ? -1 : 0;
+  *line_end = cr;
+  return static_cast<int>(cr - p + 2);
+}
+
+// 解析 [p, end) 中的十进制整数
+static bool toInteger(const char *p, const char *end, int64_t *value)
+{
+  bool negative = false;
+  if (p < end && *p == '-') {
+    negative = true;
+    ++p;
+  }
+  if (p == end || end - p > 18)
+    return false;
+  int64_t v = 0;
+  for (; p < end; ++p) {
+    if (*p < '0' || *p > '9')
+      return false;
+    v = v * 10 + (*p - '0');
+  }
+  *value = negative ? -v : v;
+  return true;
+}
+
+
+RespParser::RespParser(std::size_t max_bulk_size /*=DEFAULT_MAX_BULK_SIZE*/,
+                       std::size_t max_args /*=DEFAULT_MAX_ARGS*/) :
+  m_max_bulk_size(max_bulk_size < MAX_FRAME_SIZE ? max_bulk_size : MAX_FRAME_SIZE), m_max_args(max_args)
+{
+  /* do nothing */
+}
+
+int RespParser::parseCommand(const char *data, std::size_t len, RespCommand *cmd) const
+{
+  cmd->clear();
+  if (len == 0)
+    return 0;
+  if (data[0] != '*')
+    return parseInline(data, len, cmd);
+
+  const char *end = data + len;
+  const char *line_end = nullptr;
+  int n = readLine(data, end, &line_end);
+  if (n <= 0)
+    return n;
+  int64_t count = 0;
+  if (!toInteger(data + 1, line_end, &count) || count > static_cast<int64_t>(m_max_args))
+    return -1;
+
+  const char *p = data + n;
+  for (int64_t i = 0; i < count; ++i) {
+    if (p == end)
+      return 0;
+    if (*p != '$')
+      return -1;
+    n = readLine(p, end, &line_end);
+    if (n <= 0)
+      return n;
+    int64_t bulk_len = 0;
+    if (!toInteger(p + 1, line_end, &bulk_len) || bulk_len < 0 ||
+        static_cast<uint64_t>(bulk_len) > m_max_bulk_size)
+      return -1;
+    p += n;
+    if (static_cast<std::size_t>(p - data) + static_cast<std::size_t>(bulk_len) + 2 > MAX_FRAME_SIZE)
+      return -1;
+    if (static_cast<std::size_t>(end - p) < static_cast<std::size_t>(bulk_len) + 2)
+      return 0;
+    if (p[bulk_len] != '\r' || p[bulk_len + 1] != '\n')
+      return -1;
+    cmd->push_back(p, static_cast<std::size_t>(bulk_len));
+    p += bulk_len + 2;
+  }
+  return static_cast<int>(p - data);
+}
+
+// telnet 风格的命令，例如 "PING\r\n"，参数以空格分隔，不支持引号
+int RespParser::parseInline(const char *data, std::size_t len, RespCommand *cmd) const
+{
+  const char *end = data + len;
+  const char *nl = simd_find_byte(data, end, '\n');
+  if (nl == end)
+    return len > MAX_INLINE_SIZE ? -1 : 0;
+  const char *line_end = (nl > data && *(nl - 1) == '\r') ? nl - 1 : nl;
+
+  const char *p = data;
+  while (p < line_end) {
+    while (p < line_end && (*p == ' ' || *p == '\t')) ++p;
+    const char *b = p;
+    while (p < line_end && *p != ' ' && *p != '\t') ++p;
+    if (p > b)
+      cmd->push_back(b, p - b);
+  }
+  return static_cast<int>(nl - data + 1);
+}
+
+int RespParser::parseValue(const char *data, std::size_t len, RespValue *value) const
+{
+  return parseValue(data, len, value, 0);
+}
+
+int RespParser::parseValue(const char *data, std::size_t len, RespValue *value, int depth) const
+{
+  if (len == 0)
+    return 0;
+  if (depth > MAX_DEPTH)
+    return -1;
+
+  const char *end = data + len;
+  const char *line_end = nullptr;
+  int n = readLine(data, end, &line_end);
+  if (n <= 0)
+    return n;
+
+  value->elements.clear();
+  value->data = nullptr;
+  value->len = 0;
+  value->integer = 0;
+  const char *line = data + 1;
+
+  switch (data[0]) {
+  case '+':
+  case '-':
+  case ',':
+  case '(':
+    value->type = static_cast<RespValue::Type>(data[0]);
+    value->data = line;
+    value->len = line_end - line;
+    return n;
+
+  case ':':
+    value->type = RespValue::Integer;
+    return toInteger(line, line_end, &value->integer) ? n : -1;
+
+  case '_':
+    value->type = RespValue::Null;
+    return line == line_end ? n : -1;
+
+  case '#':
+    value->type = RespValue::Boolean;
+    if (line_end - line != 1 || (*line != 't' && *line != 'f'))
+      return -1;
+    value->integer = (*line == 't');
+    return n;
+
+  case '$':
+  case '!':
+  case '=': {
+    int64_t bulk_len = 0;
+    if (!toInteger(line, line_end, &bulk_len))
+      return -1;
+    // RESP2 的空值
+    if (bulk_len == -1 && data[0] == '$') {
+      value->type = RespValue::Null;
+      return n;
+    }
+    if (bulk_len < 0 || static_cast<uint64_t>(bulk_len) > m_max_bulk_size)
+      return -1;
+    if (len - n < static_cast<std::size_t>(bulk_len) + 2)
+      return 0;
+    const char *p = data + n;
+    if (p[bulk_len] != '\r' || p[bulk_len + 1] != '\n')
+      return -1;
+    value->type = static_cast<RespValue::Type>(data[0]);
+    value->data = p;
+    value->len = static_cast<std::size_t>(bulk_len);
+    return static_cast<int>(n + bulk_len + 2);
+  }
+
+  case '*':
+  case '~':
+  case '>':
+  case '%':
+  case '|': {
+    int64_t count = 0;
+    if (!toInteger(line, line_end, &count))
+      return -1;
+    if (count == -1 && data[0] == '*') {
+      value->type = RespValue::Null;
+      return n;
+    }
+    if (data[0] == '%' || data[0] == '|')
+      count *= 2;
+    if (count < 0 || static_cast<uint64_t>(count) > m_max_args)
+      return -1;
+    /* 元素个数来自对端，不能据此直接分配：按缓存中剩余的字节最多能容纳的元素数预留，
+     * 之后每解析出一个元素再追加，数据不完整时不会为还没有到达的元素分配内存 */
+    value->type = static_cast<RespValue::Type>(data[0]);
+    std::size_t offset = n;
+    value->elements.reserve(std::min(static_cast<std::size_t>(count), (len - offset) / MIN_ELEMENT_SIZE));
+    for (int64_t i = 0; i < count; ++i) {
+      value->elements.emplace_back();
+      int m = parseValue(data + offset, len - offset, &value->elements.back(), depth + 1);
+      if (m <= 0)
+        return m;
+      if (offset + m > MAX_FRAME_SIZE)
+        return -1;
+      offset += m;
+    }
+    return static_cast<int>(offset);
+  }
+
+  default:
+    return -1;
+  }
+}
@@ -0,0 +1,126 @@
+/* Redis 序列化协议（RESP2/RESP3）的解析器，直接在接收缓存中解析，解析结果只引用缓存中的数据 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_REDIS_RESP_H
+#define ZEST_NET_REDIS_RESP_H
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace zest
+{
+namespace net
+{
+namespace redis
+{
+
+/* 一条命令，例如 SET key value，每个参数都指向接收缓存
+ * 只在处理命令的回调函数执行期间有效 */
+class RespCommand
+{
+ public:
+  struct Arg
+  {
+    const char *data;
+    std::size_t len;
+
+    std::string str() const {return std::string(data, len);}
+
+    bool equalsIgnoreCase(const char *s) const
+    {
+      return strlen(s) == len && strncasecmp(data, s, len) == 0;
+    }
+  };
+
+  std::size_t size() const {return m_args.size();}
+
+  bool empty() const {return m_args.empty();}
+
+  const Arg &operator[](std::size_t i) const {return m_args[i];}
+
+  void clear() {m_args.clear();}
+
+  void push_back(const char *data, std::size_t len) {m_args.push_back(Arg{data, len});}
+
+ private:
+  std::vector<Arg> m_args;
+};
+
+/* 任意一个RESP值，用于解析服务器的回复
+ * 字符串类的值（简单字符串、错误、批量字符串、浮点数、大整数、原样字符串）由 data/len 指向缓存中的数据
+ * 聚合类的值（数组、集合、推送、映射、属性）的元素保存在 elements 中，映射按 键,值,键,值 的顺序保存 */
+struct RespValue
+{
+  enum Type {
+    SimpleString = '+',
+    Error = '-',
+    Integer = ':',
+    BulkString = '$',
+    Array = '*',
+    Null = '_',         // RESP3，RESP2 的 $-1 和 *-1 也解析为 Null
+    Double = ',',
+    Boolean = '#',
+    BigNumber = '(',
+    BulkError = '!',
+    Verbatim = '=',
+    Map = '%',
+    Set = '~',
+    Push = '>',
+    Attribute = '|',
+  };
+
+  Type type {Null};
+  const char *data {nullptr};
+  std::size_t len {0};
+  int64_t integer {0};             // Integer 的值，Boolean 为 0 或 1
+  std::vector<RespValue> elements;
+
+  std::string str() const {return data ? std::string(data, len) : std::string();}
+
+  bool isError() const {return type == Error || type == BulkError;}
+};
+
+class RespParser
+{
+ public:
+  static const std::size_t DEFAULT_MAX_BULK_SIZE = 512 * 1024 * 1024;
+  static const std::size_t DEFAULT_MAX_ARGS = 64 * 1024;
+  static const std::size_t MAX_FRAME_SIZE = 1024 * 1024 * 1024;   // 一条命令或一个值的总字节数，返回值不会溢出 int
+  static const int MAX_DEPTH = 32;          // 聚合类型的最大嵌套层数
+
+  explicit RespParser(std::size_t max_bulk_size = DEFAULT_MAX_BULK_SIZE,
+                      std::size_t max_args = DEFAULT_MAX_ARGS);
+
+  /* 从 [data, data+len) 中解析一条命令（批量字符串组成的数组，或者 telnet 风格的内联命令）
+   * 返回命令占用的字节数，数据不够时返回 0，格式错误或者超过 MAX_FRAME_SIZE 时返回 -1
+   * 空的内联命令（空行）返回占用的字节数，cmd 为空 */
+  int parseCommand(const char *data, std::size_t len, RespCommand *cmd) const;
+
+  // 从 [data, data+len) 中解析一个值，返回值同上
+  int parseValue(const char *data, std::size_t len, RespValue *value) const;
+
+  std::size_t maxBulkSize() const {return m_max_bulk_size;}
+
+ private:
+  int parseInline(const char *data, std::size_t len, RespCommand *cmd) const;
+  int parseValue(const char *data, std::size_t len, RespValue *value, int depth) const;
+
+ private:
+  std::size_t m_max_bulk_size;
+  std::size_t m_max_args;
+};
+
+} // namespace redis
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_REDIS_RESP_H
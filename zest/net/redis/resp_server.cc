@@ -0,0 +1,176 @@
+/* 基于 TcpServer 的 RESP 命令服务器，一次读取中的所有命令依次处理，回复按顺序合并成一次发送 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/redis/resp_server.h"
+
+#include <ctype.h>
+
+#include "zest/base/logging.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::redis;
+using std::placeholders::_1;
+
+// 命令名的最大长度，更长的一定是未知命令
+static const std::size_t MAX_COMMAND_NAME = 32;
+
+// 每个连接的状态
+struct RespSession
+{
+  int m_protocol {2};        // HELLO 协商的协议版本
+  bool m_closing {false};    // 收到 QUIT 或者协议错误，回复发完后关闭连接
+  RespCommand m_command;     // 复用参数数组的内存
+};
+
+// 连接上下文中保存会话状态的槽位
+static const ContextSlot<RespSession> RESP_SESSION_SLOT;
+
+static std::string toUpper(const char *data, std::size_t len)
+{
+  std::string name(data, len);
+  for (auto &c : name)
+    c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+  return name;
+}
+
+
+RespServer::RespServer(NetBaseAddress &local_addr, int thread_nums /*=4*/) :
+  m_server(local_addr, thread_nums)
+{
+  m_server.setOnConnectionCallback(std::bind(&RespServer::onConnection, this, _1));
+  m_server.setMessageCallback(std::bind(&RespServer::onMessage, this, _1));
+  m_server.setWriteCompleteCallback(std::bind(&RespServer::onWriteComplete, this, _1));
+
+  handle("PING", [](TcpConnection&, const RespCommand &cmd, RespWriter &writer){
+    if (cmd.size() > 1)
+      writer.bulk(cmd[1].data, cmd[1].len);
+    else
+      writer.simpleString("PONG", 4);
+  });
+  handle("ECHO", [](TcpConnection&, const RespCommand &cmd, RespWriter &writer){
+    if (cmd.size() != 2)
+      writer.error("ERR wrong number of arguments for 'echo' command");
+    else
+      writer.bulk(cmd[1].data, cmd[1].len);
+  });
+  handle("QUIT", [](TcpConnection &conn, const RespCommand&, RespWriter &writer){
+    conn.Get(RESP_SESSION_SLOT)->m_closing = true;
+    writer.simpleString("OK", 2);
+  });
+  // redis-cli 启动时会发送 COMMAND DOCS，回复空数组即可
+  handle("COMMAND", [](TcpConnection&, const RespCommand&, RespWriter &writer){
+    writer.arrayHeader(0);
+  });
+  // HELLO [protover]，协商协议版本，回复服务器信息
+  handle("HELLO", [](TcpConnection &conn, const RespCommand &cmd, RespWriter &writer){
+    RespSession *session = conn.Get(RESP_SESSION_SLOT);
+    if (cmd.size() > 1) {
+      if (cmd[1].equalsIgnoreCase("2"))
+        session->m_protocol = 2;
+      else if (cmd[1].equalsIgnoreCase("3"))
+        session->m_protocol = 3;
+      else {
+        writer.error("NOPROTO unsupported protocol version");
+        return;
+      }
+    }
+    writer.setProtocol(session->m_protocol);
+    writer.mapHeader(7);
+    writer.bulk("server");
+    writer.bulk("zest");
+    writer.bulk("version");
+    writer.bulk("1.0.0");
+    writer.bulk("proto");
+    writer.integer(session->m_protocol);
+    writer.bulk("id");
+    writer.integer(conn.socketfd());
+    writer.bulk("mode");
+    writer.bulk("standalone");
+    writer.bulk("role");
+    writer.bulk("master");
+    writer.bulk("modules");
+    writer.arrayHeader(0);
+  });
+}
+
+void RespServer::handle(const std::string &name, const CommandCallback &cb)
+{
+  m_commands[toUpper(name.data(), name.size())] = cb;
+}
+
+void RespServer::start()
+{
+  m_server.start();
+}
+
+void RespServer::onConnection(TcpConnection &conn)
+{
+  conn.Put(RESP_SESSION_SLOT);
+  conn.waitForMessage();
+}
+
+/* 处理接收缓存中所有完整的命令，回复写进同一个 RespWriter，最后一次性交给发送队列
+ * 客户端流水线发来的一批命令只需要一次读和一次写 */
+void RespServer::onMessage(TcpConnection &conn)
+{
+  RespSession *session = conn.Get(RESP_SESSION_SLOT);
+  if (session == nullptr)
+    return;
+  if (session->m_closing) {
+    conn.clearData();
+    return;
+  }
+
+  const char *data = conn.peek();
+  std::size_t size = conn.dataSize();
+  std::size_t offset = 0;
+  RespWriter writer(session->m_protocol);
+  RespCommand &cmd = session->m_command;
+
+  while (offset < size && !session->m_closing) {
+    int n = m_parser.parseCommand(data + offset, size - offset, &cmd);
+    if (n == 0)
+      break;
+    if (n < 0) {
+      LOG_DEBUG << "RESP protocol error from " << conn.peerAddress().to_string();
+      writer.error("ERR Protocol error");
+      session->m_closing = true;
+      offset = size;
+      break;
+    }
+    offset += n;
+    if (!cmd.empty())
+      dispatch(conn, cmd, writer);
+  }
+
+  if (offset == size)
+    conn.clearData();
+  else if (offset > 0)
+    conn.clearBytesData(offset);
+
+  writer.flush(conn);
+  if (session->m_closing)
+    conn.shutdown();
+}
+
+// 大的回复发送时改为监听可写事件，发完之后重新监听可读事件
+void RespServer::onWriteComplete(TcpConnection &conn)
+{
+  conn.waitForMessage();
+}
+
+void RespServer::dispatch(TcpConnection &conn, const RespCommand &cmd, RespWriter &writer)
+{
+  if (cmd[0].len <= MAX_COMMAND_NAME) {
+    auto it = m_commands.find(toUpper(cmd[0].data, cmd[0].len));
+    if (it != m_commands.end()) {
+      it->second(conn, cmd, writer);
+      return;
+    }
+  }
+  std::string name(cmd[0].data, std::min(cmd[0].len, MAX_COMMAND_NAME));
+  writer.error("ERR unknown command '" + name + "'");
+}
@@ -0,0 +1,64 @@
+/* 基于 TcpServer 的 RESP 命令服务器，一次读取中的所有命令依次处理，回复按顺序合并成一次发送 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_REDIS_RESP_SERVER_H
+#define ZEST_NET_REDIS_RESP_SERVER_H
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/base_addr.h"
+#include "zest/net/redis/resp.h"
+#include "zest/net/redis/resp_writer.h"
+#include "zest/net/tcp_server.h"
+
+namespace zest
+{
+namespace net
+{
+namespace redis
+{
+
+/* 命令处理函数在连接所属的IO线程中调用，必须向 writer 写入恰好一个回复
+ * cmd 中的参数指向接收缓存，只在处理函数执行期间有效
+ * 内置的命令：PING、ECHO、HELLO（切换 RESP2/RESP3）、QUIT、COMMAND，可以被覆盖 */
+class RespServer : public noncopyable
+{
+ public:
+  using CommandCallback = std::function<void(TcpConnection&, const RespCommand&, RespWriter&)>;
+
+  explicit RespServer(NetBaseAddress &local_addr, int thread_nums = 4);
+
+  // 注册命令，命令名不区分大小写，必须在 start() 之前调用
+  void handle(const std::string &name, const CommandCallback &cb);
+
+  // 单个批量字符串的大小上限，超出时回复协议错误并关闭连接
+  void setMaxBulkSize(std::size_t bytes) {m_parser = RespParser(bytes);}
+
+  TcpServer &tcpServer() {return m_server;}
+
+  void start();
+
+ private:
+  void onConnection(TcpConnection &conn);
+  void onMessage(TcpConnection &conn);
+  void onWriteComplete(TcpConnection &conn);
+  void dispatch(TcpConnection &conn, const RespCommand &cmd, RespWriter &writer);
+
+ private:
+  TcpServer m_server;
+  RespParser m_parser;
+  std::unordered_map<std::string, CommandCallback> m_commands;
+};
+
+} // namespace redis
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_REDIS_RESP_SERVER_H
@@ -0,0 +1,178 @@
+/* RESP2/RESP3 编码器，把一批回复（或命令）编码进同一块内存，最后一次性交给连接的发送队列 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/redis/resp_writer.h"
+
+#include <stdio.h>
+
+#include <cmath>
+#include <utility>
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::redis;
+
+// 追加 "<type><value>\r\n"，避免 std::to_string 的临时字符串
+void RespWriter::appendHeader(char type, int64_t value)
+{
+  char buf[24];
+  char *p = buf + sizeof(buf);
+  *--p = '\n';
+  *--p = '\r';
+  uint64_t v = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+  do {
+    *--p = static_cast<char>('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+  if (value < 0)
+    *--p = '-';
+  *--p = type;
+  m_buffer.append(p, buf + sizeof(buf) - p);
+}
+
+void RespWriter::simpleString(const char *str, std::size_t len)
+{
+  m_buffer += '+';
+  m_buffer.append(str, len);
+  m_buffer += "\r\n";
+}
+
+void RespWriter::error(const std::string &msg)
+{
+  m_buffer += '-';
+  m_buffer += msg;
+  m_buffer += "\r\n";
+}
+
+void RespWriter::integer(int64_t value)
+{
+  appendHeader(':', value);
+}
+
+void RespWriter::bulk(const char *data, std::size_t len)
+{
+  appendHeader('$', static_cast<int64_t>(len));
+  m_buffer.append(data, len);
+  m_buffer += "\r\n";
+}
+
+void RespWriter::bulk(const Slice &slice)
+{
+  if (slice.size() <= INLINE_BULK_SIZE) {
+    bulk(slice.data(), slice.size());
+    return;
+  }
+  // 长度和之前的数据形成一个数据片，后面跟着不拷贝的 slice
+  appendHeader('$', static_cast<int64_t>(slice.size()));
+  m_segments.push_back(Slice(std::move(m_buffer)));
+  m_segments.push_back(slice);
+  m_buffer.clear();
+  m_buffer += "\r\n";
+}
+
+void RespWriter::null()
+{
+  if (m_protocol >= 3)
+    m_buffer += "_\r\n";
+  else
+    m_buffer += "$-1\r\n";
+}
+
+void RespWriter::nullArray()
+{
+  if (m_protocol >= 3)
+    m_buffer += "_\r\n";
+  else
+    m_buffer += "*-1\r\n";
+}
+
+void RespWriter::arrayHeader(std::size_t count)
+{
+  appendHeader('*', static_cast<int64_t>(count));
+}
+
+void RespWriter::mapHeader(std::size_t count)
+{
+  if (m_protocol >= 3)
+    appendHeader('%', static_cast<int64_t>(count));
+  else
+    appendHeader('*', static_cast<int64_t>(count * 2));
+}
+
+void RespWriter::setHeader(std::size_t count)
+{
+  appendHeader(m_protocol >= 3 ? '~' : '*', static_cast<int64_t>(count));
+}
+
+void RespWriter::pushHeader(std::size_t count)
+{
+  appendHeader(m_protocol >= 3 ? '>' : '*', static_cast<int64_t>(count));
+}
+
+void RespWriter::doubleValue(double value)
+{
+  char buf[32];
+  int n;
+  if (std::isinf(value))
+    n = snprintf(buf, sizeof(buf), value > 0 ? "inf" : "-inf");
+  else if (std::isnan(value))
+    n = snprintf(buf, sizeof(buf), "nan");
+  else
+    n = snprintf(buf, sizeof(buf), "%.17g", value);
+  if (m_protocol >= 3) {
+    m_buffer += ',';
+    m_buffer.append(buf, n);
+    m_buffer += "\r\n";
+  }
+  else {
+    bulk(buf, n);
+  }
+}
+
+void RespWriter::boolean(bool value)
+{
+  if (m_protocol >= 3)
+    m_buffer += value ? "#t\r\n" : "#f\r\n";
+  else
+    m_buffer += value ? ":1\r\n" : ":0\r\n";
+}
+
+void RespWriter::command(const std::vector<std::string> &args)
+{
+  arrayHeader(args.size());
+  for (const auto &arg : args)
+    bulk(arg);
+}
+
+std::size_t RespWriter::size() const
+{
+  std::size_t total = m_buffer.size();
+  for (const auto &slice : m_segments)
+    total += slice.size();
+  return total;
+}
+
+void RespWriter::flush(TcpConnection &conn)
+{
+  for (const auto &slice : m_segments)
+    conn.send(slice);
+  m_segments.clear();
+  if (!m_buffer.empty()) {
+    conn.send(Slice(std::move(m_buffer)));
+    m_buffer.clear();
+  }
+}
+
+std::string RespWriter::take()
+{
+  std::string result;
+  result.reserve(size());
+  for (const auto &slice : m_segments)
+    result.append(slice.data(), slice.size());
+  result += m_buffer;
+  m_segments.clear();
+  m_buffer.clear();
+  return result;
+}
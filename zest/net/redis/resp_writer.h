@@ -0,0 +1,91 @@
+/* RESP2/RESP3 编码器，把一批回复（或命令）编码进同一块内存，最后一次性交给连接的发送队列 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_REDIS_RESP_WRITER_H
+#define ZEST_NET_REDIS_RESP_WRITER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "zest/net/slice.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+namespace redis
+{
+
+/* RESP3 新增的类型在 RESP2 下自动降级：
+ *   null() -> $-1，map -> 偶数个元素的数组，set -> 数组，double -> 批量字符串，boolean -> 整数
+ * 较大的 Slice 类型的批量字符串不拷贝，作为单独的数据片发送 */
+class RespWriter
+{
+ public:
+  // 大于这个大小的 Slice 不拷贝
+  static const std::size_t INLINE_BULK_SIZE = 4096;
+
+  explicit RespWriter(int protocol = 2) : m_protocol(protocol) { /* do nothing */ }
+
+  void setProtocol(int protocol) {m_protocol = protocol;}
+
+  int protocol() const {return m_protocol;}
+
+  void simpleString(const char *str, std::size_t len);
+  void simpleString(const std::string &str) {simpleString(str.data(), str.size());}
+
+  // msg 应当以错误类型开头，例如 "ERR unknown command"
+  void error(const std::string &msg);
+
+  void integer(int64_t value);
+
+  void bulk(const char *data, std::size_t len);
+  void bulk(const std::string &str) {bulk(str.data(), str.size());}
+  void bulk(const Slice &slice);
+
+  void null();
+  void nullArray();
+
+  void arrayHeader(std::size_t count);
+  void mapHeader(std::size_t count);      // count 是键值对的数量
+  void setHeader(std::size_t count);
+  void pushHeader(std::size_t count);     // RESP2 下降级为数组
+
+  void doubleValue(double value);
+  void boolean(bool value);
+
+  // 编码一条命令，例如 command({"SET", "key", "value"})
+  void command(const std::vector<std::string> &args);
+
+  bool empty() const {return m_buffer.empty() && m_segments.empty();}
+
+  // 已经编码的字节数
+  std::size_t size() const;
+
+  // 把编码好的数据交给连接发送，之后 RespWriter 变为空
+  void flush(TcpConnection &conn);
+
+  // 取出编码好的数据，用于不经过 TcpConnection 发送的场景
+  std::string take();
+
+ private:
+  void appendHeader(char type, int64_t value);
+
+ private:
+  int m_protocol;
+  std::string m_buffer;           // 还没有形成数据片的数据
+  std::vector<Slice> m_segments;  // 已经形成的数据片，保证和 m_buffer 的顺序
+};
+
+} // namespace redis
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_REDIS_RESP_WRITER_H
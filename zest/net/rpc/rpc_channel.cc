@@ -0,0 +1,378 @@
+/* 一条连接上的多路复用 RPC 通道，两端都可以发起调用，同时有多个调用在途，响应按完成的顺序返回 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/rpc/rpc_channel.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "zest/base/logging.h"
+#include "zest/base/util.h"
+#include "zest/net/eventloop.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::rpc;
+using std::placeholders::_1;
+
+// 连接上下文中保存 RpcChannel 的槽位
+static const ContextSlot<RpcChannel::s_ptr> RPC_CHANNEL_SLOT;
+
+// 调用截止时间的定时器
+static const char *RPC_DEADLINE_TIMER = "__rpc_deadline";
+
+
+/*************************** RpcResponder ***************************/
+
+struct RpcResponder::State
+{
+  State(std::weak_ptr<RpcChannel> channel, uint64_t call_id, uint32_t method)
+    : m_channel(channel), m_call_id(call_id), m_method(method) { /* do nothing */ }
+
+  // 处理函数既没有回复也没有保留句柄，自动回复错误，否则调用方只能等到超时
+  ~State()
+  {
+    if (!m_replied) {
+      LOG_ERROR << "RPC call " << m_call_id << " of method " << m_method << " dropped without reply";
+      send(RpcHandlerError, Slice(std::string("no reply")));
+    }
+  }
+
+  void send(RpcStatus status, const Slice &payload)
+  {
+    m_replied = true;
+    RpcChannel::s_ptr channel = m_channel.lock();
+    if (channel)
+      channel->sendResponse(m_call_id, m_method, status, payload);
+  }
+
+  std::weak_ptr<RpcChannel> m_channel;
+  uint64_t m_call_id;
+  uint32_t m_method;
+  bool m_replied {false};
+};
+
+RpcResponder::RpcResponder(std::weak_ptr<RpcChannel> channel, uint64_t call_id, uint32_t method)
+  : m_state(std::make_shared<State>(channel, call_id, method))
+{
+  /* do nothing */
+}
+
+void RpcResponder::reply(const char *data, std::size_t len)
+{
+  if (!m_state->m_replied)
+    m_state->send(RpcOk, Slice(data, len));
+}
+
+void RpcResponder::reply(const Slice &payload)
+{
+  if (!m_state->m_replied)
+    m_state->send(RpcOk, payload);
+}
+
+void RpcResponder::fail(const std::string &message)
+{
+  if (!m_state->m_replied)
+    m_state->send(RpcHandlerError, Slice(message));
+}
+
+bool RpcResponder::replied() const
+{
+  return m_state->m_replied;
+}
+
+uint64_t RpcResponder::callId() const
+{
+  return m_state->m_call_id;
+}
+
+
+/*************************** RpcChannel ***************************/
+
+/* 编码一帧：长度字段 + 帧头 + payload
+ * payload 不大，或者不是共享的 Slice（shared 为空）时，整帧拷贝到同一个数据片中（head）
+ * 否则 head 只有长度字段和帧头，body 就是共享的 payload，不拷贝 */
+static void encodeFrame(const LengthCodec &codec, const RpcHeader &header,
+                        const char *data, std::size_t len, const Slice *shared,
+                        Slice *head, Slice *body)
+{
+  char prefix[LengthCodec::MAX_HEADER_SIZE + RPC_HEADER_SIZE];
+  std::size_t n = codec.encodeHeader(prefix, RPC_HEADER_SIZE + len);
+  encodeRpcHeader(header, prefix + n);
+  n += RPC_HEADER_SIZE;
+
+  if (shared == nullptr || len <= RpcChannel::INLINE_PAYLOAD_SIZE) {
+    std::string frame;
+    frame.reserve(n + len);
+    frame.append(prefix, n);
+    frame.append(data, len);
+    *head = Slice(std::move(frame));
+    *body = Slice();
+  }
+  else {
+    *head = Slice(prefix, n);
+    *body = *shared;
+  }
+}
+
+RpcChannel::s_ptr RpcChannel::attach(TcpConnection &conn, std::shared_ptr<const HandlerMap> handlers /*=nullptr*/,
+                                     std::size_t max_frame_size /*=DEFAULT_MAX_FRAME_SIZE*/)
+{
+  s_ptr channel = std::make_shared<RpcChannel>(conn, handlers, max_frame_size);
+  if (!conn.Put(RPC_CHANNEL_SLOT, channel))
+    return get(conn);
+  conn.setMessageCallback(std::bind(&RpcChannel::onMessage, channel.get(), _1));
+  conn.setCloseCallback([](TcpConnection &c){
+    s_ptr ch = RpcChannel::get(c);
+    if (ch)
+      ch->onClose();
+  });
+  return channel;
+}
+
+RpcChannel::s_ptr RpcChannel::get(const TcpConnection &conn)
+{
+  s_ptr *channel = conn.Get(RPC_CHANNEL_SLOT);
+  return channel ? *channel : nullptr;
+}
+
+RpcChannel::RpcChannel(TcpConnection &conn, std::shared_ptr<const HandlerMap> handlers,
+                       std::size_t max_frame_size) :
+  m_conn(&conn), m_eventloop(conn.getEventLoop()), m_handlers(handlers),
+  m_codec(LengthCodec::Fixed32, true, max_frame_size)
+{
+  m_codec.setFrameCallback([this](TcpConnection &c, const char *data, std::size_t len){
+    this->handleFrame(c, data, len);
+  });
+}
+
+void RpcChannel::call(uint32_t method, const char *data, std::size_t len,
+                      const ResponseCallback &cb, uint64_t timeout_ms /*=0*/)
+{
+  RpcHeader header;
+  header.type = RpcRequestFrame;
+  header.method = method;
+  header.call_id = m_next_call_id.fetch_add(1, std::memory_order_relaxed);
+
+  Slice head, body;
+  encodeFrame(m_codec, header, data, len, nullptr, &head, &body);
+  submitCall(header.call_id, head, body, cb, timeout_ms);
+}
+
+void RpcChannel::call(uint32_t method, const Slice &payload,
+                      const ResponseCallback &cb, uint64_t timeout_ms /*=0*/)
+{
+  RpcHeader header;
+  header.type = RpcRequestFrame;
+  header.method = method;
+  header.call_id = m_next_call_id.fetch_add(1, std::memory_order_relaxed);
+
+  Slice head, body;
+  encodeFrame(m_codec, header, payload.data(), payload.size(), &payload, &head, &body);
+  submitCall(header.call_id, head, body, cb, timeout_ms);
+}
+
+// 请求已经在调用线程编码好，登记和发送转到IO线程
+void RpcChannel::submitCall(uint64_t call_id, const Slice &head, const Slice &body,
+                            const ResponseCallback &cb, uint64_t timeout_ms)
+{
+  if (m_eventloop->isThisThread()) {
+    callInLoop(call_id, head, body, cb, timeout_ms);
+  }
+  else {
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, call_id, head, body, cb, timeout_ms](){
+      self->callInLoop(call_id, head, body, cb, timeout_ms);
+    });
+  }
+}
+
+// 先登记再发送，响应不可能在登记之前到达
+void RpcChannel::callInLoop(uint64_t call_id, const Slice &head, const Slice &body,
+                            const ResponseCallback &cb, uint64_t timeout_ms)
+{
+  if (m_closed || m_conn->getState() != Connected) {
+    const char *msg = rpcStatusString(RpcConnectionClosed);
+    if (cb)
+      cb(RpcConnectionClosed, msg, strlen(msg));
+    return;
+  }
+
+  Pending &pending = m_pending[call_id];
+  pending.m_callback = cb;
+  if (timeout_ms > 0) {
+    pending.m_deadline = get_now_ms() + static_cast<int64_t>(timeout_ms);
+    m_deadlines.insert({pending.m_deadline, call_id});
+    armDeadlineTimer();
+  }
+  m_pending_count.fetch_add(1, std::memory_order_relaxed);
+
+  sendInLoop(head, body);
+}
+
+void RpcChannel::sendResponse(uint64_t call_id, uint32_t method, RpcStatus status, const Slice &payload)
+{
+  RpcHeader header;
+  header.type = RpcResponseFrame;
+  header.status = static_cast<uint8_t>(status);
+  header.method = method;
+  header.call_id = call_id;
+  sendFrame(header, payload);
+}
+
+void RpcChannel::sendFrame(const RpcHeader &header, const Slice &payload)
+{
+  Slice head, body;
+  encodeFrame(m_codec, header, payload.data(), payload.size(), &payload, &head, &body);
+
+  if (m_eventloop->isThisThread()) {
+    sendInLoop(head, body);
+  }
+  else {
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, head, body](){
+      self->sendInLoop(head, body);
+    });
+  }
+}
+
+void RpcChannel::sendInLoop(const Slice &head, const Slice &body)
+{
+  if (m_closed)
+    return;
+  if (body.empty())
+    m_conn->send(head);
+  else
+    m_conn->send(head, body);
+}
+
+void RpcChannel::onMessage(TcpConnection &conn)
+{
+  m_codec.onMessage(conn);
+}
+
+// 连接断开，所有在途的调用以 RpcConnectionClosed 结束，之后不再访问 TcpConnection
+void RpcChannel::onClose()
+{
+  if (m_closed)
+    return;
+  m_closed = true;
+
+  std::unordered_map<uint64_t, Pending> pending;
+  pending.swap(m_pending);
+  m_deadlines.clear();
+  m_pending_count.store(0, std::memory_order_relaxed);
+
+  const char *msg = rpcStatusString(RpcConnectionClosed);
+  for (auto &it : pending) {
+    if (it.second.m_callback)
+      it.second.m_callback(RpcConnectionClosed, msg, strlen(msg));
+  }
+}
+
+void RpcChannel::handleFrame(TcpConnection &conn, const char *data, std::size_t len)
+{
+  RpcHeader header;
+  if (!decodeRpcHeader(data, len, &header)) {
+    LOG_ERROR << "bad RPC frame from " << conn.peerAddress().to_string() << ", close connection";
+    conn.close();
+    return;
+  }
+  data += RPC_HEADER_SIZE;
+  len -= RPC_HEADER_SIZE;
+
+  if (header.type == RpcRequestFrame) {
+    handleRequest(header, data, len);
+  }
+  else if (header.type == RpcResponseFrame) {
+    handleResponse(header, data, len);
+  }
+  else {
+    LOG_ERROR << "unknown RPC frame type " << static_cast<int>(header.type)
+              << " from " << conn.peerAddress().to_string() << ", close connection";
+    conn.close();
+  }
+}
+
+void RpcChannel::handleRequest(const RpcHeader &header, const char *data, std::size_t len)
+{
+  const Handler *handler = nullptr;
+  if (m_handlers) {
+    auto it = m_handlers->find(header.method);
+    if (it != m_handlers->end())
+      handler = &it->second;
+  }
+
+  if (handler == nullptr) {
+    const char *msg = rpcStatusString(RpcNoSuchMethod);
+    sendResponse(header.call_id, header.method, RpcNoSuchMethod, Slice(msg, strlen(msg)));
+    return;
+  }
+
+  RpcResponder responder(shared_from_this(), header.call_id, header.method);
+  RpcRequest request(header.call_id, header.method, data, len);
+  (*handler)(request, responder);
+}
+
+// 找不到对应的调用说明已经超时，响应直接丢弃
+void RpcChannel::handleResponse(const RpcHeader &header, const char *data, std::size_t len)
+{
+  auto it = m_pending.find(header.call_id);
+  if (it == m_pending.end()) {
+    LOG_DEBUG << "drop RPC response " << header.call_id << ", the call has already finished";
+    return;
+  }
+
+  ResponseCallback cb = std::move(it->second.m_callback);
+  if (it->second.m_deadline > 0)
+    m_deadlines.erase({it->second.m_deadline, header.call_id});
+  m_pending.erase(it);
+  m_pending_count.fetch_sub(1, std::memory_order_relaxed);
+
+  RpcStatus status = static_cast<RpcStatus>(header.status);
+  if (cb)
+    cb(status, data, len);
+}
+
+/* 所有调用共用一个定时器，总是对准最早的截止时间
+ * 截止时间最早的调用提前完成时不必修改定时器，到期后会自动对准下一个 */
+void RpcChannel::armDeadlineTimer()
+{
+  if (m_closed || m_deadlines.empty())
+    return;
+  int64_t earliest = m_deadlines.begin()->first;
+  if (m_timer_deadline != 0 && m_timer_deadline <= earliest)
+    return;
+  if (m_timer_deadline != 0)
+    m_conn->cancelTimer(RPC_DEADLINE_TIMER);
+
+  int64_t delay = std::max<int64_t>(earliest - get_now_ms(), 1);
+  m_timer_deadline = earliest;
+  m_conn->addTimer(RPC_DEADLINE_TIMER, static_cast<uint64_t>(delay), [this](TcpConnection&){
+    this->m_timer_deadline = 0;
+    this->expireCalls();
+  });
+}
+
+void RpcChannel::expireCalls()
+{
+  const char *msg = rpcStatusString(RpcTimeout);
+  int64_t now = get_now_ms();
+  // 回调函数中可能发起新的调用，所以每次都从头取最早的一个
+  while (!m_closed && !m_deadlines.empty() && m_deadlines.begin()->first <= now) {
+    uint64_t call_id = m_deadlines.begin()->second;
+    m_deadlines.erase(m_deadlines.begin());
+    auto it = m_pending.find(call_id);
+    if (it == m_pending.end())
+      continue;
+    ResponseCallback cb = std::move(it->second.m_callback);
+    m_pending.erase(it);
+    m_pending_count.fetch_sub(1, std::memory_order_relaxed);
+    if (cb)
+      cb(RpcTimeout, msg, strlen(msg));
+  }
+  armDeadlineTimer();
+}
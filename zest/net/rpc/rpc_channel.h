@@ -0,0 +1,172 @@
+/* 一条连接上的多路复用 RPC 通道，两端都可以发起调用，同时有多个调用在途，响应按完成的顺序返回 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_RPC_RPC_CHANNEL_H
+#define ZEST_NET_RPC_RPC_CHANNEL_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/length_codec.h"
+#include "zest/net/rpc/rpc_protocol.h"
+#include "zest/net/slice.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+
+namespace rpc
+{
+
+class RpcChannel;
+
+// 收到的请求，payload 直接指向接收缓存，只在处理函数执行期间有效
+class RpcRequest
+{
+ public:
+  RpcRequest(uint64_t call_id, uint32_t method, const char *data, std::size_t len)
+    : m_call_id(call_id), m_method(method), m_data(data), m_len(len) { /* do nothing */ }
+
+  uint64_t callId() const {return m_call_id;}
+
+  uint32_t method() const {return m_method;}
+
+  const char *data() const {return m_data;}
+
+  std::size_t size() const {return m_len;}
+
+  std::string str() const {return std::string(m_data, m_len);}
+
+ private:
+  uint64_t m_call_id;
+  uint32_t m_method;
+  const char *m_data;
+  std::size_t m_len;
+};
+
+/* 回复一个请求的句柄，可以拷贝，可以交给其它线程稍后回复，但同一时刻只能有一个线程使用它
+ * 只有第一次 reply() 或 fail() 有效，最后一个句柄析构时还没有回复，会自动回复 RpcHandlerError
+ * 连接断开后的回复会被丢弃 */
+class RpcResponder
+{
+ public:
+  RpcResponder(std::weak_ptr<RpcChannel> channel, uint64_t call_id, uint32_t method);
+
+  void reply(const char *data, std::size_t len);
+  void reply(const std::string &payload) {reply(payload.data(), payload.size());}
+  void reply(const Slice &payload);        // 较大的 Slice 不拷贝
+
+  // 调用方收到 RpcHandlerError，message 作为错误信息
+  void fail(const std::string &message);
+
+  bool replied() const;
+
+  uint64_t callId() const;
+
+ private:
+  struct State;
+  std::shared_ptr<State> m_state;
+};
+
+/* RpcChannel 保存在 TcpConnection 的上下文中，和连接一起销毁
+ * call() 可以在任意线程调用，请求的编码在调用线程完成，登记和发送在连接所属的IO线程中完成
+ * 处理函数和完成回调都在连接所属的IO线程中执行，不能阻塞 */
+class RpcChannel : public std::enable_shared_from_this<RpcChannel>, public noncopyable
+{
+ public:
+  using s_ptr = std::shared_ptr<RpcChannel>;
+  using Handler = std::function<void(const RpcRequest&, RpcResponder&)>;
+  using HandlerMap = std::unordered_map<uint32_t, Handler>;
+  // 调用完成，status 不是 RpcOk 时 data 是错误信息
+  using ResponseCallback = std::function<void(RpcStatus status, const char *data, std::size_t len)>;
+
+  // 不大于这个大小的 payload 和帧头拷贝到一起发送，更大的 Slice 单独作为一个数据片，不拷贝
+  static const std::size_t INLINE_PAYLOAD_SIZE = 4096;
+
+  /* 在连接上创建通道，保存到连接的上下文中，并接管连接的消息回调和关闭回调
+   * handlers 为空时收到的请求都回复 RpcNoSuchMethod，只作为调用方使用
+   * 必须在连接开始读取数据（waitForMessage）之前调用 */
+  static s_ptr attach(TcpConnection &conn, std::shared_ptr<const HandlerMap> handlers = nullptr,
+                      std::size_t max_frame_size = LengthCodec::DEFAULT_MAX_FRAME_SIZE);
+
+  // 获取连接上的通道，没有时返回 nullptr，例如在服务端的处理函数中反向调用客户端
+  static s_ptr get(const TcpConnection &conn);
+
+  RpcChannel(TcpConnection &conn, std::shared_ptr<const HandlerMap> handlers, std::size_t max_frame_size);
+
+  /* 发起一次调用，cb 在收到响应、超时或者连接断开时执行，恰好执行一次
+   * timeout_ms 为 0 表示不设截止时间 */
+  void call(uint32_t method, const char *data, std::size_t len,
+            const ResponseCallback &cb, uint64_t timeout_ms = 0);
+  void call(uint32_t method, const std::string &payload,
+            const ResponseCallback &cb, uint64_t timeout_ms = 0)
+  { call(method, payload.data(), payload.size(), cb, timeout_ms); }
+  void call(uint32_t method, const Slice &payload,
+            const ResponseCallback &cb, uint64_t timeout_ms = 0);
+
+  // 已经发出、还没有完成的调用数量，可以在任意线程读取
+  std::size_t pendingCalls() const {return m_pending_count.load(std::memory_order_relaxed);}
+
+  // 连接的消息回调和关闭回调，attach() 已经设置好，一般不需要直接调用
+  void onMessage(TcpConnection &conn);
+  void onClose();
+
+  // 发送一个响应，可以在任意线程调用，由 RpcResponder 使用
+  void sendResponse(uint64_t call_id, uint32_t method, RpcStatus status, const Slice &payload);
+
+ private:
+  struct Pending
+  {
+    ResponseCallback m_callback;
+    int64_t m_deadline {0};     // 截止时间（毫秒），0 表示没有
+  };
+
+  void submitCall(uint64_t call_id, const Slice &head, const Slice &body,
+                  const ResponseCallback &cb, uint64_t timeout_ms);
+  void callInLoop(uint64_t call_id, const Slice &head, const Slice &body,
+                  const ResponseCallback &cb, uint64_t timeout_ms);
+  void sendFrame(const RpcHeader &header, const Slice &payload);
+  void sendInLoop(const Slice &head, const Slice &body);
+  void handleFrame(TcpConnection &conn, const char *data, std::size_t len);
+  void handleRequest(const RpcHeader &header, const char *data, std::size_t len);
+  void handleResponse(const RpcHeader &header, const char *data, std::size_t len);
+  void armDeadlineTimer();
+  void expireCalls();
+
+ private:
+  TcpConnection *m_conn;
+  std::shared_ptr<EventLoop> m_eventloop;
+  std::shared_ptr<const HandlerMap> m_handlers;
+  LengthCodec m_codec;
+
+  std::atomic<uint64_t> m_next_call_id {1};
+  std::atomic<std::size_t> m_pending_count {0};
+
+  // 以下成员只在连接所属的IO线程中访问
+  bool m_closed {false};
+  std::unordered_map<uint64_t, Pending> m_pending;        // 在途的调用
+  std::set<std::pair<int64_t, uint64_t>> m_deadlines;     // (截止时间, call_id)，按截止时间排序
+  int64_t m_timer_deadline {0};                           // 已经登记的定时器的到期时间，0 表示没有
+};
+
+} // namespace rpc
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_RPC_RPC_CHANNEL_H
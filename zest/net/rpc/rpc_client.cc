@@ -0,0 +1,158 @@
+/* RPC 客户端，一条连接上同时发起任意多个调用，连接由内部的IO线程驱动，调用方不会被阻塞 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/rpc/rpc_client.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "zest/base/logging.h"
+#include "zest/base/sync.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/io_thread.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::rpc;
+
+
+RpcClient::RpcClient(NetBaseAddress &peer_addr) :
+  m_peer_addr(peer_addr.copy()), m_io_thread(new IOThread())
+{
+  m_io_thread->start();
+}
+
+RpcClient::~RpcClient()
+{
+  disconnect();
+}
+
+bool RpcClient::connect(uint64_t timeout_ms /*=3000*/)
+{
+  if (connected())
+    return true;
+  disconnect();
+
+  int fd = socket(m_peer_addr->family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    LOG_ERROR << "create socket failed, errno = " << errno;
+    return false;
+  }
+
+  int rt = ::connect(fd, m_peer_addr->sockaddr(), m_peer_addr->socklen());
+  if (rt == -1 && errno == EINPROGRESS) {
+    // 非阻塞连接，可写时通过 SO_ERROR 确认结果
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    do {
+      rt = poll(&pfd, 1, static_cast<int>(timeout_ms));
+    } while (rt == -1 && errno == EINTR);
+    if (rt == 0) {
+      LOG_ERROR << "Timeout, can't connect with server: " << m_peer_addr->to_string();
+      ::close(fd);
+      return false;
+    }
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (rt == -1 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0) {
+      LOG_ERROR << "Connect to " << m_peer_addr->to_string() << " failed, errno = " << (error ? error : errno);
+      ::close(fd);
+      return false;
+    }
+  }
+  else if (rt == -1) {
+    LOG_ERROR << "Connect to " << m_peer_addr->to_string() << " failed, errno = " << errno;
+    ::close(fd);
+    return false;
+  }
+
+  // 连接建立之后交给IO线程，和服务端接受的连接一样由事件循环驱动
+  TcpConnection::s_ptr conn(new TcpConnection(fd, m_io_thread->get_eventloop(), m_peer_addr));
+  m_channel = RpcChannel::attach(*conn);
+  conn->setTcpNoDelay(true);
+  conn->setWriteCompleteCallback([](TcpConnection &c){
+    c.waitForMessage();
+  });
+  m_connection = conn;
+  m_connection->waitForMessage();
+  return true;
+}
+
+/* 在IO线程中关闭连接，并等到本轮循环结束才返回
+ * 此时IO线程中不会再有引用这个连接的任务（读写事件、合并写等），连接对象可以安全析构 */
+void RpcClient::disconnect()
+{
+  if (!m_connection)
+    return;
+
+  Sem done(0);
+  TcpConnection::s_ptr conn = m_connection;
+  EventLoop::s_ptr eventloop = m_io_thread->get_eventloop();
+  eventloop->runInLoop([conn, eventloop, &done](){
+    if (conn->getState() == Connected || conn->getState() == HalfClosing)
+      conn->close();
+    eventloop->runAtIterationEnd([&done](){
+      done.post();
+    });
+  });
+  done.wait();
+
+  m_channel.reset();
+  m_connection.reset();
+}
+
+bool RpcClient::connected() const
+{
+  return m_connection && m_connection->getState() == Connected;
+}
+
+void RpcClient::call(uint32_t method, const std::string &payload,
+                     const ResponseCallback &cb, uint64_t timeout_ms /*=0*/)
+{
+  if (!m_channel) {
+    const char *msg = rpcStatusString(RpcConnectionClosed);
+    if (cb)
+      cb(RpcConnectionClosed, msg, strlen(msg));
+    return;
+  }
+  m_channel->call(method, payload, cb, timeout_ms);
+}
+
+void RpcClient::call(uint32_t method, const Slice &payload,
+                     const ResponseCallback &cb, uint64_t timeout_ms /*=0*/)
+{
+  if (!m_channel) {
+    const char *msg = rpcStatusString(RpcConnectionClosed);
+    if (cb)
+      cb(RpcConnectionClosed, msg, strlen(msg));
+    return;
+  }
+  m_channel->call(method, payload, cb, timeout_ms);
+}
+
+RpcStatus RpcClient::callSync(uint32_t method, const std::string &payload,
+                              std::string *response, uint64_t timeout_ms /*=0*/)
+{
+  Sem done(0);
+  RpcStatus result = RpcOk;
+  call(method, payload, [&](RpcStatus status, const char *data, std::size_t len){
+    result = status;
+    if (response)
+      response->assign(data, len);
+    done.post();
+  }, timeout_ms);
+  done.wait();
+  return result;
+}
+
+std::size_t RpcClient::pendingCalls() const
+{
+  return m_channel ? m_channel->pendingCalls() : 0;
+}
@@ -0,0 +1,77 @@
+/* RPC 客户端，一条连接上同时发起任意多个调用，连接由内部的IO线程驱动，调用方不会被阻塞 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_RPC_RPC_CLIENT_H
+#define ZEST_NET_RPC_RPC_CLIENT_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/base_addr.h"
+#include "zest/net/rpc/rpc_channel.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class IOThread;
+
+namespace rpc
+{
+
+/* 和 TcpClient 不同，连接建立之后由内部的IO线程持续监听，call() 只负责把请求交给IO线程
+ * 完成回调在IO线程中执行，不能阻塞；callSync() 是阻塞调用方的简单封装
+ * connect() / disconnect() 不能和 call() 并发调用 */
+class RpcClient : public noncopyable
+{
+ public:
+  using ResponseCallback = RpcChannel::ResponseCallback;
+
+  explicit RpcClient(NetBaseAddress &peer_addr);
+
+  ~RpcClient();
+
+  // 阻塞等待连接建立，超时或者失败时返回 false
+  bool connect(uint64_t timeout_ms = 3000);
+
+  // 断开连接，在途的调用以 RpcConnectionClosed 结束，返回时连接已经关闭
+  void disconnect();
+
+  bool connected() const;
+
+  // 没有连接时 cb 立即以 RpcConnectionClosed 执行
+  void call(uint32_t method, const std::string &payload,
+            const ResponseCallback &cb, uint64_t timeout_ms = 0);
+  void call(uint32_t method, const Slice &payload,
+            const ResponseCallback &cb, uint64_t timeout_ms = 0);
+
+  // 同步调用，成功时 response 是响应，失败时是错误信息，不能在IO线程（完成回调）中调用
+  RpcStatus callSync(uint32_t method, const std::string &payload,
+                     std::string *response, uint64_t timeout_ms = 0);
+
+  // 在途的调用数量
+  std::size_t pendingCalls() const;
+
+  RpcChannel::s_ptr channel() const {return m_channel;}
+
+ private:
+  NetBaseAddress::s_ptr m_peer_addr;
+  std::unique_ptr<IOThread> m_io_thread;
+  TcpConnection::s_ptr m_connection {nullptr};
+  RpcChannel::s_ptr m_channel {nullptr};
+};
+
+} // namespace rpc
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_RPC_RPC_CLIENT_H
@@ -0,0 +1,64 @@
+/* RPC 的帧格式 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/rpc/rpc_protocol.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::rpc;
+
+static void putBigEndian(char *buf, uint64_t value, int bytes)
+{
+  for (int i = bytes - 1; i >= 0; --i) {
+    buf[i] = static_cast<char>(value & 0xff);
+    value >>= 8;
+  }
+}
+
+static uint64_t getBigEndian(const char *buf, int bytes)
+{
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; ++i)
+    value = (value << 8) | static_cast<unsigned char>(buf[i]);
+  return value;
+}
+
+void zest::net::rpc::encodeRpcHeader(const RpcHeader &header, char *buf)
+{
+  buf[0] = static_cast<char>(header.type);
+  buf[1] = static_cast<char>(header.status);
+  putBigEndian(buf + 2, header.method, 4);
+  putBigEndian(buf + 6, header.call_id, 8);
+}
+
+bool zest::net::rpc::decodeRpcHeader(const char *data, std::size_t len, RpcHeader *header)
+{
+  if (len < RPC_HEADER_SIZE)
+    return false;
+  header->type = static_cast<uint8_t>(data[0]);
+  header->status = static_cast<uint8_t>(data[1]);
+  header->method = static_cast<uint32_t>(getBigEndian(data + 2, 4));
+  header->call_id = getBigEndian(data + 6, 8);
+  return true;
+}
+
+const char *zest::net::rpc::rpcStatusString(RpcStatus status)
+{
+  switch (status)
+  {
+  case RpcOk:
+    return "ok";
+  case RpcNoSuchMethod:
+    return "no such method";
+  case RpcHandlerError:
+    return "handler error";
+  case RpcTimeout:
+    return "timeout";
+  case RpcConnectionClosed:
+    return "connection closed";
+  default:
+    return "unknown status";
+  }
+}
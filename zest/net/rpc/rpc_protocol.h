@@ -0,0 +1,63 @@
+/* RPC 的帧格式，帧由 LengthCodec 分帧（4字节大端长度字段），帧内容为：
+ *   [type:1][status:1][method:4][call_id:8][payload]
+ * 多字节整数都是大端，call_id 由发起调用的一方分配，响应原样带回，因此响应可以乱序返回 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_RPC_RPC_PROTOCOL_H
+#define ZEST_NET_RPC_RPC_PROTOCOL_H
+
+#include <stdint.h>
+
+#include <cstddef>
+
+namespace zest
+{
+namespace net
+{
+namespace rpc
+{
+
+enum RpcFrameType {
+  RpcRequestFrame = 0,
+  RpcResponseFrame = 1,
+};
+
+/* 调用的结果，前三个由对端在响应中返回，后两个在本地产生
+ * 失败时响应的 payload 是错误信息 */
+enum RpcStatus {
+  RpcOk = 0,
+  RpcNoSuchMethod = 1,      // 对端没有注册这个方法
+  RpcHandlerError = 2,      // 处理函数调用了 fail()，或者没有回复就丢弃了 RpcResponder
+  RpcTimeout = 3,           // 截止时间之前没有收到响应
+  RpcConnectionClosed = 4,  // 连接断开，或者调用时连接已经不可用
+};
+
+// 帧头的字节数（不含长度字段）
+static const std::size_t RPC_HEADER_SIZE = 14;
+
+struct RpcHeader
+{
+  uint8_t type {RpcRequestFrame};
+  uint8_t status {RpcOk};
+  uint32_t method {0};
+  uint64_t call_id {0};
+};
+
+// 把帧头写进 buf（至少 RPC_HEADER_SIZE 字节）
+void encodeRpcHeader(const RpcHeader &header, char *buf);
+
+// 从 [data, data+len) 中解析帧头，长度不够时返回 false
+bool decodeRpcHeader(const char *data, std::size_t len, RpcHeader *header);
+
+// 状态对应的描述，例如 RpcTimeout -> "timeout"
+const char *rpcStatusString(RpcStatus status);
+
+} // namespace rpc
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_RPC_RPC_PROTOCOL_H
@@ -0,0 +1,44 @@
+/* 基于 TcpServer 的 RPC 服务器，按方法号分发请求，同一条连接上的请求可以并发处理、乱序回复 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/rpc/rpc_server.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::rpc;
+using std::placeholders::_1;
+
+
+RpcServer::RpcServer(NetBaseAddress &local_addr, int thread_nums /*=4*/) :
+  m_server(local_addr, thread_nums),
+  m_handlers(std::make_shared<RpcChannel::HandlerMap>()),
+  m_max_frame_size(LengthCodec::DEFAULT_MAX_FRAME_SIZE)
+{
+  m_server.setOnConnectionCallback(std::bind(&RpcServer::onConnection, this, _1));
+  m_server.setWriteCompleteCallback(std::bind(&RpcServer::onWriteComplete, this, _1));
+}
+
+void RpcServer::registerMethod(uint32_t method, const Handler &handler)
+{
+  (*m_handlers)[method] = handler;
+}
+
+void RpcServer::start()
+{
+  m_server.start();
+}
+
+void RpcServer::onConnection(TcpConnection &conn)
+{
+  RpcChannel::attach(conn, m_handlers, m_max_frame_size);
+  conn.setTcpNoDelay(true);
+  conn.waitForMessage();
+}
+
+// 大的响应发送时改为监听可写事件，发完之后重新监听可读事件
+void RpcServer::onWriteComplete(TcpConnection &conn)
+{
+  conn.waitForMessage();
+}
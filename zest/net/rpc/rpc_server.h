@@ -0,0 +1,60 @@
+/* 基于 TcpServer 的 RPC 服务器，按方法号分发请求，同一条连接上的请求可以并发处理、乱序回复 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_RPC_RPC_SERVER_H
+#define ZEST_NET_RPC_RPC_SERVER_H
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/base_addr.h"
+#include "zest/net/rpc/rpc_channel.h"
+#include "zest/net/tcp_server.h"
+
+namespace zest
+{
+namespace net
+{
+namespace rpc
+{
+
+/* 每条连接创建一个 RpcChannel，所有连接共享同一张方法表
+ * 处理函数在连接所属的IO线程中执行，耗时的处理可以把 RpcResponder 拷贝到其它线程，稍后回复 */
+class RpcServer : public noncopyable
+{
+ public:
+  using Handler = RpcChannel::Handler;
+
+  explicit RpcServer(NetBaseAddress &local_addr, int thread_nums = 4);
+
+  // 注册方法，必须在 start() 之前调用
+  void registerMethod(uint32_t method, const Handler &handler);
+
+  // 单个帧的大小上限，超出时断开连接
+  void setMaxFrameSize(std::size_t bytes) {m_max_frame_size = bytes;}
+
+  TcpServer &tcpServer() {return m_server;}
+
+  void start();
+
+ private:
+  void onConnection(TcpConnection &conn);
+  void onWriteComplete(TcpConnection &conn);
+
+ private:
+  TcpServer m_server;
+  std::shared_ptr<RpcChannel::HandlerMap> m_handlers;
+  std::size_t m_max_frame_size;
+};
+
+} // namespace rpc
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_RPC_RPC_SERVER_H
@@ -0,0 +1,570 @@
+/* 基于共享内存环的同机连接：握手走 Unix 域套接字，之后数据在两个进程映射的 SPSC 环中传递，用 eventfd 作门铃 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/shm/shm_connection.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "zest/base/logging.h"
+#include "zest/base/util.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/fd_event.h"
+#include "zest/net/shm/shm_ring.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::shm;
+
+
+// 一次门铃最多连续处理的轮数，之后让出给同一线程的其它连接
+static const int MAX_INPUT_ROUNDS = 16;
+
+// 客户端等待服务器确认握手的时间
+static const int HANDSHAKE_TIMEOUT_SECONDS = 3;
+
+static std::size_t pageSize()
+{
+  return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// 共享头部占用的字节数，按页对齐，后面的环才能用 mmap 映射
+static std::size_t headerBytes()
+{
+  std::size_t page = pageSize();
+  return (sizeof(ShmSharedHeader) + page - 1) / page * page;
+}
+
+// 环的大小取不小于 bytes 的 2 的幂，至少一页
+static uint64_t roundRingBytes(std::size_t bytes)
+{
+  uint64_t ring = pageSize();
+  while (ring < bytes)
+    ring <<= 1;
+  return ring;
+}
+
+
+ShmConnection::ShmConnection(std::shared_ptr<EventLoop> eventloop, bool is_server, int control_fd,
+                             int memfd, int my_doorbell, int peer_doorbell) :
+  m_eventloop(eventloop), m_is_server(is_server), m_control_fd(control_fd), m_memfd(memfd),
+  m_my_doorbell(my_doorbell), m_peer_doorbell(peer_doorbell)
+{
+  /* do nothing */
+}
+
+ShmConnection::~ShmConnection()
+{
+  LOG_DEBUG << "ShmConnection::~ShmConnection(), this = " << this;
+  if (m_mapping)
+    munmap(m_mapping, m_mapping_len);
+  for (int fd : {m_control_fd, m_memfd, m_my_doorbell, m_peer_doorbell}) {
+    if (fd >= 0)
+      ::close(fd);
+  }
+}
+
+/* 客户端创建 memfd 和两个 eventfd，通过 Unix 域套接字一次发给服务器，
+ * 服务器映射成功后回复一个字节，之后这个套接字只用来发现对端进程退出
+ * memfd 封住大小，任何一方都不能再截短它，映射的页不会越过文件末尾 */
+ShmConnection::s_ptr ShmConnection::connect(std::shared_ptr<EventLoop> eventloop, UnixAddress &addr,
+                                            std::size_t ring_bytes /*=DEFAULT_RING_BYTES*/)
+{
+  uint64_t ring = roundRingBytes(ring_bytes);
+  int memfd = static_cast<int>(syscall(SYS_memfd_create, "zest_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+  if (memfd == -1) {
+    LOG_ERROR << "memfd_create failed, errno = " << errno;
+    return nullptr;
+  }
+  if (ftruncate(memfd, headerBytes() + 2 * ring) == -1 ||
+      fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == -1) {
+    LOG_ERROR << "ftruncate or seal memfd failed, errno = " << errno;
+    ::close(memfd);
+    return nullptr;
+  }
+  int server_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int client_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  s_ptr conn(new ShmConnection(eventloop, false, sockfd, memfd, client_doorbell, server_doorbell));
+  if (server_doorbell == -1 || client_doorbell == -1 || sockfd == -1) {
+    LOG_ERROR << "create eventfd or socket failed, errno = " << errno;
+    return nullptr;
+  }
+  if (!conn->mapMemory(ring, true))
+    return nullptr;
+
+  if (::connect(sockfd, addr.sockaddr(), addr.socklen()) == -1) {
+    LOG_ERROR << "connect to " << addr.to_string() << " failed, errno = " << errno;
+    return nullptr;
+  }
+
+  ShmHello hello;
+  hello.m_magic = SHM_MAGIC;
+  hello.m_version = SHM_VERSION;
+  hello.m_ring_bytes = ring;
+  int fds[3] = {memfd, server_doorbell, client_doorbell};
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  struct iovec iov;
+  iov.iov_base = &hello;
+  iov.iov_len = sizeof(hello);
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  if (::sendmsg(sockfd, &msg, 0) != static_cast<ssize_t>(sizeof(hello))) {
+    LOG_ERROR << "send shm handshake failed, errno = " << errno;
+    return nullptr;
+  }
+
+  timeval timeout = {HANDSHAKE_TIMEOUT_SECONDS, 0};
+  setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  char ack = 0;
+  if (::recv(sockfd, &ack, 1, 0) != 1 || ack != 1) {
+    LOG_ERROR << "shm handshake rejected by " << addr.to_string();
+    return nullptr;
+  }
+  set_non_blocking(sockfd);
+  return conn;
+}
+
+/* 整块映射的布局：共享头部，然后每个环占两倍大小的地址空间，同一段数据连续映射两次
+ * 客户端负责初始化共享头部，服务器只检查
+ * 服务器还要检查 memfd 足够大并且已经封住大小，否则客户端截短文件后访问映射会收到 SIGBUS */
+bool ShmConnection::mapMemory(uint64_t ring_bytes, bool init)
+{
+  std::size_t header_bytes = headerBytes();
+  if (!init) {
+    struct stat st;
+    int seals = fcntl(m_memfd, F_GET_SEALS);
+    if (fstat(m_memfd, &st) == -1 || static_cast<uint64_t>(st.st_size) < header_bytes + 2 * ring_bytes ||
+        seals == -1 || (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW)) {
+      LOG_ERROR << "shm memfd is too small or not sealed";
+      return false;
+    }
+  }
+  std::size_t len = header_bytes + 4 * ring_bytes;
+  char *base = static_cast<char*>(mmap(NULL, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (base == MAP_FAILED) {
+    LOG_ERROR << "reserve " << len << " bytes address space failed, errno = " << errno;
+    return false;
+  }
+  m_mapping = base;
+  m_mapping_len = len;
+
+  if (mmap(base, header_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_memfd, 0) == MAP_FAILED) {
+    LOG_ERROR << "mmap shm header failed, errno = " << errno;
+    return false;
+  }
+  char *rings[2];
+  for (int i = 0; i < 2; ++i) {
+    rings[i] = base + header_bytes + 2 * i * ring_bytes;
+    off_t offset = static_cast<off_t>(header_bytes + i * ring_bytes);
+    if (mmap(rings[i], ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_memfd, offset) == MAP_FAILED ||
+        mmap(rings[i] + ring_bytes, ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_memfd, offset) == MAP_FAILED) {
+      LOG_ERROR << "mmap shm ring failed, errno = " << errno;
+      return false;
+    }
+  }
+
+  m_header = reinterpret_cast<ShmSharedHeader*>(base);
+  if (init) {
+    memset(static_cast<void*>(m_header), 0, sizeof(ShmSharedHeader));
+    m_header->m_magic = SHM_MAGIC;
+    m_header->m_version = SHM_VERSION;
+    m_header->m_ring_bytes = ring_bytes;
+  }
+  else if (m_header->m_magic != SHM_MAGIC || m_header->m_version != SHM_VERSION ||
+           m_header->m_ring_bytes != ring_bytes) {
+    LOG_ERROR << "invalid shm header";
+    return false;
+  }
+
+  // 环 0 是客户端到服务器，环 1 是服务器到客户端
+  int rx = m_is_server ? 0 : 1;
+  m_rx.reset(new ShmRing(&m_header->m_rings[rx], rings[rx], ring_bytes));
+  m_tx.reset(new ShmRing(&m_header->m_rings[1 - rx], rings[1 - rx], ring_bytes));
+  return true;
+}
+
+/* 注册门铃和控制套接字，回调里只持有弱引用，连接在同一轮的其它事件中析构也不会访问已释放的对象
+ * 注册之前对端可能已经写入了数据，本轮结束时检查一次 */
+void ShmConnection::waitForMessage()
+{
+  if (!m_eventloop->isThisThread()) {
+    m_eventloop->runInLoop(std::bind(&ShmConnection::waitForMessage, shared_from_this()));
+    return;
+  }
+  if (m_started || m_state != Connected)
+    return;
+  m_started = true;
+
+  std::weak_ptr<ShmConnection> weak = shared_from_this();
+  m_doorbell_event = std::make_shared<FdEvent>(m_my_doorbell);
+  m_doorbell_event->listen(EPOLLIN | EPOLLET, [weak](){
+    if (s_ptr self = weak.lock())
+      self->handleDoorbell();
+  });
+  m_eventloop->addEpollEvent(m_doorbell_event);
+  m_control_event = std::make_shared<FdEvent>(m_control_fd);
+  m_control_event->listen(EPOLLIN | EPOLLET, [weak](){
+    if (s_ptr self = weak.lock())
+      self->handleControl();
+  });
+  m_eventloop->addEpollEvent(m_control_event);
+
+  m_eventloop->runAtIterationEnd([weak](){
+    if (s_ptr self = weak.lock())
+      self->processInput();
+  });
+}
+
+const char *ShmConnection::peek() const
+{
+  return m_rx->readPtr();
+}
+
+std::size_t ShmConnection::dataSize() const
+{
+  return static_cast<std::size_t>(m_rx->readable());
+}
+
+std::string ShmConnection::data() const
+{
+  return std::string(peek(), dataSize());
+}
+
+std::size_t ShmConnection::find(char c, std::size_t from /*=0*/) const
+{
+  std::size_t size = dataSize();
+  if (from >= size)
+    return std::string::npos;
+  const char *p = peek();
+  const void *pos = memchr(p + from, c, size - from);
+  return pos ? static_cast<const char*>(pos) - p : std::string::npos;
+}
+
+std::size_t ShmConnection::find(const std::string &delim, std::size_t from /*=0*/) const
+{
+  std::size_t size = dataSize();
+  if (from >= size || delim.empty())
+    return std::string::npos;
+  const char *p = peek();
+  const char *pos = std::search(p + from, p + size, delim.begin(), delim.end());
+  return pos == p + size ? std::string::npos : pos - p;
+}
+
+void ShmConnection::clearData()
+{
+  clearBytesData(static_cast<int>(dataSize()));
+}
+
+// 推进 tail 把空间还给对端，对端因为环满在等待时，本轮结束时叫醒它
+void ShmConnection::clearBytesData(int bytes)
+{
+  if (bytes <= 0)
+    return;
+  uint64_t n = std::min<uint64_t>(static_cast<uint64_t>(bytes), m_rx->readable());
+  m_rx->consume(n);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_rx->producerBlocked().load(std::memory_order_relaxed) &&
+      m_rx->producerBlocked().exchange(0)) {
+    m_ring_pending = true;
+    scheduleIterationEnd();
+  }
+}
+
+void ShmConnection::send(const std::string &str)
+{
+  send(str.data(), str.size());
+}
+
+void ShmConnection::send(const char *str)
+{
+  send(str, strlen(str));
+}
+
+// IO线程中直接拷贝进环，不需要先拷贝一份；其它线程调用时先拷贝到数据片中
+void ShmConnection::send(const char *str, std::size_t len)
+{
+  if (m_eventloop->isThisThread())
+    sendInLoop(str, len, nullptr);
+  else
+    send(Slice(std::string(str, len)));
+}
+
+void ShmConnection::send(const Slice &slice)
+{
+  if (m_eventloop->isThisThread()) {
+    sendInLoop(slice.data(), slice.size(), &slice);
+  }
+  else {
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, slice](){
+      self->sendInLoop(slice.data(), slice.size(), &slice);
+    });
+  }
+}
+
+/* 发送队列为空时直接写进环，写不下的部分排队，等对端读出数据后由门铃叫醒再写
+ * 对端睡眠时不立即敲门铃，本轮结束时敲一次，同一轮的多次发送只产生一次系统调用 */
+void ShmConnection::sendInLoop(const char *data, std::size_t len, const Slice *owner)
+{
+  if (m_state != Connected || len == 0)
+    return;
+  m_wrote = true;
+  std::size_t written = 0;
+  if (m_pending.empty()) {
+    written = static_cast<std::size_t>(std::min<uint64_t>(m_tx->writable(), len));
+    if (written > 0) {
+      m_tx->write(data, written);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (m_tx->consumerSleeping().load(std::memory_order_relaxed) &&
+          m_tx->consumerSleeping().exchange(0))
+        m_ring_pending = true;
+    }
+  }
+  if (written < len) {
+    if (owner) {
+      Slice rest = *owner;
+      rest.remove_prefix(written);
+      m_pending.push_back(rest);
+    }
+    else {
+      m_pending.push_back(Slice(std::string(data + written, len - written)));
+    }
+    flushPending();
+  }
+  if (ringCorrupted())
+    return;
+  scheduleIterationEnd();
+}
+
+// 把排队的数据写进环，写不下时置 producer_blocked 再检查一次，避免对端恰好在置位之前读完
+void ShmConnection::flushPending()
+{
+  bool wrote = false;
+  while (!m_pending.empty()) {
+    uint64_t room = m_tx->writable();
+    if (room == 0) {
+      m_tx->producerBlocked().store(1);
+      if (m_tx->writable() == 0)
+        break;
+      m_tx->producerBlocked().store(0, std::memory_order_relaxed);
+      continue;
+    }
+    Slice &front = m_pending.front();
+    std::size_t n = static_cast<std::size_t>(std::min<uint64_t>(room, front.size()));
+    m_tx->write(front.data(), n);
+    front.remove_prefix(n);
+    if (front.empty())
+      m_pending.pop_front();
+    wrote = true;
+  }
+  if (wrote) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_tx->consumerSleeping().load(std::memory_order_relaxed) &&
+        m_tx->consumerSleeping().exchange(0))
+      m_ring_pending = true;
+    scheduleIterationEnd();
+  }
+}
+
+void ShmConnection::ringPeer()
+{
+  m_ring_pending = false;
+  uint64_t one = 1;
+  if (::write(m_peer_doorbell, &one, sizeof(one)) == sizeof(one))
+    m_doorbells_sent.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ShmConnection::scheduleIterationEnd()
+{
+  if (m_iteration_end_pending)
+    return;
+  m_iteration_end_pending = true;
+  std::weak_ptr<ShmConnection> weak = shared_from_this();
+  m_eventloop->runAtIterationEnd([weak](){
+    if (s_ptr self = weak.lock())
+      self->finishIteration();
+  });
+}
+
+// 本轮结束：敲一次对端的门铃，发送队列清空时调用写完成回调
+void ShmConnection::finishIteration()
+{
+  m_iteration_end_pending = false;
+  if (m_state != Connected)
+    return;
+  if (m_ring_pending)
+    ringPeer();
+  if (m_wrote && m_pending.empty()) {
+    m_wrote = false;
+    if (m_write_complete_callback)
+      m_write_complete_callback(*this);
+  }
+}
+
+void ShmConnection::handleDoorbell()
+{
+  uint64_t count;
+  while (::read(m_my_doorbell, &count, sizeof(count)) == sizeof(count))
+    m_doorbells_received.fetch_add(1, std::memory_order_relaxed);
+  if (m_state != Connected)
+    return;
+  flushPending();
+  if (ringCorrupted())
+    return;
+  processInput();
+}
+
+// 握手之后对端不会再发数据，可读只意味着对端进程退出或者关闭了套接字
+void ShmConnection::handleControl()
+{
+  if (m_state != Connected)
+    return;
+  char buf[64];
+  ssize_t n;
+  while ((n = ::recv(m_control_fd, buf, sizeof(buf), 0)) > 0) {
+    /* 丢弃 */
+  }
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    processInput();
+    close();
+  }
+}
+
+/* 有新数据就调用消息回调，没有消费完的数据留在环中，等下次有新数据时一起交给回调
+ * 准备回到 epoll 之前先置 consumer_sleeping 再检查一次，之后到达的数据由对端敲门铃 */
+void ShmConnection::processInput()
+{
+  if (m_state != Connected)
+    return;
+  s_ptr self = shared_from_this();   // 回调中可能关闭连接，连接随之被移出连接表
+  m_rx->consumerSleeping().store(0, std::memory_order_relaxed);
+
+  int rounds = 0;
+  while (true) {
+    uint64_t head = m_rx->head();
+    if (m_rx->corrupted())
+      break;
+    if (head != m_delivered_head) {
+      m_delivered_head = head;
+      if (m_message_callback)
+        m_message_callback(*this);
+      if (m_state != Connected)
+        return;
+      if (++rounds >= MAX_INPUT_ROUNDS) {
+        // 对端一直在写，让出给同一线程的其它连接，敲自己的门铃下一轮继续
+        uint64_t one = 1;
+        if (::write(m_my_doorbell, &one, sizeof(one)) != sizeof(one))
+          LOG_ERROR << "write shm doorbell failed, errno = " << errno;
+        return;
+      }
+      continue;
+    }
+
+    // 忙等之前先把本轮积攒的门铃敲掉，对端才能尽快处理我们的数据
+    if (m_busy_poll_us > 0) {
+      if (m_ring_pending)
+        ringPeer();
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_busy_poll_us);
+      while (m_rx->head() == m_delivered_head && !peerClosed() &&
+             std::chrono::steady_clock::now() < deadline) {
+        /* spin */
+      }
+      if (m_rx->head() != m_delivered_head)
+        continue;
+    }
+
+    m_rx->consumerSleeping().store(1);
+    if (m_rx->head() != m_delivered_head) {
+      m_rx->consumerSleeping().store(0, std::memory_order_relaxed);
+      continue;
+    }
+    break;
+  }
+  if (ringCorrupted())
+    return;
+  if (peerClosed())
+    close();
+}
+
+// 对端改写了环的索引，数据量超出了环的容量，按协议错误关闭连接
+bool ShmConnection::ringCorrupted()
+{
+  if (!m_rx->corrupted() && !m_tx->corrupted())
+    return false;
+  LOG_ERROR << "shm ring index out of range, close connection";
+  close();
+  return true;
+}
+
+bool ShmConnection::peerClosed() const
+{
+  return m_header->m_closed[m_is_server ? 0 : 1].load() != 0;
+}
+
+std::size_t ShmConnection::outputBytes() const
+{
+  std::size_t bytes = 0;
+  for (const Slice &slice : m_pending)
+    bytes += slice.size();
+  return bytes;
+}
+
+/* 在共享头部标记关闭并叫醒对端，对端读完环中剩下的数据后也会关闭
+ * 映射保留到析构，关闭回调中仍然可以读取环中的数据 */
+void ShmConnection::close()
+{
+  m_eventloop->assertInLoopThread();
+  if (m_state != Connected)
+    return;
+  s_ptr self = shared_from_this();
+
+  m_state = Closed;
+  if (m_close_callback)
+    m_close_callback(*this);
+  m_header->m_closed[m_is_server ? 1 : 0].store(1);
+  ringPeer();
+  if (m_started) {
+    m_eventloop->deleteEpollEvent(m_doorbell_event);
+    m_eventloop->deleteEpollEvent(m_control_event);
+  }
+  m_pending.clear();
+  ::close(m_control_fd);
+  m_control_fd = -1;
+}
@@ -0,0 +1,148 @@
+/* 基于共享内存环的同机连接：握手走 Unix 域套接字，之后数据在两个进程映射的 SPSC 环中传递，用 eventfd 作门铃 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_SHM_SHM_CONNECTION_H
+#define ZEST_NET_SHM_SHM_CONNECTION_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/slice.h"
+#include "zest/net/tcp_connection.h"
+#include "zest/net/unix_addr.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+class FdEvent;
+
+namespace shm
+{
+
+class ShmRing;
+struct ShmSharedHeader;
+class ShmServer;
+
+/* 接口和 TcpConnection 保持一致：接收的数据用 peek()/dataSize() 查看，用 clearBytesData() 消费，
+ * 不同的是数据直接在共享的环中，没有拷贝到接收缓存；一条不完整的消息不能超过环的大小
+ * 发送时数据直接拷贝进对端可见的环，只有对端已经回到 epoll 等待时才写 eventfd 叫醒它，
+ * 双方都忙碌时数据通路上没有系统调用
+ * 所有方法只能在所属的IO线程中调用，send 除外 */
+class ShmConnection : public noncopyable, public std::enable_shared_from_this<ShmConnection>
+{
+  friend class ShmServer;
+
+ public:
+  using s_ptr = std::shared_ptr<ShmConnection>;
+  using ConnectionCallbackFunc = std::function<void(ShmConnection&)>;
+
+  static const std::size_t DEFAULT_RING_BYTES = 1024 * 1024;
+
+  /* 连接 addr 上的 ShmServer，创建共享内存和门铃，阻塞等待服务器确认，失败返回 nullptr
+   * ring_bytes 是每个方向的环的大小，会向上取整到 2 的幂
+   * 返回的连接属于 eventloop，设置好回调函数后调用 waitForMessage() 开始接收 */
+  static s_ptr connect(std::shared_ptr<EventLoop> eventloop, UnixAddress &addr,
+                       std::size_t ring_bytes = DEFAULT_RING_BYTES);
+
+  ~ShmConnection();
+
+  void waitForMessage();              // 开始接收，在 IO 线程中注册门铃
+  const char *peek() const;           // 指向环中数据的指针，不拷贝数据
+  std::size_t dataSize() const;       // 环中可读的数据量
+  std::string data() const;           // 拷贝一份环中的数据
+  std::size_t find(char c, std::size_t from = 0) const;   // 在环中查找，找不到返回 std::string::npos
+  std::size_t find(const std::string &delim, std::size_t from = 0) const;
+  void clearData();                   // 消费环中全部数据
+  void clearBytesData(int bytes);     // 消费 bytes 个字节
+  void send(const std::string &str);  // 发送数据，可以在任意线程调用
+  void send(const char *str);
+  void send(const char *str, std::size_t len);
+  void send(const Slice &slice);
+  void close();                       // 断开连接，对端随后也会关闭
+
+  // 回到 epoll 之前先忙等 us 微秒，对端在这段时间里发来的数据不需要门铃，0 表示不忙等
+  void setBusyPoll(uint64_t us) {m_busy_poll_us = us;}
+
+  // 环满了还没有写进去的字节数
+  std::size_t outputBytes() const;
+
+  // 敲对端门铃和被对端叫醒的次数，即数据通路上的系统调用次数
+  uint64_t doorbellsSent() const {return m_doorbells_sent.load(std::memory_order_relaxed);}
+  uint64_t doorbellsReceived() const {return m_doorbells_received.load(std::memory_order_relaxed);}
+
+  std::shared_ptr<EventLoop> getEventLoop() const {return m_eventloop;}
+  TcpState getState() const {return m_state;}
+
+  void setMessageCallback(const ConnectionCallbackFunc &cb) {m_message_callback = cb;}
+  void setWriteCompleteCallback(const ConnectionCallbackFunc &cb) {m_write_complete_callback = cb;}
+  void setCloseCallback(const ConnectionCallbackFunc &cb) {m_close_callback = cb;}
+
+ private:
+  ShmConnection(std::shared_ptr<EventLoop> eventloop, bool is_server, int control_fd,
+                int memfd, int my_doorbell, int peer_doorbell);
+
+  bool mapMemory(uint64_t ring_bytes, bool init);
+  void handleDoorbell();
+  void handleControl();
+  void processInput();
+  void sendInLoop(const char *data, std::size_t len, const Slice *owner);
+  void flushPending();
+  void ringPeer();
+  void finishIteration();
+  void scheduleIterationEnd();
+  bool peerClosed() const;
+  bool ringCorrupted();
+
+ private:
+  std::shared_ptr<EventLoop> m_eventloop;
+  bool m_is_server;
+  TcpState m_state {Connected};
+  bool m_started {false};
+
+  int m_control_fd;        // 握手用的 Unix 域套接字，之后只用来发现对端进程退出
+  int m_memfd;
+  int m_my_doorbell;       // 自己监听的 eventfd
+  int m_peer_doorbell;     // 对端监听的 eventfd
+  std::shared_ptr<FdEvent> m_doorbell_event;
+  std::shared_ptr<FdEvent> m_control_event;
+
+  void *m_mapping {nullptr};          // 整块映射的地址和长度
+  std::size_t m_mapping_len {0};
+  ShmSharedHeader *m_header {nullptr};
+  std::unique_ptr<ShmRing> m_rx;
+  std::unique_ptr<ShmRing> m_tx;
+
+  uint64_t m_delivered_head {0};      // 已经交给消息回调的数据的位置，有新数据时才再次回调
+  std::deque<Slice> m_pending;        // 环满时等待写入的数据
+  bool m_iteration_end_pending {false};
+  bool m_ring_pending {false};        // 本轮结束时需要敲对端的门铃
+  bool m_wrote {false};               // 本轮有数据写入，结束时调用写完成回调
+  uint64_t m_busy_poll_us {0};
+
+  std::atomic<uint64_t> m_doorbells_sent {0};
+  std::atomic<uint64_t> m_doorbells_received {0};
+
+  ConnectionCallbackFunc m_message_callback {nullptr};
+  ConnectionCallbackFunc m_write_complete_callback {nullptr};
+  ConnectionCallbackFunc m_close_callback {nullptr};
+};
+
+} // namespace shm
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_SHM_SHM_CONNECTION_H
@@ -0,0 +1,131 @@
+/* 共享内存中的单生产者单消费者字节环，两个进程各自映射同一块 memfd */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is an internal header file, you should not include this.
+
+#ifndef ZEST_NET_SHM_SHM_RING_H
+#define ZEST_NET_SHM_SHM_RING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+namespace zest
+{
+namespace net
+{
+namespace shm
+{
+
+static const uint32_t SHM_MAGIC = 0x4d48535a;   // "ZSHM"
+static const uint32_t SHM_VERSION = 1;
+
+// 客户端通过 Unix 域套接字发给服务器的握手消息，同时携带 memfd 和两个 eventfd
+struct ShmHello
+{
+  uint32_t m_magic;
+  uint32_t m_version;
+  uint64_t m_ring_bytes;   // 每个方向的环的大小，2 的幂并且是页大小的整数倍
+};
+
+/* 一个方向的环的控制字段，生产者和消费者修改的字段放在不同的缓存行，避免伪共享
+ * m_head 和 m_tail 是累计的字节数，不回绕，差值就是环中的数据量 */
+struct ShmRingHeader
+{
+  alignas(64) std::atomic<uint64_t> m_head;            // 只由生产者修改
+  alignas(64) std::atomic<uint64_t> m_tail;            // 只由消费者修改
+  alignas(64) std::atomic<uint32_t> m_consumer_sleeping;  // 消费者回到 epoll 之前置 1，生产者写入后需要敲门铃
+  std::atomic<uint32_t> m_producer_blocked;            // 生产者等待空间，消费者读出数据后需要敲门铃
+};
+
+// memfd 的第一页，之后依次是两个方向的环的数据区
+struct ShmSharedHeader
+{
+  uint32_t m_magic;
+  uint32_t m_version;
+  uint64_t m_ring_bytes;
+  std::atomic<uint32_t> m_closed[2];   // 0: 客户端，1: 服务器，一侧关闭后对端也关闭
+  ShmRingHeader m_rings[2];            // 0: 客户端 -> 服务器，1: 服务器 -> 客户端
+};
+
+/* 数据区被连续映射了两次，从任意位置开始的一段数据在地址上都是连续的，读写时不用处理回绕
+ * 共享内存对端可以随意改写，自己负责的索引在本地保存一份，只把它发布出去；
+ * 对端的索引每次只读一次并检查数据量不超过容量，超过时视为协议错误，由连接关闭 */
+class ShmRing
+{
+ public:
+  ShmRing() = default;
+  ShmRing(ShmRingHeader *header, char *data, uint64_t capacity) :
+    m_header(header), m_data(data), m_capacity(capacity),
+    m_head(header->m_head.load(std::memory_order_relaxed)),
+    m_tail(header->m_tail.load(std::memory_order_relaxed))
+  { /* do nothing */ }
+
+  uint64_t capacity() const {return m_capacity;}
+
+  // 对端写坏了索引，之后 writable() 和 readable() 都返回 0
+  bool corrupted() const {return m_corrupted;}
+
+  // 生产者：可写的字节数，写入后发布新的 head
+  uint64_t writable() const
+  {
+    uint64_t used = m_head - m_header->m_tail.load(std::memory_order_acquire);
+    if (used > m_capacity || m_corrupted) {
+      m_corrupted = true;
+      return 0;
+    }
+    return m_capacity - used;
+  }
+
+  // len 不能超过 writable() 的返回值
+  void write(const char *data, uint64_t len)
+  {
+    memcpy(m_data + (m_head & (m_capacity - 1)), data, len);
+    m_head += len;
+    m_header->m_head.store(m_head, std::memory_order_release);
+  }
+
+  // 消费者：可读的数据和起始地址，读完后推进 tail
+  uint64_t readable() const
+  {
+    uint64_t used = m_header->m_head.load(std::memory_order_acquire) - m_tail;
+    if (used > m_capacity || m_corrupted) {
+      m_corrupted = true;
+      return 0;
+    }
+    return used;
+  }
+  uint64_t head() const {return m_tail + readable();}
+  uint64_t tail() const {return m_tail;}
+  char *readPtr() const {return m_data + (m_tail & (m_capacity - 1));}
+
+  // len 不能超过 readable() 的返回值
+  void consume(uint64_t len)
+  {
+    m_tail += len;
+    m_header->m_tail.store(m_tail, std::memory_order_release);
+  }
+
+/* 门铃：等待的一方先置标志再重新检查条件，另一方修改数据后检查标志，
+   * 两边都用 seq_cst，保证不会出现双方都以为对方会敲门铃的情况
+   * 标志由敲门铃的一方清除，对方忙碌期间的后续写入不再产生系统调用 */
+  std::atomic<uint32_t> &consumerSleeping() {return m_header->m_consumer_sleeping;}
+  std::atomic<uint32_t> &producerBlocked() {return m_header->m_producer_blocked;}
+
+ private:
+  ShmRingHeader *m_header {nullptr};
+  char *m_data {nullptr};
+  uint64_t m_capacity {0};
+  uint64_t m_head {0};               // 生产者发布的 head 的本地副本
+  uint64_t m_tail {0};               // 消费者发布的 tail 的本地副本
+  mutable bool m_corrupted {false};
+};
+
+} // namespace shm
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_SHM_SHM_RING_H
@@ -0,0 +1,115 @@
+/* 共享内存连接的服务器：在 Unix 域套接字上接受客户端的握手，为每个客户端创建一个 ShmConnection */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/shm/shm_server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "zest/base/logging.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/shm/shm_ring.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::shm;
+using std::placeholders::_1;
+
+
+// 客户端连上之后必须在这段时间内完成握手
+static const uint64_t HANDSHAKE_TIMEOUT_MS = 3000;
+
+
+ShmServer::ShmServer(UnixAddress &local_addr, int thread_nums /*=4*/) :
+  m_server(local_addr, thread_nums)
+{
+  m_server.setOnConnectionCallback(std::bind(&ShmServer::onControlConnection, this, _1));
+  m_server.setMessageCallback(std::bind(&ShmServer::onHandshake, this, _1));
+}
+
+void ShmServer::start()
+{
+  m_server.start();
+}
+
+std::size_t ShmServer::connectionCount() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_connections.size();
+}
+
+// 在IO线程中执行，接收文件描述符的设置在开始读取数据之前生效
+void ShmServer::onControlConnection(TcpConnection &conn)
+{
+  conn.setFdPassing(true);
+  conn.addTimer("__shm_handshake", HANDSHAKE_TIMEOUT_MS, [](TcpConnection &conn){
+    LOG_ERROR << "shm handshake timeout: " << conn.peerAddress().to_string();
+    conn.close();
+  });
+  conn.waitForMessage();
+}
+
+/* 握手消息带着 memfd 和两个 eventfd，检查通过后把套接字复制一份交给 ShmConnection，
+ * 回复一个字节，然后关闭原来的 TcpConnection；memfd 的大小和封印由 mapMemory() 检查 */
+void ShmServer::onHandshake(TcpConnection &conn)
+{
+  if (conn.dataSize() < sizeof(ShmHello))
+    return;
+  ShmHello hello;
+  memcpy(&hello, conn.peek(), sizeof(hello));
+  std::vector<int> fds = conn.takeReceivedFds();
+
+  bool ok = hello.m_magic == SHM_MAGIC && hello.m_version == SHM_VERSION && fds.size() == 3;
+  uint64_t ring = hello.m_ring_bytes;
+  ok = ok && ring > 0 && (ring & (ring - 1)) == 0 && ring <= m_max_ring_bytes &&
+       ring % static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) == 0;
+
+  ShmConnection::s_ptr shm = nullptr;
+  if (ok) {
+    int control_fd = fcntl(conn.socketfd(), F_DUPFD_CLOEXEC, 0);
+    // 客户端监听 fds[2]，服务器监听 fds[1]
+    shm.reset(new ShmConnection(conn.getEventLoop(), true, control_fd, fds[0], fds[1], fds[2]));
+    fds.clear();
+    if (control_fd == -1 || !shm->mapMemory(ring, false))
+      shm = nullptr;
+  }
+  for (int fd : fds)
+    ::close(fd);
+
+  char ack = shm ? 1 : 0;
+  if (::send(conn.socketfd(), &ack, 1, MSG_NOSIGNAL) != 1)
+    shm = nullptr;
+  if (!shm) {
+    LOG_ERROR << "invalid shm handshake from " << conn.peerAddress().to_string();
+    conn.close();
+    return;
+  }
+  conn.clearData();
+  conn.close();
+
+  shm->setMessageCallback(m_message_callback);
+  shm->setWriteCompleteCallback(m_write_complete_callback);
+  shm->setBusyPoll(m_busy_poll_us);
+  ShmConnection::ConnectionCallbackFunc close_cb = m_close_callback;
+  shm->setCloseCallback([this, close_cb](ShmConnection &conn){
+    if (close_cb)
+      close_cb(conn);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_connections.erase(conn.shared_from_this());
+  });
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_connections.insert(shm);
+  }
+  LOG_INFO << "Accept new shm connection, ptr = " << shm.get() << ", ring " << ring << " bytes";
+  if (m_on_connection_callback)
+    m_on_connection_callback(*shm);
+  else
+    shm->waitForMessage();
+}
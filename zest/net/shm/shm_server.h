@@ -0,0 +1,76 @@
+/* 共享内存连接的服务器：在 Unix 域套接字上接受客户端的握手，为每个客户端创建一个 ShmConnection */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_SHM_SHM_SERVER_H
+#define ZEST_NET_SHM_SHM_SERVER_H
+
+#include <stdint.h>
+
+#include <mutex>
+#include <unordered_set>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/shm/shm_connection.h"
+#include "zest/net/tcp_server.h"
+#include "zest/net/unix_addr.h"
+
+namespace zest
+{
+namespace net
+{
+namespace shm
+{
+
+/* 握手完成后，连接属于接受它的IO线程，所有回调都在这个IO线程中执行（包括连接回调）
+ * 没有设置连接回调时直接开始接收；回调函数必须在 start() 之前设置 */
+class ShmServer : public noncopyable
+{
+ public:
+  explicit ShmServer(UnixAddress &local_addr, int thread_nums = 4);
+
+  void setOnConnectionCallback(const ShmConnection::ConnectionCallbackFunc &cb) {m_on_connection_callback = cb;}
+  void setMessageCallback(const ShmConnection::ConnectionCallbackFunc &cb) {m_message_callback = cb;}
+  void setWriteCompleteCallback(const ShmConnection::ConnectionCallbackFunc &cb) {m_write_complete_callback = cb;}
+  void setCloseCallback(const ShmConnection::ConnectionCallbackFunc &cb) {m_close_callback = cb;}
+
+  // 新连接的忙等时间，见 ShmConnection::setBusyPoll()
+  void setBusyPoll(uint64_t us) {m_busy_poll_us = us;}
+
+  // 客户端请求的环超过这个大小时拒绝握手
+  void setMaxRingBytes(std::size_t bytes) {m_max_ring_bytes = bytes;}
+
+  // 当前的连接数
+  std::size_t connectionCount() const;
+
+  TcpServer &tcpServer() {return m_server;}
+
+  // 收到 SIGINT 或 SIGTERM 后返回
+  void start();
+
+ private:
+  void onControlConnection(TcpConnection &conn);
+  void onHandshake(TcpConnection &conn);
+
+ private:
+  TcpServer m_server;
+  ShmConnection::ConnectionCallbackFunc m_on_connection_callback {nullptr};
+  ShmConnection::ConnectionCallbackFunc m_message_callback {nullptr};
+  ShmConnection::ConnectionCallbackFunc m_write_complete_callback {nullptr};
+  ShmConnection::ConnectionCallbackFunc m_close_callback {nullptr};
+  uint64_t m_busy_poll_us {0};
+  std::size_t m_max_ring_bytes {64 * 1024 * 1024};
+
+  // 握手完成的连接，在IO线程中加入和移除
+  mutable std::mutex m_mutex;
+  std::unordered_set<ShmConnection::s_ptr> m_connections;
+};
+
+} // namespace shm
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_SHM_SHM_SERVER_H
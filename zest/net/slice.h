@@ -0,0 +1,144 @@
+/* 引用计数的只读数据片，多个连接发送同一份数据时共享同一块内存，不发生拷贝
+ * SliceBuilder 用于构造 Slice，在数据前面预留空间，可以在写完消息体之后再补上消息头 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_SLICE_H
+#define ZEST_NET_SLICE_H
+
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace zest
+{
+namespace net
+{
+
+/* Slice 是对一块不可变数据的引用，拷贝 Slice 只增加引用计数
+ * 数据本身在最后一个引用它的 Slice 析构时才被释放
+ * 因此可以安全地在线程之间传递，用于向大量连接广播同一条消息 */
+class Slice
+{
+ public:
+  Slice() = default;
+
+  // 接管 str 的内存，不发生拷贝
+  explicit Slice(std::string &&str)
+    : m_payload(std::make_shared<const std::string>(std::move(str))),
+      m_offset(0), m_length(m_payload->size())
+  { /* do nothing */ }
+
+  // 拷贝一次 str，之后的所有传递都不再拷贝
+  explicit Slice(const std::string &str)
+    : m_payload(std::make_shared<const std::string>(str)),
+      m_offset(0), m_length(m_payload->size())
+  { /* do nothing */ }
+
+  Slice(const char *str, std::size_t len)
+    : m_payload(std::make_shared<const std::string>(str, len)),
+      m_offset(0), m_length(len)
+  { /* do nothing */ }
+
+  const char *data() const {return m_payload ? m_payload->data() + m_offset : nullptr;}
+
+  std::size_t size() const {return m_length;}
+
+  bool empty() const {return m_length == 0;}
+
+  // 返回 [pos, pos+n) 范围的子片，与原 Slice 共享同一块内存
+  Slice subslice(std::size_t pos, std::size_t n = std::string::npos) const
+  {
+    Slice tmp(*this);
+    if (pos > m_length)
+      pos = m_length;
+    tmp.m_offset += pos;
+    tmp.m_length = (n < m_length - pos) ? n : m_length - pos;
+    return tmp;
+  }
+
+  // 丢弃前 n 个字节，用于发送了一部分数据的情况
+  void remove_prefix(std::size_t n)
+  {
+    if (n > m_length)
+      n = m_length;
+    m_offset += n;
+    m_length -= n;
+  }
+
+  std::string to_string() const {return empty() ? std::string() : std::string(data(), m_length);}
+
+  // 共享这块数据的 Slice 数量
+  long use_count() const {return m_payload.use_count();}
+
+ private:
+  std::shared_ptr<const std::string> m_payload {nullptr};
+  std::size_t m_offset {0};
+  std::size_t m_length {0};
+};
+
+/* 构造 Slice 的缓冲区，在数据前面预留 headroom 个字节
+ * 长度前缀之类的协议，在写完消息体之后才知道消息头的内容，
+ * 此时用 prepend() 把消息头写进预留的空间，不需要再拷贝一次消息体
+ * 最后用 build() 把整块内存交给 Slice，同样不发生拷贝 */
+class SliceBuilder
+{
+ public:
+  static const std::size_t DEFAULT_HEADROOM = 16;
+
+  explicit SliceBuilder(std::size_t headroom = DEFAULT_HEADROOM, std::size_t capacity = 0)
+    : m_buffer(headroom, '\0'), m_head(headroom), m_headroom(headroom)
+  {
+    m_buffer.reserve(headroom + capacity);
+  }
+
+  void append(const char *str, std::size_t len) {m_buffer.append(str, len);}
+
+  void append(const std::string &str) {m_buffer.append(str);}
+
+  // 在数据前面插入 len 个字节，预留空间足够时不移动已有的数据
+  void prepend(const char *str, std::size_t len)
+  {
+    if (len <= m_head) {
+      m_head -= len;
+      memcpy(&m_buffer[m_head], str, len);
+    }
+    else {
+      // 预留空间不够，只能移动数据
+      m_buffer.replace(0, m_head, str, len);
+      m_head = 0;
+    }
+  }
+
+  const char *data() const {return m_buffer.data() + m_head;}
+
+  std::size_t size() const {return m_buffer.size() - m_head;}
+
+  // 剩余的预留空间
+  std::size_t headroom() const {return m_head;}
+
+  // 生成 Slice，之后 SliceBuilder 变为空并重新预留构造时指定的空间，可以重新使用
+  Slice build()
+  {
+    std::size_t head = m_head;
+    Slice slice(std::move(m_buffer));
+    m_buffer.assign(m_headroom, '\0');
+    m_head = m_headroom;
+    return slice.subslice(head);
+  }
+
+ private:
+  std::string m_buffer;     // [预留空间][数据]
+  std::size_t m_head {0};   // 数据的起始位置，也就是剩余的预留空间大小
+  std::size_t m_headroom;   // 构造时指定的预留空间，build() 之后恢复
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_SLICE_H
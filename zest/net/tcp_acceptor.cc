@@ -6,13 +6,16 @@
 #include "zest/net/tcp_acceptor.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "zest/base/logging.h"
 #include "zest/base/util.h"
 #include "zest/net/inet_addr.h"
+#include "zest/net/unix_addr.h"
 
 using namespace zest;
 using namespace zest::net;
@@ -42,15 +45,39 @@ TcpAcceptor::TcpAcceptor(AddressPtr addr) : m_local_addr(addr), m_domain(addr->f
       LOG_ERROR << "setsockopt REUSEADDR failed, errno = " << errno;
   }
 
+  // 上次运行留下的套接字文件会导致 bind 失败，只删除套接字文件，不碰普通文件
+  if (m_domain == AF_UNIX) {
+    UnixAddress *unix_addr = static_cast<UnixAddress*>(m_local_addr.get());
+    struct stat st;
+    if (!unix_addr->isAbstract() && ::stat(unix_addr->path().c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+      ::unlink(unix_addr->path().c_str());
+  }
+
   if (bind(m_listenfd, m_local_addr->sockaddr(), m_local_addr->socklen()) == -1) {
     LOG_FATAL << "bind failed, errno = " << errno;
     close(m_listenfd);
     exit(-1);
   }
 
+  m_reserve_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+  if (m_reserve_fd == -1)
+    LOG_ERROR << "open reserve fd failed, errno = " << errno;
+
   LOG_DEBUG << "create acceptor successful";
 }
 
+TcpAcceptor::~TcpAcceptor()
+{
+  ::close(m_listenfd);
+  if (m_reserve_fd != -1)
+    ::close(m_reserve_fd);
+  if (m_domain == AF_UNIX) {
+    UnixAddress *unix_addr = static_cast<UnixAddress*>(m_local_addr.get());
+    if (!unix_addr->isAbstract())
+      ::unlink(unix_addr->path().c_str());
+  }
+}
+
 void TcpAcceptor::listen()
 {
   int ret = ::listen(m_listenfd, 1000);
@@ -61,30 +88,87 @@ void TcpAcceptor::listen()
   }
 }
 
-// 接受新连接，并返回客户端套接字和地址
-std::unordered_map<int, NetBaseAddress::s_ptr> TcpAcceptor::accept()
+// 接受新连接，追加到 clients 的末尾，最多接受 max_accept 个
+bool TcpAcceptor::accept(std::vector<AcceptedSocket> &clients, std::size_t max_accept /*=SIZE_MAX*/)
 {
-  std::unordered_map<int, NetBaseAddress::s_ptr> new_clients;
-  if (m_domain == PF_INET) {
-    sockaddr_in client_addr;
-    socklen_t len = sizeof(client_addr);
-    memset(&client_addr, 0, len);
-    int clientfd;
-    while ((clientfd = ::accept(m_listenfd, reinterpret_cast<sockaddr*>(&client_addr), &len)) != -1) {
-      InetAddress::s_ptr peer_addr = std::make_shared<InetAddress>(client_addr);
-      if (peer_addr->check() == false) {
-        LOG_ERROR << "invalid peer address";
-        close(clientfd);
+  if (m_domain != PF_INET && m_domain != PF_UNIX) {
+    // other protocol...
+    LOG_ERROR << "Unknow protocol families: " << m_domain;
+    return true;
+  }
+
+  AcceptedSocket client;
+  uint64_t rejected = 0;
+  std::size_t accepted = 0;
+  bool drained = false;
+  while (accepted < max_accept) {
+    client.m_len = sizeof(client.m_addr);
+    memset(&client.m_addr, 0, client.m_len);
+    client.m_fd = ::accept(m_listenfd, reinterpret_cast<sockaddr*>(&client.m_addr), &client.m_len);
+    if (client.m_fd == -1) {
+      // 文件描述符耗尽，拒绝 backlog 中的连接，直到取空
+      if ((errno == EMFILE || errno == ENFILE) && rejectOne()) {
+        ++rejected;
         continue;
       }
-      new_clients.insert({clientfd, peer_addr});
-      memset(&client_addr, 0, len);
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        drained = true;
+        break;
+      }
+      // 对端在 accept 之前就断开了，继续取下一个
+      if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+        continue;
+      LOG_ERROR << "accept failed, errno = " << errno;
+      break;
     }
+
+    if (client.m_addr.ss_family != AF_INET && client.m_addr.ss_family != AF_UNIX) {
+      LOG_ERROR << "invalid peer address";
+      close(client.m_fd);
+      continue;
+    }
+    clients.push_back(client);
+    ++accepted;
   }
-  else {
-    // other protocol...
-    LOG_ERROR << "Unknow protocol families: " << m_domain;
+
+  if (rejected > 0)
+    LOG_ERROR << "too many open files, reject " << rejected << " connections";
+  return drained;
+}
+
+// 失败时 errno 是 accept 的错误码，backlog 已经取空时为 EAGAIN
+bool TcpAcceptor::rejectOne()
+{
+  if (m_reserve_fd == -1) {
+    // 上次没能重新打开，这次也打不开说明仍然没有空闲的文件描述符
+    m_reserve_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (m_reserve_fd == -1) {
+      errno = EMFILE;
+      return false;
+    }
+  }
+  ::close(m_reserve_fd);
+  int fd = ::accept(m_listenfd, NULL, NULL);
+  int saved_errno = errno;
+  if (fd != -1)
+    ::close(fd);
+  m_reserve_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    errno = saved_errno;
+    return false;
   }
-  
-  return new_clients;
+  m_rejected.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+NetBaseAddress::s_ptr TcpAcceptor::makePeerAddress(const sockaddr_storage &addr, socklen_t len)
+{
+  NetBaseAddress::s_ptr peer_addr;
+  if (addr.ss_family == AF_INET)
+    peer_addr = std::make_shared<InetAddress>(*reinterpret_cast<const sockaddr_in*>(&addr));
+  else if (addr.ss_family == AF_UNIX)
+    peer_addr = std::make_shared<UnixAddress>(*reinterpret_cast<const sockaddr_un*>(&addr), len);
+  if (peer_addr && !peer_addr->check())
+    return nullptr;
+  return peer_addr;
 }
@@ -8,8 +8,13 @@
 #ifndef ZEST_NET_TCP_ACCEPTOR_H
 #define ZEST_NET_TCP_ACCEPTOR_H
 
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <cstddef>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
 #include "zest/base/noncopyable.h"
 
@@ -21,6 +26,14 @@ namespace net
 
 class NetBaseAddress;  // 前向声明
 
+// 新接受的连接，地址对象由使用者构造（可以复用已有的对象）
+struct AcceptedSocket
+{
+  int m_fd;
+  sockaddr_storage m_addr;
+  socklen_t m_len;
+};
+
 class TcpAcceptor : public noncopyable
 {
   using AddressPtr = std::shared_ptr<NetBaseAddress>;
@@ -29,16 +42,33 @@ class TcpAcceptor : public noncopyable
   using s_ptr = std::shared_ptr<TcpAcceptor>;
 
   TcpAcceptor(AddressPtr addr);
+  ~TcpAcceptor();
   void listen();
   int socketfd() const {return m_listenfd;}
 
-  // 接受新连接，并返回客户端套接字和地址
-  std::unordered_map<int, AddressPtr> accept();
+  /* 接受新连接，追加到 clients 的末尾，clients 可以在多次调用之间复用，避免每次分配内存
+   * 最多接受 max_accept 个，返回 true 表示 backlog 已经取空；
+   * 返回 false 表示 backlog 中可能还有连接，监听套接字是ET模式，调用者需要稍后再来取 */
+  bool accept(std::vector<AcceptedSocket> &clients, std::size_t max_accept = SIZE_MAX);
+
+  // 文件描述符耗尽时接受后立即关闭的连接数，可以由任意线程读取
+  uint64_t rejected() const {return m_rejected.load(std::memory_order_relaxed);}
+
+  // 根据协议族构造对端地址，不支持的协议族或者不合法的地址返回 nullptr
+  static AddressPtr makePeerAddress(const sockaddr_storage &addr, socklen_t len);
   
  private:
   AddressPtr m_local_addr;
   int m_domain;
   int m_listenfd;
+
+  /* 预留的文件描述符，文件描述符耗尽（EMFILE）时先关闭它，腾出一个位置接受连接后立即关闭，再重新打开
+   * 否则连接一直留在 backlog 中，客户端得不到任何回应 */
+  int m_reserve_fd {-1};
+  std::atomic<uint64_t> m_rejected {0};
+
+  // 关闭预留的文件描述符，接受一个连接并立即关闭，再重新打开，成功拒绝返回 true
+  bool rejectOne();
 };
   
 } // namespace net
@@ -12,6 +12,8 @@
 #include <iterator>
 #include <string>
 
+#include "zest/base/simd_search.h"
+
 
 namespace zest
 {
@@ -91,6 +93,21 @@ class TcpBuffer
 
   bool empty() const {return m_start_index >= m_buffer.size();}
 
+  // 底层 std::string 占用的内存
+  std::size_t capacity() const {return m_buffer.capacity();}
+
+  // 把容量缩小到 max(size(), keep)，std::string 的 clear() 不会释放内存，突发的大消息之后需要手动回收
+  void trim(std::size_t keep)
+  {
+    if (m_buffer.capacity() <= keep || m_buffer.capacity() <= size())
+      return;
+    std::string tmp;
+    tmp.reserve(std::max(size(), keep));
+    tmp.append(m_buffer, m_start_index, std::string::npos);
+    m_buffer.swap(tmp);
+    m_start_index = 0;
+  }
+
   std::string to_string() const { return m_buffer.substr(m_start_index); }
 
   const char* c_str()
@@ -99,6 +116,41 @@ class TcpBuffer
     return m_buffer.c_str();
   }
 
+  // 指向可读数据的指针，不拷贝数据，在下一次修改缓冲区之前有效
+  const char* peek() const { return m_buffer.data() + m_start_index; }
+
+  // 可修改的指针，用于原地解码（例如 WebSocket 去掩码），不能改变数据的长度
+  char* mutablePeek() { return &m_buffer[0] + m_start_index; }
+
+  /* 以下查找函数从可读数据的第 from 个字节开始查找，返回相对于可读数据起点的下标，找不到时返回 npos
+   * 增量解析时，可以把上次没找到时的 size()-(分隔符长度-1) 作为 from，避免重复扫描 */
+  std::size_t find(char c, std::size_t from = 0) const
+  {
+    if (from >= size())
+      return std::string::npos;
+    const char *end = peek() + size();
+    const char *p = simd_find_byte(peek() + from, end, c);
+    return p == end ? std::string::npos : p - peek();
+  }
+
+  std::size_t findCRLF(std::size_t from = 0) const
+  {
+    if (from >= size())
+      return std::string::npos;
+    const char *end = peek() + size();
+    const char *p = simd_find_crlf(peek() + from, end);
+    return p == end ? std::string::npos : p - peek();
+  }
+
+  std::size_t find(const char *needle, std::size_t len, std::size_t from = 0) const
+  {
+    if (from > size())
+      return std::string::npos;
+    const char *end = peek() + size();
+    const char *p = simd_find(peek() + from, end, needle, len);
+    return (p == end && len > 0) ? std::string::npos : p - peek();
+  }
+
   std::string substr(std::size_t pos = 0, std::size_t n = 0)
   {
     if (n != 0)
@@ -14,6 +14,7 @@
 #include "zest/base/logging.h"
 #include "zest/net/eventloop.h"
 #include "zest/net/fd_event.h"
+#include "zest/net/output_queue.h"
 #include "zest/net/tcp_buffer.h"
 #include "zest/net/timer_container.h"
 #include "zest/net/timer_event.h"
@@ -117,8 +118,8 @@ bool TcpClient::send(const std::string &str)
     return false;
   FdEvent::s_ptr fd_event = std::make_shared<FdEvent>(m_connection->socketfd());
 
-  TcpBuffer tmp_buf(str);
-  swap(*m_connection->m_out_buffer, tmp_buf);
+  m_connection->m_out_queue->clear();
+  m_connection->m_out_queue->append(Slice(str));
 
   fd_event->listen(EPOLLOUT | EPOLLET, std::bind(&TcpConnection::handleWrite, m_connection.get(), true));
   m_eventloop->addEpollEvent(fd_event);
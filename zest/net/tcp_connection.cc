@@ -7,12 +7,25 @@
 
 #include <arpa/inet.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "zest/base/logging.h"
+#include "zest/base/util.h"
+#include "zest/net/buffer_budget.h"
+#include "zest/net/connection_registry.h"
 #include "zest/net/eventloop.h"
 #include "zest/net/fd_event.h"
+#include "zest/net/output_queue.h"
+#include "zest/net/tcp_acceptor.h"
 #include "zest/net/tcp_buffer.h"
 #include "zest/net/timer_container.h"
 #include "zest/net/timer_event.h"
@@ -20,10 +33,37 @@
 using namespace zest;
 using namespace zest::net;
 
+// 一次 writev 最多携带的数据片数量
+static const int MAX_IOV_NUM = 64;
+
+// 超出内存预算时，每次最多读取这么多数据，间隔 BUDGET_READ_RETRY_MS 之后再读
+static const ssize_t BUDGET_READ_QUOTA = 16 * 1024;
+static const uint64_t BUDGET_READ_RETRY_MS = 10;
+
+// splice 的数据源（管道、套接字）暂时没有数据时，间隔 FILE_SOURCE_RETRY_MS 之后再读
+static const uint64_t FILE_SOURCE_RETRY_MS = 10;
+
+// 一次 sendmsg 最多携带的文件描述符数量（内核的 SCM_MAX_FD）
+static const std::size_t MAX_PASSED_FDS = 253;
+
+// 连接对象被复用时，接收缓存保留的容量
+static const std::size_t RECYCLED_BUFFER_KEEP = 4096;
+
+// SO_RCVLOWAT 的上限，更大的帧分多次唤醒，避免接收窗口被内核收紧
+static const std::size_t MAX_RCVLOWAT = 256 * 1024;
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
 
 TcpConnection::TcpConnection(int fd, EventLoopPtr eventloop, NetAddrPtr peer_addr) :
   m_sockfd(fd), m_eventloop(eventloop), m_peer_addr(peer_addr), 
-  m_in_buffer(new TcpBuffer()), m_out_buffer(new TcpBuffer()),
+  m_in_buffer(new TcpBuffer()), m_out_queue(new OutputQueue()),
   m_state(Connected), m_fd_event(new FdEvent(m_sockfd)),
   m_timer_container(new TimerContainer<std::string>(eventloop))
 {
@@ -36,6 +76,85 @@ TcpConnection::~TcpConnection()
   // FIXME: What if m_state == Connected now?
   // assert(m_state == Closed || m_state == NotConnected);
   delete m_timer_container;
+  closeSplicePipe();
+  closeReceivedFds();
+  // 没有经过 close() 的连接，在这里把统计的内存还回去
+  if (m_accounted_bytes != 0) {
+    m_eventloop->addBufferBytes(-m_accounted_bytes);
+    BufferBudget::add(-m_accounted_bytes);
+  }
+}
+
+TcpConnection::TcpConnection(EventLoopPtr eventloop) :
+  m_sockfd(-1), m_eventloop(eventloop), m_peer_addr(nullptr),
+  m_in_buffer(new TcpBuffer()), m_out_queue(new OutputQueue()),
+  m_state(NotConnected), m_fd_event(new FdEvent(-1)),
+  m_timer_container(new TimerContainer<std::string>(eventloop))
+{
+  /* do nothing */
+}
+
+/* 连接已经 close()，回到刚构造时的状态，在IO线程的本轮循环结束时调用，
+ * 这时本轮中捕获了 this 的任务（flush 等）都已经执行完
+ * 上下文中的对象和回调函数在这里析构，接收缓存只保留 RECYCLED_BUFFER_KEEP 的容量 */
+void TcpConnection::recycle()
+{
+  m_eventloop->assertInLoopThread();
+  m_context.clear();
+  m_slots.clear();
+  clearTimer();
+  m_message_callback = nullptr;
+  m_write_complete_callback = nullptr;
+  m_close_callback = nullptr;
+
+  m_in_buffer->clear();
+  m_in_buffer->trim(RECYCLED_BUFFER_KEEP);
+  m_out_queue->clear();
+  m_fd_event->reset(-1);
+  m_sockfd = -1;
+  m_state = NotConnected;
+
+  m_read_armed = false;
+  m_flush_pending = false;
+  m_shutdown_pending = false;
+  m_max_buffered = 0;
+  m_reading_paused = false;
+  m_read_pending = false;
+  m_min_read_bytes = 0;
+  m_rcvlowat = 1;
+  closeSplicePipe();
+  m_fd_passing = false;
+  closeReceivedFds();
+
+  m_zerocopy_threshold = 0;
+  m_zerocopy_next_id = 0;
+  m_zerocopy_pending.clear();
+  m_registry = nullptr;
+
+  // close() 已经把统计的内存还回去了
+  m_last_active_ms = 0;
+  m_trim_quiet_ms = 0;
+  m_trim_keep = 0;
+}
+
+// 对端地址是 IPv4 并且没有被共享时，直接覆盖原来的地址对象，地址不合法时返回 false
+bool TcpConnection::reopen(int fd, const sockaddr_storage &addr, socklen_t len)
+{
+  if (m_peer_addr && m_peer_addr.use_count() == 1 &&
+      m_peer_addr->family() == AF_INET && addr.ss_family == AF_INET) {
+    *static_cast<InetAddress*>(m_peer_addr.get()) = InetAddress(*reinterpret_cast<const sockaddr_in*>(&addr));
+  }
+  else {
+    NetAddrPtr peer_addr = TcpAcceptor::makePeerAddress(addr, len);
+    if (!peer_addr)
+      return false;
+    m_peer_addr = peer_addr;
+  }
+  m_sockfd = fd;
+  m_fd_event->reset(fd);
+  m_fd_event->set_non_blocking();
+  m_state = Connected;
+  return true;
 }
 
 void TcpConnection::waitForMessage()
@@ -43,11 +162,17 @@ void TcpConnection::waitForMessage()
   if (m_eventloop->isThisThread()) {
     if (m_state != Connected && m_state != HalfClosing)
       return;
-    m_fd_event->listen(EPOLLIN | EPOLLET, std::bind(&TcpConnection::handleRead, this, false));
+    // 已经在监听可读事件，不必再调用 epoll_ctl（请求-响应式的服务每次写完都会调用本函数）
+    if (m_read_armed)
+      return;
+    // 同时监听 EPOLLRDHUP：数据和 FIN 一起到达时只有一次通知，handleRead 要读到 0 才能发现对端关闭
+    // 只捕获 this 的 lambda 可以存放在 std::function 内部，不需要分配内存
+    m_fd_event->listen(EPOLLIN | EPOLLRDHUP | EPOLLET, [this](){this->handleRead(false);});
     m_eventloop->addEpollEvent(m_fd_event);
+    m_read_armed = true;
   }
   else {
-    m_eventloop->runInLoop(std::bind(&TcpConnection::waitForMessage, this));
+    m_eventloop->runInLoop(std::bind(&TcpConnection::waitForMessage, shared_from_this()));
   }
 }
 
@@ -61,31 +186,256 @@ std::size_t TcpConnection::dataSize() const
   return m_in_buffer->size();
 }
 
+const char *TcpConnection::peek() const
+{
+  return m_in_buffer->peek();
+}
+
+char *TcpConnection::mutablePeek()
+{
+  return m_in_buffer->mutablePeek();
+}
+
+std::size_t TcpConnection::find(char c, std::size_t from /*=0*/) const
+{
+  return m_in_buffer->find(c, from);
+}
+
+std::size_t TcpConnection::find(const std::string &delim, std::size_t from /*=0*/) const
+{
+  return m_in_buffer->find(delim.data(), delim.size(), from);
+}
+
+std::size_t TcpConnection::findCRLF(std::size_t from /*=0*/) const
+{
+  return m_in_buffer->findCRLF(from);
+}
+
 void TcpConnection::send(const std::string &str)
+{
+  send(Slice(str));
+}
+
+void TcpConnection::send(std::string &&str)
+{
+  send(Slice(std::move(str)));
+}
+
+void TcpConnection::send(const char *str)
+{
+  send(Slice(str, strlen(str)));
+}
+
+void TcpConnection::send(const char *str, std::size_t len)
+{
+  send(Slice(str, len));
+}
+
+/* 把数据片追加到发送队列的末尾，队列中只保存引用，不拷贝数据
+ * 跨线程调用时，lambda 捕获的也只是 Slice 的引用计数
+ * 数据不会立刻发送，而是在本轮事件循环结束时，由 flush() 把同一轮中多次 send 的数据用一次 writev 发出 */
+void TcpConnection::send(const Slice &slice)
 {
   if (m_eventloop->isThisThread()) {
     if (m_state != Connected)
       return;
-    
-    TcpBuffer tmp_buf(str);
-    swap(*m_out_buffer, tmp_buf);
 
-    m_fd_event->listen(EPOLLOUT | EPOLLET, std::bind(&TcpConnection::handleWrite, this, false));
-    m_eventloop->addEpollEvent(m_fd_event);
+    bool was_empty = m_out_queue->empty();
+    m_out_queue->append(slice);
+    m_eventloop->recordWriteRequest();
+    scheduleFlush(was_empty);
   }
   else {
-    m_eventloop->runInLoop([str, this](){this->send(str);});
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, slice](){self->send(slice);});
   }
 }
 
-void TcpConnection::send(const char *str)
+/* 消息头和消息体分别是两个数据片，例如给共享的消息体加上各自的消息头
+ * 跨线程调用时两个数据片在同一个任务中入队，不会和其它线程发送的数据交错 */
+void TcpConnection::send(const Slice &head, const Slice &body)
 {
-  send(std::string(str));
+  if (m_eventloop->isThisThread()) {
+    if (m_state != Connected)
+      return;
+
+    bool was_empty = m_out_queue->empty();
+    m_out_queue->append(head);
+    m_out_queue->append(body);
+    m_eventloop->recordWriteRequest();
+    scheduleFlush(was_empty);
+  }
+  else {
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, head, body](){self->send(head, body);});
+  }
 }
 
-void TcpConnection::send(const char *str, std::size_t len)
+// 消息头已经写进了预留空间，整块内存直接交给发送队列
+void TcpConnection::send(SliceBuilder &&builder)
+{
+  send(builder.build());
+}
+
+/* 发送文件 fd 中从 offset 开始的 len 个字节，和普通的 send 一起按顺序排队
+ * 数据由 sendfile 直接从文件发往套接字，不经过用户空间，sendfile 不可用时改用 splice
+ * fd 由调用者负责，在 cb 被调用（即数据全部交给内核）之前不能关闭 */
+void TcpConnection::sendFile(int fd, off_t offset, std::size_t len, ConnectionCallbackFunc cb /*=nullptr*/)
+{
+  if (m_eventloop->isThisThread()) {
+    if (m_state != Connected)
+      return;
+
+    bool was_empty = m_out_queue->empty();
+    m_out_queue->appendFile(fd, offset, len, [this, cb](){
+      if (cb) cb(*this);
+    });
+    m_eventloop->recordWriteRequest();
+    scheduleFlush(was_empty);
+  }
+  else {
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, fd, offset, len, cb](){self->sendFile(fd, offset, len, cb);});
+  }
+}
+
+/* 通过 Unix 域套接字发送文件描述符（SCM_RIGHTS），fds 附在 data 的第一个字节上，和普通的 send 一起按顺序排队
+ * fds 在调用时就复制了一份，调用者可以立即关闭自己的 fd；data 不能为空，否则文件描述符无法送达
+ * 对端需要调用 setFdPassing(true)，用 takeReceivedFds() 取出 */
+void TcpConnection::sendFds(const std::vector<int> &fds, const Slice &data)
+{
+  if (data.empty() || fds.empty() || fds.size() > MAX_PASSED_FDS) {
+    LOG_ERROR << "sendFds needs 1 to " << MAX_PASSED_FDS << " fds and non-empty data";
+    return;
+  }
+  std::vector<int> dup_fds;
+  for (int fd : fds) {
+    int new_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (new_fd == -1) {
+      LOG_ERROR << "dup fd " << fd << " failed, errno = " << errno;
+      for (int dup_fd : dup_fds)
+        ::close(dup_fd);
+      return;
+    }
+    dup_fds.push_back(new_fd);
+  }
+  if (m_eventloop->isThisThread()) {
+    sendFdsInLoop(std::move(dup_fds), data);
+  }
+  else {
+    auto holder = std::make_shared<std::vector<int>>(std::move(dup_fds));
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, holder, data](){self->sendFdsInLoop(std::move(*holder), data);});
+  }
+}
+
+void TcpConnection::sendFdsInLoop(std::vector<int> fds, const Slice &data)
+{
+  if (m_state != Connected) {
+    for (int fd : fds)
+      ::close(fd);
+    return;
+  }
+  bool was_empty = m_out_queue->empty();
+  m_out_queue->appendWithFds(data, std::move(fds));
+  m_eventloop->recordWriteRequest();
+  scheduleFlush(was_empty);
+}
+
+/* 开启后 handleRead 改用 recvmsg，收到的文件描述符带有 FD_CLOEXEC，按到达顺序保存
+ * 不开启时对端发来的文件描述符会被内核丢弃 */
+void TcpConnection::setFdPassing(bool on)
+{
+  if (m_eventloop->isThisThread()) {
+    m_fd_passing = on;
+  }
+  else {
+    m_eventloop->runInLoop(std::bind(&TcpConnection::setFdPassing, shared_from_this(), on));
+  }
+}
+
+// 只能在IO线程中调用，一般是在消息回调中解析出一条带文件描述符的消息之后
+std::vector<int> TcpConnection::takeReceivedFds()
+{
+  m_eventloop->assertInLoopThread();
+  std::vector<int> fds;
+  fds.swap(m_received_fds);
+  return fds;
+}
+
+/* 流式接收模式，max_buffered 为接收缓存的上限，0 表示关闭
+ * 开启后，接收缓存达到上限时就调用消息回调函数，而不是等到数据全部读完，
+ * 回调函数应当用 clearData()/clearBytesData() 消费数据，否则会暂停读取，
+ * 这样无论消息多大，每个连接占用的内存都不会超过上限 */
+void TcpConnection::setStreamingMode(std::size_t max_buffered)
+{
+  if (m_eventloop->isThisThread()) {
+    m_max_buffered = max_buffered;
+  }
+  else {
+    m_eventloop->runInLoop(std::bind(&TcpConnection::setStreamingMode, shared_from_this(), max_buffered));
+  }
+}
+
+// 暂停读取，数据留在内核的接收缓冲区中，由TCP流量控制让对端减慢发送
+void TcpConnection::pauseReading()
+{
+  if (m_eventloop->isThisThread()) {
+    m_reading_paused = true;
+  }
+  else {
+    m_eventloop->runInLoop(std::bind(&TcpConnection::pauseReading, shared_from_this()));
+  }
+}
+
+/* 恢复读取，在本轮循环结束时把暂停期间到达的数据读出来
+ * 已经关闭的连接不再登记：它的回收任务已经排在前面，登记的任务执行时对象可能已经被复用或释放 */
+void TcpConnection::resumeReading()
+{
+  if (m_eventloop->isThisThread()) {
+    m_reading_paused = false;
+    if (m_read_pending && m_state != Closed) {
+      m_read_pending = false;
+      m_eventloop->runAtIterationEnd([this](){
+        if (!this->m_reading_paused)
+          this->handleRead(false);
+      });
+    }
+  }
+  else {
+    m_eventloop->runInLoop(std::bind(&TcpConnection::resumeReading, shared_from_this()));
+  }
+}
+
+/* 读取提示：长度前缀的协议解析出帧头后，就知道还需要多少数据才能组成完整的帧
+ * 通过 SO_RCVLOWAT 让内核在接收缓冲区的数据达到要求时才报告可读，
+ * 大帧不再每到一个TCP分段就唤醒一次，也不会反复解析不完整的帧
+ * bytes 包括接收缓存中已有的数据，不足 bytes 时也不会调用消息回调（对端关闭除外） */
+void TcpConnection::setMinReadBytes(std::size_t bytes)
+{
+  if (m_eventloop->isThisThread()) {
+    m_min_read_bytes = bytes;
+    updateReceiveLowWatermark();
+  }
+  else {
+    m_eventloop->runInLoop(std::bind(&TcpConnection::setMinReadBytes, shared_from_this(), bytes));
+  }
+}
+
+// 内核只需要等待还差的那部分数据，值没有变化时不调用 setsockopt
+void TcpConnection::updateReceiveLowWatermark()
 {
-  send(std::string(str, len));
+  std::size_t need = 1;
+  if (m_min_read_bytes > m_in_buffer->size())
+    need = std::min(m_min_read_bytes - m_in_buffer->size(), MAX_RCVLOWAT);
+  int lowat = static_cast<int>(need);
+  if (lowat == m_rcvlowat)
+    return;
+  if (setsockopt(m_sockfd, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat)) == -1) {
+    LOG_ERROR << "setsockopt SO_RCVLOWAT failed, errno = " << errno << ", fd = " << m_sockfd;
+    return;
+  }
+  m_rcvlowat = lowat;
 }
 
 void TcpConnection::clearData()
@@ -107,13 +457,18 @@ void TcpConnection::shutdown()
 {
   if (m_eventloop->isThisThread()) {
     if (m_state == Connected) {
+      // 发送队列中还有数据，等数据发完再半关闭
+      if (!m_out_queue->empty()) {
+        m_shutdown_pending = true;
+        return;
+      }
       ::shutdown(m_sockfd, SHUT_WR);
       setState(HalfClosing);
       waitForMessage();
     }
   }
   else {
-   m_eventloop->runInLoop(std::bind(&TcpConnection::shutdown, this)); 
+    m_eventloop->runInLoop(std::bind(&TcpConnection::shutdown, shared_from_this()));
   }
 }
 
@@ -129,11 +484,15 @@ void TcpConnection::close()
   if (m_close_callback)
     m_close_callback(*this);
   deleteFromEventLoop();
+  m_out_queue->clear();
+  closeSplicePipe();
+  closeReceivedFds();
+  updateBufferAccounting();
+
+  // 由 ConnectionRegistry 持有的连接，在本轮循环结束时释放，调用者在这之前仍然可以使用当前对象
+  if (m_registry)
+    m_registry->onClosed(*this);
 
-  // ::close()必须放在最后
-  // 因为close后该fd可能会被其它线程重用
-  // 导致 TcpServer的ConnectionMap 中当前对象的智能指针被覆盖，当前对象被析构
-  // 所以必须保证::close()后不再使用当前对象的任何资源
   LOG_DEBUG << "TcpConnection::close(), this = " << this << ", sockfd = " << m_sockfd;
   ::close(m_sockfd);
 }
@@ -142,16 +501,41 @@ void TcpConnection::handleRead(bool client)
 {
   if (m_state != Connected && m_state != HalfClosing)
     return;
-  bool is_error = false, is_closed = false, is_finished = false;
+  // 暂停读取时不从内核取数据，由 resumeReading() 重新读取（ET模式下不会再有新的通知）
+  if (m_reading_paused) {
+    m_read_pending = true;
+    return;
+  }
+  bool is_error = false, is_closed = false, is_finished = false, is_throttled = false;
   char tmp_buf[1500];
+  // 超出全局内存预算，限制每次读取的数据量，数据留在内核中，由TCP流量控制让对端减慢发送
+  bool throttled = !client && BufferBudget::exceeded();
 
   if (m_state == HalfClosing)
     is_closed = true;
+  // 对端已经发来 FIN，读到的数据少于请求也不能停，一直读到 0
+  bool peer_closed = m_fd_event->returnedEvents() & EPOLLRDHUP;
 
   ssize_t recv_len = 0;
   while (!is_error && !is_closed && !is_finished) {
-    memset(tmp_buf, 0, sizeof(tmp_buf));
-    ssize_t len = ::recv(m_sockfd, tmp_buf, sizeof(tmp_buf), 0);
+    std::size_t want = sizeof(tmp_buf);
+    if (m_max_buffered > 0) {
+      // 流式接收：缓存满了就先交给回调函数处理，保证缓存的数据量有上限
+      if (m_in_buffer->size() >= m_max_buffered) {
+        if (m_message_callback)
+          m_message_callback(*this);
+        if (m_state != Connected && m_state != HalfClosing)
+          return;
+        // 回调函数没有消费数据或者暂停了读取，剩下的数据留在内核中，等待 resumeReading()
+        if (m_reading_paused || m_in_buffer->size() >= m_max_buffered) {
+          m_read_pending = true;
+          return;
+        }
+      }
+      want = std::min(want, m_max_buffered - m_in_buffer->size());
+    }
+
+    ssize_t len = m_fd_passing ? readWithFds(tmp_buf, want) : ::recv(m_sockfd, tmp_buf, want, 0);
     if (len < 0) {
       if (errno == EAGAIN || errno == EWOULDBLOCK)
         is_finished = true;
@@ -167,10 +551,17 @@ void TcpConnection::handleRead(bool client)
     else {
       m_in_buffer->append(tmp_buf, len);
       recv_len += len;
-      if (len < sizeof(tmp_buf))
+      // 带文件描述符的消息会让 recvmsg 提前返回，读到的数据少于请求不代表已经读完
+      if (len < want && !m_fd_passing && !peer_closed)
         is_finished = true;
+      else if (throttled && recv_len >= BUDGET_READ_QUOTA) {
+        is_throttled = true;
+        break;
+      }
     }
   }
+  if (recv_len > 0 && m_trim_quiet_ms > 0)
+    m_last_active_ms = get_now_ms();
 
   // 出错的情况，半关闭连接，然后等待对端关闭
   if (is_error) {
@@ -187,15 +578,31 @@ void TcpConnection::handleRead(bool client)
   }
   if (is_closed) {
     LOG_DEBUG << "receive FIN from peer: " << m_peer_addr->to_string();
-    this->close();
+    // FIN 之前的数据先交给回调函数，例如对端发完最后一个响应就关闭
+    if (recv_len > 0 && m_message_callback)
+      m_message_callback(*this);
+    if (m_state == Connected || m_state == HalfClosing)
+      this->close();
     if (client)
       m_eventloop->stop();
     return;
   }
 
   // LOG_DEBUG << "receive " << recv_len << " bytes data from " << m_peer_addr->to_string();
-  if (m_message_callback)
+  // 数据还不够调用者要求的数量，不必调用回调函数
+  if (m_message_callback && m_in_buffer->size() >= m_min_read_bytes)
     m_message_callback(*this);
+  if (m_state != Connected && m_state != HalfClosing)
+    return;
+  if (m_min_read_bytes > 0 || m_rcvlowat != 1)
+    updateReceiveLowWatermark();
+  updateBufferAccounting();
+  // ET模式下剩下的数据不会再有通知，稍后主动读取
+  if (is_throttled) {
+    addTimer("__budget_read", BUDGET_READ_RETRY_MS, [](TcpConnection &conn){
+      conn.handleRead(false);
+    });
+  }
   if (client)
     m_eventloop->stop();
 }
@@ -206,24 +613,57 @@ void TcpConnection::handleWrite(bool client)
     return;
   bool is_error = false;
 
-  while (!m_out_buffer->empty()) {
-    const char *ptr = m_out_buffer->c_str();
-    ssize_t len = ::send(m_sockfd, ptr, m_out_buffer->size(), 0);
+  while (!m_out_queue->empty() && m_state == Connected) {
+    ssize_t len = 0;
+    if (m_out_queue->frontIsFile()) {
+      len = writeFileRegion(m_out_queue->frontFile());
+    }
+    else if (m_out_queue->frontHasFds()) {
+      len = writeWithFds();
+    }
+    else if (m_zerocopy_threshold > 0 && m_out_queue->frontSlice().size() >= m_zerocopy_threshold) {
+      // 大数据片使用 MSG_ZEROCOPY，内核直接引用用户内存，完成后通过错误队列通知
+      const Slice &slice = m_out_queue->frontSlice();
+      len = ::send(m_sockfd, slice.data(), slice.size(), MSG_ZEROCOPY);
+      m_eventloop->recordWriteSyscall();
+      if (len > 0)
+        m_zerocopy_pending.push_back({m_zerocopy_next_id++, slice});
+    }
+    else {
+      struct iovec iov[MAX_IOV_NUM];
+      int iov_num = m_out_queue->fillIovec(iov, MAX_IOV_NUM);
+      len = ::writev(m_sockfd, iov, iov_num);
+      m_eventloop->recordWriteSyscall();
+    }
     if (len == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK)
         break;
-      else if (errno = EINTR)
+      else if (errno == EINTR)
         continue;
       else {
         is_error = true;
         break;
       }
     }
-    m_out_buffer->move_forward(len);
+    m_out_queue->consume(len);
+
+    // 文件已经全部交给内核，通知调用者
+    if (!m_out_queue->empty() && m_out_queue->frontIsFile() && m_out_queue->frontFile().finished()) {
+      auto done_cb = m_out_queue->frontFile().m_done_callback;
+      m_out_queue->popFront();
+      if (done_cb) done_cb();
+    }
   }
 
+  if (m_state != Connected)
+    return;
+  if (m_trim_quiet_ms > 0)
+    m_last_active_ms = get_now_ms();
+  updateBufferAccounting();
+
   if (is_error) {
-    LOG_ERROR << "TCP write error, shutdown connection";
+    LOG_ERROR << "TCP write error, shutdown connection, errno = " << errno;
+    m_out_queue->clear();
     if (!client)
       this->shutdown();
     else {
@@ -238,20 +678,203 @@ void TcpConnection::handleWrite(bool client)
   }
 
   // 缓冲区没写完，遇到 EAGAIN 或 EWOULDBLOCK 错误，继续等待套接字可写
-  if (!m_out_buffer->empty()) {
+  if (!m_out_queue->empty()) {
+    // 等待的是 splice 的数据源，由定时器重试，不监听可写事件
+    if (m_out_queue->frontIsFile() && m_out_queue->frontFile().m_use_splice &&
+        m_out_queue->frontFile().m_in_pipe == 0)
+      return;
+    if (!client) {
+      m_fd_event->listen(EPOLLOUT | EPOLLET, std::bind(&TcpConnection::handleWrite, this, false));
+      m_eventloop->addEpollEvent(m_fd_event);
+      m_read_armed = false;
+    }
     return;
   }
 
   // LOG_DEBUG << "send data to " << m_peer_addr->to_string();
   if (m_write_complete_callback)
     m_write_complete_callback(*this);
+  if (m_shutdown_pending && m_out_queue->empty()) {
+    m_shutdown_pending = false;
+    this->shutdown();
+  }
   if (client)
     m_eventloop->stop();
 }
 
+/* 发送队列头部的文件区间，返回本次发往套接字的字节数，出错返回 -1 并设置 errno
+ * 先尝试 sendfile，如果 fd 不支持（EINVAL/ENOSYS/ESPIPE），则通过管道用 splice 搬运 */
+ssize_t TcpConnection::writeFileRegion(FileRegion &file)
+{
+  if (!file.m_use_splice) {
+    ssize_t len = ::sendfile(m_sockfd, file.m_fd, &file.m_offset, file.m_length);
+    m_eventloop->recordWriteSyscall();
+    if (len > 0) {
+      file.m_length -= len;
+      return len;
+    }
+    if (len == 0) {
+      // 文件比预期的短
+      if (file.m_length > 0) {
+        LOG_ERROR << "sendfile reach end of file, " << file.m_length << " bytes left, fd = " << file.m_fd;
+        errno = EIO;
+        return -1;
+      }
+      return 0;
+    }
+    if (errno != EINVAL && errno != ENOSYS && errno != ESPIPE)
+      return -1;
+    LOG_DEBUG << "sendfile not supported for fd " << file.m_fd << ", fall back to splice";
+    file.m_use_splice = true;
+    if (::lseek(file.m_fd, 0, SEEK_CUR) == -1 && errno == ESPIPE)
+      file.m_seekable = false;
+  }
+
+  if (m_splice_pipe[0] == -1 && ::pipe2(m_splice_pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+    LOG_ERROR << "create splice pipe failed, errno = " << errno;
+    return -1;
+  }
+
+  // 文件 -> 管道
+  if (file.m_length > 0) {
+    loff_t offset = file.m_offset;
+    ssize_t n = ::splice(file.m_fd, file.m_seekable ? &offset : nullptr, m_splice_pipe[1], nullptr, file.m_length,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    m_eventloop->recordWriteSyscall();
+    if (n > 0) {
+      file.m_offset = offset;
+      file.m_length -= n;
+      file.m_in_pipe += n;
+    }
+    else if (n == 0) {
+      LOG_ERROR << "splice reach end of file, " << file.m_length << " bytes left, fd = " << file.m_fd;
+      errno = EIO;
+      return -1;
+    }
+    else if (errno != EAGAIN) {
+      return -1;
+    }
+    else if (file.m_in_pipe == 0) {
+      /* 数据源暂时没有数据，管道里也没有可发的，套接字仍然可写，EPOLLOUT 不会再来通知
+       * 用定时器稍后重试；数据源的 fd 属于调用者，不能注册到 epoll 中 */
+      addTimer("__file_source_retry", FILE_SOURCE_RETRY_MS, [](TcpConnection &conn){
+        conn.handleWrite(false);
+      });
+      errno = EAGAIN;
+      return -1;
+    }
+  }
+
+  // 管道 -> 套接字
+  if (file.m_in_pipe == 0)
+    return 0;
+  ssize_t len = ::splice(m_splice_pipe[0], nullptr, m_sockfd, nullptr, file.m_in_pipe,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  m_eventloop->recordWriteSyscall();
+  if (len > 0)
+    file.m_in_pipe -= len;
+  return len;
+}
+
+// 发送队列头部带文件描述符的数据，文件描述符放在控制信息中，和后面的数据片一起用一次 sendmsg 发出
+ssize_t TcpConnection::writeWithFds()
+{
+  const std::vector<int> &fds = m_out_queue->frontFds();
+  struct iovec iov[MAX_IOV_NUM];
+  int iov_num = m_out_queue->fillIovec(iov, MAX_IOV_NUM);
+  char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+  memset(control, 0, sizeof(control));
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iov_num;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+  memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+  ssize_t len = ::sendmsg(m_sockfd, &msg, 0);
+  m_eventloop->recordWriteSyscall();
+  // 文件描述符已经交给内核，即使数据只发出了一部分，剩下的数据也不能再带一次
+  if (len > 0)
+    m_out_queue->releaseFrontFds();
+  return len;
+}
+
+// 用 recvmsg 读取数据，控制信息中的文件描述符追加到 m_received_fds
+ssize_t TcpConnection::readWithFds(char *buf, std::size_t len)
+{
+  char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+  struct iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n = ::recvmsg(m_sockfd, &msg, MSG_CMSG_CLOEXEC);
+  if (n < 0)
+    return n;
+  for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    const unsigned char *data = CMSG_DATA(cmsg);
+    for (std::size_t i = 0; i < count; ++i) {
+      int fd;
+      memcpy(&fd, data + i * sizeof(int), sizeof(int));
+      m_received_fds.push_back(fd);
+    }
+  }
+  if (msg.msg_flags & MSG_CTRUNC)
+    LOG_ERROR << "some passed fds were discarded by the kernel, fd = " << m_sockfd;
+  return n;
+}
+
+void TcpConnection::closeReceivedFds()
+{
+  for (int fd : m_received_fds)
+    ::close(fd);
+  m_received_fds.clear();
+}
+
+// 在事件循环本轮结束时调用，把本轮中积累的数据一次性发出
+void TcpConnection::flush()
+{
+  m_flush_pending = false;
+  if (m_state != Connected)
+    return;
+  handleWrite(false);
+}
+
+// 队列原本不为空，说明已经登记了 flush 或者正在等待套接字可写，新数据会一起发出
+void TcpConnection::scheduleFlush(bool was_empty)
+{
+  if (was_empty && !m_flush_pending) {
+    m_flush_pending = true;
+    m_eventloop->runAtIterationEnd(std::bind(&TcpConnection::flush, this));
+  }
+}
+
 void TcpConnection::addTimer(const std::string &timer_name, uint64_t interval,
                              ConnectionCallbackFunc cb, bool periodic /*=false*/)
 {
+  // 其它线程添加的定时器在IO线程中登记，任务持有连接的引用，连接已经关闭就不再添加
+  if (!m_eventloop->isThisThread()) {
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, timer_name, interval, cb, periodic](){
+      if (self->m_state != Closed)
+        self->addTimer(timer_name, interval, cb, periodic);
+    });
+    return;
+  }
   m_timer_container->addTimer(
     timer_name,
     interval,
@@ -266,25 +889,196 @@ void TcpConnection::addTimer(const std::string &timer_name, uint64_t interval,
 
 void TcpConnection::resetTimer(const std::string &timer_name)
 {
+  if (!m_eventloop->isThisThread()) {
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, timer_name](){self->resetTimer(timer_name);});
+    return;
+  }
   m_timer_container->resetTimer(timer_name);
 }
 
 void TcpConnection::resetTimer(const std::string &timer_name, uint64_t interval)
 {
+  if (!m_eventloop->isThisThread()) {
+    s_ptr self = shared_from_this();
+    m_eventloop->runInLoop([self, timer_name, interval](){self->resetTimer(timer_name, interval);});
+    return;
+  }
   m_timer_container->resetTimer(timer_name, interval);
 }
 
 void TcpConnection::cancelTimer(const std::string &timer_name)
 {
+  if (!m_eventloop->isThisThread()) {
+    m_eventloop->runInLoop(std::bind(&TcpConnection::cancelTimer, shared_from_this(), timer_name));
+    return;
+  }
   m_timer_container->cancelTimer(timer_name);
 }
 
 void TcpConnection::clearTimer()
 {
+  if (!m_eventloop->isThisThread()) {
+    m_eventloop->runInLoop(std::bind(&TcpConnection::clearTimer, shared_from_this()));
+    return;
+  }
   m_timer_container->clearTimer();
 }
 
+void TcpConnection::setZeroCopyThreshold(std::size_t threshold)
+{
+  if (m_eventloop->isThisThread()) {
+    if (threshold > 0 && m_zerocopy_threshold == 0) {
+      int one = 1;
+      if (setsockopt(m_sockfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == -1) {
+        LOG_ERROR << "setsockopt SO_ZEROCOPY failed, errno = " << errno << ", fd = " << m_sockfd;
+        return;
+      }
+      // 完成通知通过 EPOLLERR 报告，由 handleError 读取
+      m_fd_event->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+    }
+    m_zerocopy_threshold = threshold;
+  }
+  else {
+    m_eventloop->runInLoop(std::bind(&TcpConnection::setZeroCopyThreshold, shared_from_this(), threshold));
+  }
+}
+
+// setsockopt 本身是线程安全的，不必转到IO线程
+// Unix 域套接字没有 Nagle 算法，直接忽略
+void TcpConnection::setTcpNoDelay(bool on)
+{
+  if (m_peer_addr->family() == AF_UNIX)
+    return;
+  int opt = on ? 1 : 0;
+  if (setsockopt(m_sockfd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) == -1)
+    LOG_ERROR << "setsockopt TCP_NODELAY failed, errno = " << errno << ", fd = " << m_sockfd;
+}
+
+/* 空闲回收：突发的大消息会让接收缓存的容量一直保持在峰值，
+ * 连接数很多时这部分内存很可观，因此在连接空闲一段时间后把容量缩小 */
+void TcpConnection::setIdleBufferTrim(uint64_t quiet_ms, std::size_t keep_bytes)
+{
+  if (m_eventloop->isThisThread()) {
+    m_trim_quiet_ms = quiet_ms;
+    m_trim_keep = keep_bytes;
+    m_last_active_ms = get_now_ms();
+    if (quiet_ms == 0)
+      cancelTimer("__trim_idle_buffer");
+  }
+  else {
+    m_eventloop->runInLoop(std::bind(&TcpConnection::setIdleBufferTrim, shared_from_this(), quiet_ms, keep_bytes));
+  }
+}
+
+std::size_t TcpConnection::bufferBytes() const
+{
+  return m_accounted_bytes > 0 ? static_cast<std::size_t>(m_accounted_bytes) : 0;
+}
+
+std::size_t TcpConnection::outputBytes() const
+{
+  return m_out_queue->size();
+}
+
+/* 把缓冲区占用的变化计入所在 EventLoop 和全局预算
+ * 发送队列中共享的数据片在每个连接中都会被计算一次，统计的是连接“持有”的内存，而不是实际分配的内存 */
+void TcpConnection::updateBufferAccounting()
+{
+  int64_t bytes = 0;
+  if (m_state != Closed)
+    bytes = static_cast<int64_t>(m_in_buffer->capacity() + m_out_queue->size());
+  int64_t delta = bytes - m_accounted_bytes;
+  if (delta != 0) {
+    m_accounted_bytes = bytes;
+    m_eventloop->addBufferBytes(delta);
+    BufferBudget::add(delta);
+  }
+
+  // 容量超过保留值，登记一个回收定时器（已经登记过的话 addTimer 什么也不做）
+  if (m_trim_quiet_ms > 0 && m_state != Closed && m_in_buffer->capacity() > m_trim_keep) {
+    addTimer("__trim_idle_buffer", m_trim_quiet_ms, [](TcpConnection &conn){
+      conn.trimIdleBuffer();
+    });
+  }
+}
+
+void TcpConnection::trimIdleBuffer()
+{
+  int64_t idle = get_now_ms() - m_last_active_ms;
+  if (idle < static_cast<int64_t>(m_trim_quiet_ms)) {
+    // 期间有过读写，等到空闲时间足够再回收
+    addTimer("__trim_idle_buffer", m_trim_quiet_ms - idle, [](TcpConnection &conn){
+      conn.trimIdleBuffer();
+    });
+    return;
+  }
+  LOG_DEBUG << "trim idle buffer, capacity = " << m_in_buffer->capacity() << ", fd = " << m_sockfd;
+  m_in_buffer->trim(m_trim_keep);
+  updateBufferAccounting();
+}
+
+/* 处理 EPOLLERR，读取套接字错误队列中的 MSG_ZEROCOPY 完成通知，释放内核已经发送完的数据片
+ * 错误队列中没有通知而套接字确实出错时，和其它fd一样从epoll中删除 */
+void TcpConnection::handleError()
+{
+  while (true) {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(m_sockfd, &msg, MSG_ERRQUEUE) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;   // EAGAIN，错误队列已经读完
+    }
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+          !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+        continue;
+      struct sock_extended_err *serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+      if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0)
+        continue;
+      // 内核无法零拷贝（例如发往回环地址）时会退化为拷贝，功能不受影响
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        LOG_DEBUG << "MSG_ZEROCOPY fell back to copy, fd = " << m_sockfd;
+      releaseZeroCopy(serr->ee_info, serr->ee_data);
+    }
+  }
+
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(m_sockfd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error != 0) {
+    LOG_ERROR << "socket error on " << m_peer_addr->to_string() << ", errno = " << error;
+    deleteFromEventLoop();
+  }
+}
+
+// 序号在 [lo, hi] 内的零拷贝发送已经完成，释放对应的数据片（序号是32位的，会回绕）
+void TcpConnection::releaseZeroCopy(uint32_t lo, uint32_t hi)
+{
+  auto it = m_zerocopy_pending.begin();
+  while (it != m_zerocopy_pending.end()) {
+    if (static_cast<uint32_t>(it->first - lo) <= static_cast<uint32_t>(hi - lo))
+      it = m_zerocopy_pending.erase(it);
+    else
+      ++it;
+  }
+}
+
+void TcpConnection::closeSplicePipe()
+{
+  if (m_splice_pipe[0] != -1) {
+    ::close(m_splice_pipe[0]);
+    ::close(m_splice_pipe[1]);
+    m_splice_pipe[0] = m_splice_pipe[1] = -1;
+  }
+}
+
 void TcpConnection::deleteFromEventLoop()
 {
   m_eventloop->deleteEpollEvent(m_sockfd);
+  m_read_armed = false;
 }
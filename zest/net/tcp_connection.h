@@ -8,24 +8,31 @@
 #ifndef ZEST_NET_TCP_CONNECTION_H
 #define ZEST_NET_TCP_CONNECTION_H
 
+#include <deque>
 #include <functional>
 #include <memory>
 #include <string>
 #include <typeinfo>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "zest/base/noncopyable.h"
 #include "zest/net/base_addr.h"
+#include "zest/net/context_slot.h"
 #include "zest/net/inet_addr.h"
+#include "zest/net/slice.h"
 
 namespace zest
 {
 namespace net
 {
 
+class ConnectionRegistry;
 class EventLoop;
 class FdEvent;
+struct FileRegion;
+class OutputQueue;
 class TcpBuffer;
 class TcpConnection;
 class TimerEvent;
@@ -40,15 +47,19 @@ enum TcpState {
 };
 
 
-class TcpConnection : public noncopyable
+class TcpConnection : public noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
   friend class TcpClient;
+  friend class TcpRelay;
+  friend class ConnectionFreeList;
+  friend class ConnectionRegistry;
  private:
   using ConnectionCallbackFunc = std::function<void(TcpConnection&)>;
   using EventLoopPtr = std::shared_ptr<EventLoop>;
   using NetAddrPtr = std::shared_ptr<NetBaseAddress>;
   using FdEventPtr = std::shared_ptr<FdEvent>;
   using BufferPtr = std::shared_ptr<TcpBuffer>;
+  using OutputQueuePtr = std::shared_ptr<OutputQueue>;
   using TimerPtr = std::shared_ptr<TimerEvent>;
 
   /*********************** 定义两个内嵌类 ***********************/
@@ -110,6 +121,8 @@ class TcpConnection : public noncopyable
         return nullptr;
       return reinterpret_cast<ValueType*>(it->second.m_value);
     }
+
+    void clear() {m_context_map.clear();}
     
    private:
     std::unordered_map<std::string, ContextValue> m_context_map;
@@ -125,16 +138,53 @@ class TcpConnection : public noncopyable
   void waitForMessage();              // 等待数据到达
   std::string data() const;           // 获取接收缓存中的数据
   std::size_t dataSize() const;       // 接收缓存中数据量
+  const char *peek() const;           // 指向接收缓存中数据的指针，不拷贝数据
+  char *mutablePeek();                // 同上，可以原地修改数据（例如去掩码），但不能改变长度
+  std::size_t find(char c, std::size_t from = 0) const;   // 在接收缓存中查找，找不到返回 std::string::npos
+  std::size_t find(const std::string &delim, std::size_t from = 0) const;
+  std::size_t findCRLF(std::size_t from = 0) const;
   void send(const std::string &str);  // 发送数据
+  void send(std::string &&str);
   void send(const char *str);
   void send(const char *str, std::size_t len);
+  void send(const Slice &slice);      // 发送共享的数据片，不拷贝数据
+  void send(SliceBuilder &&builder);  // 发送构造好的消息，不拷贝数据
+  void send(const Slice &head, const Slice &body);  // 两个数据片作为一条消息发送，中间不会插入其它数据
+  void sendFile(int fd, off_t offset, std::size_t len,   // 零拷贝发送文件，发送完成后调用cb
+                ConnectionCallbackFunc cb = nullptr);
+  void sendFds(const std::vector<int> &fds, const Slice &data);  // 通过 Unix 域套接字把 fds 随 data 发给对端
+  void setFdPassing(bool on);      // 用 recvmsg 接收对端发来的文件描述符
+  std::vector<int> takeReceivedFds();  // 取走已经收到的文件描述符，调用者负责关闭
+  void setStreamingMode(std::size_t max_buffered);  // 流式接收，接收缓存达到上限就调用消息回调
+  void pauseReading();             // 暂停从套接字读取数据
+  void resumeReading();            // 恢复读取
+  bool isReadingPaused() const {return m_reading_paused;}
+  void setMinReadBytes(std::size_t bytes);  // 接收缓存至少有 bytes 字节时才唤醒，0 表示取消
   void clearData();                // 清空接收缓存
   void clearBytesData(int bytes);  // 丢弃接收缓存中bytes个字节的数据
   void shutdown();                 // 半关闭
   void close();                    // 断开连接
 
+  // 开启 MSG_ZEROCOPY，不小于 threshold 字节的数据片由内核直接从用户内存发送，0 表示关闭
+  void setZeroCopyThreshold(std::size_t threshold);
+
+  // 设置 TCP_NODELAY，关闭 Nagle 算法，请求-响应式的小消息不必等待对端的确认
+  void setTcpNoDelay(bool on);
+
+  // 连接空闲 quiet_ms 毫秒后，把接收缓存的容量缩小到 keep_bytes，0 表示不回收
+  void setIdleBufferTrim(uint64_t quiet_ms, std::size_t keep_bytes);
+
+  // 接收缓存和发送队列占用的内存
+  std::size_t bufferBytes() const;
+
+  // 发送队列中还没有写入套接字的字节数，用于判断慢速的接收方
+  std::size_t outputBytes() const;
+
   int socketfd() const {return m_sockfd;}
 
+  // 连接所属的IO线程的事件循环
+  std::shared_ptr<EventLoop> getEventLoop() const {return m_eventloop;}
+
   NetBaseAddress &peerAddress() const {return *m_peer_addr;}
 
   void setState(TcpState s) {m_state = s;}
@@ -156,6 +206,13 @@ class TcpConnection : public noncopyable
   template <typename ValueType>
   ValueType* Get(const std::string &key) const;
 
+  // 用登记过的槽位存取，对象构造在连接内部，不需要哈希字符串和比较类型名
+  template <typename ValueType, typename... Args>
+  bool Put(const ContextSlot<ValueType> &slot, Args&&... args);
+
+  template <typename ValueType>
+  ValueType* Get(const ContextSlot<ValueType> &slot) const;
+
   void addTimer(const std::string &timer_name, uint64_t interval, 
                 ConnectionCallbackFunc cb, bool periodic = false);
 
@@ -170,8 +227,28 @@ class TcpConnection : public noncopyable
   void deleteFromEventLoop();
   
  private:
+  // 连接对象池预先分配的对象，还没有套接字
+  explicit TcpConnection(EventLoopPtr eventloop);
+
+  // 由连接对象池调用：recycle 在IO线程中释放上一个连接的状态，reopen 用新的套接字重新打开
+  void recycle();
+  bool reopen(int fd, const sockaddr_storage &addr, socklen_t len);
+
   void handleRead(bool client = false);
   void handleWrite(bool client = false);
+  void flush();
+  void scheduleFlush(bool was_empty);
+  ssize_t writeFileRegion(FileRegion &file);
+  ssize_t writeWithFds();
+  ssize_t readWithFds(char *buf, std::size_t len);
+  void sendFdsInLoop(std::vector<int> fds, const Slice &data);
+  void closeReceivedFds();
+  void closeSplicePipe();
+  void handleError();
+  void releaseZeroCopy(uint32_t lo, uint32_t hi);
+  void updateBufferAccounting();
+  void updateReceiveLowWatermark();
+  void trimIdleBuffer();
   
  private:
   int m_sockfd;
@@ -179,11 +256,38 @@ class TcpConnection : public noncopyable
   NetAddrPtr m_peer_addr;
 
   BufferPtr m_in_buffer;
-  BufferPtr m_out_buffer;
+  OutputQueuePtr m_out_queue;
   TcpState m_state;
   FdEventPtr m_fd_event;
   Context m_context;
+  ContextStorage m_slots;
   TimerContainer<std::string> *m_timer_container;
+  bool m_read_armed {false};         // epoll 中注册的是可读事件
+  bool m_flush_pending {false};      // 已经登记了本轮结束时的 flush
+  bool m_shutdown_pending {false};   // 发送队列清空后执行半关闭
+  std::size_t m_max_buffered {0};    // 流式接收模式下接收缓存的上限，0 表示不限制
+  bool m_reading_paused {false};     // 暂停读取
+  bool m_read_pending {false};       // 暂停期间有数据没有读出
+  std::size_t m_min_read_bytes {0};  // 调用者需要的最少数据量，0 表示有数据就唤醒
+  int m_rcvlowat {1};                // 当前套接字的 SO_RCVLOWAT
+  int m_splice_pipe[2] {-1, -1};     // sendfile 不可用时，splice 使用的管道
+  bool m_fd_passing {false};         // 用 recvmsg 读取，接收 SCM_RIGHTS
+  std::vector<int> m_received_fds;   // 收到但还没有被取走的文件描述符
+
+  // TcpServer 接受的连接由所属IO线程的 ConnectionRegistry 持有，close() 时通知它释放
+  ConnectionRegistry *m_registry {nullptr};
+  std::size_t m_registry_index {0};  // 在 ConnectionRegistry 数组中的下标
+
+  // MSG_ZEROCOPY 相关，内核发送完成之前必须持有数据片的引用
+  std::size_t m_zerocopy_threshold {0};
+  uint32_t m_zerocopy_next_id {0};                          // 内核为每次零拷贝发送分配的序号
+  std::deque<std::pair<uint32_t, Slice>> m_zerocopy_pending;  // 等待内核完成通知的数据片
+
+  // 缓冲区内存统计和空闲回收
+  int64_t m_accounted_bytes {0};     // 已经计入 EventLoop 和全局预算的字节数
+  int64_t m_last_active_ms {0};      // 最近一次读写的时间
+  uint64_t m_trim_quiet_ms {0};      // 空闲多久之后回收接收缓存，0 表示不回收
+  std::size_t m_trim_keep {0};       // 回收后保留的容量
 
   ConnectionCallbackFunc m_message_callback {nullptr};
   ConnectionCallbackFunc m_write_complete_callback {nullptr};
@@ -206,6 +310,21 @@ ValueType* TcpConnection::Get(const std::string &key) const
 {
   return m_context.Get<ValueType>(key);
 }
+
+/* 向槽位中放置对象，槽位中已经有对象时返回 false
+ * 槽位和字符串名字是两套独立的上下文，同一个对象只能用其中一种方式存取 */
+template <typename ValueType, typename... Args>
+bool TcpConnection::Put(const ContextSlot<ValueType> &slot, Args&&... args)
+{
+  return m_slots.emplace(slot, std::forward<Args>(args)...);
+}
+
+// 获取槽位中的对象，没有放置过返回 nullptr
+template <typename ValueType>
+ValueType* TcpConnection::Get(const ContextSlot<ValueType> &slot) const
+{
+  return m_slots.get(slot);
+}
   
 } // namespace net 
 } // namespace zest
@@ -0,0 +1,355 @@
+/* 异步的主动连接：在已有的 IO 线程的事件循环中发起非阻塞 connect，支持超时和指数退避重连 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/tcp_connector.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+
+#include "zest/base/logging.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/fd_event.h"
+#include "zest/net/timer_event.h"
+
+using namespace zest;
+using namespace zest::net;
+
+
+// 退避时间加上随机抖动，[delay/2, delay]
+static uint64_t jitter(uint64_t delay)
+{
+  static thread_local std::mt19937 gen(std::random_device{}());
+  if (delay < 2)
+    return delay;
+  std::uniform_int_distribution<uint64_t> dis(delay / 2, delay);
+  return dis(gen);
+}
+
+TcpConnector::TcpConnector(std::shared_ptr<EventLoop> eventloop, NetBaseAddress &peer_addr) :
+  m_eventloop(eventloop), m_peer_addr(peer_addr.copy())
+{
+  /* do nothing */
+}
+
+TcpConnector::~TcpConnector()
+{
+  if (m_timeout_timer)
+    m_timeout_timer->set_valid(false);
+  if (m_retry_timer)
+    m_retry_timer->set_valid(false);
+  if (m_sockfd != -1) {
+    if (m_eventloop->isThisThread())
+      m_eventloop->deleteEpollEvent(m_sockfd);
+    ::close(m_sockfd);
+  }
+  // 连接还在时关闭它，对象留到本轮循环结束再释放，本轮中登记的 flush 等任务还持有它的裸指针
+  if (m_connection && m_eventloop->isThisThread()) {
+    TcpState state = m_connection->getState();
+    if (state == Connected || state == HalfClosing) {
+      TcpConnection::s_ptr conn = m_connection;
+      conn->close();
+      m_eventloop->runAtIterationEnd([conn](){});
+    }
+  }
+}
+
+void TcpConnector::setRetry(uint64_t initial_ms, uint64_t max_ms, int max_retries /*=-1*/)
+{
+  m_initial_backoff = std::max<uint64_t>(initial_ms, 1);
+  m_max_backoff = std::max(max_ms, m_initial_backoff);
+  m_max_retries = max_retries;
+  m_backoff = m_initial_backoff;
+}
+
+void TcpConnector::start()
+{
+  auto self = shared_from_this();
+  m_eventloop->runInLoop([self](){
+    self->startInLoop();
+  });
+}
+
+void TcpConnector::stop()
+{
+  auto self = shared_from_this();
+  m_eventloop->runInLoop([self](){
+    self->stopInLoop();
+  });
+}
+
+void TcpConnector::startInLoop()
+{
+  m_eventloop->assertInLoopThread();
+  m_stopped = false;
+  if (m_state == kDisconnected && !m_retry_timer)
+    connect();
+}
+
+void TcpConnector::stopInLoop()
+{
+  m_eventloop->assertInLoopThread();
+  m_stopped = true;
+  if (m_retry_timer) {
+    m_retry_timer->set_valid(false);
+    m_retry_timer.reset();
+  }
+  if (m_state == kConnecting) {
+    int sockfd = removeConnectingSocket();
+    ::close(sockfd);
+    m_state = kDisconnected;
+  }
+  else if (m_state == kConnected && m_connection) {
+    m_connection->shutdown();
+  }
+}
+
+void TcpConnector::connect()
+{
+  m_retry_timer.reset();
+  m_attempts.fetch_add(1, std::memory_order_relaxed);
+
+  int sockfd = ::socket(m_peer_addr->family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sockfd == -1) {
+    int err = errno;
+    LOG_ERROR << "create socket failed, errno = " << err;
+    // 文件描述符用完是暂时的，其它错误重试也没有用
+    if (err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM)
+      retry(err);
+    else
+      giveUp(err);
+    return;
+  }
+
+  int rt = ::connect(sockfd, m_peer_addr->sockaddr(), m_peer_addr->socklen());
+  int err = rt == 0 ? 0 : errno;
+  switch (err)
+  {
+  case 0:
+  case EINPROGRESS:
+  case EINTR:
+  case EISCONN:
+    connecting(sockfd);
+    break;
+
+  // 对端没有监听、网络暂时不可达、本地端口用完，或者 Unix 域套接字的 backlog 已满，稍后重试
+  case EAGAIN:
+  case EADDRINUSE:
+  case EADDRNOTAVAIL:
+  case ECONNREFUSED:
+  case ENETUNREACH:
+  case EHOSTUNREACH:
+  case ETIMEDOUT:
+  case ENOENT:
+    ::close(sockfd);
+    retry(err);
+    break;
+
+  default:
+    LOG_ERROR << "connect to " << m_peer_addr->to_string() << " failed, errno = " << err;
+    ::close(sockfd);
+    giveUp(err);
+    break;
+  }
+}
+
+void TcpConnector::connecting(int sockfd)
+{
+  m_state = kConnecting;
+  m_sockfd = sockfd;
+
+  // 回调函数只持有弱引用，连接器被释放后事件和定时器自然失效
+  std::weak_ptr<TcpConnector> weak_self = shared_from_this();
+  m_fd_event = std::make_shared<FdEvent>(sockfd);
+  // 连接完成或者失败时套接字都会变为可写，失败时同时报告 EPOLLERR，结果统一由 SO_ERROR 判断
+  auto on_writable = [weak_self](){
+    auto self = weak_self.lock();
+    if (self)
+      self->handleWrite();
+  };
+  m_fd_event->listen(EPOLLOUT | EPOLLET, on_writable, on_writable);
+  m_eventloop->addEpollEvent(m_fd_event);
+
+  if (m_connect_timeout > 0) {
+    m_timeout_timer = std::make_shared<TimerEvent>(
+      m_connect_timeout,
+      [weak_self](){
+        auto self = weak_self.lock();
+        if (self)
+          self->handleTimeout();
+      }
+    );
+    m_eventloop->addTimerEvent(m_timeout_timer);
+  }
+}
+
+// 取消可写事件和超时定时器，返回正在连接的套接字
+int TcpConnector::removeConnectingSocket()
+{
+  int sockfd = m_sockfd;
+  m_eventloop->deleteEpollEvent(sockfd);
+  m_fd_event.reset();
+  if (m_timeout_timer) {
+    m_timeout_timer->set_valid(false);
+    m_timeout_timer.reset();
+  }
+  m_sockfd = -1;
+  return sockfd;
+}
+
+void TcpConnector::handleWrite()
+{
+  // 同一轮中可写和出错两个事件都会调用到这里，只处理一次
+  if (m_state != kConnecting)
+    return;
+
+  int sockfd = removeConnectingSocket();
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+    error = errno;
+
+  if (error != 0) {
+    LOG_DEBUG << "connect to " << m_peer_addr->to_string() << " failed, errno = " << error;
+    ::close(sockfd);
+    retry(error);
+  }
+  else if (isSelfConnect(sockfd)) {
+    // 连接本机上没有监听的端口时，内核可能把临时端口分配成目标端口，自己连上了自己
+    LOG_INFO << "self connect to " << m_peer_addr->to_string() << ", retry";
+    ::close(sockfd);
+    retry(ECONNREFUSED);
+  }
+  else {
+    newConnection(sockfd);
+  }
+}
+
+void TcpConnector::handleTimeout()
+{
+  m_timeout_timer.reset();
+  if (m_state != kConnecting)
+    return;
+  LOG_DEBUG << "connect to " << m_peer_addr->to_string() << " timeout";
+  int sockfd = removeConnectingSocket();
+  ::close(sockfd);
+  retry(ETIMEDOUT);
+}
+
+void TcpConnector::newConnection(int sockfd)
+{
+  m_state = kConnected;
+  m_retries = 0;
+  m_backoff = m_initial_backoff;
+
+  m_connection = std::make_shared<TcpConnection>(sockfd, m_eventloop, m_peer_addr);
+  m_connection->setMessageCallback(m_message_callback);
+  m_connection->setWriteCompleteCallback(m_write_complete_callback);
+  std::weak_ptr<TcpConnector> weak_self = shared_from_this();
+  m_connection->setCloseCallback([weak_self](TcpConnection &conn){
+    auto self = weak_self.lock();
+    if (self)
+      self->handleClose(conn);
+  });
+  m_connected.store(true, std::memory_order_relaxed);
+
+  LOG_INFO << "Connected to " << m_peer_addr->to_string() << ", fd = " << sockfd;
+  // 和 TcpServer 一样：设置了连接回调函数则交给它，否则直接等待数据
+  if (m_connection_callback)
+    m_connection_callback(*m_connection);
+  else
+    m_connection->waitForMessage();
+}
+
+void TcpConnector::handleClose(TcpConnection &conn)
+{
+  if (m_close_callback)
+    m_close_callback(conn);
+
+  m_state = kDisconnected;
+  m_connected.store(false, std::memory_order_relaxed);
+
+  // close() 返回之前还会用到连接对象，本轮中登记的任务也持有它的裸指针，所以留到本轮循环结束再释放
+  TcpConnection::s_ptr closed = std::move(m_connection);
+  m_connection.reset();
+  m_eventloop->runAtIterationEnd([closed](){});
+
+  if (m_reconnect && !m_stopped) {
+    LOG_INFO << "connection to " << m_peer_addr->to_string() << " closed, reconnect";
+    scheduleConnect();
+  }
+}
+
+void TcpConnector::retry(int err)
+{
+  m_state = kDisconnected;
+  m_failures.fetch_add(1, std::memory_order_relaxed);
+  if (m_stopped)
+    return;
+
+  if (m_max_retries >= 0 && m_retries >= m_max_retries) {
+    LOG_ERROR << "connect to " << m_peer_addr->to_string() << " failed after "
+              << m_retries << " retries, errno = " << err;
+    giveUp(err);
+    return;
+  }
+  ++m_retries;
+  scheduleConnect();
+}
+
+void TcpConnector::scheduleConnect()
+{
+  uint64_t delay = jitter(m_backoff);
+  m_backoff = std::min(m_backoff * 2, m_max_backoff);
+  LOG_DEBUG << "retry connecting to " << m_peer_addr->to_string() << " in " << delay << " ms";
+
+  std::weak_ptr<TcpConnector> weak_self = shared_from_this();
+  m_retry_timer = std::make_shared<TimerEvent>(
+    delay,
+    [weak_self](){
+      auto self = weak_self.lock();
+      if (self && !self->m_stopped && self->m_state == kDisconnected)
+        self->connect();
+    }
+  );
+  m_eventloop->addTimerEvent(m_retry_timer);
+}
+
+void TcpConnector::giveUp(int err)
+{
+  m_state = kDisconnected;
+  m_stopped = true;
+  if (m_connect_failed_callback)
+    m_connect_failed_callback(*this, err);
+}
+
+bool TcpConnector::isSelfConnect(int sockfd) const
+{
+  sockaddr_storage local, peer;
+  socklen_t local_len = sizeof(local), peer_len = sizeof(peer);
+  memset(&local, 0, sizeof(local));
+  memset(&peer, 0, sizeof(peer));
+  if (getsockname(sockfd, reinterpret_cast<sockaddr*>(&local), &local_len) == -1 ||
+      getpeername(sockfd, reinterpret_cast<sockaddr*>(&peer), &peer_len) == -1)
+    return false;
+
+  if (local.ss_family == AF_INET && peer.ss_family == AF_INET) {
+    const sockaddr_in *l = reinterpret_cast<const sockaddr_in*>(&local);
+    const sockaddr_in *p = reinterpret_cast<const sockaddr_in*>(&peer);
+    return l->sin_port == p->sin_port && l->sin_addr.s_addr == p->sin_addr.s_addr;
+  }
+  if (local.ss_family == AF_INET6 && peer.ss_family == AF_INET6) {
+    const sockaddr_in6 *l = reinterpret_cast<const sockaddr_in6*>(&local);
+    const sockaddr_in6 *p = reinterpret_cast<const sockaddr_in6*>(&peer);
+    return l->sin6_port == p->sin6_port &&
+           memcmp(&l->sin6_addr, &p->sin6_addr, sizeof(l->sin6_addr)) == 0;
+  }
+  return false;
+}
@@ -0,0 +1,142 @@
+/* 异步的主动连接：在已有的 IO 线程的事件循环中发起非阻塞 connect，支持超时和指数退避重连 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_TCP_CONNECTOR_H
+#define ZEST_NET_TCP_CONNECTOR_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/base_addr.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+class FdEvent;
+class TimerEvent;
+
+/* 和阻塞的 TcpClient 不同，TcpConnector 不拥有事件循环，也不会阻塞调用者：
+ * connect 的结果、收到的数据和连接断开都通过回调函数在所属的IO线程中通知，
+ * 所以一个线程可以同时驱动成千上万个主动连接
+ * 连接建立后得到的是一个普通的 TcpConnection，消息、写完成、关闭回调的用法和服务器端的连接完全一样
+ * 必须由 std::shared_ptr 管理；析构必须在所属的IO线程中进行，或者在事件循环停止之后 */
+class TcpConnector : public noncopyable, public std::enable_shared_from_this<TcpConnector>
+{
+ public:
+  using s_ptr = std::shared_ptr<TcpConnector>;
+  using ConnectionCallbackFunc = std::function<void(TcpConnection&)>;
+  using ConnectFailedCallbackFunc = std::function<void(TcpConnector&, int err)>;
+
+  static const uint64_t DEFAULT_CONNECT_TIMEOUT = 3000;   // ms
+  static const uint64_t DEFAULT_INITIAL_BACKOFF = 100;    // ms
+  static const uint64_t DEFAULT_MAX_BACKOFF = 30000;      // ms
+
+  TcpConnector(std::shared_ptr<EventLoop> eventloop, NetBaseAddress &peer_addr);
+  ~TcpConnector();
+
+  // 以下设置必须在 start() 之前调用
+  void setConnectTimeout(uint64_t ms) {m_connect_timeout = ms;}   // 0 表示不设超时，由内核决定
+
+  /* 连接失败后等待 initial_ms 重试，每次失败等待时间翻倍，最多 max_ms
+   * 实际等待时间在 [delay/2, delay] 之间随机，避免大量连接同时重试
+   * max_retries 为连续失败后的重试次数上限，-1 表示一直重试，0 表示不重试 */
+  void setRetry(uint64_t initial_ms, uint64_t max_ms, int max_retries = -1);
+
+  // 建立的连接断开后自动重连（同样使用退避），默认不重连
+  void setReconnect(bool on) {m_reconnect = on;}
+
+  // 连接建立后在IO线程中调用，没有设置时自动调用 waitForMessage()
+  void setConnectionCallback(const ConnectionCallbackFunc &cb) {m_connection_callback = cb;}
+  void setMessageCallback(const ConnectionCallbackFunc &cb) {m_message_callback = cb;}
+  void setWriteCompleteCallback(const ConnectionCallbackFunc &cb) {m_write_complete_callback = cb;}
+  void setCloseCallback(const ConnectionCallbackFunc &cb) {m_close_callback = cb;}
+
+  // 重试次数用完、或者遇到不可恢复的错误（例如地址族不支持）时调用，之后不再重试
+  void setConnectFailedCallback(const ConnectFailedCallbackFunc &cb) {m_connect_failed_callback = cb;}
+
+  // 开始连接，可以在任意线程调用
+  void start();
+
+  // 停止连接和重试，已经建立的连接在发送队列清空后半关闭，可以在任意线程调用
+  void stop();
+
+  // 当前的连接，没有连接时返回 nullptr，只能在IO线程中调用
+  TcpConnection::s_ptr connection() const {return m_connection;}
+
+  bool connected() const {return m_connected.load(std::memory_order_relaxed);}
+  std::shared_ptr<EventLoop> getEventLoop() const {return m_eventloop;}
+  NetBaseAddress &peerAddress() const {return *m_peer_addr;}
+
+  // 统计数据，可以在任意线程读取
+  uint64_t connectAttempts() const {return m_attempts.load(std::memory_order_relaxed);}
+  uint64_t connectFailures() const {return m_failures.load(std::memory_order_relaxed);}
+
+ private:
+  enum State {
+    kDisconnected,
+    kConnecting,
+    kConnected,
+  };
+
+  void startInLoop();
+  void stopInLoop();
+  void connect();
+  void connecting(int sockfd);
+  void handleWrite();
+  void handleTimeout();
+  void handleClose(TcpConnection &conn);
+  void newConnection(int sockfd);
+  int removeConnectingSocket();
+  void retry(int err);
+  void scheduleConnect();
+  void giveUp(int err);
+  bool isSelfConnect(int sockfd) const;
+
+ private:
+  std::shared_ptr<EventLoop> m_eventloop;
+  NetBaseAddress::s_ptr m_peer_addr;
+
+  uint64_t m_connect_timeout {DEFAULT_CONNECT_TIMEOUT};
+  uint64_t m_initial_backoff {DEFAULT_INITIAL_BACKOFF};
+  uint64_t m_max_backoff {DEFAULT_MAX_BACKOFF};
+  int m_max_retries {-1};
+  bool m_reconnect {false};
+
+  // 以下成员只在IO线程中访问
+  State m_state {kDisconnected};
+  bool m_stopped {true};
+  int m_sockfd {-1};                          // 正在连接的套接字
+  int m_retries {0};                          // 连续失败的次数，连接成功后清零
+  uint64_t m_backoff {DEFAULT_INITIAL_BACKOFF};
+  std::shared_ptr<FdEvent> m_fd_event;        // 等待连接完成的可写事件
+  std::shared_ptr<TimerEvent> m_timeout_timer;
+  std::shared_ptr<TimerEvent> m_retry_timer;
+  TcpConnection::s_ptr m_connection;
+
+  std::atomic<bool> m_connected {false};
+  std::atomic<uint64_t> m_attempts {0};
+  std::atomic<uint64_t> m_failures {0};
+
+  ConnectionCallbackFunc m_connection_callback {nullptr};
+  ConnectionCallbackFunc m_message_callback {nullptr};
+  ConnectionCallbackFunc m_write_complete_callback {nullptr};
+  ConnectionCallbackFunc m_close_callback {nullptr};
+  ConnectFailedCallbackFunc m_connect_failed_callback {nullptr};
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_TCP_CONNECTOR_H
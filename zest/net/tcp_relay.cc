@@ -0,0 +1,300 @@
+/* 两个 TCP 连接之间的双向转发，数据经过管道用 splice 在内核中搬运，不拷贝到用户空间 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/tcp_relay.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <initializer_list>
+
+#include "zest/base/logging.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/fd_event.h"
+#include "zest/net/output_queue.h"
+#include "zest/net/tcp_buffer.h"
+#include "zest/net/timer_event.h"
+
+using namespace zest;
+using namespace zest::net;
+
+
+// 发送队列还没有清空时，隔多久再检查一次
+static const uint64_t START_RETRY_INTERVAL = 1;   // ms
+
+TcpRelay::TcpRelay(TcpConnection &a, TcpConnection &b) :
+  m_a(a), m_b(b), m_eventloop(a.getEventLoop())
+{
+  m_dirs[0].m_src = &a;
+  m_dirs[0].m_dst = &b;
+  m_dirs[1].m_src = &b;
+  m_dirs[1].m_dst = &a;
+}
+
+TcpRelay::~TcpRelay()
+{
+  if (m_start_timer)
+    m_start_timer->set_valid(false);
+}
+
+void TcpRelay::start()
+{
+  auto self = shared_from_this();
+  m_eventloop->runInLoop([self](){
+    self->startInLoop();
+  });
+}
+
+void TcpRelay::abort()
+{
+  auto self = shared_from_this();
+  m_eventloop->runInLoop([self](){
+    self->finish(ECONNABORTED);
+  });
+}
+
+void TcpRelay::startInLoop()
+{
+  m_eventloop->assertInLoopThread();
+  m_start_timer.reset();
+  if (m_started || m_finished)
+    return;
+  if (m_b.getEventLoop() != m_eventloop) {
+    LOG_ERROR << "TcpRelay: connections belong to different IO threads";
+    finish(EINVAL);
+    return;
+  }
+  if (m_a.getState() != Connected || m_b.getState() != Connected) {
+    LOG_ERROR << "TcpRelay: connection is not connected";
+    finish(ENOTCONN);
+    return;
+  }
+
+  // 发送队列中的数据由连接自己发完，管道中的数据必须排在它们后面
+  if (!m_a.m_out_queue->empty() || !m_b.m_out_queue->empty()) {
+    std::weak_ptr<TcpRelay> weak_self = shared_from_this();
+    m_start_timer = std::make_shared<TimerEvent>(
+      START_RETRY_INTERVAL,
+      [weak_self](){
+        auto self = weak_self.lock();
+        if (self)
+          self->startInLoop();
+      }
+    );
+    m_eventloop->addTimerEvent(m_start_timer);
+    return;
+  }
+
+  for (auto &d : m_dirs) {
+    if (!setupPipe(d)) {
+      finish(errno);
+      return;
+    }
+    // 接收缓存中已经读出、还没有被消费的数据
+    if (d.m_src->dataSize() > 0) {
+      d.m_prefix = d.m_src->data();
+      d.m_src->clearData();
+    }
+  }
+  m_started = true;
+
+  // 任一连接被其它代码关闭时，转发随之结束
+  std::weak_ptr<TcpRelay> weak_self = shared_from_this();
+  for (TcpConnection *conn : {&m_a, &m_b}) {
+    TcpConnection::ConnectionCallbackFunc orig = conn->m_close_callback;
+    conn->m_close_callback = [weak_self, orig](TcpConnection &c){
+      if (orig)
+        orig(c);
+      auto self = weak_self.lock();
+      if (self && !self->m_finished)
+        self->finish(ECONNABORTED);
+    };
+  }
+
+  /* 接管两个套接字：同时监听可读和可写，ET 模式下只注册一次，之后不再调用 epoll_ctl
+   * 事件的回调函数持有 shared_ptr，转发期间对象不会被释放 */
+  auto self = shared_from_this();
+  for (int side = 0; side < 2; ++side) {
+    TcpConnection &conn = side == 0 ? m_a : m_b;
+    conn.deleteFromEventLoop();
+    m_events[side] = std::make_shared<FdEvent>(conn.socketfd());
+    m_events[side]->listen(EPOLLOUT | EPOLLET, [self, side](){
+      self->handleEvent(side, false, true);
+    });
+    m_events[side]->listen(EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+      [self, side](){
+        self->handleEvent(side, true, false);
+      },
+      [self, side](){
+        self->handleError(side);
+      }
+    );
+    m_eventloop->addEpollEvent(m_events[side]);
+  }
+
+  LOG_DEBUG << "TcpRelay start: " << m_a.peerAddress().to_string() << " <-> " << m_b.peerAddress().to_string();
+  pump(m_dirs[0]);
+  pump(m_dirs[1]);
+}
+
+// 复用目标连接的 splice 管道
+bool TcpRelay::setupPipe(Direction &d)
+{
+  int *pipefd = d.m_dst->m_splice_pipe;
+  if (pipefd[0] == -1 && ::pipe2(pipefd, O_NONBLOCK | O_CLOEXEC) == -1) {
+    LOG_ERROR << "TcpRelay: create pipe failed, errno = " << errno;
+    return false;
+  }
+  int capacity = ::fcntl(pipefd[1], F_SETPIPE_SZ, static_cast<int>(m_pipe_size));
+  if (capacity == -1)
+    capacity = ::fcntl(pipefd[1], F_GETPIPE_SZ);
+  d.m_pipe_capacity = capacity > 0 ? static_cast<std::size_t>(capacity) : 65536;
+  return true;
+}
+
+void TcpRelay::handleEvent(int side, bool readable, bool writable)
+{
+  if (m_finished)
+    return;
+  // side 的套接字可读，推动 side 作为源的方向；可写，推动 side 作为目标的方向
+  if (readable) {
+    m_dirs[side].m_src_readable = true;
+    pump(m_dirs[side]);
+  }
+  if (writable && !m_finished) {
+    m_dirs[1 - side].m_dst_writable = true;
+    pump(m_dirs[1 - side]);
+  }
+}
+
+void TcpRelay::handleError(int side)
+{
+  if (m_finished)
+    return;
+  int error = 0;
+  socklen_t len = sizeof(error);
+  TcpConnection &conn = side == 0 ? m_a : m_b;
+  if (getsockopt(conn.socketfd(), SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+    error = errno;
+  if (error == 0)
+    return;
+  LOG_ERROR << "TcpRelay: socket error on " << conn.peerAddress().to_string() << ", errno = " << error;
+  finish(error);
+}
+
+bool TcpRelay::writePrefix(Direction &d)
+{
+  while (!d.m_prefix.empty() && d.m_dst_writable) {
+    ssize_t n = ::send(d.m_dst->socketfd(), d.m_prefix.data(), d.m_prefix.size(), MSG_NOSIGNAL);
+    if (n > 0) {
+      d.m_prefix.erase(0, n);
+      d.m_bytes.fetch_add(n, std::memory_order_relaxed);
+    }
+    else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      d.m_dst_writable = false;
+    }
+    else if (errno != EINTR) {
+      finish(errno);
+      return false;
+    }
+  }
+  return true;
+}
+
+void TcpRelay::pump(Direction &d)
+{
+  if (m_finished || d.m_shut)
+    return;
+  if (!writePrefix(d) || !d.m_prefix.empty())
+    return;
+
+  int src = d.m_src->socketfd(), dst = d.m_dst->socketfd();
+  int *pipefd = d.m_dst->m_splice_pipe;
+  while (true) {
+    bool progress = false;
+
+    // 套接字 -> 管道，管道满了就停，数据留在源套接字的接收缓存中
+    if (!d.m_src_eof && d.m_src_readable && d.m_in_pipe < d.m_pipe_capacity) {
+      ssize_t n = ::splice(src, nullptr, pipefd[1], nullptr, d.m_pipe_capacity - d.m_in_pipe,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      m_splice_calls.fetch_add(1, std::memory_order_relaxed);
+      if (n > 0) {
+        d.m_in_pipe += n;
+        progress = true;
+      }
+      else if (n == 0) {
+        d.m_src_eof = true;
+      }
+      else if (errno == EAGAIN) {
+        /* 管道按页存放数据，小的数据段也占一页，管道中有数据时 EAGAIN 也可能是管道满了，
+         * 这时不能认为源套接字已经读空，清空管道后再读一次 */
+        if (d.m_in_pipe == 0)
+          d.m_src_readable = false;
+      }
+      else if (errno != EINTR) {
+        finish(errno);
+        return;
+      }
+    }
+
+    // 管道 -> 套接字，目标套接字的发送缓存满了就等待可写事件
+    if (d.m_in_pipe > 0 && d.m_dst_writable) {
+      ssize_t n = ::splice(pipefd[0], nullptr, dst, nullptr, d.m_in_pipe,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      m_splice_calls.fetch_add(1, std::memory_order_relaxed);
+      if (n > 0) {
+        d.m_in_pipe -= n;
+        d.m_bytes.fetch_add(n, std::memory_order_relaxed);
+        progress = true;
+      }
+      else if (n < 0 && errno == EAGAIN) {
+        d.m_dst_writable = false;
+      }
+      else if (n < 0 && errno != EINTR) {
+        finish(errno);
+        return;
+      }
+    }
+
+    if (!progress)
+      break;
+  }
+
+  // 源已经读到 FIN，管道也已经清空，把半关闭传给目标
+  if (d.m_src_eof && d.m_in_pipe == 0 && !d.m_shut) {
+    ::shutdown(dst, SHUT_WR);
+    d.m_shut = true;
+    LOG_DEBUG << "TcpRelay: half close " << d.m_dst->peerAddress().to_string();
+    if (m_dirs[0].m_shut && m_dirs[1].m_shut)
+      finish(0);
+  }
+}
+
+void TcpRelay::finish(int err)
+{
+  if (m_finished)
+    return;
+  m_finished = true;
+  m_error = err;
+  if (m_start_timer) {
+    m_start_timer->set_valid(false);
+    m_start_timer.reset();
+  }
+
+  // close() 会把套接字从 epoll 中删除，注册的事件随之释放
+  for (TcpConnection *conn : {&m_a, &m_b}) {
+    if (conn->getState() == Connected || conn->getState() == HalfClosing)
+      conn->close();
+  }
+  m_events[0].reset();
+  m_events[1].reset();
+
+  LOG_DEBUG << "TcpRelay finish, a->b " << bytesAtoB() << " bytes, b->a " << bytesBtoA()
+            << " bytes, errno = " << err;
+  if (m_finish_callback)
+    m_finish_callback(*this);
+}
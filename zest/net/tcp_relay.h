@@ -0,0 +1,114 @@
+/* 两个 TCP 连接之间的双向转发，数据经过管道用 splice 在内核中搬运，不拷贝到用户空间 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_TCP_RELAY_H
+#define ZEST_NET_TCP_RELAY_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+class FdEvent;
+class TimerEvent;
+
+/* 用于四层转发/代理：start() 之后两个连接不再调用消息回调，收到的数据直接 splice 进对方的套接字
+ * 每个方向使用目标连接自己的 splice 管道（sendFile 也用它），数据的路径是 套接字 -> 管道 -> 套接字
+ * 背压：管道满了就不再从源套接字读取，数据留在内核的接收缓存中，由 TCP 流量控制让对端减慢发送
+ * 半关闭：一个方向读到 FIN 并且管道中的数据全部写出后，对目标套接字 shutdown(SHUT_WR)，另一个方向继续转发
+ * 两个方向都结束，或者任一方向出错时，关闭两个连接（会调用各自的关闭回调），然后调用结束回调
+ * 两个连接必须属于同一个IO线程；必须由 std::shared_ptr 管理，转发期间对象由注册的事件持有 */
+class TcpRelay : public noncopyable, public std::enable_shared_from_this<TcpRelay>
+{
+ public:
+  using s_ptr = std::shared_ptr<TcpRelay>;
+  using FinishCallback = std::function<void(TcpRelay&)>;
+
+  static const std::size_t DEFAULT_PIPE_SIZE = 1024 * 1024;
+
+  TcpRelay(TcpConnection &a, TcpConnection &b);
+  ~TcpRelay();
+
+  // 以下设置必须在 start() 之前调用
+  // 每个方向管道的容量，受 /proc/sys/fs/pipe-max-size 限制，设置失败时使用系统默认的 64KB
+  void setPipeSize(std::size_t bytes) {m_pipe_size = bytes;}
+  void setFinishCallback(const FinishCallback &cb) {m_finish_callback = cb;}
+
+  /* 开始转发，可以在任意线程调用
+   * 等两个连接的发送队列清空后接管它们，接收缓存中已经读出的数据先原样转发 */
+  void start();
+
+  // 停止转发并关闭两个连接，可以在任意线程调用
+  void abort();
+
+  bool finished() const {return m_finished.load(std::memory_order_relaxed);}
+
+  // 统计数据，可以在任意线程读取
+  uint64_t bytesAtoB() const {return m_dirs[0].m_bytes.load(std::memory_order_relaxed);}
+  uint64_t bytesBtoA() const {return m_dirs[1].m_bytes.load(std::memory_order_relaxed);}
+  uint64_t spliceCalls() const {return m_splice_calls.load(std::memory_order_relaxed);}
+
+  // 结束的原因，0 表示两个方向都正常结束
+  int error() const {return m_error;}
+
+ private:
+  // 一个方向：m_src -> 管道 -> m_dst
+  struct Direction
+  {
+    TcpConnection *m_src {nullptr};
+    TcpConnection *m_dst {nullptr};
+    std::string m_prefix;             // 开始转发前源连接已经读出的数据，先于管道中的数据写出
+    std::size_t m_pipe_capacity {0};
+    std::size_t m_in_pipe {0};        // 管道中还没有写出的字节数
+    bool m_src_readable {true};       // ET 模式下记录的就绪状态，遇到 EAGAIN 才清除
+    bool m_dst_writable {true};
+    bool m_src_eof {false};
+    bool m_shut {false};              // 已经对目标套接字 shutdown(SHUT_WR)
+    std::atomic<uint64_t> m_bytes {0};
+  };
+
+  void startInLoop();
+  bool setupPipe(Direction &d);
+  void handleEvent(int side, bool readable, bool writable);
+  void handleError(int side);
+  void pump(Direction &d);
+  bool writePrefix(Direction &d);
+  void finish(int err);
+
+ private:
+  TcpConnection &m_a;
+  TcpConnection &m_b;
+  std::shared_ptr<EventLoop> m_eventloop;
+  std::size_t m_pipe_size {DEFAULT_PIPE_SIZE};
+  FinishCallback m_finish_callback {nullptr};
+
+  // 以下成员只在IO线程中访问
+  bool m_started {false};
+  Direction m_dirs[2];                          // 0: a -> b，1: b -> a
+  std::shared_ptr<FdEvent> m_events[2];         // 接管后 a、b 套接字的事件
+  std::shared_ptr<TimerEvent> m_start_timer;    // 等待发送队列清空
+  int m_error {0};
+
+  std::atomic<bool> m_finished {false};
+  std::atomic<uint64_t> m_splice_calls {0};
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_TCP_RELAY_H
@@ -13,37 +13,47 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <iostream>
-#include <stdexcept>
 #include <string>
 
 #include "zest/base/util.h"
 #include "zest/net/base_addr.h"
+#include "zest/net/buffer_budget.h"
+#include "zest/net/connection_registry.h"
 #include "zest/net/eventloop.h"
 #include "zest/net/fd_event.h"
 #include "zest/net/io_thread.h"
 #include "zest/net/tcp_acceptor.h"
 #include "zest/net/thread_pool.h"
 #include "zest/net/timer_event.h"
+#include "zest/net/token_bucket.h"
 
 using namespace zest;
 using namespace zest::net;
 
 
-// 清除已断开的连接的间隔
-static const uint64_t CLEAR_CLOSED_CONNECTION_INTERVAL = 2000;
+// 空闲连接回收接收缓存的默认参数
+static const uint64_t DEFAULT_TRIM_QUIET_MS = 10000;
+static const std::size_t DEFAULT_TRIM_KEEP_BYTES = 4096;
+
+// 超出内存预算时，重新尝试接受连接的间隔
+static const uint64_t ACCEPT_RETRY_INTERVAL = 100;
 
 
 TcpServer::TcpServer(NetBaseAddress &local_addr, int thread_nums /*=4*/) :
   m_acceptor(new TcpAcceptor(local_addr.copy())),
   m_main_eventloop(EventLoop::CreateEventLoop()), 
-  m_thread_pool(new ThreadPool(thread_nums))
+  m_thread_pool(new ThreadPool(thread_nums)),
+  m_trim_quiet_ms(DEFAULT_TRIM_QUIET_MS), m_trim_keep_bytes(DEFAULT_TRIM_KEEP_BYTES)
 {
   /* do nothing */
 }
 
 TcpServer::~TcpServer()
 {
+  // 连接属于各个IO线程，先等IO线程退出，再析构 ConnectionRegistry
+  m_thread_pool->stop();
   ::close(sig_pipefd[0]);
   ::close(sig_pipefd[1]);
 }
@@ -55,20 +65,27 @@ void TcpServer::start()
   listenfd_event->listen(EPOLLIN | EPOLLET, std::bind(&TcpServer::handleAccept, this));
   m_main_eventloop->addEpollEvent(listenfd_event);
 
-  // 添加定时器定期清理断开的连接
-  TimerEvent::s_ptr clear_timer = std::make_shared<TimerEvent>(
-    CLEAR_CLOSED_CONNECTION_INTERVAL, 
-    std::bind(&TcpServer::clearClosedConnection, this),
-    true
-  );
-  m_main_eventloop->addTimerEvent(clear_timer);
-
   if (addSignalEvent() == false) {
     std::cerr << "addSignalEvent failed" << std::endl;
     LOG_FATAL << "addSignalEvent failed";
     exit(-1);
   }
 
+  // 每个IO线程一个连接表和连接对象池，预先分配的对象平均分给各个IO线程
+  const auto &io_threads = m_thread_pool->get_all_io_threads();
+  for (std::size_t i = 0; i < io_threads.size(); ++i) {
+    if (!io_threads[i] || !io_threads[i]->get_eventloop()) {
+      m_registries.emplace_back(nullptr);
+      continue;
+    }
+    m_registries.emplace_back(new ConnectionRegistry(io_threads[i]->get_eventloop(), m_max_idle_connections));
+    m_registries.back()->setNewConnectionCallback(std::bind(&TcpServer::onNewConnection, this, std::placeholders::_1));
+    std::size_t n = m_preallocate_connections / io_threads.size() +
+                    (i < m_preallocate_connections % io_threads.size() ? 1 : 0);
+    if (n > 0 && m_max_idle_connections > 0)
+      m_registries.back()->preallocate(std::min(n, m_max_idle_connections));
+  }
+
   m_thread_pool->start();
   m_acceptor->listen();
   m_main_eventloop->loop();
@@ -77,28 +94,221 @@ void TcpServer::start()
   std::cout << "TcpServer exit!" << std::endl;
 }
 
+uint64_t TcpServer::writeRequests() const
+{
+  uint64_t total = 0;
+  for (const auto &io_thread : m_thread_pool->get_all_io_threads()) {
+    if (io_thread && io_thread->get_eventloop())
+      total += io_thread->get_eventloop()->writeRequests();
+  }
+  return total;
+}
+
+uint64_t TcpServer::writeSyscalls() const
+{
+  uint64_t total = 0;
+  for (const auto &io_thread : m_thread_pool->get_all_io_threads()) {
+    if (io_thread && io_thread->get_eventloop())
+      total += io_thread->get_eventloop()->writeSyscalls();
+  }
+  return total;
+}
+
+uint64_t TcpServer::connectionsAllocated() const
+{
+  uint64_t total = 0;
+  for (const auto &registry : m_registries) {
+    if (registry)
+      total += registry->allocated();
+  }
+  return total;
+}
+
+uint64_t TcpServer::connectionsReused() const
+{
+  uint64_t total = 0;
+  for (const auto &registry : m_registries) {
+    if (registry)
+      total += registry->reused();
+  }
+  return total;
+}
+
+std::size_t TcpServer::connectionCount() const
+{
+  std::size_t total = 0;
+  for (std::size_t n : connectionsPerIOThread())
+    total += n;
+  return total;
+}
+
+std::vector<std::size_t> TcpServer::connectionsPerIOThread() const
+{
+  std::vector<std::size_t> result;
+  for (const auto &registry : m_registries)
+    result.push_back(registry ? registry->size() : 0);
+  return result;
+}
+
+void TcpServer::setAcceptRateLimit(double rate, std::size_t burst)
+{
+  if (rate <= 0) {
+    m_accept_bucket.reset();
+    return;
+  }
+  m_accept_bucket.reset(new TokenBucket());
+  m_accept_bucket->reset(rate, burst);
+}
+
+uint64_t TcpServer::connectionsRejected() const
+{
+  return m_connections_rejected.load(std::memory_order_relaxed) + m_acceptor->rejected();
+}
+
+std::vector<int64_t> TcpServer::loopLagPerIOThread() const
+{
+  std::vector<int64_t> result;
+  for (const auto &registry : m_registries)
+    result.push_back(registry ? registry->eventloop()->loopLagMs() : 0);
+  return result;
+}
+
+void TcpServer::setBufferMemoryBudget(std::size_t bytes)
+{
+  BufferBudget::setLimit(bytes);
+}
+
+std::size_t TcpServer::bufferBytes() const
+{
+  std::size_t total = 0;
+  for (std::size_t bytes : bufferBytesPerIOThread())
+    total += bytes;
+  return total;
+}
+
+std::vector<std::size_t> TcpServer::bufferBytesPerIOThread() const
+{
+  std::vector<std::size_t> result;
+  for (const auto &io_thread : m_thread_pool->get_all_io_threads()) {
+    if (io_thread && io_thread->get_eventloop())
+      result.push_back(io_thread->get_eventloop()->bufferBytes());
+    else
+      result.push_back(0);
+  }
+  return result;
+}
+
 void TcpServer::handleAccept()
 {
   assert(m_main_eventloop->isThisThread());
-  
-  auto new_clients = m_acceptor->accept();
-  for (const auto &client : new_clients) {
-    int sockfd = client.first;
-    NetBaseAddress::s_ptr peer_addr = client.second;
-    if (!peer_addr->check())
+  // 定时器还没到期时监听套接字又有了新连接，等定时器到期再一起处理
+  if (m_accept_retry_pending)
+    return;
+
+  /* 超出内存预算，暂不接受新连接，新连接留在 backlog 中
+   * ET模式下不会再有通知，所以用定时器稍后重试 */
+  if (BufferBudget::exceeded()) {
+    LOG_INFO << "buffer memory over budget (" << BufferBudget::used() << " > " << BufferBudget::limit()
+             << "), defer accepting new connections";
+    deferAccept(ACCEPT_RETRY_INTERVAL);
+    return;
+  }
+
+  // 每个IO线程是否过载，本次接受的连接只分配给没有过载的IO线程
+  m_io_thread_saturated.assign(m_registries.size(), 0);
+  if (m_max_loop_lag_ms > 0) {
+    bool all_saturated = true;
+    for (std::size_t i = 0; i < m_registries.size(); ++i) {
+      int64_t lag = m_registries[i] ? m_registries[i]->eventloop()->loopLagMs() : 0;
+      m_io_thread_saturated[i] = lag > static_cast<int64_t>(m_max_loop_lag_ms);
+      all_saturated = all_saturated && m_io_thread_saturated[i];
+    }
+    if (all_saturated) {
+      LOG_DEBUG << "all IO threads lag behind more than " << m_max_loop_lag_ms << " ms, defer accepting new connections";
+      deferAccept(m_max_loop_lag_ms);
+      return;
+    }
+  }
+
+  // 超出速率的连接留在 backlog 中，等下一个令牌
+  std::size_t max_accept = SIZE_MAX;
+  if (m_accept_bucket) {
+    max_accept = m_accept_bucket->available(get_now_ms());
+    if (max_accept == 0) {
+      deferAccept(m_accept_bucket->waitMs());
+      return;
+    }
+  }
+
+  m_accepted.clear();
+  bool drained = m_acceptor->accept(m_accepted, max_accept);
+  if (m_accept_bucket)
+    m_accept_bucket->consume(m_accepted.size());
+
+  std::size_t connections = m_max_connections > 0 ? connectionCount() : 0;
+  uint64_t rejected = 0;
+  for (const auto &client : m_accepted) {
+    int index = m_max_connections > 0 && connections >= m_max_connections ? -1 : selectIOThread();
+    if (index < 0) {
+      ::close(client.m_fd);
+      ++rejected;
       continue;
-    IOThread::s_ptr io_thread = m_thread_pool->get_io_thread();
-    auto connection = createConnection(sockfd, io_thread->get_eventloop(), peer_addr);
-    if (connection) {
-      m_connections[sockfd] = connection;
-      LOG_INFO << "Accept new connection, ptr = " << connection.get() << ", fd = " << sockfd << " address: " << peer_addr->to_string();
-      // 如果设置了连接回调函数，则执行回调函数；否则等待读取数据
-      if (m_on_connection_callback)
-        m_on_connection_callback(*connection);
-      else {
-        connection->waitForMessage();
-      }
     }
+    m_registries[index]->post(client);
+    ++connections;
+  }
+  if (rejected > 0) {
+    m_connections_rejected.fetch_add(rejected, std::memory_order_relaxed);
+    LOG_ERROR << "too many connections (max " << m_max_connections << "), reject " << rejected << " connections";
+  }
+
+  // 没有取空 backlog（达到速率上限或者 accept 出错），稍后继续
+  if (!drained)
+    deferAccept(m_accept_bucket ? m_accept_bucket->waitMs() : ACCEPT_RETRY_INTERVAL);
+}
+
+void TcpServer::deferAccept(uint64_t delay_ms)
+{
+  if (m_accept_retry_pending)
+    return;
+  m_accept_retry_pending = true;
+  m_accepts_deferred.fetch_add(1, std::memory_order_relaxed);
+  TimerEvent::s_ptr retry_timer = std::make_shared<TimerEvent>(
+    delay_ms,
+    [this](){
+      this->m_accept_retry_pending = false;
+      this->handleAccept();
+    },
+    false
+  );
+  m_main_eventloop->addTimerEvent(retry_timer);
+}
+
+int TcpServer::selectIOThread()
+{
+  for (std::size_t i = 0; i < m_registries.size(); ++i) {
+    int index = m_thread_pool->get_io_thread_index();
+    if (m_registries[index] && !m_io_thread_saturated[index])
+      return index;
+  }
+  return -1;
+}
+
+// 在IO线程中执行，连接已经加入所属IO线程的连接表
+void TcpServer::onNewConnection(TcpConnection &conn)
+{
+  conn.setMessageCallback(m_message_callback);
+  conn.setWriteCompleteCallback(m_write_complete_callback);
+  conn.setCloseCallback(m_close_callback);
+  if (m_trim_quiet_ms > 0)
+    conn.setIdleBufferTrim(m_trim_quiet_ms, m_trim_keep_bytes);
+
+  LOG_INFO << "Accept new connection, ptr = " << &conn << ", fd = " << conn.socketfd() << " address: " << conn.peerAddress().to_string();
+  // 如果设置了连接回调函数，则执行回调函数；否则等待读取数据
+  if (m_on_connection_callback)
+    m_on_connection_callback(conn);
+  else {
+    conn.waitForMessage();
   }
 }
 
@@ -125,49 +335,6 @@ void TcpServer::handleSignal()
   }
 }
 
-// 清理断开的连接
-void TcpServer::clearClosedConnection()
-{
-  assert(m_main_eventloop->isThisThread());
-
-  auto it = m_connections.begin();
-  while (it != m_connections.end()) {
-    if (it->second == nullptr || it->second->getState() == Closed) {
-      if (it->second) {
-        LOG_DEBUG << "remove closed connection: " << it->second->peerAddress().to_string();
-      }
-      it = m_connections.erase(it);
-    }
-    else
-      ++it;
-  }
-}
-
-// 一个异常安全的创建TcpConnection对象的函数
-std::shared_ptr<TcpConnection> TcpServer::createConnection(int sockfd, 
-                                    std::shared_ptr<EventLoop> eventloop, 
-                                    NetBaseAddress::s_ptr peer_addr) noexcept
-{
-  TcpConnection::s_ptr connection = nullptr;
-  try {
-    connection.reset(new TcpConnection(sockfd, eventloop, peer_addr));
-  }
-  catch(const std::bad_alloc &e) {
-    LOG_ERROR << "create new connection object failed, bad alloc";
-    return nullptr;
-  }
-  catch(const std::exception &e) {
-    LOG_ERROR << "create new connection object failed, unknow reason";
-    return nullptr;
-  }
-
-  connection->setMessageCallback(m_message_callback);
-  connection->setWriteCompleteCallback(m_write_complete_callback);
-  connection->setCloseCallback(m_close_callback);
-  
-  return connection;
-}
-
 // 向eventloop添加信号处理事件
 bool TcpServer::addSignalEvent()
 {
@@ -189,6 +356,9 @@ bool TcpServer::addSignalEvent()
     return false;
   }
 
+  // 对端已经关闭时写套接字会产生 SIGPIPE，默认行为是结束进程，写操作会返回 EPIPE，由连接自己处理
+  signal(SIGPIPE, SIG_IGN);
+
   FdEvent::s_ptr sig_pipefd_event = std::make_shared<FdEvent>(sig_pipefd[0]);
   sig_pipefd_event->listen(EPOLLIN | EPOLLET, std::bind(&TcpServer::handleSignal, this));
   m_main_eventloop->addEpollEvent(sig_pipefd_event);
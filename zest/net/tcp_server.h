@@ -9,9 +9,12 @@
 #ifndef ZEST_NET_TCP_SERVER_H
 #define ZEST_NET_TCP_SERVER_H
 
+#include <stdint.h>
+
+#include <atomic>
 #include <functional>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
 #include "zest/base/logging.h"
 #include "zest/base/noncopyable.h"
@@ -23,15 +26,17 @@ namespace zest
 namespace net
 {
 
+class ConnectionRegistry;
 class EventLoop;
 class TcpAcceptor;
 class ThreadPool;
+class TokenBucket;
+struct AcceptedSocket;
 
 
 class TcpServer: public noncopyable
 {
   using ConnectionCallbackFunc = std::function<void(TcpConnection&)>;
-  using ConnectionMap = std::unordered_map<int, TcpConnection::s_ptr>;
 
  public:
   using s_ptr = std::shared_ptr<TcpServer>;
@@ -40,6 +45,7 @@ class TcpServer: public noncopyable
 
   ~TcpServer();
 
+  // 所有回调函数都在连接所属的IO线程中执行
   void setOnConnectionCallback(const ConnectionCallbackFunc &cb)
   { m_on_connection_callback = cb; }
 
@@ -54,20 +60,72 @@ class TcpServer: public noncopyable
   
   void start();
 
+  // 写合并统计：所有IO线程中调用 send 的次数和实际执行写系统调用的次数
+  uint64_t writeRequests() const;
+  uint64_t writeSyscalls() const;
+
+  // 全部连接的缓冲区内存预算，单位字节，0 表示不限制（默认）
+  // 超出预算时连接减慢读取，主线程暂缓接受新连接，直到占用降回预算以内
+  void setBufferMemoryBudget(std::size_t bytes);
+
+  // 连接空闲 quiet_ms 毫秒后回收接收缓存，只保留 keep_bytes 的容量，quiet_ms 为 0 表示不回收
+  void setIdleBufferTrim(uint64_t quiet_ms, std::size_t keep_bytes)
+  { m_trim_quiet_ms = quiet_ms; m_trim_keep_bytes = keep_bytes; }
+
+  // 连接缓冲区占用的内存：全部IO线程之和，以及每个IO线程各自的占用
+  std::size_t bufferBytes() const;
+  std::vector<std::size_t> bufferBytesPerIOThread() const;
+
+  /* 每个IO线程缓存断开的连接对象，新连接直接复用，不再为连接对象和它的缓冲区等分配内存
+   * preallocate 个对象在启动时平均分配到各个IO线程，max_idle 是每个IO线程最多缓存的对象数，0 表示不复用
+   * 必须在 start() 之前调用 */
+  void setConnectionRecycling(std::size_t preallocate, std::size_t max_idle = DEFAULT_MAX_IDLE_CONNECTIONS)
+  { m_preallocate_connections = preallocate; m_max_idle_connections = max_idle; }
+
+  // 新分配的连接对象数（包括预先分配的），以及新连接复用缓存对象的次数
+  uint64_t connectionsAllocated() const;
+  uint64_t connectionsReused() const;
+
+  // 当前的连接数：全部IO线程之和，以及每个IO线程各自的连接数
+  std::size_t connectionCount() const;
+  std::vector<std::size_t> connectionsPerIOThread() const;
+
+  /* 接受连接的准入控制，都必须在 start() 之前调用
+   * 最大连接数，0 表示不限制（默认）；达到上限时新连接被接受后立即关闭，计入 connectionsRejected() */
+  void setMaxConnections(std::size_t n) { m_max_connections = n; }
+
+  // 接受连接的速率上限：每秒 rate 个，空闲之后最多一次接受 burst 个，rate 为 0 表示不限制（默认）
+  // 超出速率的连接留在 backlog 中，稍后再接受
+  void setAcceptRateLimit(double rate, std::size_t burst);
+
+  /* IO线程事件循环的延迟超过 lag_ms 毫秒时，不再给它分配新连接，全部IO线程都超过时暂停接受连接
+   * lag_ms 为 0 表示不检查（默认） */
+  void setMaxLoopLag(uint64_t lag_ms) { m_max_loop_lag_ms = lag_ms; }
+
+  // 被拒绝的连接数（达到最大连接数或者文件描述符耗尽），以及暂停接受连接的次数（超出速率、IO线程过载或者超出内存预算）
+  uint64_t connectionsRejected() const;
+  uint64_t acceptsDeferred() const { return m_accepts_deferred.load(std::memory_order_relaxed); }
+
+  // 每个IO线程事件循环当前的延迟，单位毫秒
+  std::vector<int64_t> loopLagPerIOThread() const;
+
+  static const std::size_t DEFAULT_MAX_IDLE_CONNECTIONS = 1024;
+
  private:
 
   void handleAccept();
 
+  // 暂停接受连接，delay_ms 毫秒后重试，ET模式下 backlog 中剩下的连接不会再有通知
+  void deferAccept(uint64_t delay_ms);
+
+  // 按轮转调度选择一个没有过载的IO线程，全部过载时返回 -1
+  int selectIOThread();
+
   // 信号产生时的回调函数
   void handleSignal();
 
-  // 清理断开的连接
-  void clearClosedConnection();
-
-  // 一个异常安全的创建TcpConnection对象的函数
-  TcpConnection::s_ptr createConnection(int sockfd, 
-                                    std::shared_ptr<EventLoop> eventloop, 
-                                    NetBaseAddress::s_ptr peer_addr) noexcept;
+  // 新连接加入IO线程之后，在IO线程中设置回调函数
+  void onNewConnection(TcpConnection &conn);
 
   // 向eventloop添加信号处理事件
   bool addSignalEvent();
@@ -80,8 +138,13 @@ class TcpServer: public noncopyable
   std::shared_ptr<EventLoop> m_main_eventloop;    // 主线程eventloop，负责监听本地地址的套接字
   std::unique_ptr<ThreadPool> m_thread_pool;      // 线程池
 
-  // 所有的TCP连接
-  ConnectionMap m_connections;
+  // 每个IO线程持有自己的连接和连接对象池，下标和 ThreadPool 中的IO线程一致，主线程只读取统计数据
+  std::vector<std::unique_ptr<ConnectionRegistry>> m_registries;
+  std::size_t m_preallocate_connections {0};
+  std::size_t m_max_idle_connections {DEFAULT_MAX_IDLE_CONNECTIONS};
+
+  // 一次 handleAccept 接受的连接，复用内存
+  std::vector<AcceptedSocket> m_accepted;
 
   // 各种事件的回调函数
   ConnectionCallbackFunc m_on_connection_callback {nullptr};
@@ -89,6 +152,20 @@ class TcpServer: public noncopyable
   ConnectionCallbackFunc m_write_complete_callback {nullptr};
   ConnectionCallbackFunc m_close_callback {nullptr};
 
+  // 空闲连接回收接收缓存的参数
+  uint64_t m_trim_quiet_ms;
+  std::size_t m_trim_keep_bytes;
+
+  bool m_accept_retry_pending {false};   // 已经登记了稍后重新接受连接的定时器
+
+  // 准入控制
+  std::size_t m_max_connections {0};
+  std::unique_ptr<TokenBucket> m_accept_bucket;   // 为空表示不限制速率
+  uint64_t m_max_loop_lag_ms {0};
+  std::vector<char> m_io_thread_saturated;   // 本次 handleAccept 中每个IO线程是否过载，复用内存
+  std::atomic<uint64_t> m_connections_rejected {0};
+  std::atomic<uint64_t> m_accepts_deferred {0};
+
   // 用于传递信号的管道
   int m_pipefd[2];
 };
@@ -52,10 +52,15 @@ void ThreadPool::stop()
 
 // 按照轮转调度法获取io线程
 IOThread::s_ptr ThreadPool::get_io_thread()
+{
+  return m_thread_pool[get_io_thread_index()];
+}
+
+int ThreadPool::get_io_thread_index()
 {
   // 考虑到IO线程中 EventLoop::CreateEventLoop() 可能失败，所以要判断eventloop是否在运行
   if (m_thread_pool[m_index] && m_thread_pool[m_index]->is_valid()) {
-    auto rt = m_thread_pool[m_index];
+    int rt = m_index;
     m_index = (m_index + 1) % m_thread_num;
     return rt;
   }
@@ -63,7 +68,7 @@ IOThread::s_ptr ThreadPool::get_io_thread()
   for (int i = (m_index+1) % m_thread_num; i != m_index; i = (i+1) % m_thread_num) {
     if (m_thread_pool[i] && m_thread_pool[i]->is_valid()) {
       m_index = (i + 1) % m_thread_num;
-      return m_thread_pool[i];
+      return i;
     }
   }
 
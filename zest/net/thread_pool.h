@@ -32,6 +32,12 @@ class ThreadPool: public noncopyable
 
   // 按照轮转调度法获取io线程
   IOThread::s_ptr get_io_thread();
+
+  // 同上，返回的是io线程在 get_all_io_threads() 中的下标
+  int get_io_thread_index();
+
+  // 获取所有io线程，用于汇总统计数据
+  const std::vector<IOThread::s_ptr> &get_all_io_threads() const {return m_thread_pool;}
   
  private:
   int m_thread_num;   // 线程数
@@ -0,0 +1,44 @@
+/* 令牌桶，限制接受新连接的速率 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/token_bucket.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "zest/base/util.h"
+
+using namespace zest;
+using namespace zest::net;
+
+
+void TokenBucket::reset(double rate, std::size_t burst)
+{
+  m_rate = rate > 0 ? rate : 0;
+  m_burst = static_cast<double>(std::max<std::size_t>(burst, 1));
+  m_tokens = m_burst;
+  m_last_ms = get_now_ms();
+}
+
+std::size_t TokenBucket::available(int64_t now_ms)
+{
+  if (now_ms > m_last_ms) {
+    m_tokens = std::min(m_burst, m_tokens + m_rate * (now_ms - m_last_ms) / 1000);
+    m_last_ms = now_ms;
+  }
+  return static_cast<std::size_t>(m_tokens);
+}
+
+void TokenBucket::consume(std::size_t n)
+{
+  m_tokens = std::max(0.0, m_tokens - n);
+}
+
+uint64_t TokenBucket::waitMs() const
+{
+  if (m_rate <= 0 || m_tokens >= 1)
+    return 1;
+  return std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil((1 - m_tokens) * 1000 / m_rate)));
+}
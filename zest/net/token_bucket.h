@@ -0,0 +1,50 @@
+/* 令牌桶，限制接受新连接的速率 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is an internal header file, you should not include this.
+
+#ifndef ZEST_NET_TOKEN_BUCKET_H
+#define ZEST_NET_TOKEN_BUCKET_H
+
+#include <stdint.h>
+
+#include <cstddef>
+
+namespace zest
+{
+namespace net
+{
+
+/* 每秒补充 rate 个令牌，最多积累 burst 个，空闲之后可以一次接受 burst 个连接
+ * 不加锁，只能在一个线程中使用 */
+class TokenBucket
+{
+ public:
+  TokenBucket() = default;
+
+  // rate 为 0 表示不限制，burst 至少为 1
+  void reset(double rate, std::size_t burst);
+  bool enabled() const {return m_rate > 0;}
+
+  // 按经过的时间补充令牌，返回可以取用的整数个令牌
+  std::size_t available(int64_t now_ms);
+
+  // 取走 n 个令牌，n 不能超过 available() 的返回值
+  void consume(std::size_t n);
+
+  // 距离下一个令牌补充完成的毫秒数，至少为 1
+  uint64_t waitMs() const;
+
+ private:
+  double m_rate {0};         // 每秒补充的令牌数
+  double m_burst {0};        // 令牌数的上限
+  double m_tokens {0};       // 当前的令牌数
+  int64_t m_last_ms {0};     // 上次补充令牌的时间
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_TOKEN_BUCKET_H
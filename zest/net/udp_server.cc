@@ -0,0 +1,137 @@
+/* 封装 UdpServer：每个IO线程一个绑定同一地址的 UdpSocket（SO_REUSEPORT），由内核把数据报分发到各个线程 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/udp_server.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "zest/base/logging.h"
+#include "zest/base/util.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/fd_event.h"
+#include "zest/net/io_thread.h"
+#include "zest/net/thread_pool.h"
+
+using namespace zest;
+using namespace zest::net;
+
+
+UdpServer::UdpServer(NetBaseAddress &local_addr, int thread_nums /*=4*/) :
+  m_local_addr(local_addr.copy()),
+  m_main_eventloop(EventLoop::CreateEventLoop()),
+  m_thread_pool(new ThreadPool(thread_nums))
+{
+  /* do nothing */
+}
+
+UdpServer::~UdpServer()
+{
+  ::close(sig_pipefd[0]);
+  ::close(sig_pipefd[1]);
+}
+
+void UdpServer::start()
+{
+  // 每个IO线程一个套接字，套接字的设置和注册都在所属的IO线程中完成
+  for (const auto &io_thread : m_thread_pool->get_all_io_threads()) {
+    std::unique_ptr<UdpSocket> sock(new UdpSocket(io_thread->get_eventloop(), *m_local_addr, true));
+    if (!sock->valid()) {
+      std::cerr << "create UDP socket failed" << std::endl;
+      LOG_FATAL << "create UDP socket on " << m_local_addr->to_string() << " failed";
+      exit(-1);
+    }
+    sock->setMessageCallback(m_message_callback);
+    sock->setBatchSize(m_batch_size);
+    sock->setMaxDatagramSize(m_max_datagram);
+    if (m_gro && !sock->enableGro(true))
+      LOG_INFO << "UDP_GRO is not supported, receive datagrams one by one";
+    if (m_gso_size > 0 && !sock->enableGso(m_gso_size))
+      LOG_INFO << "UDP_SEGMENT is not supported, send datagrams one by one";
+    sock->start();
+    m_sockets.push_back(std::move(sock));
+  }
+
+  if (addSignalEvent() == false) {
+    std::cerr << "addSignalEvent failed" << std::endl;
+    LOG_FATAL << "addSignalEvent failed";
+    exit(-1);
+  }
+
+  m_thread_pool->start();
+  m_main_eventloop->loop();
+
+  LOG_INFO << "UdpServer exit!";
+  std::cout << "UdpServer exit!" << std::endl;
+}
+
+UdpStats UdpServer::stats() const
+{
+  UdpStats total;
+  for (const auto &sock : m_sockets) {
+    UdpStats s = sock->stats();
+    total.m_packets_received += s.m_packets_received;
+    total.m_bytes_received += s.m_bytes_received;
+    total.m_recv_syscalls += s.m_recv_syscalls;
+    total.m_packets_sent += s.m_packets_sent;
+    total.m_send_syscalls += s.m_send_syscalls;
+    total.m_send_dropped += s.m_send_dropped;
+    total.m_truncated += s.m_truncated;
+  }
+  return total;
+}
+
+void UdpServer::handleSignal()
+{
+  char signals[1024];
+  int ret = recv(sig_pipefd[0], signals, 1024, 0);
+  if (ret <= 0)
+    return;
+  for (int i = 0; i < ret; ++i) {
+    if (signals[i] == SIGINT || signals[i] == SIGTERM) {
+      LOG_INFO << "receive signal " << static_cast<int>(signals[i]);
+      this->shutdown();
+    }
+    else {
+      LOG_ERROR << "get some signals, and don't know how to handle";
+    }
+  }
+}
+
+// 向eventloop添加信号处理事件
+bool UdpServer::addSignalEvent()
+{
+  if (socketpair(PF_UNIX, SOCK_STREAM, 0, sig_pipefd) == -1) {
+    LOG_ERROR << "socketpair failed, errno = " << errno;
+    return false;
+  }
+
+  if (!set_non_blocking(sig_pipefd[0]) || !set_non_blocking(sig_pipefd[1])) {
+    LOG_ERROR << "set sig_pipefd nonblocking failed, errno" << errno;
+    return false;
+  }
+
+  if (!add_signal(SIGINT) || !add_signal(SIGTERM)) {
+    LOG_ERROR << "add_signal failed";
+    return false;
+  }
+
+  FdEvent::s_ptr sig_pipefd_event = std::make_shared<FdEvent>(sig_pipefd[0]);
+  sig_pipefd_event->listen(EPOLLIN | EPOLLET, std::bind(&UdpServer::handleSignal, this));
+  m_main_eventloop->addEpollEvent(sig_pipefd_event);
+
+  return true;
+}
+
+// 先停止IO线程，之后才能在主线程中销毁套接字
+void UdpServer::shutdown()
+{
+  m_main_eventloop->stop();
+  m_thread_pool->stop();
+}
@@ -0,0 +1,70 @@
+/* 封装 UdpServer：每个IO线程一个绑定同一地址的 UdpSocket（SO_REUSEPORT），由内核把数据报分发到各个线程 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_UDP_SERVER_H
+#define ZEST_NET_UDP_SERVER_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/base_addr.h"
+#include "zest/net/udp_socket.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+class ThreadPool;
+
+/* 回调函数在收到数据报的IO线程中执行，回复时调用参数中的 UdpSocket::sendTo()
+ * 同一个对端的数据报由内核按四元组哈希，总是交给同一个线程 */
+class UdpServer : public noncopyable
+{
+ public:
+  explicit UdpServer(NetBaseAddress &local_addr, int thread_nums = 4);
+  ~UdpServer();
+
+  // 以下设置必须在 start() 之前调用，含义见 UdpSocket
+  void setMessageCallback(const UdpSocket::MessageCallback &cb) {m_message_callback = cb;}
+  void setBatchSize(int n) {m_batch_size = n;}
+  void setMaxDatagramSize(std::size_t bytes) {m_max_datagram = bytes;}
+  void enableGro(bool on) {m_gro = on;}
+  void enableGso(uint16_t segment_size) {m_gso_size = segment_size;}
+
+  // 开始接收数据报，收到 SIGINT 或 SIGTERM 后返回
+  void start();
+
+  // 所有套接字的统计数据之和
+  UdpStats stats() const;
+
+ private:
+  void handleSignal();
+  bool addSignalEvent();
+  void shutdown();
+
+ private:
+  NetBaseAddress::s_ptr m_local_addr;
+  std::shared_ptr<EventLoop> m_main_eventloop;   // 主线程只处理信号
+  std::unique_ptr<ThreadPool> m_thread_pool;
+  std::vector<std::unique_ptr<UdpSocket>> m_sockets;
+
+  UdpSocket::MessageCallback m_message_callback {nullptr};
+  int m_batch_size {UdpSocket::DEFAULT_BATCH_SIZE};
+  std::size_t m_max_datagram {UdpSocket::DEFAULT_MAX_DATAGRAM};
+  bool m_gro {false};
+  uint16_t m_gso_size {0};
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_UDP_SERVER_H
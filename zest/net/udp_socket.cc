@@ -0,0 +1,439 @@
+/* 封装 UDP 套接字：用 recvmmsg / sendmmsg 批量收发，可选 UDP_GRO 接收合并和 UDP_SEGMENT 发送分段 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/udp_socket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "zest/base/logging.h"
+#include "zest/base/util.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/fd_event.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+using namespace zest;
+using namespace zest::net;
+
+
+// 开启 GRO 后每个接收缓存的大小，能放下内核合并的最大数据报
+static const std::size_t GRO_BUFFER_SIZE = 65536;
+
+// 开启 GRO 后一次 recvmmsg 最多接收的数据报数，限制接收缓存的总大小
+static const int GRO_MAX_BATCH = 16;
+
+// 一次 sendmmsg 最多发送的消息数
+static const int MAX_SEND_BATCH = 64;
+
+// 一个 GSO 消息最多包含的分段数和字节数（内核限制为 64 段，UDP 数据报不超过 65507 字节）
+static const int MAX_GSO_SEGMENTS = 64;
+static const std::size_t MAX_GSO_BYTES = 65000;
+
+
+struct UdpSocket::IoBatch
+{
+  // 接收：batch 个接收缓存连在一起
+  std::vector<char> m_buffer;
+  std::vector<mmsghdr> m_msgs;
+  std::vector<iovec> m_iovs;
+  std::vector<sockaddr_storage> m_addrs;
+  std::vector<char> m_control;
+
+  // 发送
+  std::vector<iovec> m_send_iovs;
+};
+
+
+UdpPeer::UdpPeer()
+{
+  memset(&m_addr, 0, sizeof(m_addr));
+}
+
+UdpPeer::UdpPeer(NetBaseAddress &addr)
+{
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_len = std::min<socklen_t>(addr.socklen(), sizeof(m_addr));
+  memcpy(&m_addr, addr.sockaddr(), m_len);
+}
+
+bool UdpPeer::operator==(const UdpPeer &rhs) const
+{
+  return m_len == rhs.m_len && memcmp(&m_addr, &rhs.m_addr, m_len) == 0;
+}
+
+std::string UdpPeer::to_string() const
+{
+  char ip[INET6_ADDRSTRLEN] = {0};
+  if (m_addr.ss_family == AF_INET) {
+    const sockaddr_in *addr = reinterpret_cast<const sockaddr_in*>(&m_addr);
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr->sin_port));
+  }
+  if (m_addr.ss_family == AF_INET6) {
+    const sockaddr_in6 *addr = reinterpret_cast<const sockaddr_in6*>(&m_addr);
+    inet_ntop(AF_INET6, &addr->sin6_addr, ip, sizeof(ip));
+    return "[" + std::string(ip) + "]:" + std::to_string(ntohs(addr->sin6_port));
+  }
+  return "unknown";
+}
+
+
+UdpSocket::UdpSocket(std::shared_ptr<EventLoop> eventloop, NetBaseAddress &local_addr,
+                     bool reuse_port /*=false*/) :
+  m_eventloop(eventloop), m_batch(new IoBatch())
+{
+  if (!local_addr.check()) {
+    LOG_ERROR << "invalid address: " << local_addr.to_string();
+    return;
+  }
+  int fd = socket(local_addr.family(), SOCK_DGRAM, 0);
+  if (fd == -1) {
+    LOG_ERROR << "UDP socket failed, errno = " << errno;
+    return;
+  }
+  if (!set_non_blocking(fd)) {
+    LOG_ERROR << "set UDP socket nonblocking failed";
+    ::close(fd);
+    return;
+  }
+  int on = 1;
+  if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1)
+    LOG_ERROR << "setsockopt REUSEPORT failed, errno = " << errno;
+  if (bind(fd, local_addr.sockaddr(), local_addr.socklen()) == -1) {
+    LOG_ERROR << "UDP bind " << local_addr.to_string() << " failed, errno = " << errno;
+    ::close(fd);
+    return;
+  }
+  m_sockfd = fd;
+  m_fd_event = std::make_shared<FdEvent>(m_sockfd);
+}
+
+UdpSocket::~UdpSocket()
+{
+  if (m_sockfd >= 0)
+    ::close(m_sockfd);
+}
+
+bool UdpSocket::enableGro(bool on)
+{
+  int val = on ? 1 : 0;
+  if (m_sockfd < 0 || setsockopt(m_sockfd, SOL_UDP, UDP_GRO, &val, sizeof(val)) == -1) {
+    LOG_DEBUG << "UDP_GRO is not supported, errno = " << errno;
+    m_gro = false;
+    return false;
+  }
+  m_gro = on;
+  return true;
+}
+
+// 分段大小在每个消息的控制信息中指定，这里只检查内核是否支持
+bool UdpSocket::enableGso(uint16_t segment_size)
+{
+  if (segment_size == 0) {
+    m_gso_size = 0;
+    return true;
+  }
+  int val = segment_size;
+  if (m_sockfd < 0 || setsockopt(m_sockfd, SOL_UDP, UDP_SEGMENT, &val, sizeof(val)) == -1) {
+    LOG_DEBUG << "UDP_SEGMENT is not supported, errno = " << errno;
+    m_gso_size = 0;
+    return false;
+  }
+  val = 0;
+  setsockopt(m_sockfd, SOL_UDP, UDP_SEGMENT, &val, sizeof(val));
+  m_gso_size = segment_size;
+  return true;
+}
+
+void UdpSocket::start()
+{
+  if (m_eventloop->isThisThread())
+    startInLoop();
+  else
+    m_eventloop->runInLoop(std::bind(&UdpSocket::startInLoop, this));
+}
+
+void UdpSocket::stop()
+{
+  if (m_eventloop->isThisThread())
+    stopInLoop();
+  else
+    m_eventloop->runInLoop(std::bind(&UdpSocket::stopInLoop, this));
+}
+
+void UdpSocket::startInLoop()
+{
+  if (m_started || m_sockfd < 0)
+    return;
+  m_started = true;
+  if (m_gro)
+    m_batch_size = std::min(m_batch_size, GRO_MAX_BATCH);
+  std::size_t slot = m_gro ? GRO_BUFFER_SIZE : m_max_datagram;
+  m_batch->m_buffer.resize(slot * m_batch_size);
+  m_batch->m_msgs.resize(m_batch_size);
+  m_batch->m_iovs.resize(m_batch_size);
+  m_batch->m_addrs.resize(m_batch_size);
+  m_batch->m_control.resize(m_batch_size * CMSG_SPACE(sizeof(int)));
+  m_batch->m_send_iovs.reserve(m_gso_size > 0 ? MAX_SEND_BATCH * MAX_GSO_SEGMENTS : MAX_SEND_BATCH);
+  updateEvent(false);
+}
+
+void UdpSocket::stopInLoop()
+{
+  if (!m_started)
+    return;
+  m_started = false;
+  m_eventloop->deleteEpollEvent(m_sockfd);
+  m_write_armed = false;
+  m_send_dropped.fetch_add(m_pending.size(), std::memory_order_relaxed);
+  m_pending.clear();
+}
+
+void UdpSocket::updateEvent(bool want_write)
+{
+  if (want_write) {
+    // listen() 按事件类型保存回调函数，先登记可写回调，再把可读和可写一起注册
+    m_fd_event->listen(EPOLLOUT | EPOLLET, std::bind(&UdpSocket::handleWrite, this));
+    m_fd_event->listen(EPOLLIN | EPOLLOUT | EPOLLET, std::bind(&UdpSocket::handleRead, this));
+  }
+  else {
+    m_fd_event->listen(EPOLLIN | EPOLLET, std::bind(&UdpSocket::handleRead, this));
+  }
+  m_eventloop->addEpollEvent(m_fd_event);
+  m_write_armed = want_write;
+}
+
+/* ET 模式，每次最多收 batch 个数据报，收到的数量不足 batch 说明接收队列已经空了
+ * 之后有新的数据报到达时 epoll 会再次通知 */
+void UdpSocket::handleRead()
+{
+  if (!m_started)
+    return;
+  std::size_t slot = m_gro ? GRO_BUFFER_SIZE : m_max_datagram;
+  int batch = m_batch_size;
+  std::vector<mmsghdr> &msgs = m_batch->m_msgs;
+  std::vector<iovec> &iovs = m_batch->m_iovs;
+  std::vector<sockaddr_storage> &addrs = m_batch->m_addrs;
+  std::vector<char> &control = m_batch->m_control;
+  UdpPeer peer;
+
+  while (m_started) {
+    for (int i = 0; i < batch; ++i) {
+      iovs[i].iov_base = &m_batch->m_buffer[i * slot];
+      iovs[i].iov_len = slot;
+      msghdr &hdr = msgs[i].msg_hdr;
+      hdr.msg_name = &addrs[i];
+      hdr.msg_namelen = sizeof(sockaddr_storage);
+      hdr.msg_iov = &iovs[i];
+      hdr.msg_iovlen = 1;
+      hdr.msg_control = m_gro ? &control[i * CMSG_SPACE(sizeof(int))] : NULL;
+      hdr.msg_controllen = m_gro ? CMSG_SPACE(sizeof(int)) : 0;
+      hdr.msg_flags = 0;
+    }
+    int n = recvmmsg(m_sockfd, msgs.data(), batch, MSG_DONTWAIT, NULL);
+    m_recv_syscalls.fetch_add(1, std::memory_order_relaxed);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        LOG_ERROR << "recvmmsg failed, errno = " << errno;
+      break;
+    }
+
+    uint64_t packets = 0, bytes = 0;
+    for (int i = 0; i < n && m_started; ++i) {
+      msghdr &hdr = msgs[i].msg_hdr;
+      if (hdr.msg_flags & MSG_TRUNC) {
+        m_truncated.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      std::size_t len = msgs[i].msg_len;
+      std::size_t segment = len;
+      if (m_gro) {
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+          if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gso_size;
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            if (gso_size > 0)
+              segment = static_cast<std::size_t>(gso_size);
+          }
+        }
+      }
+      memcpy(&peer.m_addr, &addrs[i], hdr.msg_namelen);
+      peer.m_len = hdr.msg_namelen;
+
+      // GRO 合并的数据报按分段大小拆开，最后一段可能比较短；空数据报也要交给回调函数
+      const char *data = &m_batch->m_buffer[i * slot];
+      std::size_t off = 0;
+      do {
+        std::size_t part = std::min(segment, len - off);
+        ++packets;
+        bytes += part;
+        if (m_message_callback)
+          m_message_callback(*this, data + off, part, peer);
+        off += part;
+      } while (off < len && m_started);
+    }
+    m_packets_received.fetch_add(packets, std::memory_order_relaxed);
+    m_bytes_received.fetch_add(bytes, std::memory_order_relaxed);
+    if (n < batch)
+      break;
+  }
+}
+
+void UdpSocket::handleWrite()
+{
+  if (m_started)
+    flush();
+}
+
+void UdpSocket::sendTo(const char *data, std::size_t len, const UdpPeer &peer)
+{
+  sendTo(Slice(data, len), peer);
+}
+
+void UdpSocket::sendTo(const Slice &data, const UdpPeer &peer)
+{
+  if (m_eventloop->isThisThread())
+    sendInLoop(data, peer);
+  else
+    m_eventloop->runInLoop(std::bind(&UdpSocket::sendInLoop, this, data, peer));
+}
+
+void UdpSocket::sendInLoop(const Slice &data, const UdpPeer &peer)
+{
+  if (!m_started || m_pending.size() >= m_max_pending) {
+    m_send_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  m_pending.push_back({data, peer});
+  if (!m_flush_pending && !m_write_armed) {
+    m_flush_pending = true;
+    m_eventloop->runAtIterationEnd([this](){
+      m_flush_pending = false;
+      if (m_started)
+        flush();
+    });
+  }
+}
+
+/* 把发送队列中的数据报用 sendmmsg 发出
+ * 开启 GSO 时，发往同一地址的连续数据报，除最后一个外大小都等于分段大小，就合并成一个消息 */
+void UdpSocket::flush()
+{
+  mmsghdr msgs[MAX_SEND_BATCH];
+  int counts[MAX_SEND_BATCH];   // 每个消息包含的数据报数
+  char control[MAX_SEND_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+  std::vector<iovec> &iovs = m_batch->m_send_iovs;
+
+  while (!m_pending.empty()) {
+    iovs.clear();
+    int nmsg = 0;
+    std::size_t idx = 0;
+    while (nmsg < MAX_SEND_BATCH && idx < m_pending.size()) {
+      PendingDatagram &first = m_pending[idx];
+      std::size_t iov_begin = iovs.size();
+      iovs.push_back({const_cast<char*>(first.m_data.data()), first.m_data.size()});
+      std::size_t bytes = first.m_data.size();
+      int segments = 1;
+      ++idx;
+      if (m_gso_size > 0) {
+        while (idx < m_pending.size() && segments < MAX_GSO_SEGMENTS &&
+               iovs.back().iov_len == m_gso_size &&
+               m_pending[idx].m_data.size() <= m_gso_size &&
+               m_pending[idx].m_data.size() > 0 &&
+               bytes + m_pending[idx].m_data.size() <= MAX_GSO_BYTES &&
+               m_pending[idx].m_peer == first.m_peer) {
+          const Slice &next = m_pending[idx].m_data;
+          iovs.push_back({const_cast<char*>(next.data()), next.size()});
+          bytes += next.size();
+          ++segments;
+          ++idx;
+        }
+      }
+
+      msghdr &hdr = msgs[nmsg].msg_hdr;
+      memset(&hdr, 0, sizeof(hdr));
+      hdr.msg_name = const_cast<sockaddr_storage*>(&first.m_peer.m_addr);
+      hdr.msg_namelen = first.m_peer.m_len;
+      hdr.msg_iov = NULL;   // iovs 可能还会扩容，最后统一设置
+      hdr.msg_iovlen = iovs.size() - iov_begin;
+      if (segments > 1) {
+        hdr.msg_control = control[nmsg];
+        hdr.msg_controllen = sizeof(control[nmsg]);
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t gso_size = m_gso_size;
+        memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+      }
+      counts[nmsg] = segments;
+      ++nmsg;
+    }
+    std::size_t iov_index = 0;
+    for (int i = 0; i < nmsg; ++i) {
+      msgs[i].msg_hdr.msg_iov = &iovs[iov_index];
+      iov_index += msgs[i].msg_hdr.msg_iovlen;
+    }
+
+    int sent = sendmmsg(m_sockfd, msgs, nmsg, 0);
+    m_send_syscalls.fetch_add(1, std::memory_order_relaxed);
+    if (sent == -1) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // 发送缓冲区满了，等待可写事件
+        if (!m_write_armed)
+          updateEvent(true);
+        return;
+      }
+      // 第一个消息发送失败（例如对端端口不可达、数据报过大），丢弃它，继续发送后面的
+      LOG_DEBUG << "sendmmsg to " << m_pending.front().m_peer.to_string() << " failed, errno = " << errno;
+      m_send_dropped.fetch_add(counts[0], std::memory_order_relaxed);
+      for (int i = 0; i < counts[0]; ++i)
+        m_pending.pop_front();
+      continue;
+    }
+
+    uint64_t packets = 0;
+    for (int i = 0; i < sent; ++i)
+      packets += counts[i];
+    m_packets_sent.fetch_add(packets, std::memory_order_relaxed);
+    m_pending.erase(m_pending.begin(), m_pending.begin() + packets);
+  }
+
+  if (m_write_armed)
+    updateEvent(false);
+}
+
+UdpStats UdpSocket::stats() const
+{
+  UdpStats stats;
+  stats.m_packets_received = m_packets_received.load(std::memory_order_relaxed);
+  stats.m_bytes_received = m_bytes_received.load(std::memory_order_relaxed);
+  stats.m_recv_syscalls = m_recv_syscalls.load(std::memory_order_relaxed);
+  stats.m_packets_sent = m_packets_sent.load(std::memory_order_relaxed);
+  stats.m_send_syscalls = m_send_syscalls.load(std::memory_order_relaxed);
+  stats.m_send_dropped = m_send_dropped.load(std::memory_order_relaxed);
+  stats.m_truncated = m_truncated.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,157 @@
+/* 封装 UDP 套接字：用 recvmmsg / sendmmsg 批量收发，可选 UDP_GRO 接收合并和 UDP_SEGMENT 发送分段 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_UDP_SOCKET_H
+#define ZEST_NET_UDP_SOCKET_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/base_addr.h"
+#include "zest/net/slice.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+class FdEvent;
+
+// 数据报的对端地址，直接保存 sockaddr，收发时不做字符串转换
+struct UdpPeer
+{
+  sockaddr_storage m_addr;
+  socklen_t m_len {0};
+
+  UdpPeer();
+  explicit UdpPeer(NetBaseAddress &addr);
+
+  const ::sockaddr *sockaddr() const {return reinterpret_cast<const ::sockaddr*>(&m_addr);}
+  bool operator==(const UdpPeer &rhs) const;
+  std::string to_string() const;
+};
+
+// 收发统计，可以在任意线程读取
+struct UdpStats
+{
+  uint64_t m_packets_received {0};
+  uint64_t m_bytes_received {0};
+  uint64_t m_recv_syscalls {0};
+  uint64_t m_packets_sent {0};
+  uint64_t m_send_syscalls {0};
+  uint64_t m_send_dropped {0};     // 发送队列满或者发送出错而丢弃的数据报
+  uint64_t m_truncated {0};        // 超过 setMaxDatagramSize() 被截断而丢弃的数据报
+};
+
+/* UdpSocket 属于一个 EventLoop，收发都在这个IO线程中进行
+ * 接收：一次 recvmmsg 最多收 batch 个数据报，开启 GRO 后内核合并的数据报在这里拆回原来的大小，再逐个调用回调函数
+ * 发送：sendTo 只是放入发送队列，本轮循环结束时用 sendmmsg 一次发出；开启 GSO 后，
+ *       发往同一地址、大小等于分段大小的连续数据报合并成一个消息交给内核分段 */
+class UdpSocket : public noncopyable
+{
+ public:
+  using s_ptr = std::shared_ptr<UdpSocket>;
+  using MessageCallback = std::function<void(UdpSocket&, const char *data, std::size_t len, const UdpPeer &peer)>;
+
+  static const int DEFAULT_BATCH_SIZE = 64;
+  static const std::size_t DEFAULT_MAX_DATAGRAM = 2048;
+  static const std::size_t DEFAULT_MAX_PENDING = 4096;
+
+  /* 创建套接字并绑定到 local_addr，失败时 valid() 返回 false
+   * reuse_port 为 true 时设置 SO_REUSEPORT，多个套接字可以绑定同一个地址，由内核分发数据报 */
+  UdpSocket(std::shared_ptr<EventLoop> eventloop, NetBaseAddress &local_addr, bool reuse_port = false);
+  ~UdpSocket();
+
+  bool valid() const {return m_sockfd >= 0;}
+  int socketfd() const {return m_sockfd;}
+  std::shared_ptr<EventLoop> getEventLoop() const {return m_eventloop;}
+
+  // 以下设置必须在 start() 之前调用
+  void setMessageCallback(const MessageCallback &cb) {m_message_callback = cb;}
+  void setBatchSize(int n) {m_batch_size = n > 0 ? n : 1;}             // 一次 recvmmsg 最多接收的数据报数
+  void setMaxDatagramSize(std::size_t bytes) {m_max_datagram = bytes;} // 不开启 GRO 时每个接收缓存的大小
+  void setMaxPending(std::size_t n) {m_max_pending = n;}               // 发送队列的上限，超出时丢弃
+
+  /* 开启 UDP_GRO，内核把同一个流的多个数据报合并后一次交给用户态，返回内核是否支持
+   * 开启后每个接收缓存为 64KB，batch 最多为 16 */
+  bool enableGro(bool on);
+
+  // 发送时使用 UDP_SEGMENT 分段，segment_size 为 0 表示关闭，返回内核是否支持
+  bool enableGso(uint16_t segment_size);
+
+  // 开始接收，可以在任意线程调用
+  void start();
+
+  // 停止接收，丢弃发送队列，可以在任意线程调用
+  void stop();
+
+  /* 发送一个数据报，可以在任意线程调用，const char* 版本会把数据拷贝到一个数据片中
+   * 数据报放入发送队列，本轮循环结束时和其它数据报一起发出 */
+  void sendTo(const char *data, std::size_t len, const UdpPeer &peer);
+  void sendTo(const Slice &data, const UdpPeer &peer);
+  void sendTo(const Slice &data, NetBaseAddress &peer) {sendTo(data, UdpPeer(peer));}
+
+  UdpStats stats() const;
+
+ private:
+  struct PendingDatagram
+  {
+    Slice m_data;
+    UdpPeer m_peer;
+  };
+
+  struct IoBatch;   // recvmmsg / sendmmsg 使用的数组，避免每次收发重新分配
+
+  void startInLoop();
+  void stopInLoop();
+  void sendInLoop(const Slice &data, const UdpPeer &peer);
+  void handleRead();
+  void handleWrite();
+  void flush();
+  void updateEvent(bool want_write);
+
+ private:
+  std::shared_ptr<EventLoop> m_eventloop;
+  int m_sockfd {-1};
+  std::shared_ptr<FdEvent> m_fd_event;
+  MessageCallback m_message_callback {nullptr};
+
+  int m_batch_size {DEFAULT_BATCH_SIZE};
+  std::size_t m_max_datagram {DEFAULT_MAX_DATAGRAM};
+  std::size_t m_max_pending {DEFAULT_MAX_PENDING};
+  bool m_gro {false};
+  uint16_t m_gso_size {0};
+
+  // 以下成员只在IO线程中访问
+  bool m_started {false};
+  std::unique_ptr<IoBatch> m_batch;
+  std::deque<PendingDatagram> m_pending;   // 等待发送的数据报
+  bool m_flush_pending {false};            // 已经登记了本轮结束时的 flush
+  bool m_write_armed {false};              // 发送缓冲区满，正在等待可写事件
+
+  std::atomic<uint64_t> m_packets_received {0};
+  std::atomic<uint64_t> m_bytes_received {0};
+  std::atomic<uint64_t> m_recv_syscalls {0};
+  std::atomic<uint64_t> m_packets_sent {0};
+  std::atomic<uint64_t> m_send_syscalls {0};
+  std::atomic<uint64_t> m_send_dropped {0};
+  std::atomic<uint64_t> m_truncated {0};
+};
+
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_UDP_SOCKET_H
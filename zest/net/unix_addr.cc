@@ -0,0 +1,89 @@
+/* 封装 Unix 域套接字地址，支持文件路径和 Linux 的抽象命名空间 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/unix_addr.h"
+#include <stddef.h>
+#include <string.h>
+#include "zest/base/logging.h"
+
+using namespace zest;
+using namespace zest::net;
+
+UnixAddress::UnixAddress(const std::string &path)
+{
+  memset(&m_sockaddr, 0, sizeof(m_sockaddr));
+  m_sockaddr.sun_family = AF_UNIX;
+  m_abstract = !path.empty() && path[0] == '@';
+  m_path = m_abstract ? path.substr(1) : path;
+
+  // 文件路径需要以 '\0' 结尾，抽象命名空间的名字前面有一个 '\0'，两种情况都要多占一个字节
+  if (m_path.empty() || m_path.size() + 1 > sizeof(m_sockaddr.sun_path)) {
+    LOG_ERROR << "invalid Unix domain socket address: " << path;
+    return;
+  }
+  if (m_abstract)
+    memcpy(m_sockaddr.sun_path + 1, m_path.data(), m_path.size());
+  else
+    memcpy(m_sockaddr.sun_path, m_path.data(), m_path.size());
+  m_len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + m_path.size() + 1);
+}
+
+UnixAddress::UnixAddress(const char *path) : UnixAddress(std::string(path))
+{
+  /* 使用了委托构造函数 */
+}
+
+// 客户端通常没有绑定地址，这时 len 只包含 sun_family
+UnixAddress::UnixAddress(const sockaddr_un &addr, socklen_t len)
+{
+  memset(&m_sockaddr, 0, sizeof(m_sockaddr));
+  if (len < sizeof(sa_family_t) || len > sizeof(m_sockaddr) || addr.sun_family != AF_UNIX)
+    return;
+  memcpy(&m_sockaddr, &addr, len);
+  m_len = len;
+
+  std::size_t path_len = len - offsetof(sockaddr_un, sun_path);
+  if (len <= offsetof(sockaddr_un, sun_path) || path_len == 0)
+    return;
+  if (m_sockaddr.sun_path[0] == '\0') {
+    m_abstract = true;
+    m_path.assign(m_sockaddr.sun_path + 1, path_len - 1);
+  }
+  else {
+    m_path.assign(m_sockaddr.sun_path, strnlen(m_sockaddr.sun_path, path_len));
+  }
+}
+
+::sockaddr* UnixAddress::sockaddr()
+{
+  return reinterpret_cast<::sockaddr*>(&m_sockaddr);
+}
+
+socklen_t UnixAddress::socklen() const
+{
+  return m_len;
+}
+
+int UnixAddress::family() const
+{
+  return AF_UNIX;
+}
+
+std::string UnixAddress::to_string() const
+{
+  if (m_path.empty())
+    return "unix:(unnamed)";
+  return m_abstract ? "unix:@" + m_path : "unix:" + m_path;
+}
+
+bool UnixAddress::check() const
+{
+  return m_len != 0;
+}
+
+NetBaseAddress::s_ptr UnixAddress::copy() const
+{
+  return std::make_shared<UnixAddress>(*this);
+}
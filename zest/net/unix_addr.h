@@ -0,0 +1,53 @@
+/* 封装 Unix 域套接字地址，支持文件路径和 Linux 的抽象命名空间 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_UNIX_ADDR_H
+#define ZEST_NET_UNIX_ADDR_H
+
+#include <sys/un.h>
+#include <string>
+#include "zest/net/base_addr.h"
+
+namespace zest
+{
+namespace net
+{
+
+/* 同一台机器上的进程间通信，不经过TCP协议栈，TcpServer 和 TcpClient 都可以直接使用
+ * 以 '@' 开头的名字表示抽象命名空间（不在文件系统中创建文件，最后一个引用关闭后自动消失），
+ * 其它的表示文件路径，TcpServer 监听前会删除同名的残留套接字文件，退出时再删除 */
+class UnixAddress : public NetBaseAddress
+{
+ public:
+  UnixAddress() = delete;
+  ~UnixAddress() = default;
+
+  UnixAddress(const std::string &path);
+  UnixAddress(const char *path);
+  UnixAddress(const sockaddr_un &addr, socklen_t len);   // accept 等系统调用返回的地址
+
+  ::sockaddr* sockaddr() override;
+  socklen_t socklen() const override;
+  int family() const override;
+  std::string to_string() const override;
+  bool check() const override;
+  NetBaseAddress::s_ptr copy() const override;
+
+  bool isAbstract() const {return m_abstract;}
+  const std::string &path() const {return m_path;}   // 抽象命名空间时不含开头的 '@'
+
+ private:
+  sockaddr_un m_sockaddr;
+  socklen_t m_len {0};      // 为 0 表示地址不合法
+  std::string m_path;
+  bool m_abstract {false};
+};
+  
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_UNIX_ADDR_H
@@ -0,0 +1,567 @@
+/* WebSocket 连接（RFC 6455）：完成升级握手后，直接在接收缓存中解析帧并原地去掩码 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/websocket/websocket.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include <utility>
+
+#include "zest/base/logging.h"
+#include "zest/base/sha1.h"
+#include "zest/base/simd_mask.h"
+#include "zest/net/eventloop.h"
+#include "zest/net/http/http_parser.h"
+#include "zest/net/http/http_response.h"
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::websocket;
+using std::placeholders::_1;
+
+// 连接上下文中保存 WebSocket 的槽位
+static const ContextSlot<WebSocketPtr> WEBSOCKET_SLOT;
+
+// 关闭握手的超时定时器
+static const char *WEBSOCKET_CLOSE_TIMER = "__websocket_close";
+
+// 握手时拼接在 Sec-WebSocket-Key 后面的固定字符串
+static const char *WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// 升级请求的头部上限
+static const std::size_t MAX_HANDSHAKE_SIZE = 8 * 1024;
+
+// 帧头最长 14 字节：2 字节基本头 + 8 字节扩展长度 + 4 字节掩码
+static const std::size_t MAX_FRAME_HEADER = 14;
+
+// 控制帧的数据不能超过 125 字节
+static const std::size_t MAX_CONTROL_PAYLOAD = 125;
+
+// 不完整的帧至少有这么大时，才用 setMinReadBytes 让内核攒够整帧再唤醒
+static const std::size_t LARGE_FRAME_HINT = 64 * 1024;
+
+// 不大于这个大小的数据和帧头拷贝到同一个数据片中
+static const std::size_t INLINE_PAYLOAD_SIZE = 4096;
+
+
+// 检查 UTF-8 编码，纯 ASCII 的部分每次检查 8 字节
+static bool validUtf8(const char *data, std::size_t len)
+{
+  const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char *end = p + len;
+  while (p < end) {
+    if (end - p >= 8) {
+      uint64_t v;
+      memcpy(&v, p, 8);
+      if ((v & 0x8080808080808080ULL) == 0) {
+        p += 8;
+        continue;
+      }
+    }
+    unsigned char c = *p;
+    if (c < 0x80) {
+      ++p;
+      continue;
+    }
+    int n;
+    uint32_t cp;
+    if ((c & 0xE0) == 0xC0) {
+      n = 1;
+      cp = c & 0x1F;
+    }
+    else if ((c & 0xF0) == 0xE0) {
+      n = 2;
+      cp = c & 0x0F;
+    }
+    else if ((c & 0xF8) == 0xF0) {
+      n = 3;
+      cp = c & 0x07;
+    }
+    else {
+      return false;
+    }
+    if (end - p <= n)
+      return false;
+    for (int i = 1; i <= n; ++i) {
+      if ((p[i] & 0xC0) != 0x80)
+        return false;
+      cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    // 过长编码、代理区和超出范围的码点都是非法的
+    if ((n == 1 && cp < 0x80) || (n == 2 && cp < 0x800) || (n == 3 && cp < 0x10000) ||
+        (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+      return false;
+    p += n + 1;
+  }
+  return true;
+}
+
+// header 中是否包含 token（逗号分隔，不区分大小写），例如 Connection: keep-alive, Upgrade
+static bool headerHasToken(const http::HttpRequest::Field &header, const char *token)
+{
+  std::size_t token_len = strlen(token);
+  std::size_t pos = 0;
+  while (pos < header.len) {
+    const char *comma = static_cast<const char*>(memchr(header.data + pos, ',', header.len - pos));
+    std::size_t begin = pos, end = comma ? comma - header.data : header.len;
+    pos = end + 1;
+    while (begin < end && (header.data[begin] == ' ' || header.data[begin] == '\t'))
+      ++begin;
+    while (end > begin && (header.data[end - 1] == ' ' || header.data[end - 1] == '\t'))
+      --end;
+    if (end - begin == token_len && strncasecmp(header.data + begin, token, token_len) == 0)
+      return true;
+  }
+  return false;
+}
+
+// 写无掩码的帧头，返回帧头的字节数
+static std::size_t encodeFrameHeader(char *buf, int opcode, std::size_t len)
+{
+  buf[0] = static_cast<char>(0x80 | opcode);
+  if (len < 126) {
+    buf[1] = static_cast<char>(len);
+    return 2;
+  }
+  if (len <= 0xFFFF) {
+    buf[1] = 126;
+    buf[2] = static_cast<char>(len >> 8);
+    buf[3] = static_cast<char>(len);
+    return 4;
+  }
+  buf[1] = 127;
+  for (int i = 0; i < 8; ++i)
+    buf[2 + i] = static_cast<char>(static_cast<uint64_t>(len) >> ((7 - i) * 8));
+  return 10;
+}
+
+static bool validCloseCode(uint16_t code)
+{
+  if (code >= 3000 && code <= 4999)
+    return true;
+  return code >= 1000 && code <= 1011 && code != 1004 && code != 1005 && code != 1006;
+}
+
+
+WebSocketPtr WebSocket::attach(TcpConnection &conn, std::shared_ptr<const WebSocketConfig> config)
+{
+  WebSocketPtr ws = std::make_shared<WebSocket>(conn, config);
+  if (!conn.Put(WEBSOCKET_SLOT, ws))
+    return get(conn);
+  conn.setMessageCallback(std::bind(&WebSocket::onMessage, ws.get(), _1));
+  conn.setCloseCallback([](TcpConnection &c){
+    WebSocketPtr ws = WebSocket::get(c);
+    if (ws)
+      ws->onClose();
+  });
+  return ws;
+}
+
+WebSocketPtr WebSocket::get(const TcpConnection &conn)
+{
+  WebSocketPtr *ws = conn.Get(WEBSOCKET_SLOT);
+  return ws ? *ws : nullptr;
+}
+
+Slice WebSocket::encodeFrame(WsOpcode opcode, const char *data, std::size_t len)
+{
+  char header[MAX_FRAME_HEADER];
+  std::size_t n = encodeFrameHeader(header, opcode, len);
+  std::string frame;
+  frame.reserve(n + len);
+  frame.append(header, n);
+  frame.append(data, len);
+  return Slice(std::move(frame));
+}
+
+WebSocket::WebSocket(TcpConnection &conn, std::shared_ptr<const WebSocketConfig> config) :
+  m_conn(&conn), m_eventloop(conn.getEventLoop()), m_peer_addr(conn.peerAddress().copy()),
+  m_config(config), m_handshake_parser(new http::HttpParser(MAX_HANDSHAKE_SIZE, 0))
+{
+  /* do nothing */
+}
+
+WebSocket::~WebSocket() = default;
+
+void WebSocket::sendText(const char *data, std::size_t len)
+{
+  sendInLoop(encodeFrame(WsText, data, len), Slice());
+}
+
+void WebSocket::sendBinary(const char *data, std::size_t len)
+{
+  sendInLoop(encodeFrame(WsBinary, data, len), Slice());
+}
+
+void WebSocket::sendBinary(const Slice &data)
+{
+  if (data.size() <= INLINE_PAYLOAD_SIZE) {
+    sendBinary(data.data(), data.size());
+    return;
+  }
+  char header[MAX_FRAME_HEADER];
+  std::size_t n = encodeFrameHeader(header, WsBinary, data.size());
+  sendInLoop(Slice(header, n), data);
+}
+
+void WebSocket::sendFrame(const Slice &frame)
+{
+  sendInLoop(frame, Slice());
+}
+
+void WebSocket::ping(const std::string &payload /*=""*/)
+{
+  std::size_t len = std::min(payload.size(), MAX_CONTROL_PAYLOAD);
+  sendInLoop(encodeFrame(WsPing, payload.data(), len), Slice());
+}
+
+// 编码在调用线程完成，发送转到IO线程，连接断开或者开始关闭之后不再发送
+void WebSocket::sendInLoop(const Slice &head, const Slice &body)
+{
+  if (!m_eventloop->isThisThread()) {
+    WebSocketPtr self = shared_from_this();
+    m_eventloop->runInLoop([self, head, body](){
+      self->sendInLoop(head, body);
+    });
+    return;
+  }
+  if (m_state != Open)
+    return;
+  if (body.empty())
+    m_conn->send(head);
+  else
+    m_conn->send(head, body);
+}
+
+void WebSocket::close(uint16_t code /*=WsCloseNormal*/, const std::string &reason /*=""*/)
+{
+  if (m_eventloop->isThisThread()) {
+    closeInLoop(code, reason);
+  }
+  else {
+    WebSocketPtr self = shared_from_this();
+    m_eventloop->runInLoop([self, code, reason](){
+      self->closeInLoop(code, reason);
+    });
+  }
+}
+
+void WebSocket::closeInLoop(uint16_t code, const std::string &reason)
+{
+  if (m_state != Open)
+    return;
+  m_state = Closing;
+  m_open.store(false, std::memory_order_relaxed);
+  sendClose(code, reason);
+  // 对端迟迟不回应关闭帧，直接断开
+  m_conn->addTimer(WEBSOCKET_CLOSE_TIMER, m_config->m_close_timeout_ms, [](TcpConnection &conn){
+    conn.close();
+  });
+}
+
+void WebSocket::sendClose(uint16_t code, const std::string &reason)
+{
+  if (m_close_sent)
+    return;
+  m_close_sent = true;
+  char payload[MAX_CONTROL_PAYLOAD];
+  std::size_t len = 0;
+  if (code != WsCloseNoStatus) {
+    payload[0] = static_cast<char>(code >> 8);
+    payload[1] = static_cast<char>(code);
+    len = 2 + std::min(reason.size(), MAX_CONTROL_PAYLOAD - 2);
+    memcpy(payload + 2, reason.data(), len - 2);
+  }
+  m_conn->send(encodeFrame(WsClose, payload, len));
+}
+
+/* 依次处理接收缓存中所有完整的帧，掩码直接在接收缓存中去掉，未分片的消息不发生拷贝
+ * 全部处理完之后统一从接收缓存中丢弃 */
+void WebSocket::onMessage(TcpConnection &conn)
+{
+  char *data = conn.mutablePeek();
+  std::size_t size = conn.dataSize();
+  std::size_t offset = 0;
+  std::size_t need = 0;   // 下一个不完整的帧需要的字节数
+
+  if (m_handshake_parser) {
+    // 握手已经被拒绝，丢弃之后收到的数据
+    if (m_state != Handshake) {
+      conn.clearData();
+      return;
+    }
+    offset = handleHandshake(conn, data, size);
+    if (m_handshake_parser) {
+      if (m_state == Handshake && offset > 0)
+        conn.clearBytesData(offset);
+      return;
+    }
+    if (m_state == Closed)
+      return;
+  }
+
+  while (offset < size && (m_state == Open || m_state == Closing)) {
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(data + offset);
+    std::size_t avail = size - offset;
+    if (avail < 2)
+      break;
+
+    bool fin = p[0] & 0x80;
+    int opcode = p[0] & 0x0F;
+    bool masked = p[1] & 0x80;
+    uint64_t len = p[1] & 0x7F;
+    std::size_t header = 2;
+    if (len == 126) {
+      if (avail < 4)
+        break;
+      len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+      header = 4;
+    }
+    else if (len == 127) {
+      if (avail < 10)
+        break;
+      len = 0;
+      for (int i = 0; i < 8; ++i)
+        len = (len << 8) | p[2 + i];
+      header = 10;
+    }
+
+    // 没有协商扩展，RSV 位必须为 0；客户端发来的帧必须有掩码
+    if ((p[0] & 0x70) != 0 || !masked) {
+      failConnection(conn, WsCloseProtocolError, (p[0] & 0x70) ? "reserved bits set" : "frame not masked");
+      return;
+    }
+    // 控制帧不能分片（RFC 6455 5.5），看到帧头就可以判断，不必等负载到齐
+    if (opcode >= 0x8 && !fin) {
+      failConnection(conn, WsCloseProtocolError, "fragmented control frame");
+      return;
+    }
+    if (len > m_config->m_max_message_size) {
+      failConnection(conn, WsCloseMessageTooBig, "message too big");
+      return;
+    }
+    header += 4;
+    if (avail < header + len) {
+      need = header + len;
+      break;
+    }
+
+    char *payload = data + offset + header;
+    simd_xor_mask(payload, len, data + offset + header - 4);
+    offset += header + len;
+    if (!handleFrame(conn, opcode, fin, payload, len))
+      return;
+  }
+
+  if (m_state == Closed)
+    return;
+  updateReadHint(conn, need);
+  if (offset == size)
+    conn.clearData();
+  else if (offset > 0)
+    conn.clearBytesData(offset);
+}
+
+// 返回一帧之后连接是否仍然可以继续处理，出错或者连接已经断开时返回 false
+bool WebSocket::handleFrame(TcpConnection &conn, int opcode, bool fin, char *payload, std::size_t len)
+{
+  if (opcode >= 0x8)
+    return handleControlFrame(conn, opcode, payload, len);
+
+  // 开始关闭之后不再处理数据帧
+  if (m_state != Open)
+    return true;
+
+  if (opcode == WsText || opcode == WsBinary) {
+    if (m_fragment_opcode != -1) {
+      failConnection(conn, WsCloseProtocolError, "expected continuation frame");
+      return false;
+    }
+    if (fin) {
+      if (opcode == WsText && !validUtf8(payload, len)) {
+        failConnection(conn, WsCloseInvalidPayload, "invalid UTF-8");
+        return false;
+      }
+      deliverMessage(payload, len, opcode == WsBinary);
+    }
+    else {
+      m_fragment_opcode = opcode;
+      m_fragments.assign(payload, len);
+    }
+  }
+  else if (opcode == WsContinuation) {
+    if (m_fragment_opcode == -1) {
+      failConnection(conn, WsCloseProtocolError, "unexpected continuation frame");
+      return false;
+    }
+    if (m_fragments.size() + len > m_config->m_max_message_size) {
+      failConnection(conn, WsCloseMessageTooBig, "message too big");
+      return false;
+    }
+    m_fragments.append(payload, len);
+    if (fin) {
+      bool binary = m_fragment_opcode == WsBinary;
+      m_fragment_opcode = -1;
+      if (!binary && !validUtf8(m_fragments.data(), m_fragments.size())) {
+        failConnection(conn, WsCloseInvalidPayload, "invalid UTF-8");
+        return false;
+      }
+      std::string message;
+      message.swap(m_fragments);
+      deliverMessage(message.data(), message.size(), binary);
+    }
+  }
+  else {
+    failConnection(conn, WsCloseProtocolError, "unknown opcode");
+    return false;
+  }
+  return m_state != Closed;
+}
+
+bool WebSocket::handleControlFrame(TcpConnection &conn, int opcode, char *payload, std::size_t len)
+{
+  if (len > MAX_CONTROL_PAYLOAD) {
+    failConnection(conn, WsCloseProtocolError, "control frame too big");
+    return false;
+  }
+
+  if (opcode == WsPing) {
+    if (m_state == Open)
+      conn.send(encodeFrame(WsPong, payload, len));
+    return true;
+  }
+  if (opcode == WsPong)
+    return true;
+  if (opcode != WsClose) {
+    failConnection(conn, WsCloseProtocolError, "unknown opcode");
+    return false;
+  }
+
+  // 关闭帧：记录对端的状态码，回应关闭帧，发送队列清空后半关闭，等待对端断开
+  uint16_t code = WsCloseNoStatus;
+  if (len == 1) {
+    failConnection(conn, WsCloseProtocolError, "invalid close frame");
+    return false;
+  }
+  if (len >= 2) {
+    code = static_cast<uint16_t>((static_cast<unsigned char>(payload[0]) << 8) |
+                                 static_cast<unsigned char>(payload[1]));
+    if (!validCloseCode(code) || !validUtf8(payload + 2, len - 2)) {
+      failConnection(conn, WsCloseProtocolError, "invalid close frame");
+      return false;
+    }
+  }
+  m_close_code = code;
+  m_close_reason.assign(len > 2 ? payload + 2 : "", len > 2 ? len - 2 : 0);
+  m_state = Closing;
+  m_open.store(false, std::memory_order_relaxed);
+  sendClose(code, "");
+  conn.cancelTimer(WEBSOCKET_CLOSE_TIMER);
+  conn.shutdown();
+  return true;
+}
+
+void WebSocket::deliverMessage(const char *data, std::size_t len, bool binary)
+{
+  if (m_config->m_message_callback)
+    m_config->m_message_callback(shared_from_this(), data, len, binary);
+}
+
+// 协议错误：发送带状态码的关闭帧，丢弃之后收到的所有数据，发送完后半关闭
+void WebSocket::failConnection(TcpConnection &conn, uint16_t code, const char *reason)
+{
+  LOG_DEBUG << "WebSocket protocol error from " << conn.peerAddress().to_string() << ": " << reason;
+  if (m_state == Closed)
+    return;
+  if (m_close_code == WsCloseAbnormal)
+    m_close_code = code;
+  m_state = Closing;
+  m_open.store(false, std::memory_order_relaxed);
+  sendClose(code, reason);
+  conn.clearData();
+  conn.shutdown();
+}
+
+void WebSocket::updateReadHint(TcpConnection &conn, std::size_t need)
+{
+  std::size_t hint = need >= LARGE_FRAME_HINT ? need : 0;
+  if (hint != m_read_hint) {
+    conn.setMinReadBytes(hint);
+    m_read_hint = hint;
+  }
+}
+
+// 连接断开，之后不再访问 TcpConnection；握手没有完成的连接不调用关闭回调
+void WebSocket::onClose()
+{
+  State state = m_state;
+  m_state = Closed;
+  m_open.store(false, std::memory_order_relaxed);
+  m_fragments.clear();
+  if (state != Closed && !m_handshake_parser && m_config->m_close_callback)
+    m_config->m_close_callback(shared_from_this(), m_close_code, m_close_reason);
+}
+
+/* 解析升级请求，返回可以丢弃的字节数
+ * 握手成功时状态变为 Open，请求之后紧跟着的数据由调用者当作帧继续处理 */
+std::size_t WebSocket::handleHandshake(TcpConnection &conn, const char *data, std::size_t len)
+{
+  std::size_t consumed = 0;
+  http::HttpParser::Result res = m_handshake_parser->parse(data, len, &consumed);
+  if (res == http::HttpParser::NeedMore)
+    return consumed;
+  if (res == http::HttpParser::Error) {
+    rejectHandshake(conn, m_handshake_parser->errorCode());
+    return 0;
+  }
+
+  const http::HttpRequest &req = m_handshake_parser->request();
+  if (req.method() != "GET" || !headerHasToken(req.header("Upgrade"), "websocket") ||
+      !headerHasToken(req.header("Connection"), "upgrade")) {
+    rejectHandshake(conn, 400);
+    return 0;
+  }
+  if (req.header("Sec-WebSocket-Version") != "13") {
+    rejectHandshake(conn, 426);
+    return 0;
+  }
+  std::string key = req.header("Sec-WebSocket-Key").str();
+  std::string decoded;
+  if (!base64_decode(key, &decoded) || decoded.size() != 16) {
+    rejectHandshake(conn, 400);
+    return 0;
+  }
+
+  std::string accept_src = key + WEBSOCKET_GUID;
+  unsigned char digest[SHA1_DIGEST_SIZE];
+  sha1(accept_src.data(), accept_src.size(), digest);
+  std::string response =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: " + base64_encode(digest, SHA1_DIGEST_SIZE) + "\r\n\r\n";
+  conn.send(std::move(response));
+
+  m_state = Open;
+  m_open.store(true, std::memory_order_relaxed);
+  if (m_config->m_open_callback)
+    m_config->m_open_callback(shared_from_this(), req);
+  m_handshake_parser.reset();
+  return consumed;
+}
+
+void WebSocket::rejectHandshake(TcpConnection &conn, int code)
+{
+  LOG_DEBUG << "reject WebSocket handshake from " << conn.peerAddress().to_string() << ", status " << code;
+  std::string response = "HTTP/1.1 " + std::to_string(code) + " " + http::statusReason(code) + "\r\n";
+  if (code == 426)
+    response += "Sec-WebSocket-Version: 13\r\n";
+  response += "Content-Length: 0\r\nConnection: close\r\n\r\n";
+  conn.send(std::move(response));
+  conn.clearData();
+  m_state = Closing;
+  conn.shutdown();
+}
@@ -0,0 +1,167 @@
+/* WebSocket 连接（RFC 6455）：完成升级握手后，直接在接收缓存中解析帧并原地去掩码 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_WEBSOCKET_WEBSOCKET_H
+#define ZEST_NET_WEBSOCKET_WEBSOCKET_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/http/http_request.h"
+#include "zest/net/slice.h"
+#include "zest/net/tcp_connection.h"
+
+namespace zest
+{
+namespace net
+{
+
+class EventLoop;
+
+namespace http
+{
+class HttpParser;
+} // namespace http
+
+namespace websocket
+{
+
+enum WsOpcode {
+  WsContinuation = 0x0,
+  WsText = 0x1,
+  WsBinary = 0x2,
+  WsClose = 0x8,
+  WsPing = 0x9,
+  WsPong = 0xA,
+};
+
+// 常用的关闭状态码
+enum WsCloseCode {
+  WsCloseNormal = 1000,
+  WsCloseGoingAway = 1001,
+  WsCloseProtocolError = 1002,
+  WsCloseUnsupportedData = 1003,
+  WsCloseNoStatus = 1005,         // 只用于回调函数，表示对端的关闭帧没有状态码
+  WsCloseAbnormal = 1006,         // 只用于回调函数，表示没有收到关闭帧连接就断开了
+  WsCloseInvalidPayload = 1007,
+  WsClosePolicyViolation = 1008,
+  WsCloseMessageTooBig = 1009,
+  WsCloseInternalError = 1011,
+};
+
+class WebSocket;
+
+using WebSocketPtr = std::shared_ptr<WebSocket>;
+
+/* 所有回调函数都在连接所属的IO线程中执行
+ * 消息回调的 data 直接指向接收缓存（分片的消息除外），只在回调函数执行期间有效 */
+struct WebSocketConfig
+{
+  using OpenCallback = std::function<void(const WebSocketPtr&, const http::HttpRequest&)>;
+  using MessageCallback = std::function<void(const WebSocketPtr&, const char *data, std::size_t len, bool binary)>;
+  using CloseCallback = std::function<void(const WebSocketPtr&, uint16_t code, const std::string &reason)>;
+
+  static const std::size_t DEFAULT_MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+
+  OpenCallback m_open_callback {nullptr};
+  MessageCallback m_message_callback {nullptr};
+  CloseCallback m_close_callback {nullptr};
+  std::size_t m_max_message_size {DEFAULT_MAX_MESSAGE_SIZE};   // 一条消息（所有分片之和）的上限
+  uint64_t m_close_timeout_ms {5000};   // 发出关闭帧后等待对端回应的时间，超时直接断开
+};
+
+/* WebSocket 保存在 TcpConnection 的上下文中，和连接一起销毁
+ * 发送函数可以在任意线程调用；连接关闭之后的发送会被丢弃
+ * 服务端发出的帧没有掩码，同一个编码好的帧可以发给任意多个连接（见 encodeFrame / sendFrame） */
+class WebSocket : public std::enable_shared_from_this<WebSocket>, public noncopyable
+{
+ public:
+  /* 在连接上创建 WebSocket，保存到连接的上下文中，并接管连接的消息回调和关闭回调
+   * 连接上收到的第一个请求必须是升级请求，握手完成后调用 m_open_callback
+   * 必须在连接开始读取数据（waitForMessage）之前调用 */
+  static WebSocketPtr attach(TcpConnection &conn, std::shared_ptr<const WebSocketConfig> config);
+
+  // 获取连接上的 WebSocket，没有时返回 nullptr
+  static WebSocketPtr get(const TcpConnection &conn);
+
+  /* 编码一个完整的（FIN）无掩码帧，用于广播：编码一次，对每个连接调用 sendFrame
+   * 帧头和数据在同一个数据片中 */
+  static Slice encodeFrame(WsOpcode opcode, const char *data, std::size_t len);
+
+  WebSocket(TcpConnection &conn, std::shared_ptr<const WebSocketConfig> config);
+  ~WebSocket();
+
+  void sendText(const char *data, std::size_t len);
+  void sendText(const std::string &text) {sendText(text.data(), text.size());}
+  void sendBinary(const char *data, std::size_t len);
+  void sendBinary(const std::string &data) {sendBinary(data.data(), data.size());}
+  void sendBinary(const Slice &data);     // 数据不拷贝，帧头单独作为一个数据片
+
+  // 发送 encodeFrame() 编码好的帧，不拷贝数据
+  void sendFrame(const Slice &frame);
+
+  void ping(const std::string &payload = "");
+
+  // 发起关闭握手，对端回应关闭帧或者超时后断开连接
+  void close(uint16_t code = WsCloseNormal, const std::string &reason = "");
+
+  // 握手已经完成，并且还没有开始关闭
+  bool isOpen() const {return m_open.load(std::memory_order_relaxed);}
+
+  NetBaseAddress &peerAddress() const {return *m_peer_addr;}
+
+  // 连接的消息回调和关闭回调，attach() 已经设置好，一般不需要直接调用
+  void onMessage(TcpConnection &conn);
+  void onClose();
+
+ private:
+  enum State {
+    Handshake,    // 等待升级请求
+    Open,         // 正常收发消息
+    Closing,      // 已经发出或收到关闭帧，不再处理数据帧
+    Closed,       // TCP 连接已经断开
+  };
+
+  std::size_t handleHandshake(TcpConnection &conn, const char *data, std::size_t len);
+  void rejectHandshake(TcpConnection &conn, int code);
+  bool handleFrame(TcpConnection &conn, int opcode, bool fin, char *payload, std::size_t len);
+  bool handleControlFrame(TcpConnection &conn, int opcode, char *payload, std::size_t len);
+  void deliverMessage(const char *data, std::size_t len, bool binary);
+  void failConnection(TcpConnection &conn, uint16_t code, const char *reason);
+  void sendInLoop(const Slice &head, const Slice &body);
+  void closeInLoop(uint16_t code, const std::string &reason);
+  void sendClose(uint16_t code, const std::string &reason);
+  void updateReadHint(TcpConnection &conn, std::size_t need);
+
+ private:
+  TcpConnection *m_conn;
+  std::shared_ptr<EventLoop> m_eventloop;
+  NetBaseAddress::s_ptr m_peer_addr;
+  std::shared_ptr<const WebSocketConfig> m_config;
+  std::atomic<bool> m_open {false};
+
+  // 以下成员只在连接所属的IO线程中访问
+  State m_state {Handshake};
+  std::unique_ptr<http::HttpParser> m_handshake_parser;
+  std::string m_fragments;             // 分片消息已经收到的部分
+  int m_fragment_opcode {-1};          // 分片消息的类型，-1 表示没有未完成的分片消息
+  bool m_close_sent {false};
+  uint16_t m_close_code {WsCloseAbnormal};
+  std::string m_close_reason;
+  std::size_t m_read_hint {0};         // 已经设置的 setMinReadBytes
+};
+
+} // namespace websocket
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_WEBSOCKET_WEBSOCKET_H
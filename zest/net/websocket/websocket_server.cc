@@ -0,0 +1,76 @@
+/* 基于 TcpServer 的 WebSocket 服务器，支持把编码一次的帧广播给所有连接 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+#include "zest/net/websocket/websocket_server.h"
+
+#include <vector>
+
+using namespace zest;
+using namespace zest::net;
+using namespace zest::net::websocket;
+using std::placeholders::_1;
+
+
+WebSocketServer::WebSocketServer(NetBaseAddress &local_addr, int thread_nums /*=4*/) :
+  m_server(local_addr, thread_nums),
+  m_config(std::make_shared<WebSocketConfig>())
+{
+  m_server.setOnConnectionCallback(std::bind(&WebSocketServer::onConnection, this, _1));
+  m_server.setWriteCompleteCallback(std::bind(&WebSocketServer::onWriteComplete, this, _1));
+}
+
+void WebSocketServer::start()
+{
+  // 在用户的回调外面包一层，维护广播列表
+  WebSocketConfig::OpenCallback open_cb = m_config->m_open_callback;
+  m_config->m_open_callback = [this, open_cb](const WebSocketPtr &ws, const http::HttpRequest &req){
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_sockets.insert(ws);
+    }
+    if (open_cb)
+      open_cb(ws, req);
+  };
+  WebSocketConfig::CloseCallback close_cb = m_config->m_close_callback;
+  m_config->m_close_callback = [this, close_cb](const WebSocketPtr &ws, uint16_t code, const std::string &reason){
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_sockets.erase(ws);
+    }
+    if (close_cb)
+      close_cb(ws, code, reason);
+  };
+  m_server.start();
+}
+
+void WebSocketServer::broadcast(const Slice &frame)
+{
+  std::vector<WebSocketPtr> sockets;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    sockets.reserve(m_sockets.size());
+    sockets.assign(m_sockets.begin(), m_sockets.end());
+  }
+  for (const WebSocketPtr &ws : sockets)
+    ws->sendFrame(frame);
+}
+
+std::size_t WebSocketServer::connectionCount() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_sockets.size();
+}
+
+void WebSocketServer::onConnection(TcpConnection &conn)
+{
+  WebSocket::attach(conn, m_config);
+  conn.waitForMessage();
+}
+
+// 大的消息发送时改为监听可写事件，发完之后重新监听可读事件
+void WebSocketServer::onWriteComplete(TcpConnection &conn)
+{
+  conn.waitForMessage();
+}
@@ -0,0 +1,73 @@
+/* 基于 TcpServer 的 WebSocket 服务器，支持把编码一次的帧广播给所有连接 */
+
+// Copyright 2023, Huanggomery. All rights reserved.
+// Author: Huanggomery (huanggomery@gmail.com)
+
+// This is a public header file, it must only include public header files.
+
+#ifndef ZEST_NET_WEBSOCKET_WEBSOCKET_SERVER_H
+#define ZEST_NET_WEBSOCKET_WEBSOCKET_SERVER_H
+
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+#include "zest/base/noncopyable.h"
+#include "zest/net/base_addr.h"
+#include "zest/net/tcp_server.h"
+#include "zest/net/websocket/websocket.h"
+
+namespace zest
+{
+namespace net
+{
+namespace websocket
+{
+
+/* 每条连接先完成升级握手，握手成功后加入广播列表，断开时移出
+ * 回调函数在连接所属的IO线程中执行，必须在 start() 之前设置 */
+class WebSocketServer : public noncopyable
+{
+ public:
+  explicit WebSocketServer(NetBaseAddress &local_addr, int thread_nums = 4);
+
+  void setOpenCallback(const WebSocketConfig::OpenCallback &cb) {m_config->m_open_callback = cb;}
+  void setMessageCallback(const WebSocketConfig::MessageCallback &cb) {m_config->m_message_callback = cb;}
+  void setCloseCallback(const WebSocketConfig::CloseCallback &cb) {m_config->m_close_callback = cb;}
+
+  // 一条消息（所有分片之和）的上限，超出时以 1009 关闭连接
+  void setMaxMessageSize(std::size_t bytes) {m_config->m_max_message_size = bytes;}
+
+  // 发出关闭帧后等待对端回应的时间
+  void setCloseTimeout(uint64_t ms) {m_config->m_close_timeout_ms = ms;}
+
+  /* 把 WebSocket::encodeFrame() 编码好的帧发给所有已经打开的连接，帧只编码一次，数据不拷贝
+   * 可以在任意线程调用 */
+  void broadcast(const Slice &frame);
+  void broadcastText(const std::string &text) {broadcast(WebSocket::encodeFrame(WsText, text.data(), text.size()));}
+
+  // 当前打开的连接数
+  std::size_t connectionCount() const;
+
+  TcpServer &tcpServer() {return m_server;}
+
+  void start();
+
+ private:
+  void onConnection(TcpConnection &conn);
+  void onWriteComplete(TcpConnection &conn);
+
+ private:
+  TcpServer m_server;
+  std::shared_ptr<WebSocketConfig> m_config;
+
+  // 握手完成的连接，在IO线程中加入和移除，broadcast() 可能在任意线程读取
+  mutable std::mutex m_mutex;
+  std::unordered_set<WebSocketPtr> m_sockets;
+};
+
+} // namespace websocket
+} // namespace net
+} // namespace zest
+
+#endif // ZEST_NET_WEBSOCKET_WEBSOCKET_SERVER_H